@@ -1,4 +1,5 @@
 #include "EmbeddingBag.h"
+#include "MergedEmbeddingBag.h"
 #include "autocast/autocast_mode.h"
 #include "cpu/kernels/Embeddingbag.h"
 #include "utils/rw_lock.h"
@@ -120,6 +121,27 @@ at::Tensor dil_qembeddingbag(
       kCPU, weight, indices, offsets, o_scale, include_last_offset);
 }
 
+at::Tensor embedding_bag_rowwise_quantized(
+    const at::Tensor& qweight,
+    const at::Tensor& indices,
+    const at::Tensor& offsets,
+    int64_t pooling_mode,
+    bool include_last_offset,
+    int64_t bit_width,
+    at::ScalarType output_dtype) {
+  RECORD_FUNCTION(
+      "embedding_bag_rowwise_quantized", c10::ArrayRef<c10::IValue>({}));
+  // a single table is a merged embedding bag of one table
+  return rowwise_quantized_merged_embeddingbag_forward_cpu(
+      {qweight},
+      {indices.contiguous()},
+      {offsets.contiguous()},
+      pooling_mode,
+      include_last_offset,
+      bit_width,
+      output_dtype)[0];
+}
+
 } // namespace cpu
 } // namespace torch_ipex
 
@@ -176,5 +198,13 @@ TORCH_LIBRARY_FRAGMENT(torch_ipex, m) {
       "embedding_bag",
       c10::DispatchKey::AutocastCPU,
       torch_ipex::autocast::embedding_bag);
+  m.def(
+      "embedding_bag_rowwise_quantized(Tensor qweight, Tensor indices, Tensor "
+      "offsets, int pooling_mode, bool include_last_offset, int bit_width, "
+      "ScalarType output_dtype) -> Tensor");
+  m.impl(
+      "embedding_bag_rowwise_quantized",
+      c10::DispatchKey::CPU,
+      torch_ipex::cpu::embedding_bag_rowwise_quantized);
 }
 } // namespace
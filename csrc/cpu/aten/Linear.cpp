@@ -363,7 +363,8 @@ at::Tensor woq_linear_pack_weight(
     const at::Tensor& weight,
     const at::Tensor& scales,
     const at::Tensor& zero_points,
-    int64_t lowp_mode) {
+    int64_t lowp_mode,
+    int64_t group_size) {
   // TPP kernel does not support edge cases
   // It generates packed weight in 4d (Nc, Kc, block_k, block_n)
   auto N = weight.size(0), K = weight.size(1);
@@ -372,7 +373,8 @@ at::Tensor woq_linear_pack_weight(
     bool is_int4 = weight.scalar_type() == c10::kQUInt4x2;
     size_t block_n = 32;
     size_t block_k = 64;
-    while (K % block_k != 0) {
+    // A K block should not cross the groups of scales and zero points
+    while (K % block_k != 0 || (group_size > 0 && group_size % block_k != 0)) {
       block_k /= 2;
     }
     assert(block_k > 0);
@@ -393,19 +395,24 @@ at::Tensor woq_linear_pack_weight(
           0,
           pad_size_bytes);
       auto packed_b = woq_tpp_gemm_packB_stub(
-          kCPU, weight_int4, is_int4, block_n, block_k, lowp_mode);
+          kCPU, weight_int4, is_int4, block_n, block_k, lowp_mode, group_size);
       if (packed_b.defined()) {
         return packed_b;
       }
     }
     if (!(N % block_n) && !(K % block_k)) {
       auto packed_b = woq_tpp_gemm_packB_stub(
-          kCPU, weight, is_int4, block_n, block_k, lowp_mode);
+          kCPU, weight, is_int4, block_n, block_k, lowp_mode, group_size);
       if (packed_b.defined()) {
         return packed_b;
       }
     }
   }
+  if (group_size > 0) {
+    // The fallback kernels only support per-channel qparams, keep the weight
+    // plain for woq_linear_group_wise_ref
+    return weight;
+  }
   return woq_linear_packB_stub(kCPU, weight, scales, zero_points);
 }
 
@@ -425,6 +432,37 @@ at::Tensor woq_linear_unpack_weight(
   return woq_linear_unpackB_stub(kCPU, weight);
 }
 
+// Reference path of the int4 weight quantized group-wise along K when the TPP
+// kernel is not available. The weight is plain in [N, K] and the scales and
+// zero points are in [N, K / group_size].
+static void woq_linear_group_wise_ref(
+    const at::Tensor& self,
+    const at::Tensor& weight,
+    const at::Tensor& scales_float,
+    const at::Tensor& zero_points_float,
+    const at::Tensor& bias,
+    at::Tensor& output) {
+  using namespace at::indexing;
+  auto N = weight.size(0), K = weight.size(1);
+  auto group_size = K / scales_float.size(1);
+  auto w_packed = at::empty({N, K / 2}, weight.options().dtype(at::kByte));
+  std::memcpy(w_packed.data_ptr(), weight.data_ptr(), N * K / 2);
+  auto w_uint8 = at::empty({N, K}, w_packed.options());
+  w_uint8.index({Slice(), Slice(None, None, 2)})
+      .copy_(w_packed.bitwise_and(0xf));
+  w_uint8.index({Slice(), Slice(1, None, 2)})
+      .copy_(w_packed.bitwise_right_shift(4));
+  auto w = (w_uint8.to(at::kFloat) -
+            zero_points_float.repeat_interleave(group_size, 1)) *
+      scales_float.repeat_interleave(group_size, 1);
+  auto dtype = self.scalar_type();
+  auto y = at::linear(
+      self,
+      w.to(dtype),
+      bias.defined() ? c10::make_optional(bias.to(dtype)) : c10::nullopt);
+  output.copy_(y);
+}
+
 DEFINE_DISPATCH(woq_gemm_kernel_stub);
 void woq_linear_kernel_output(
     const at::Tensor& self,
@@ -434,6 +472,12 @@ void woq_linear_kernel_output(
     const at::Tensor& bias,
     int64_t lowp_mode,
     at::Tensor& output) {
+  // per-channel scales are 1D while group-wise ones are [N, G]
+  if (scales_float.dim() > 1) {
+    woq_linear_group_wise_ref(
+        self, weight, scales_float, zero_points_float, bias, output);
+    return;
+  }
   woq_gemm_kernel_stub(
       kCPU,
       self,
@@ -521,6 +565,16 @@ void woq_linear_eltwise_kernel_output(
     const c10::optional<c10::string_view>& algorithm,
     int64_t lowp_mode,
     at::Tensor& output) {
+  if (scales_float.dim() > 1) {
+    woq_linear_group_wise_ref(
+        self, weight, scales_float, zero_points_float, bias, output);
+    if (post_op == "relu") {
+      at::relu_(output);
+    } else if (post_op == "gelu") {
+      output.copy_(at::gelu(output, algorithm.value_or("none")));
+    }
+    return;
+  }
   woq_gemm_eltwise_kernel_stub(
       kCPU,
       self,
@@ -738,6 +792,98 @@ at::Tensor woq_linear_add_add_kernel(
   return at::add(y, others[1]);
 }
 
+at::Tensor woq_linear_silu_mul_kernel(
+    const at::Tensor& self,
+    const at::Tensor& weight,
+    const std::vector<at::Tensor>& scales_list,
+    const std::vector<at::Tensor>& zps_list,
+    const std::vector<at::Tensor>& bias_list,
+    bool is_int4,
+    int64_t lowp_mode,
+    int64_t act_quant_mode) {
+  if (weight.dim() > 2) {
+    auto out = woq_tpp_gemm_kernel_stub(
+        kCPU,
+        self,
+        weight,
+        scales_list,
+        zps_list,
+        bias_list,
+        is_int4,
+        lowp_mode,
+        /* num_concats */ 2,
+        WOQ_FUSE_SILU_MUL, // post op silu-mul
+        std::vector<at::Tensor>(),
+        act_quant_mode);
+    if (out.defined()) {
+      return out;
+    }
+  }
+  auto input_size = self.sizes();
+  std::vector<int64_t> output_size(input_size.begin(), input_size.end() - 1);
+  output_size.push_back(weight.size(0));
+  auto output = at::empty(output_size, self.options());
+  output.set_requires_grad(self.requires_grad());
+  woq_linear_kernel_output(
+      self,
+      weight,
+      scales_list[0],
+      zps_list[0],
+      bias_list[0],
+      lowp_mode,
+      output);
+  auto gate_up = output.chunk(2, -1);
+  return at::silu(gate_up[0]) * gate_up[1];
+}
+
+DEFINE_DISPATCH(woq_tpp_gemm_quantized_a_kernel_stub);
+at::Tensor woq_linear_quantized_input_kernel(
+    const at::Tensor& self,
+    const at::Tensor& self_scales,
+    const at::Tensor& self_zero_points,
+    at::ScalarType out_dtype,
+    const at::Tensor& weight,
+    const std::vector<at::Tensor>& scales_list,
+    const std::vector<at::Tensor>& zps_list,
+    const std::vector<at::Tensor>& bias_list,
+    bool is_int4,
+    int64_t lowp_mode,
+    int64_t num_concats,
+    int64_t act_quant_mode) {
+  if (weight.dim() > 2) {
+    auto out = woq_tpp_gemm_quantized_a_kernel_stub(
+        kCPU,
+        self,
+        self_scales,
+        self_zero_points,
+        out_dtype,
+        weight,
+        scales_list,
+        zps_list,
+        bias_list,
+        is_int4,
+        lowp_mode,
+        num_concats);
+    if (out.defined()) {
+      return out;
+    }
+  }
+  // dequantize the input and quantize it again as the GEMM requires
+  auto x = ((self.to(at::kFloat) - self_zero_points.unsqueeze(-1)) *
+            self_scales.unsqueeze(-1))
+               .to(out_dtype);
+  return woq_linear_kernel(
+      x,
+      weight,
+      scales_list,
+      zps_list,
+      bias_list,
+      is_int4,
+      lowp_mode,
+      num_concats,
+      act_quant_mode);
+}
+
 at::Tensor woq_linear_add_forward(
     const at::Tensor& input,
     const at::Tensor& op_context,
@@ -758,6 +904,30 @@ at::Tensor woq_linear_add_add_forward(
              op_context.data_ptr<int64_t>()[0])
       ->run_add_add(input, others);
 }
+
+at::Tensor woq_linear_silu_mul_forward(
+    const at::Tensor& input,
+    const at::Tensor& op_context) {
+  RECORD_FUNCTION(
+      "torch_ipex::woq_linear_silu_mul", c10::ArrayRef<c10::IValue>({}));
+  return reinterpret_cast<IpexWoqLinearOpContext*>(
+             op_context.data_ptr<int64_t>()[0])
+      ->run_silu_mul(input);
+}
+
+at::Tensor woq_linear_quantized_input_forward(
+    const at::Tensor& input,
+    const at::Tensor& input_scales,
+    const at::Tensor& input_zero_points,
+    at::ScalarType out_dtype,
+    const at::Tensor& op_context) {
+  RECORD_FUNCTION(
+      "torch_ipex::woq_linear_quantized_input",
+      c10::ArrayRef<c10::IValue>({}));
+  return reinterpret_cast<IpexWoqLinearOpContext*>(
+             op_context.data_ptr<int64_t>()[0])
+      ->run_quantized_input(input, input_scales, input_zero_points, out_dtype);
+}
 #endif
 
 } // namespace cpu
@@ -871,6 +1041,17 @@ at::Tensor woq_linear_add_add_forward(
       op_context,
       cpu_cached_cast(target_type, others));
 }
+
+at::Tensor woq_linear_silu_mul_forward(
+    const at::Tensor& input,
+    const at::Tensor& op_context) {
+  c10::impl::ExcludeDispatchKeyGuard no_autocastCPU(DispatchKey::AutocastCPU);
+  static auto op = torch::Dispatcher::singleton()
+                       .findSchemaOrThrow("torch_ipex::woq_linear_silu_mul", "")
+                       .typed<decltype(woq_linear_silu_mul_forward)>();
+  auto target_type = get_autocast_dtype();
+  return op.call(cpu_cached_cast(target_type, input), op_context);
+}
 #endif
 } // namespace autocast
 } // namespace torch_ipex
@@ -927,6 +1108,24 @@ TORCH_LIBRARY_FRAGMENT(torch_ipex, m) {
       "woq_linear_add_add",
       c10::DispatchKey::AutocastCPU,
       torch_ipex::autocast::woq_linear_add_add_forward);
+  m.def("woq_linear_silu_mul(Tensor input, Tensor W_prepack) -> Tensor");
+  m.impl(
+      "woq_linear_silu_mul",
+      c10::DispatchKey::CPU,
+      torch_ipex::cpu::woq_linear_silu_mul_forward);
+  m.impl(
+      "woq_linear_silu_mul",
+      c10::DispatchKey::AutocastCPU,
+      torch_ipex::autocast::woq_linear_silu_mul_forward);
+  // The input is quantized to uint8 per row, e.g., by add_rmsnorm_quantize
+  m.def(
+      "woq_linear_quantized_input(Tensor input, Tensor input_scales, "
+      "Tensor input_zero_points, ScalarType out_dtype, Tensor W_prepack) "
+      "-> Tensor");
+  m.impl(
+      "woq_linear_quantized_input",
+      c10::DispatchKey::CPU,
+      torch_ipex::cpu::woq_linear_quantized_input_forward);
 #endif
   // fuse eltwise
   m.def(
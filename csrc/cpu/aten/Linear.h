@@ -84,7 +84,8 @@ at::Tensor woq_linear_pack_weight(
     const at::Tensor& weight,
     const at::Tensor& scale,
     const at::Tensor& zero_points,
-    int64_t lowp_mode);
+    int64_t lowp_mode,
+    int64_t group_size);
 
 at::Tensor woq_linear_unpack_weight(
     const at::Tensor& weight,
@@ -174,6 +175,33 @@ at::Tensor woq_linear_add_add_kernel(
     const std::vector<at::Tensor>& others,
     int64_t act_quant_mode);
 
+// silu(gate) * up with the weight being the concat of the gate and up weights
+at::Tensor woq_linear_silu_mul_kernel(
+    const at::Tensor& self,
+    const at::Tensor& weight,
+    const std::vector<at::Tensor>& scales_list,
+    const std::vector<at::Tensor>& zps_list,
+    const std::vector<at::Tensor>& bias_list,
+    bool is_int4,
+    int64_t lowp_mode,
+    int64_t act_quant_mode);
+
+// The linear of an input quantized to uint8 per row, with the scales and zero
+// points of its rows
+at::Tensor woq_linear_quantized_input_kernel(
+    const at::Tensor& self,
+    const at::Tensor& self_scales,
+    const at::Tensor& self_zero_points,
+    at::ScalarType out_dtype,
+    const at::Tensor& weight,
+    const std::vector<at::Tensor>& scales_list,
+    const std::vector<at::Tensor>& zps_list,
+    const std::vector<at::Tensor>& bias_list,
+    bool is_int4,
+    int64_t lowp_mode,
+    int64_t num_concats,
+    int64_t act_quant_mode);
+
 namespace {
 void woq_gemm_kernel_impl(
     const at::Tensor& self,
@@ -250,19 +278,36 @@ using woq_tpp_gemm_kernel_fn = at::Tensor (*)(
     int64_t);
 
 using woq_tpp_gemm_packB_fn =
-    at::Tensor (*)(const at::Tensor&, bool, size_t, size_t, int64_t);
+    at::Tensor (*)(const at::Tensor&, bool, size_t, size_t, int64_t, int64_t);
 
 using woq_tpp_gemm_unpackB_fn =
     at::Tensor (*)(const at::Tensor&, bool, int64_t);
 
+using woq_tpp_gemm_quantized_a_kernel_fn = at::Tensor (*)(
+    const at::Tensor&,
+    const at::Tensor&,
+    const at::Tensor&,
+    at::ScalarType,
+    const at::Tensor&,
+    const std::vector<at::Tensor>&,
+    const std::vector<at::Tensor>&,
+    const std::vector<at::Tensor>&,
+    bool,
+    int64_t,
+    int64_t);
+
 DECLARE_DISPATCH(woq_tpp_gemm_kernel_fn, woq_tpp_gemm_kernel_stub);
 DECLARE_DISPATCH(woq_tpp_gemm_packB_fn, woq_tpp_gemm_packB_stub);
 DECLARE_DISPATCH(woq_tpp_gemm_unpackB_fn, woq_tpp_gemm_unpackB_stub);
+DECLARE_DISPATCH(
+    woq_tpp_gemm_quantized_a_kernel_fn,
+    woq_tpp_gemm_quantized_a_kernel_stub);
 
 #define WOQ_FUSE_NONE 0
 #define WOQ_FUSE_GELU 1
 #define WOQ_FUSE_ADD 2
 #define WOQ_FUSE_ADD_ADD 3
+#define WOQ_FUSE_SILU_MUL 4
 #endif
 
 } // namespace cpu
@@ -6,6 +6,9 @@ namespace torch_ipex {
 namespace cpu {
 
 DEFINE_DISPATCH(masked_multihead_self_attention_kernel_stub);
+DEFINE_DISPATCH(paged_masked_multihead_self_attention_kernel_stub);
+DEFINE_DISPATCH(
+    continuous_batching_masked_multihead_self_attention_kernel_stub);
 
 /*
  *Caculate the masked multihead attention for decoder layer in decoder only
@@ -21,6 +24,10 @@ DEFINE_DISPATCH(masked_multihead_self_attention_kernel_stub);
  *@param max_positions
  *@param head_mask
  *@param attention_mask
+ *@param key_scale The scales of the int8/fp8-e4m3 key cache [max_positions,
+ *beam_size*batch, kv_head], only needed when key_cache is passed in int8 or
+ *fp8-e4m3. It is resized in place when the cache is allocated or grows.
+ *@param value_scale The scales of the int8/fp8-e4m3 value cache
  *@return {attn_weights, attn_outs}
  */
 std::tuple<at::Tensor, at::Tensor, at::Tensor, at::Tensor, at::Tensor>
@@ -35,7 +42,9 @@ masked_multihead_self_attention_forward_cpu(
     const double scale_attn,
     int64_t max_positions,
     const c10::optional<at::Tensor>& head_mask /* optional */,
-    const c10::optional<at::Tensor>& attention_mask /* optional */) {
+    const c10::optional<at::Tensor>& attention_mask /* optional */,
+    const c10::optional<at::Tensor>& key_scale /* optional */,
+    const c10::optional<at::Tensor>& value_scale /* optional */) {
   return masked_multihead_self_attention_kernel_stub(
       kCPU,
       query,
@@ -48,7 +57,243 @@ masked_multihead_self_attention_forward_cpu(
       scale_attn,
       max_positions,
       head_mask,
-      attention_mask);
+      attention_mask,
+      key_scale,
+      value_scale);
+}
+
+/*
+ *Caculate the masked multihead attention for decoder layer with the paged kv
+ *cache. The cache grows by one block at a time from the pool without copying
+ *the past tokens.
+ *@param query
+ *@param key
+ *@param value
+ *@param key_cache The pool of key blocks [num_blocks, block_size, kv_head,
+ *head_size]
+ *@param value_cache The pool of value blocks with the same shape of key_cache
+ *@param block_table The blocks owned by every beam row [beam_size*batch,
+ *max_blocks_per_seq], -1 for the block not allocated yet
+ *@param free_blocks The free list of the pool made by
+ *paged_kv_cache_init_free_blocks
+ *@param beam_idx
+ *@param seq_info
+ *@param scale_attn
+ *@param head_mask
+ *@param attention_mask
+ *@param key_scale The scales of the int8/fp8-e4m3 key pool [num_blocks,
+ *block_size, kv_head], only needed when key_cache is int8 or fp8-e4m3
+ *@param value_scale The scales of the int8/fp8-e4m3 value pool
+ *@return {attn_outs, attn_weights, key_cache, value_cache, beam_idx}
+ */
+std::tuple<at::Tensor, at::Tensor, at::Tensor, at::Tensor, at::Tensor>
+paged_masked_multihead_self_attention_forward_cpu(
+    at::Tensor& query,
+    at::Tensor& key,
+    at::Tensor& value,
+    at::Tensor& key_cache,
+    at::Tensor& value_cache,
+    at::Tensor& block_table,
+    at::Tensor& free_blocks,
+    at::Tensor& beam_idx,
+    at::Tensor seq_info,
+    const double scale_attn,
+    const c10::optional<at::Tensor>& head_mask /* optional */,
+    const c10::optional<at::Tensor>& attention_mask /* optional */,
+    const c10::optional<at::Tensor>& key_scale /* optional */,
+    const c10::optional<at::Tensor>& value_scale /* optional */) {
+  return paged_masked_multihead_self_attention_kernel_stub(
+      kCPU,
+      query,
+      key,
+      value,
+      key_cache,
+      value_cache,
+      block_table,
+      free_blocks,
+      beam_idx,
+      seq_info,
+      scale_attn,
+      head_mask,
+      attention_mask,
+      key_scale,
+      value_scale);
+}
+
+/*
+ *Caculate the masked multihead attention for the continuous batching. Every
+ *sequence has its own past length and its own slot of the paged kv cache, so
+ *the sequences can join and leave the batch at any step and the prompt of the
+ *new sequences are processed together with the next token of the others.
+ *@param query Packed query of all the sequences [num_tokens, head_num,
+ *head_size]
+ *@param key Packed key [num_tokens, kv_head, head_size]
+ *@param value Packed value [num_tokens, kv_head, head_size]
+ *@param key_cache The pool of key blocks [num_blocks, block_size, kv_head,
+ *head_size]
+ *@param value_cache The pool of value blocks with the same shape of key_cache
+ *@param block_table The blocks owned by every slot [num_slots,
+ *max_blocks_per_seq], -1 for the block not allocated yet
+ *@param free_blocks The free list of the pool made by
+ *paged_kv_cache_init_free_blocks
+ *@param query_start_loc The start of every sequence in the packed tokens
+ *[num_seqs + 1]
+ *@param past_lens The length of the past tokens of every sequence [num_seqs]
+ *@param slot_ids The slot of every sequence in the block table [num_seqs]
+ *@param scale_attn
+ *@return {attn_outs, key_cache, value_cache}
+ */
+std::tuple<at::Tensor, at::Tensor, at::Tensor>
+continuous_batching_masked_multihead_self_attention_forward_cpu(
+    at::Tensor& query,
+    at::Tensor& key,
+    at::Tensor& value,
+    at::Tensor& key_cache,
+    at::Tensor& value_cache,
+    at::Tensor& block_table,
+    at::Tensor& free_blocks,
+    at::Tensor& query_start_loc,
+    at::Tensor& past_lens,
+    at::Tensor& slot_ids,
+    const double scale_attn) {
+  return continuous_batching_masked_multihead_self_attention_kernel_stub(
+      kCPU,
+      query,
+      key,
+      value,
+      key_cache,
+      value_cache,
+      block_table,
+      free_blocks,
+      query_start_loc,
+      past_lens,
+      slot_ids,
+      scale_attn);
+}
+
+/*
+ *Make the free list of a pool of num_blocks kv cache blocks with all the
+ *blocks free. The free list is [2 * num_blocks + 1] of int64, the number of
+ *free blocks at the position 0, the ids of the free blocks after it and the
+ *reference count of every block at the last num_blocks positions, 0 for a
+ *free block. A block is referenced by every beam row (or slot) owning it in
+ *the block table.
+ *@param num_blocks
+ */
+at::Tensor paged_kv_cache_init_free_blocks(int64_t num_blocks) {
+  TORCH_CHECK(
+      num_blocks > 0,
+      "The kv cache block pool must have a block to use ipex::paged_kv_cache_init_free_blocks");
+  auto free_blocks = at::zeros({2 * num_blocks + 1}, at::kLong);
+  auto free_blocks_ptr = free_blocks.data_ptr<long>();
+  free_blocks_ptr[0] = num_blocks;
+  for (auto i = 0; i < num_blocks; i++) {
+    free_blocks_ptr[i + 1] = i;
+  }
+  return free_blocks;
+}
+
+/*
+ *Return the blocks owned by the finished beam rows (or slots) to the pool. A
+ *block shared by several beam rows, e.g., a prompt block, is returned when the
+ *last row referencing it is freed.
+ *The past tokens of a beam row are read from the rows of its beams in
+ *beam_idx, e.g., from another beam of the same batch after the beams are
+ *reordered, so a row is not freed while a row not freed still reaches it
+ *through beam_idx.
+ *@param block_table
+ *@param free_blocks
+ *@param rows The beam rows or the slots of the finished sequences
+ *@param beam_idx The beam info returned by
+ *paged_masked_multihead_self_attention [max_positions, beam_size*batch], None
+ *for the slots of the continuous batching
+ *@param seq_len The number of tokens in the cache of every beam row
+ */
+void paged_kv_cache_free_blocks(
+    at::Tensor& block_table,
+    at::Tensor& free_blocks,
+    at::IntArrayRef rows,
+    const c10::optional<at::Tensor>& beam_idx,
+    int64_t seq_len) {
+  TORCH_CHECK(
+      block_table.dim() == 2 && block_table.scalar_type() == at::kLong &&
+          free_blocks.dim() == 1 && free_blocks.scalar_type() == at::kLong &&
+          free_blocks.numel() % 2 == 1 && free_blocks.is_contiguous(),
+      "block_table must be [num_rows, max_blocks_per_seq] and free_blocks must be made by paged_kv_cache_init_free_blocks to use ipex::paged_kv_cache_free_blocks");
+  auto num_rows = block_table.size(0);
+  auto num_blocks = (free_blocks.numel() - 1) / 2;
+  auto block_table_access = block_table.accessor<long, 2>();
+  auto free_blocks_ptr = free_blocks.data_ptr<long>();
+  auto ref_counts = free_blocks_ptr + num_blocks + 1;
+  auto owns_blocks = [&](int64_t row) {
+    for (auto i = 0; i < block_table.size(1); i++) {
+      if (block_table_access[row][i] >= 0) {
+        return true;
+      }
+    }
+    return false;
+  };
+  std::vector<bool> freed(num_rows, false);
+  for (auto row : rows) {
+    TORCH_CHECK(
+        row >= 0 && row < num_rows,
+        "The row ",
+        row,
+        " is out of the block table of ",
+        num_rows,
+        " rows in ipex::paged_kv_cache_free_blocks");
+    freed[row] = true;
+  }
+  if (beam_idx.has_value() && beam_idx.value().defined()) {
+    auto& beam_idx_v = beam_idx.value();
+    TORCH_CHECK(
+        beam_idx_v.dim() == 2 && beam_idx_v.scalar_type() == at::kLong &&
+            beam_idx_v.size(0) >= seq_len && beam_idx_v.size(1) == num_rows,
+        "beam_idx must be [max_positions, num_rows] of int64 and cover seq_len to use ipex::paged_kv_cache_free_blocks");
+    auto beam_idx_access = beam_idx_v.accessor<long, 2>();
+    for (auto row = 0; row < num_rows; row++) {
+      if (freed[row] || !owns_blocks(row)) {
+        continue;
+      }
+      // walk back the beams of the past tokens of the row not freed
+      auto beam = row;
+      for (auto ti = seq_len - 1; ti >= 0; ti--) {
+        beam = beam_idx_access[ti][beam];
+        TORCH_CHECK(
+            beam >= 0 && beam < num_rows && !freed[beam],
+            "The row ",
+            beam,
+            " is still reached by the row ",
+            row,
+            " through beam_idx and can't be freed in ipex::paged_kv_cache_free_blocks");
+      }
+    }
+  }
+  for (auto row : rows) {
+    for (auto i = 0; i < block_table.size(1); i++) {
+      auto block_id = block_table_access[row][i];
+      if (block_id < 0) {
+        continue;
+      }
+      TORCH_CHECK(
+          block_id < num_blocks,
+          "The kv cache block ",
+          block_id,
+          " is out of the pool in ipex::paged_kv_cache_free_blocks");
+      TORCH_CHECK(
+          ref_counts[block_id] > 0,
+          "The kv cache block ",
+          block_id,
+          " is freed twice in ipex::paged_kv_cache_free_blocks");
+      block_table_access[row][i] = -1;
+      ref_counts[block_id] -= 1;
+      if (ref_counts[block_id] > 0) {
+        continue;
+      }
+      free_blocks_ptr[0] += 1;
+      free_blocks_ptr[free_blocks_ptr[0]] = block_id;
+    }
+  }
 }
 
 } // namespace cpu
@@ -60,10 +305,40 @@ TORCH_LIBRARY_FRAGMENT(torch_ipex, m) {
   m.def(
       "masked_multihead_self_attention(Tensor query, Tensor key, Tensor value, Tensor key_cache, \
        Tensor value_cache, Tensor beam_idx, Tensor seq_info, float scale_attn, int max_positions, \
-       Tensor? head_mask, Tensor? attention_mask)-> (Tensor, Tensor, Tensor, Tensor, Tensor)");
+       Tensor? head_mask, Tensor? attention_mask, Tensor(a!)? key_scale=None, \
+       Tensor(b!)? value_scale=None)-> (Tensor, Tensor, Tensor, Tensor, Tensor)");
   m.impl(
       "masked_multihead_self_attention",
       c10::DispatchKey::CPU,
       torch_ipex::cpu::masked_multihead_self_attention_forward_cpu);
+  m.def(
+      "paged_masked_multihead_self_attention(Tensor query, Tensor key, Tensor value, Tensor key_cache, \
+       Tensor value_cache, Tensor(a!) block_table, Tensor(b!) free_blocks, Tensor beam_idx, Tensor seq_info, \
+       float scale_attn, Tensor? head_mask, Tensor? attention_mask, Tensor(c!)? key_scale=None, \
+       Tensor(d!)? value_scale=None)-> (Tensor, Tensor, Tensor, Tensor, Tensor)");
+  m.impl(
+      "paged_masked_multihead_self_attention",
+      c10::DispatchKey::CPU,
+      torch_ipex::cpu::paged_masked_multihead_self_attention_forward_cpu);
+  m.def(
+      "continuous_batching_masked_multihead_self_attention(Tensor query, Tensor key, Tensor value, \
+       Tensor key_cache, Tensor value_cache, Tensor(a!) block_table, Tensor(b!) free_blocks, \
+       Tensor query_start_loc, Tensor past_lens, Tensor slot_ids, float scale_attn)-> (Tensor, Tensor, Tensor)");
+  m.impl(
+      "continuous_batching_masked_multihead_self_attention",
+      c10::DispatchKey::CPU,
+      torch_ipex::cpu::
+          continuous_batching_masked_multihead_self_attention_forward_cpu);
+  // no tensor to dispatch on, registered for all the dispatch keys
+  m.def(
+      "paged_kv_cache_init_free_blocks(int num_blocks) -> Tensor",
+      torch_ipex::cpu::paged_kv_cache_init_free_blocks);
+  m.def(
+      "paged_kv_cache_free_blocks(Tensor(a!) block_table, Tensor(b!) free_blocks, int[] rows, \
+       Tensor? beam_idx=None, int seq_len=0) -> ()");
+  m.impl(
+      "paged_kv_cache_free_blocks",
+      c10::DispatchKey::CPU,
+      torch_ipex::cpu::paged_kv_cache_free_blocks);
 }
 } // namespace
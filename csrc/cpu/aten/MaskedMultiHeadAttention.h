@@ -20,7 +20,40 @@ masked_multihead_self_attention(
     const double scale_attn,
     int64_t max_positions,
     const c10::optional<at::Tensor>& head_mask /* optional */,
-    const c10::optional<at::Tensor>& attention_mask /* optional */);
+    const c10::optional<at::Tensor>& attention_mask /* optional */,
+    const c10::optional<at::Tensor>& key_scale /* optional */,
+    const c10::optional<at::Tensor>& value_scale /* optional */);
+
+std::tuple<at::Tensor, at::Tensor, at::Tensor, at::Tensor, at::Tensor>
+paged_masked_multihead_self_attention(
+    at::Tensor& query,
+    at::Tensor& key,
+    at::Tensor& value,
+    at::Tensor& key_cache,
+    at::Tensor& value_cache,
+    at::Tensor& block_table,
+    at::Tensor& free_blocks,
+    at::Tensor& beam_idx,
+    at::Tensor seq_info,
+    const double scale_attn,
+    const c10::optional<at::Tensor>& head_mask /* optional */,
+    const c10::optional<at::Tensor>& attention_mask /* optional */,
+    const c10::optional<at::Tensor>& key_scale /* optional */,
+    const c10::optional<at::Tensor>& value_scale /* optional */);
+
+std::tuple<at::Tensor, at::Tensor, at::Tensor>
+continuous_batching_masked_multihead_self_attention(
+    at::Tensor& query,
+    at::Tensor& key,
+    at::Tensor& value,
+    at::Tensor& key_cache,
+    at::Tensor& value_cache,
+    at::Tensor& block_table,
+    at::Tensor& free_blocks,
+    at::Tensor& query_start_loc,
+    at::Tensor& past_lens,
+    at::Tensor& slot_ids,
+    const double scale_attn);
 }
 
 using masked_multihead_self_attention_kernel_fn =
@@ -35,11 +68,52 @@ using masked_multihead_self_attention_kernel_fn =
         const double scale_attn,
         int64_t max_positions,
         const c10::optional<at::Tensor>& head_mask /* optional */,
-        const c10::optional<at::Tensor>& attention_mask /* optional */);
+        const c10::optional<at::Tensor>& attention_mask /* optional */,
+        const c10::optional<at::Tensor>& key_scale /* optional */,
+        const c10::optional<at::Tensor>& value_scale /* optional */);
 
 DECLARE_DISPATCH(
     masked_multihead_self_attention_kernel_fn,
     masked_multihead_self_attention_kernel_stub);
 
+using paged_masked_multihead_self_attention_kernel_fn =
+    std::tuple<at::Tensor, at::Tensor, at::Tensor, at::Tensor, at::Tensor> (*)(
+        at::Tensor& query,
+        at::Tensor& key,
+        at::Tensor& value,
+        at::Tensor& key_cache,
+        at::Tensor& value_cache,
+        at::Tensor& block_table,
+        at::Tensor& free_blocks,
+        at::Tensor& beam_idx,
+        at::Tensor seq_info,
+        const double scale_attn,
+        const c10::optional<at::Tensor>& head_mask /* optional */,
+        const c10::optional<at::Tensor>& attention_mask /* optional */,
+        const c10::optional<at::Tensor>& key_scale /* optional */,
+        const c10::optional<at::Tensor>& value_scale /* optional */);
+
+DECLARE_DISPATCH(
+    paged_masked_multihead_self_attention_kernel_fn,
+    paged_masked_multihead_self_attention_kernel_stub);
+
+using continuous_batching_masked_multihead_self_attention_kernel_fn =
+    std::tuple<at::Tensor, at::Tensor, at::Tensor> (*)(
+        at::Tensor& query,
+        at::Tensor& key,
+        at::Tensor& value,
+        at::Tensor& key_cache,
+        at::Tensor& value_cache,
+        at::Tensor& block_table,
+        at::Tensor& free_blocks,
+        at::Tensor& query_start_loc,
+        at::Tensor& past_lens,
+        at::Tensor& slot_ids,
+        const double scale_attn);
+
+DECLARE_DISPATCH(
+    continuous_batching_masked_multihead_self_attention_kernel_fn,
+    continuous_batching_masked_multihead_self_attention_kernel_stub);
+
 } // namespace cpu
 } // namespace torch_ipex
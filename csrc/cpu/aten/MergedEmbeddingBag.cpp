@@ -1,13 +1,20 @@
 #include "MergedEmbeddingBag.h"
 #include <ATen/AccumulateType.h>
+#include <ATen/MapAllocator.h>
 #include <ATen/Tensor.h>
+#include <algorithm>
 #include <torch/all.h>
+#include <unistd.h>
 #include "autocast/autocast_mode.h"
 
 namespace torch_ipex {
 namespace cpu {
 
 DEFINE_DISPATCH(merged_embeddingbag_forward_cpu_kernel_stub);
+DEFINE_DISPATCH(merged_embeddingbag_cached_forward_cpu_kernel_stub);
+DEFINE_DISPATCH(merged_embeddingbag_build_hot_row_sets_cpu_kernel_stub);
+DEFINE_DISPATCH(merged_embeddingbag_fetch_rows_cpu_kernel_stub);
+DEFINE_DISPATCH(rowwise_quantized_merged_embeddingbag_kernel_stub);
 
 std::vector<Tensor> merged_embeddingbag_forward_cpu(
     const std::vector<Tensor>& weights,
@@ -23,6 +30,221 @@ std::vector<Tensor> merged_embeddingbag_forward_cpu(
       kCPU, weights, indices, offsets, pooling_mode, include_last_offsets);
 }
 
+std::vector<Tensor> merged_embeddingbag_cached_forward_cpu(
+    const std::vector<Tensor>& weights,
+    const TensorList& indices,
+    const TensorList& offsets,
+    const int64_t pooling_mode,
+    const bool include_last_offsets,
+    const TensorList& hot_row_caches,
+    const TensorList& hot_row_sets,
+    const TensorList& hot_row_counts,
+    const Tensor& hot_row_stats,
+    const int64_t sample_stride) {
+  const int64_t num_emb = weights.size();
+  TORCH_CHECK(
+      num_emb > 0 && indices.size() == num_emb &&
+          offsets.size() == num_emb && hot_row_caches.size() == num_emb &&
+          hot_row_sets.size() == num_emb && hot_row_counts.size() == num_emb,
+      "merged_embeddingbag_cached_forward: expect the same number of weights, indices, offsets, caches, hot row sets and counts");
+  TORCH_CHECK(
+      hot_row_stats.scalar_type() == at::kLong &&
+          hot_row_stats.is_contiguous() && hot_row_stats.dim() == 2 &&
+          hot_row_stats.size(0) == num_emb && hot_row_stats.size(1) == 3,
+      "merged_embeddingbag_cached_forward: expect contiguous int64 stats of (sampled hits, sampled lookups, sampling ns) per table");
+  TORCH_CHECK(
+      sample_stride >= 0,
+      "merged_embeddingbag_cached_forward: sample_stride should be non-negative");
+  for (int64_t i = 0; i < num_emb; i++) {
+    TORCH_CHECK(
+        hot_row_caches[i].scalar_type() == weights[i].scalar_type() &&
+            hot_row_caches[i].is_contiguous() &&
+            hot_row_caches[i].dim() == 2 &&
+            hot_row_caches[i].size(1) == weights[i].size(1),
+        "merged_embeddingbag_cached_forward: expect contiguous caches of the rows of the weights");
+    const int64_t num_hot_rows =
+        std::max<int64_t>(hot_row_caches[i].size(0), 1);
+    const int64_t num_buckets =
+        hot_row_sets[i].dim() == 2 ? hot_row_sets[i].size(1) : 0;
+    TORCH_CHECK(
+        hot_row_sets[i].scalar_type() == at::kLong &&
+            hot_row_sets[i].is_contiguous() && hot_row_sets[i].size(0) == 2 &&
+            num_buckets >= 2 * num_hot_rows &&
+            (num_buckets & (num_buckets - 1)) == 0,
+        "merged_embeddingbag_cached_forward: expect contiguous int64 hot row sets of [2, num_buckets], num_buckets a power of 2 of at least twice the rows of the cache");
+    TORCH_CHECK(
+        hot_row_counts[i].scalar_type() == at::kInt &&
+            hot_row_counts[i].is_contiguous() &&
+            hot_row_counts[i].numel() == weights[i].size(0),
+        "merged_embeddingbag_cached_forward: expect contiguous int32 counts of the rows of the weights");
+    TORCH_CHECK(
+        indices[i].is_contiguous() &&
+            indices[i].scalar_type() == indices[0].scalar_type(),
+        "merged_embeddingbag_cached_forward: expect contiguous indices of the same type");
+  }
+  /*
+  pointer to merged_embeddingbag_cached_forward_cpu_kernel_impl(
+      weights, indices, offsets, pooling_mode, include_last_offsets,
+      hot_row_caches, hot_row_sets, hot_row_counts, hot_row_stats,
+      sample_stride);
+  */
+  return merged_embeddingbag_cached_forward_cpu_kernel_stub(
+      kCPU,
+      weights,
+      indices,
+      offsets,
+      pooling_mode,
+      include_last_offsets,
+      hot_row_caches,
+      hot_row_sets,
+      hot_row_counts,
+      hot_row_stats,
+      sample_stride);
+}
+
+void merged_embeddingbag_build_hot_row_sets_cpu(
+    const TensorList& hot_rows,
+    const TensorList& hot_row_sets) {
+  const int64_t num_emb = hot_rows.size();
+  TORCH_CHECK(
+      hot_row_sets.size() == num_emb,
+      "merged_embeddingbag_build_hot_row_sets: expect the same number of hot rows and hot row sets");
+  for (int64_t i = 0; i < num_emb; i++) {
+    const int64_t num_buckets =
+        hot_row_sets[i].dim() == 2 ? hot_row_sets[i].size(1) : 0;
+    TORCH_CHECK(
+        hot_rows[i].scalar_type() == at::kLong &&
+            hot_rows[i].is_contiguous() && hot_rows[i].dim() == 1,
+        "merged_embeddingbag_build_hot_row_sets: expect contiguous int64 hot rows");
+    TORCH_CHECK(
+        hot_row_sets[i].scalar_type() == at::kLong &&
+            hot_row_sets[i].is_contiguous() && hot_row_sets[i].size(0) == 2 &&
+            num_buckets >= 2 * std::max<int64_t>(hot_rows[i].numel(), 1) &&
+            (num_buckets & (num_buckets - 1)) == 0,
+        "merged_embeddingbag_build_hot_row_sets: expect contiguous int64 hot row sets of [2, num_buckets], num_buckets a power of 2 of at least twice the hot rows");
+    // -1 marks the empty buckets
+    TORCH_CHECK(
+        hot_rows[i].numel() == 0 || hot_rows[i].min().item<int64_t>() >= 0,
+        "merged_embeddingbag_build_hot_row_sets: expect non-negative hot rows");
+  }
+  /*
+  pointer to merged_embeddingbag_build_hot_row_sets_cpu_kernel_impl(
+      hot_rows, hot_row_sets);
+  */
+  merged_embeddingbag_build_hot_row_sets_cpu_kernel_stub(
+      kCPU, hot_rows, hot_row_sets);
+}
+
+void merged_embeddingbag_fetch_rows_cpu(
+    const TensorList& weights,
+    const TensorList& indices,
+    const TensorList& page_last_use,
+    const TensorList& page_lru,
+    const Tensor& fetch_stats,
+    const int64_t step,
+    const int64_t max_resident_pages) {
+  const int64_t num_emb = weights.size();
+  TORCH_CHECK(
+      num_emb > 0 && indices.size() == num_emb &&
+          page_last_use.size() == num_emb && page_lru.size() == num_emb,
+      "merged_embeddingbag_fetch_rows: expect the same number of weights, indices, page last uses and page LRUs");
+  TORCH_CHECK(
+      fetch_stats.scalar_type() == at::kLong && fetch_stats.is_contiguous() &&
+          fetch_stats.dim() == 2 && fetch_stats.size(0) == num_emb &&
+          fetch_stats.size(1) == 4,
+      "merged_embeddingbag_fetch_rows: expect contiguous int64 stats of (hits, fetches, evictions, resident pages) per table");
+  TORCH_CHECK(
+      step > 0 && max_resident_pages >= 0,
+      "merged_embeddingbag_fetch_rows: expect a positive step and a non-negative max_resident_pages");
+  const int64_t page_size = sysconf(_SC_PAGESIZE);
+  for (int64_t i = 0; i < num_emb; i++) {
+    // the least recently used pages are dropped from the mapping, which only
+    // keeps the data of a mapping shared with the file
+    auto* map = at::MapAllocator::fromDataPtr(weights[i].storage().data_ptr());
+    TORCH_CHECK(
+        map != nullptr && (map->flags() & at::ALLOCATOR_MAPPED_SHARED) &&
+            weights[i].is_contiguous() && weights[i].dim() == 2,
+        "merged_embeddingbag_fetch_rows: expect contiguous weights mapped from a file by torch.from_file(..., shared=True)");
+    const int64_t page_offset =
+        reinterpret_cast<uintptr_t>(weights[i].data_ptr()) % page_size;
+    const int64_t num_pages =
+        (page_offset + weights[i].nbytes() + page_size - 1) / page_size;
+    TORCH_CHECK(
+        page_last_use[i].scalar_type() == at::kLong &&
+            page_last_use[i].is_contiguous() &&
+            page_last_use[i].numel() == num_pages,
+        "merged_embeddingbag_fetch_rows: expect contiguous int64 last uses of the pages of the weight");
+    TORCH_CHECK(
+        page_lru[i].scalar_type() == at::kLong &&
+            page_lru[i].is_contiguous() && page_lru[i].dim() == 2 &&
+            page_lru[i].size(0) == 2 && page_lru[i].size(1) == num_pages + 1,
+        "merged_embeddingbag_fetch_rows: expect a contiguous int64 LRU of [2, num_pages + 1] of the pages of the weight");
+    TORCH_CHECK(
+        indices[i].is_contiguous() &&
+            indices[i].scalar_type() == indices[0].scalar_type(),
+        "merged_embeddingbag_fetch_rows: expect contiguous indices of the same type");
+  }
+  /*
+  pointer to merged_embeddingbag_fetch_rows_cpu_kernel_impl(
+      weights, indices, page_last_use, page_lru, fetch_stats, step,
+      max_resident_pages);
+  */
+  merged_embeddingbag_fetch_rows_cpu_kernel_stub(
+      kCPU,
+      weights,
+      indices,
+      page_last_use,
+      page_lru,
+      fetch_stats,
+      step,
+      max_resident_pages);
+}
+
+std::vector<Tensor> rowwise_quantized_merged_embeddingbag_forward_cpu(
+    const TensorList& weights,
+    const TensorList& indices,
+    const TensorList& offsets,
+    const int64_t pooling_mode,
+    const bool include_last_offsets,
+    const int64_t bit_width,
+    const ScalarType output_dtype) {
+  TORCH_CHECK(
+      bit_width == 8 || bit_width == 4,
+      "rowwise_quantized_merged_embeddingbag: only 8-bit and 4-bit tables are supported");
+  TORCH_CHECK(
+      output_dtype == at::kFloat || output_dtype == at::kBFloat16,
+      "rowwise_quantized_merged_embeddingbag: only float and bfloat16 outputs are supported");
+  TORCH_CHECK(
+      weights.size() > 0 && weights.size() == indices.size() &&
+          weights.size() == offsets.size(),
+      "rowwise_quantized_merged_embeddingbag: expect the same number of weights, indices and offsets");
+  // 2 bytes of fp16 scale and 2 bytes of fp16 bias per row
+  int64_t row_bytes = weights[0].size(1);
+  TORCH_CHECK(
+      row_bytes > 4,
+      "rowwise_quantized_merged_embeddingbag: the rows have no values");
+  for (const auto& weight : weights) {
+    TORCH_CHECK(
+        weight.scalar_type() == at::kByte && weight.dim() == 2 &&
+            weight.is_contiguous() && weight.size(1) == row_bytes,
+        "rowwise_quantized_merged_embeddingbag: expect contiguous uint8 weights with the same row size");
+  }
+  /*
+  pointer to rowwise_quantized_merged_embeddingbag_kernel_impl(
+      weights, indices, offsets, pooling_mode, include_last_offsets,
+      bit_width, output_dtype);
+  */
+  return rowwise_quantized_merged_embeddingbag_kernel_stub(
+      kCPU,
+      weights,
+      indices,
+      offsets,
+      pooling_mode,
+      include_last_offsets,
+      bit_width,
+      output_dtype);
+}
+
 } // namespace cpu
 } // namespace torch_ipex
 
@@ -64,6 +286,30 @@ TORCH_LIBRARY_FRAGMENT(torch_ipex, m) {
       "merged_embeddingbag_forward",
       c10::DispatchKey::AutocastCPU,
       torch_ipex::autocast::merged_embeddingbag_forward);
+  m.def(
+      "merged_embeddingbag_cached_forward(Tensor[] weights, Tensor[] indices, Tensor[] offsets, int pooling_mode, bool include_last_offsets, Tensor[] hot_row_caches, Tensor[] hot_row_sets, Tensor[] hot_row_counts, Tensor hot_row_stats, int sample_stride) -> Tensor[]");
+  m.impl(
+      "merged_embeddingbag_cached_forward",
+      c10::DispatchKey::CPU,
+      torch_ipex::cpu::merged_embeddingbag_cached_forward_cpu);
+  m.def(
+      "merged_embeddingbag_build_hot_row_sets(Tensor[] hot_rows, Tensor[] hot_row_sets) -> ()");
+  m.impl(
+      "merged_embeddingbag_build_hot_row_sets",
+      c10::DispatchKey::CPU,
+      torch_ipex::cpu::merged_embeddingbag_build_hot_row_sets_cpu);
+  m.def(
+      "merged_embeddingbag_fetch_rows(Tensor[] weights, Tensor[] indices, Tensor[] page_last_use, Tensor[] page_lru, Tensor fetch_stats, int step, int max_resident_pages) -> ()");
+  m.impl(
+      "merged_embeddingbag_fetch_rows",
+      c10::DispatchKey::CPU,
+      torch_ipex::cpu::merged_embeddingbag_fetch_rows_cpu);
+  m.def(
+      "rowwise_quantized_merged_embeddingbag_forward(Tensor[] weights, Tensor[] indices, Tensor[] offsets, int pooling_mode, bool include_last_offsets, int bit_width, ScalarType output_dtype) -> Tensor[]");
+  m.impl(
+      "rowwise_quantized_merged_embeddingbag_forward",
+      c10::DispatchKey::CPU,
+      torch_ipex::cpu::rowwise_quantized_merged_embeddingbag_forward_cpu);
 }
 
 } // namespace
@@ -9,28 +9,6 @@ namespace cpu {
 namespace {
 using namespace at;
 enum PoolingMode { SUM = 0, MEAN = 1 };
-template <class T>
-class EMBROW {
- public:
-  T* data = nullptr;
-  int32_t length;
-  EMBROW(int32_t len) {
-    length = len;
-    Allocator* allocator = c10::GetAllocator(c10::DeviceType::CPU);
-    data = (T*)allocator->raw_allocate(len * sizeof(T));
-    memset(data, 0, len * sizeof(T));
-  }
-  ~EMBROW() {
-    Allocator* allocator = c10::GetAllocator(c10::DeviceType::CPU);
-    allocator->raw_deallocate(data);
-  }
-};
-
-template <class T>
-class EmbeddingGradCache {
- public:
-  std::unordered_map<int32_t, EMBROW<T>> cache;
-};
 
 struct SGDArgs {
   SGDArgs(const TensorList& bf16_trail_, float weight_decay_, float lr_)
@@ -63,7 +41,8 @@ class EmbeddingGradUpdate<data_t, acc_t, SGDArgs> {
  public:
   static void update(
       data_t* weight,
-      const EmbeddingGradCache<acc_t>& egc,
+      const int64_t idx,
+      acc_t* grad,
       const SGDArgs& args,
       const int32_t table_id,
       const int64_t emb_dim);
@@ -74,7 +53,8 @@ class EmbeddingGradUpdate<data_t, acc_t, AdaGradArgs> {
  public:
   static void update(
       data_t* weight,
-      const EmbeddingGradCache<acc_t>& egc,
+      const int64_t idx,
+      acc_t* grad,
       const AdaGradArgs& args,
       const int32_t table_id,
       const int64_t emb_dim);
@@ -87,6 +67,40 @@ std::vector<Tensor> merged_embeddingbag_forward_cpu_kernel_impl(
     const int64_t pooling_mode,
     const bool include_last_offsets);
 
+std::vector<Tensor> merged_embeddingbag_cached_forward_cpu_kernel_impl(
+    const std::vector<Tensor>& weights,
+    const TensorList& indices,
+    const TensorList& offsets,
+    const int64_t pooling_mode,
+    const bool include_last_offsets,
+    const TensorList& hot_row_caches,
+    const TensorList& hot_row_sets,
+    const TensorList& hot_row_counts,
+    const Tensor& hot_row_stats,
+    const int64_t sample_stride);
+
+void merged_embeddingbag_build_hot_row_sets_cpu_kernel_impl(
+    const TensorList& hot_rows,
+    const TensorList& hot_row_sets);
+
+void merged_embeddingbag_fetch_rows_cpu_kernel_impl(
+    const TensorList& weights,
+    const TensorList& indices,
+    const TensorList& page_last_use,
+    const TensorList& page_lru,
+    const Tensor& fetch_stats,
+    const int64_t step,
+    const int64_t max_resident_pages);
+
+std::vector<Tensor> rowwise_quantized_merged_embeddingbag_kernel_impl(
+    const TensorList& weights,
+    const TensorList& indices,
+    const TensorList& offsets,
+    const int64_t pooling_mode,
+    const bool include_last_offsets,
+    const int64_t bit_width,
+    const ScalarType output_dtype);
+
 std::vector<Tensor> merged_embeddingbag_backward_cpu_kernel_impl(
     const TensorList& grad_outs_,
     const TensorList& weights,
@@ -104,7 +118,9 @@ void merged_embeddingbag_backward_sgd_cpu_kernel_impl(
     const bool include_last_offsets,
     const TensorList& bf16_trail,
     const double weight_decay,
-    const double lr);
+    const double lr,
+    const TensorList& hot_row_sets,
+    const TensorList& hot_row_caches);
 
 void merged_embeddingbag_backward_adagrad_cpu_kernel_impl(
     const TensorList& grad_outs_,
@@ -116,10 +132,70 @@ void merged_embeddingbag_backward_adagrad_cpu_kernel_impl(
     const TensorList& hessian,
     const TensorList& bf16_trail,
     const double eps,
-    const double lr);
+    const double lr,
+    const TensorList& hot_row_sets,
+    const TensorList& hot_row_caches);
 
 } // namespace
 
+// The hot rows of every table are copied to its hot row cache, a [K, emb_dim]
+// tensor next to the table. The hot row set of a table is an open addressing
+// hash of its hot rows, see HotRowSet in utils/embedding_hot_rows.h, which the
+// pooling looks every lookup up in, so that the lookups of the hot rows read
+// their copies in the cache. Every sample_stride lookups (0 to not sample) are
+// sampled into the counts of the rows, and the hits of the sampled lookups in
+// the hot row set, the sampled lookups and the nanoseconds of the sampling of
+// every table are added to its row of the stats.
+std::vector<Tensor> merged_embeddingbag_cached_forward_cpu(
+    const std::vector<Tensor>& weights,
+    const TensorList& indices,
+    const TensorList& offsets,
+    const int64_t pooling_mode,
+    const bool include_last_offsets,
+    const TensorList& hot_row_caches,
+    const TensorList& hot_row_sets,
+    const TensorList& hot_row_counts,
+    const Tensor& hot_row_stats,
+    const int64_t sample_stride);
+
+// Fill the hot row set of every table with its hot rows, the copy of the j-th
+// hot row is the row j of the cache.
+void merged_embeddingbag_build_hot_row_sets_cpu(
+    const TensorList& hot_rows,
+    const TensorList& hot_row_sets);
+
+// The weights are tables mapped from files, e.g., on NVMe, which may be larger
+// than the memory. The pages of the rows looked up by the indices are fetched
+// before the lookups, so that the pooling does not stall on the faults one by
+// one. A page is fetched once per step, and page_last_use holds the last step
+// of every page of a table. page_lru links the resident pages of a table from
+// the least to the most recently used one, as the previous and the next page
+// of every page in its 2 rows, with the head at the last column and -1 for the
+// pages not resident. The least recently used pages are evicted from the
+// memory, including the page cache, once a table has more than
+// max_resident_pages (0 to not evict). The page hits, fetches, evictions and
+// resident pages of every table are added to its row of the stats.
+void merged_embeddingbag_fetch_rows_cpu(
+    const TensorList& weights,
+    const TensorList& indices,
+    const TensorList& page_last_use,
+    const TensorList& page_lru,
+    const Tensor& fetch_stats,
+    const int64_t step,
+    const int64_t max_resident_pages);
+
+// The tables are quantized row by row: each row holds its 8-bit values, or its
+// 4-bit values with the lower nibble first, followed by its fp16 scale and
+// bias, so that w = q * scale + bias.
+std::vector<Tensor> rowwise_quantized_merged_embeddingbag_forward_cpu(
+    const TensorList& weights,
+    const TensorList& indices,
+    const TensorList& offsets,
+    const int64_t pooling_mode,
+    const bool include_last_offsets,
+    const int64_t bit_width,
+    const ScalarType output_dtype);
+
 using merged_embeddingbag_forward_cpu_kernel_fn = std::vector<Tensor> (*)(
     const std::vector<Tensor>&,
     const TensorList&,
@@ -130,6 +206,52 @@ DECLARE_DISPATCH(
     merged_embeddingbag_forward_cpu_kernel_fn,
     merged_embeddingbag_forward_cpu_kernel_stub);
 
+using merged_embeddingbag_cached_forward_cpu_kernel_fn =
+    std::vector<Tensor> (*)(
+        const std::vector<Tensor>&,
+        const TensorList&,
+        const TensorList&,
+        const int64_t,
+        const bool,
+        const TensorList&,
+        const TensorList&,
+        const TensorList&,
+        const Tensor&,
+        const int64_t);
+DECLARE_DISPATCH(
+    merged_embeddingbag_cached_forward_cpu_kernel_fn,
+    merged_embeddingbag_cached_forward_cpu_kernel_stub);
+
+using merged_embeddingbag_build_hot_row_sets_cpu_kernel_fn =
+    void (*)(const TensorList&, const TensorList&);
+DECLARE_DISPATCH(
+    merged_embeddingbag_build_hot_row_sets_cpu_kernel_fn,
+    merged_embeddingbag_build_hot_row_sets_cpu_kernel_stub);
+
+using merged_embeddingbag_fetch_rows_cpu_kernel_fn = void (*)(
+    const TensorList&,
+    const TensorList&,
+    const TensorList&,
+    const TensorList&,
+    const Tensor&,
+    const int64_t,
+    const int64_t);
+DECLARE_DISPATCH(
+    merged_embeddingbag_fetch_rows_cpu_kernel_fn,
+    merged_embeddingbag_fetch_rows_cpu_kernel_stub);
+
+using rowwise_quantized_merged_embeddingbag_kernel_fn = std::vector<Tensor> (*)(
+    const TensorList&,
+    const TensorList&,
+    const TensorList&,
+    const int64_t,
+    const bool,
+    const int64_t,
+    const ScalarType);
+DECLARE_DISPATCH(
+    rowwise_quantized_merged_embeddingbag_kernel_fn,
+    rowwise_quantized_merged_embeddingbag_kernel_stub);
+
 using merged_embeddingbag_backward_cpu_kernel_fn = std::vector<Tensor> (*)(
     const TensorList&,
     const TensorList&,
@@ -150,7 +272,9 @@ using merged_embeddingbag_backward_sgd_cpu_kernel_fn = void (*)(
     const bool,
     const TensorList&,
     const double,
-    const double);
+    const double,
+    const TensorList&,
+    const TensorList&);
 DECLARE_DISPATCH(
     merged_embeddingbag_backward_sgd_cpu_kernel_fn,
     merged_embeddingbag_backward_sgd_cpu_kernel_stub);
@@ -165,7 +289,9 @@ using merged_embeddingbag_backward_adagrad_cpu_kernel_fn = void (*)(
     const TensorList&,
     const TensorList&,
     const double,
-    const double);
+    const double,
+    const TensorList&,
+    const TensorList&);
 DECLARE_DISPATCH(
     merged_embeddingbag_backward_adagrad_cpu_kernel_fn,
     merged_embeddingbag_backward_adagrad_cpu_kernel_stub);
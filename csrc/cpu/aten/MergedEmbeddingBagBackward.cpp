@@ -38,7 +38,9 @@ void merged_embeddingbag_backward_sgd_cpu(
     const bool include_last_offsets,
     const TensorList& bf16_trail,
     const double weight_decay,
-    const double lr) {
+    const double lr,
+    const TensorList& hot_row_sets,
+    const TensorList& hot_row_caches) {
   /*
   pointer to merged_embeddingbag_backward_sgd_cpu_kernel_impl(
       grad_outs_,
@@ -49,7 +51,9 @@ void merged_embeddingbag_backward_sgd_cpu(
       include_last_offsets,
       bf16_trail,
       weight_decay,
-      lr);
+      lr,
+      hot_row_sets,
+      hot_row_caches);
   */
   return merged_embeddingbag_backward_sgd_cpu_kernel_stub(
       kCPU,
@@ -61,7 +65,9 @@ void merged_embeddingbag_backward_sgd_cpu(
       include_last_offsets,
       bf16_trail,
       weight_decay,
-      lr);
+      lr,
+      hot_row_sets,
+      hot_row_caches);
 }
 
 void merged_embeddingbag_backward_adagrad_cpu(
@@ -74,7 +80,9 @@ void merged_embeddingbag_backward_adagrad_cpu(
     const TensorList& hessian,
     const TensorList& bf16_trail,
     const double eps,
-    const double lr) {
+    const double lr,
+    const TensorList& hot_row_sets,
+    const TensorList& hot_row_caches) {
   /*
   pointer to merged_embeddingbag_backward_adagrad_cpu_kernel_impl(
       grad_outs_,
@@ -86,7 +94,9 @@ void merged_embeddingbag_backward_adagrad_cpu(
       hessian,
       bf16_trail,
       eps,
-      lr);
+      lr,
+      hot_row_sets,
+      hot_row_caches);
   */
   return merged_embeddingbag_backward_adagrad_cpu_kernel_stub(
       kCPU,
@@ -99,7 +109,9 @@ void merged_embeddingbag_backward_adagrad_cpu(
       hessian,
       bf16_trail,
       eps,
-      lr);
+      lr,
+      hot_row_sets,
+      hot_row_caches);
 }
 
 } // namespace cpu
@@ -115,13 +127,13 @@ TORCH_LIBRARY_FRAGMENT(torch_ipex, m) {
       c10::DispatchKey::CPU,
       torch_ipex::cpu::merged_embeddingbag_backward_cpu);
   m.def(
-      "merged_embeddingbag_backward_sgd(Tensor[] grad, Tensor[] weight, Tensor[] index, Tensor[] offsets, int pooling_mode, bool include_last, Tensor[] bf16_trail, float weight_decay, float lr) -> ()");
+      "merged_embeddingbag_backward_sgd(Tensor[] grad, Tensor[] weight, Tensor[] index, Tensor[] offsets, int pooling_mode, bool include_last, Tensor[] bf16_trail, float weight_decay, float lr, Tensor[] hot_row_sets=[], Tensor[] hot_row_caches=[]) -> ()");
   m.impl(
       "merged_embeddingbag_backward_sgd",
       c10::DispatchKey::CPU,
       torch_ipex::cpu::merged_embeddingbag_backward_sgd_cpu);
   m.def(
-      "merged_embeddingbag_backward_adagrad(Tensor[] grad, Tensor[] weight, Tensor[] index, Tensor[] offsets, int pooling_mode, bool include_last, Tensor[] hessian, Tensor[] bf16_trail, float eps, float lr) -> ()");
+      "merged_embeddingbag_backward_adagrad(Tensor[] grad, Tensor[] weight, Tensor[] index, Tensor[] offsets, int pooling_mode, bool include_last, Tensor[] hessian, Tensor[] bf16_trail, float eps, float lr, Tensor[] hot_row_sets=[], Tensor[] hot_row_caches=[]) -> ()");
   m.impl(
       "merged_embeddingbag_backward_adagrad",
       c10::DispatchKey::CPU,
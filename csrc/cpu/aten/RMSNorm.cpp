@@ -6,6 +6,7 @@ namespace torch_ipex {
 namespace cpu {
 
 DEFINE_DISPATCH(rmsnorm_kernel_stub);
+DEFINE_DISPATCH(add_rmsnorm_kernel_stub);
 
 at::Tensor dil_RMSNorm(
     const at::Tensor& input,
@@ -16,6 +17,60 @@ at::Tensor dil_RMSNorm(
   return rmsnorm_kernel_stub(kCPU, input, b, eps);
 }
 
+static void check_add_rmsnorm_inputs(
+    const at::Tensor& input,
+    const at::Tensor& residual) {
+  TORCH_CHECK(
+      input.sizes() == residual.sizes(),
+      "add_rmsnorm: input and residual must have the same shape");
+  TORCH_CHECK(
+      input.scalar_type() == residual.scalar_type(),
+      "add_rmsnorm: input and residual must have the same dtype");
+  TORCH_CHECK(
+      residual.is_contiguous(),
+      "add_rmsnorm: residual is updated in place and must be contiguous");
+}
+
+at::Tensor add_rmsnorm(
+    const at::Tensor& input,
+    at::Tensor& residual,
+    const at::Tensor& weight,
+    double eps,
+    c10::optional<at::ScalarType> out_dtype) {
+  RECORD_FUNCTION("ipex::add_rmsnorm", c10::ArrayRef<c10::IValue>({}));
+
+  check_add_rmsnorm_inputs(input, residual);
+  auto dtype = out_dtype.value_or(residual.scalar_type());
+  TORCH_CHECK(
+      dtype == at::kFloat || dtype == at::kBFloat16,
+      "add_rmsnorm: unsupported output dtype ",
+      dtype);
+  auto output = at::empty(residual.sizes(), residual.options().dtype(dtype));
+  at::Tensor scales, zero_points;
+  add_rmsnorm_kernel_stub(
+      kCPU, input, residual, weight, eps, output, scales, zero_points);
+  return output;
+}
+
+std::tuple<at::Tensor, at::Tensor, at::Tensor> add_rmsnorm_quantize(
+    const at::Tensor& input,
+    at::Tensor& residual,
+    const at::Tensor& weight,
+    double eps) {
+  RECORD_FUNCTION(
+      "ipex::add_rmsnorm_quantize", c10::ArrayRef<c10::IValue>({}));
+
+  check_add_rmsnorm_inputs(input, residual);
+  auto M = residual.numel() / residual.size(-1);
+  auto output =
+      at::empty(residual.sizes(), residual.options().dtype(at::kByte));
+  auto scales = at::empty({M}, residual.options().dtype(at::kFloat));
+  auto zero_points = at::empty({M}, residual.options().dtype(at::kInt));
+  add_rmsnorm_kernel_stub(
+      kCPU, input, residual, weight, eps, output, scales, zero_points);
+  return std::make_tuple(output, scales, zero_points);
+}
+
 } // namespace cpu
 } // namespace torch_ipex
 
@@ -24,5 +79,21 @@ namespace {
 TORCH_LIBRARY_FRAGMENT(torch_ipex, m) {
   m.def("rmsnorm(Tensor input, Tensor weight, float eps) -> Tensor");
   m.impl("rmsnorm", c10::DispatchKey::CPU, torch_ipex::cpu::dil_RMSNorm);
+  // Fuse the residual add before the RMSNorm of a decoder layer. The residual
+  // is updated in place, and the normalized output is in the input dtype of
+  // the next GEMM.
+  m.def(
+      "add_rmsnorm(Tensor input, Tensor(a!) residual, Tensor weight, "
+      "float eps, ScalarType? out_dtype=None) -> Tensor");
+  m.impl("add_rmsnorm", c10::DispatchKey::CPU, torch_ipex::cpu::add_rmsnorm);
+  // The output is quantized to uint8 per row, for the GEMMs which quantize
+  // their input per row, e.g., woq_linear_quantized_input.
+  m.def(
+      "add_rmsnorm_quantize(Tensor input, Tensor(a!) residual, Tensor weight, "
+      "float eps) -> (Tensor, Tensor, Tensor)");
+  m.impl(
+      "add_rmsnorm_quantize",
+      c10::DispatchKey::CPU,
+      torch_ipex::cpu::add_rmsnorm_quantize);
 }
 } // namespace
\ No newline at end of file
@@ -11,18 +11,52 @@ at::Tensor dil_RMSNorm(
     const at::Tensor& b,
     double eps);
 
+at::Tensor add_rmsnorm(
+    const at::Tensor& input,
+    at::Tensor& residual,
+    const at::Tensor& weight,
+    double eps,
+    c10::optional<at::ScalarType> out_dtype);
+
+std::tuple<at::Tensor, at::Tensor, at::Tensor> add_rmsnorm_quantize(
+    const at::Tensor& input,
+    at::Tensor& residual,
+    const at::Tensor& weight,
+    double eps);
+
 namespace {
 
 at::Tensor rmsnorm_kernel_impl(
     const at::Tensor& input,
     const at::Tensor& b,
     float eps);
+
+void add_rmsnorm_kernel_impl(
+    const at::Tensor& input,
+    at::Tensor& residual,
+    const at::Tensor& b,
+    float eps,
+    at::Tensor& output,
+    at::Tensor& scales,
+    at::Tensor& zero_points);
 }
 
 using rms_norm_kernel_fn =
     at::Tensor (*)(const at::Tensor&, const at::Tensor&, float);
 
+// residual += input, output = rmsnorm(residual). The output is quantized to
+// uint8 per row if it is kByte, with the scales and zero points of the rows.
+using add_rms_norm_kernel_fn = void (*)(
+    const at::Tensor&,
+    at::Tensor&,
+    const at::Tensor&,
+    float,
+    at::Tensor&,
+    at::Tensor&,
+    at::Tensor&);
+
 DECLARE_DISPATCH(rms_norm_kernel_fn, rmsnorm_kernel_stub);
+DECLARE_DISPATCH(add_rms_norm_kernel_fn, add_rmsnorm_kernel_stub);
 
 } // namespace cpu
 } // namespace torch_ipex
@@ -11,6 +11,7 @@ namespace torch_ipex {
 namespace cpu {
 
 DEFINE_DISPATCH(rotary_position_embedding_kernel_stub);
+DEFINE_DISPATCH(rotary_position_embedding_qk_kernel_stub);
 
 at::Tensor& rotary_position_embedding_forward_cpu(
     at::Tensor& t_in,
@@ -42,6 +43,31 @@ at::Tensor rotary_position_embedding_forward_out_cpu(
   return t_in;
 }
 
+// Apply the rotary embedding to the query and key of the QKV projection in one
+// launch, which merges the two launches of rotary_position_embedding. Return
+// the contiguous rotated query and key.
+std::tuple<at::Tensor, at::Tensor> rotary_position_embedding_qk_forward_cpu(
+    at::Tensor& t_q,
+    at::Tensor& t_k,
+    at::Tensor& t_emb_pos,
+    at::Tensor& t_pos,
+    int64_t N, // N: number of query head, KVN: number of key head
+    int64_t KVN,
+    int64_t H,
+    int64_t offset,
+    int64_t rotary_ndims) {
+  RECORD_FUNCTION(
+      "ipex::rotary_position_embedding_qk", c10::ArrayRef<c10::IValue>({}));
+  TORCH_CHECK(
+      t_q.dim() == 4 && t_k.dim() == 4,
+      "rotary_position_embedding_qk: expect query and key in [B, S, N, H]");
+  TORCH_CHECK(
+      t_q.scalar_type() == t_k.scalar_type(),
+      "rotary_position_embedding_qk: query and key should have the same data type");
+  return rotary_position_embedding_qk_kernel_stub(
+      kCPU, t_q, t_k, t_emb_pos, t_pos, N, KVN, H, offset, rotary_ndims);
+}
+
 at::Tensor& rotary_position_embedding_forward_functionalization(
     at::Tensor& t_in,
     at::Tensor& t_emb_pos,
@@ -96,5 +122,11 @@ TORCH_LIBRARY_FRAGMENT(torch_ipex, m) {
       "rotary_position_embedding_out",
       c10::DispatchKey::CPU,
       torch_ipex::cpu::rotary_position_embedding_forward_out_cpu);
+  m.def(
+      "rotary_position_embedding_qk(Tensor t_q, Tensor t_k, Tensor t_emb_pos, Tensor t_pos, int N, int KVN, int H, int offset, int rotary_ndims)-> (Tensor, Tensor)");
+  m.impl(
+      "rotary_position_embedding_qk",
+      c10::DispatchKey::CPU,
+      torch_ipex::cpu::rotary_position_embedding_qk_forward_cpu);
 }
 } // namespace
@@ -16,6 +16,17 @@ void rotary_position_embedding_kernel_impl(
     int64_t H,
     int64_t offset,
     int64_t rotary_ndims);
+
+std::tuple<at::Tensor, at::Tensor> rotary_position_embedding_qk_kernel_impl(
+    at::Tensor& t_q,
+    at::Tensor& t_k,
+    at::Tensor& t_emb_pos,
+    at::Tensor& t_pos,
+    int64_t N, // N: number of query head, KVN: number of key head
+    int64_t KVN,
+    int64_t H,
+    int64_t offset,
+    int64_t rotary_ndims);
 }
 
 using rotary_position_embedding_kernel_fn = void (*)(
@@ -31,5 +42,21 @@ DECLARE_DISPATCH(
     rotary_position_embedding_kernel_fn,
     rotary_position_embedding_kernel_stub);
 
+using rotary_position_embedding_qk_kernel_fn =
+    std::tuple<at::Tensor, at::Tensor> (*)(
+        at::Tensor& t_q,
+        at::Tensor& t_k,
+        at::Tensor& t_emb_pos,
+        at::Tensor& t_pos,
+        int64_t N, // N: number of query head, KVN: number of key head
+        int64_t KVN,
+        int64_t H,
+        int64_t offset,
+        int64_t rotary_ndims);
+
+DECLARE_DISPATCH(
+    rotary_position_embedding_qk_kernel_fn,
+    rotary_position_embedding_qk_kernel_stub);
+
 } // namespace cpu
 } // namespace torch_ipex
@@ -10,6 +10,8 @@ DEFINE_DISPATCH(tpp_linear_nobias_kernel_stub);
 DEFINE_DISPATCH(tpp_linear_bias_kernel_stub);
 DEFINE_DISPATCH(tpp_linear_gelu_kernel_stub);
 DEFINE_DISPATCH(tpp_linear_silu_kernel_stub);
+DEFINE_DISPATCH(tpp_linear_silu_mul_kernel_stub);
+DEFINE_DISPATCH(tpp_linear_qkv_rope_kernel_stub);
 DEFINE_DISPATCH(tpp_linear_relu_kernel_stub);
 DEFINE_DISPATCH(tpp_linear_add_kernel_stub);
 DEFINE_DISPATCH(tpp_linear_mul_kernel_stub);
@@ -46,6 +48,72 @@ at::Tensor tpp_linear_silu_forward_cpu(
   return tpp_linear_silu_kernel_stub(kCPU, t_in, t_wt, t_bias);
 }
 
+at::Tensor tpp_linear_silu_mul_forward_cpu(
+    at::Tensor& t_in,
+    at::Tensor& t_wt,
+    at::Tensor& t_bias,
+    c10::optional<int64_t> out_features) {
+  return tpp_linear_silu_mul_kernel_stub(kCPU, t_in, t_wt, t_bias);
+}
+
+// The QKV projection with the rotary embedding of query and key. t_wt holds
+// the blocked q, k and v weights concatenated along the output blocks. The
+// rotated key and the value are written to t_key/t_value, which may be views
+// of the kv cache, and the rotated query is returned.
+at::Tensor tpp_linear_qkv_rope_forward_cpu(
+    at::Tensor& t_in,
+    at::Tensor& t_wt,
+    at::Tensor& t_bias,
+    at::Tensor& t_emb_pos,
+    at::Tensor& t_pos,
+    at::Tensor& t_key,
+    at::Tensor& t_value,
+    int64_t num_head,
+    int64_t num_kv_head,
+    int64_t head_dim,
+    int64_t offset,
+    int64_t rotary_ndims) {
+  TORCH_CHECK(
+      t_wt.size(0) * t_wt.size(3) == (num_head + 2 * num_kv_head) * head_dim,
+      "tpp_linear_qkv_rope: the weight does not hold the q, k and v heads");
+  TORCH_CHECK(
+      head_dim % t_wt.size(3) == 0,
+      "tpp_linear_qkv_rope: the head size ",
+      head_dim,
+      " is not a multiple of the weight block ",
+      t_wt.size(3));
+  std::vector<int64_t> kv_sizes = {
+      t_in.size(0), t_in.size(1), num_kv_head, head_dim};
+  for (auto& t : {t_key, t_value}) {
+    TORCH_CHECK(
+        t.sizes() == kv_sizes && t.scalar_type() == t_in.scalar_type(),
+        "tpp_linear_qkv_rope: expect the key/value outputs of ",
+        kv_sizes,
+        " and ",
+        t_in.scalar_type());
+    // the heads are stored as is, only the batch and sequence dims can be
+    // strided
+    TORCH_CHECK(
+        t.stride(3) == 1 && t.stride(2) == head_dim,
+        "tpp_linear_qkv_rope: the heads of the key/value outputs should be "
+        "contiguous");
+  }
+  return tpp_linear_qkv_rope_kernel_stub(
+      kCPU,
+      t_in,
+      t_wt,
+      t_bias,
+      t_emb_pos,
+      t_pos,
+      t_key,
+      t_value,
+      num_head,
+      num_kv_head,
+      head_dim,
+      offset,
+      rotary_ndims);
+}
+
 at::Tensor tpp_linear_relu_forward_cpu(
     at::Tensor& t_in,
     at::Tensor& t_wt,
@@ -144,6 +212,24 @@ TORCH_LIBRARY_FRAGMENT(torch_ipex, m) {
       torch_ipex::cpu::tpp_linear_silu_forward_cpu);
 }
 
+TORCH_LIBRARY_FRAGMENT(torch_ipex, m) {
+  m.def(
+      "tpp_linear_silu_mul(Tensor t_in, Tensor t_wt, Tensor t_bias, int? out_features=None)-> Tensor out");
+  m.impl(
+      "tpp_linear_silu_mul",
+      c10::DispatchKey::CPU,
+      torch_ipex::cpu::tpp_linear_silu_mul_forward_cpu);
+}
+
+TORCH_LIBRARY_FRAGMENT(torch_ipex, m) {
+  m.def(
+      "tpp_linear_qkv_rope(Tensor t_in, Tensor t_wt, Tensor t_bias, Tensor emb_pos, Tensor position_ids, Tensor(a!) key, Tensor(b!) value, int num_head, int num_kv_head, int head_dim, int offset, int rotary_ndims)-> Tensor query");
+  m.impl(
+      "tpp_linear_qkv_rope",
+      c10::DispatchKey::CPU,
+      torch_ipex::cpu::tpp_linear_qkv_rope_forward_cpu);
+}
+
 TORCH_LIBRARY_FRAGMENT(torch_ipex, m) {
   m.def(
       "tpp_linear_add(Tensor t_in, Tensor t_in1, Tensor t_wt, Tensor t_bias, float scale, int? out_features=None)-> Tensor out");
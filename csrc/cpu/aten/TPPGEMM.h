@@ -30,6 +30,26 @@ at::Tensor tpp_linear_silu_forward_cpu(
     at::Tensor& t_bias,
     c10::optional<int64_t> out_features);
 
+at::Tensor tpp_linear_silu_mul_forward_cpu(
+    at::Tensor& t_in,
+    at::Tensor& t_wt,
+    at::Tensor& t_bias,
+    c10::optional<int64_t> out_features);
+
+at::Tensor tpp_linear_qkv_rope_forward_cpu(
+    at::Tensor& t_in,
+    at::Tensor& t_wt,
+    at::Tensor& t_bias,
+    at::Tensor& t_emb_pos,
+    at::Tensor& t_pos,
+    at::Tensor& t_key,
+    at::Tensor& t_value,
+    int64_t num_head,
+    int64_t num_kv_head,
+    int64_t head_dim,
+    int64_t offset,
+    int64_t rotary_ndims);
+
 at::Tensor tpp_linear_relu_forward_cpu(
     at::Tensor& t_in,
     at::Tensor& t_wt,
@@ -73,6 +93,23 @@ using tpp_linear_gelu_kernel_impl_fn =
 using tpp_linear_silu_kernel_impl_fn =
     at::Tensor (*)(at::Tensor&, at::Tensor&, at::Tensor&);
 
+using tpp_linear_silu_mul_kernel_impl_fn =
+    at::Tensor (*)(at::Tensor&, at::Tensor&, at::Tensor&);
+
+using tpp_linear_qkv_rope_kernel_impl_fn = at::Tensor (*)(
+    at::Tensor&,
+    at::Tensor&,
+    at::Tensor&,
+    at::Tensor&,
+    at::Tensor&,
+    at::Tensor&,
+    at::Tensor&,
+    int64_t,
+    int64_t,
+    int64_t,
+    int64_t,
+    int64_t);
+
 using tpp_linear_relu_kernel_impl_fn =
     at::Tensor (*)(at::Tensor&, at::Tensor&, at::Tensor&);
 
@@ -94,6 +131,12 @@ DECLARE_DISPATCH(tpp_linear_nobias_impl_fn, tpp_linear_nobias_kernel_stub);
 DECLARE_DISPATCH(tpp_linear_bias_kernel_impl_fn, tpp_linear_bias_kernel_stub);
 DECLARE_DISPATCH(tpp_linear_gelu_kernel_impl_fn, tpp_linear_gelu_kernel_stub);
 DECLARE_DISPATCH(tpp_linear_silu_kernel_impl_fn, tpp_linear_silu_kernel_stub);
+DECLARE_DISPATCH(
+    tpp_linear_silu_mul_kernel_impl_fn,
+    tpp_linear_silu_mul_kernel_stub);
+DECLARE_DISPATCH(
+    tpp_linear_qkv_rope_kernel_impl_fn,
+    tpp_linear_qkv_rope_kernel_stub);
 DECLARE_DISPATCH(tpp_linear_relu_kernel_impl_fn, tpp_linear_relu_kernel_stub);
 DECLARE_DISPATCH(tpp_linear_add_kernel_impl_fn, tpp_linear_add_kernel_stub);
 DECLARE_DISPATCH(tpp_linear_mul_kernel_impl_fn, tpp_linear_mul_kernel_stub);
@@ -11,6 +11,7 @@
 #include <torch/script.h>
 #include <algorithm>
 
+#include "aten/utils/embedding_prefetch.h"
 #include "autocast/autocast_mode.h"
 #include "cpu/kernels/Embeddingbag.h"
 #include "vec/vec.h"
@@ -59,15 +60,28 @@ static inline Tensor _embedding_bag_index_add_select_fast(
   auto indices_accessor = indices.accessor<int64_t, 1>();
   int64_t last_index = indices.numel();
   int64_t last_offset = output_size - 1;
+  const int64_t prefetch_distance = indices.is_contiguous()
+      ? embedding_prefetch_distance(ddim * sizeof(T), src.nbytes())
+      : 0;
 
   Tensor output = empty({output_size, src.size(1)}, src.options());
   auto* output_data = output.data_ptr<T>();
   parallel_for(0, output_size, 16, [&](int64_t start, int64_t end) {
+    // the end of the lookups of the bags of the chunk
+    const int64_t last_idx =
+        end == output_size ? last_index : offsets_data[end];
     for (int64_t i = start; i < end; i++) {
       auto* out_data_ptr = &output_data[i * ddim];
       auto inputs_start = offsets_data[i];
       auto inputs_end = i == last_offset ? last_index : offsets_data[i + 1];
       if (inputs_end - inputs_start == 1) {
+        prefetch_embedding_row_ahead(
+            indices_accessor.data(),
+            inputs_start,
+            last_idx,
+            prefetch_distance,
+            src_data,
+            ddim * sizeof(T));
         T* select_data_ptr = &src_data[indices_accessor[inputs_start] * ddim];
         move_ker(out_data_ptr, select_data_ptr, ddim);
       } else {
@@ -75,6 +89,13 @@ static inline Tensor _embedding_bag_index_add_select_fast(
         acc_t temp_out[ddim];
         zero_ker(temp_out, ddim);
         for (int64_t s = inputs_start; s < inputs_end; s++) {
+          prefetch_embedding_row_ahead(
+              indices_accessor.data(),
+              s,
+              last_idx,
+              prefetch_distance,
+              src_data,
+              ddim * sizeof(T));
           T* select_data_ptr = &src_data[indices_accessor[s] * ddim];
           add_ker(temp_out, select_data_ptr, ddim);
         }
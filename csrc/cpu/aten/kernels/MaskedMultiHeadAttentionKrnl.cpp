@@ -1,8 +1,10 @@
 #include <ATen/Tensor.h>
 #include <aten/FlashAttention.h>
 #include <aten/MaskedMultiHeadAttention.h>
+#include <c10/util/Float8_e4m3fn.h>
 #include <torch/all.h>
 #include <torch/csrc/autograd/function.h>
+#include <array>
 #include <limits>
 #include "vec/vec.h"
 
@@ -379,13 +381,263 @@ void mul_attenion_weights_and_value_of_head_half(
 }
 #endif
 
-template <typename T>
+/*
+ *The quantized kv cache keeps the key/value as int8 or fp8-e4m3 with a fp32
+ *scale for every head of every token, the scale is amax / max_quant_val.
+ */
+template <typename CT>
+struct KVCacheQuantTraits {};
+
+template <>
+struct KVCacheQuantTraits<int8_t> {
+  static constexpr float max_quant_val = 127.0f;
+  static inline int8_t quantize(float x) {
+    return (int8_t)std::nearbyint(
+        std::min(std::max(x, -max_quant_val), max_quant_val));
+  }
+  static inline float dequantize(int8_t x) {
+    return (float)x;
+  }
+};
+
+template <>
+struct KVCacheQuantTraits<c10::Float8_e4m3fn> {
+  static constexpr float max_quant_val = 448.0f;
+  static inline c10::Float8_e4m3fn quantize(float x) {
+    return c10::Float8_e4m3fn(
+        std::min(std::max(x, -max_quant_val), max_quant_val));
+  }
+  static inline float dequantize(c10::Float8_e4m3fn x) {
+    return (float)x;
+  }
+};
+
+/*
+ *The scale to quantize one head of the key/value to the cache type CT.
+ */
+template <typename T, typename CT>
+inline float quant_scale_of_head(const T* src_start, int64_t head_size) {
+  auto amax = 0.0f;
+  for (auto hsi = 0; hsi < head_size; hsi++) {
+    amax = std::max(amax, std::abs((float)src_start[hsi]));
+  }
+  return amax / KVCacheQuantTraits<CT>::max_quant_val;
+}
+
+/*
+ *Quantize one head of the key/value to the cache and save its scale.
+ */
+template <typename T, typename CT>
+void quantize_head(
+    const T* src_start,
+    CT* cache_start,
+    float* scale,
+    int64_t head_size) {
+  scale[0] = quant_scale_of_head<T, CT>(src_start, head_size);
+  auto inv_scale = scale[0] > 0.0f ? 1.0f / scale[0] : 0.0f;
+  for (auto hsi = 0; hsi < head_size; hsi++) {
+    cache_start[hsi] =
+        KVCacheQuantTraits<CT>::quantize((float)src_start[hsi] * inv_scale);
+  }
+}
+
+#if defined(CPU_CAPABILITY_AVX512)
+inline __m512 _maskz_loadu_dequant(const int8_t* data_base, __mmask16 mask) {
+  return _mm512_cvtepi32_ps(
+      _mm512_cvtepi8_epi32(_mm_maskz_loadu_epi8(mask, data_base)));
+}
+
+// fp8-e4m3 only has 256 values, decode them by a table lookup
+inline const float* fp8_e4m3_decode_table() {
+  static const auto table = [] {
+    std::array<float, 256> decoded;
+    for (auto i = 0; i < 256; i++) {
+      decoded[i] = (float)c10::Float8_e4m3fn(
+          (uint8_t)i, c10::Float8_e4m3fn::from_bits());
+    }
+    return decoded;
+  }();
+  return table.data();
+}
+
+inline __m512 _maskz_loadu_dequant(
+    const c10::Float8_e4m3fn* data_base,
+    __mmask16 mask) {
+  auto bits = _mm512_cvtepu8_epi32(_mm_maskz_loadu_epi8(mask, data_base));
+  return _mm512_mask_i32gather_ps(
+      _mm512_setzero_ps(), mask, bits, fp8_e4m3_decode_table(), 4);
+}
+#endif
+
+/*
+ *reduce the query with the key dequantized from the quantized key cache by
+ *the dimension of head_size for every head
+ */
+template <typename QT, typename CT>
+void reduce_head_quantized(
+    const QT* q_ptr_start,
+    const CT* k_cache_start,
+    const float k_scale,
+    float* attn_w_pos,
+    int64_t head_size) {
+  auto qk_sum = 0.0f;
+#if defined(CPU_CAPABILITY_AVX512)
+  auto vec_size = 16; // 512/32
+  auto qk_sum_vec = _mm512_setzero_ps();
+  for (auto hsi = 0; hsi < head_size; hsi += vec_size) {
+    __mmask16 mask = hsi + vec_size <= head_size
+        ? 0xFFFF
+        : (1 << (head_size - hsi)) - 1;
+    auto q_vec = _maskz_loadu(q_ptr_start + hsi, mask);
+    auto k_vec = _maskz_loadu_dequant(k_cache_start + hsi, mask);
+    qk_sum_vec = _mm512_fmadd_ps(q_vec, k_vec, qk_sum_vec);
+  }
+  qk_sum = _mm512_reduce_add_ps(qk_sum_vec);
+#else
+  for (auto hsi = 0; hsi < head_size; hsi++) {
+    qk_sum += (float)q_ptr_start[hsi] *
+        KVCacheQuantTraits<CT>::dequantize(k_cache_start[hsi]);
+  }
+#endif
+  attn_w_pos[0] += qk_sum * k_scale;
+}
+
+/*
+ *reduce the query with the key of the current token quantized to the cache
+ *type CT, and store the quantized key and its scale to the key cache if
+ *store_key like reduce_head does. The query reads the key dequantized back,
+ *the same as the next tokens read it from the cache.
+ */
+template <typename QT, typename CT>
+void reduce_head_quantized(
+    const QT* q_ptr_start,
+    const QT* k_ptr_start,
+    float* attn_w_pos,
+    int64_t head_size,
+    bool store_key,
+    CT* k_cache_start,
+    float* k_scale) {
+  auto scale = quant_scale_of_head<QT, CT>(k_ptr_start, head_size);
+  auto inv_scale = scale > 0.0f ? 1.0f / scale : 0.0f;
+  auto qk_sum = 0.0f;
+  for (auto hsi = 0; hsi < head_size; hsi++) {
+    auto quantized =
+        KVCacheQuantTraits<CT>::quantize((float)k_ptr_start[hsi] * inv_scale);
+    if (store_key) {
+      k_cache_start[hsi] = quantized;
+    }
+    qk_sum += (float)q_ptr_start[hsi] *
+        KVCacheQuantTraits<CT>::dequantize(quantized);
+  }
+  if (store_key) {
+    k_scale[0] = scale;
+  }
+  attn_w_pos[0] += qk_sum * scale;
+}
+
+/*
+ *reduce the attention_weights with the value dequantized from the quantized
+ *value cache by the dimension of head_size for every head
+ */
+template <typename CT>
+void mul_attenion_weights_and_value_of_head_quantized(
+    const float attn_w,
+    const CT* v_cache_start,
+    const float v_scale,
+    float* attn_out_start,
+    int64_t head_size) {
+  auto scaled_attn_w = attn_w * v_scale;
+#if defined(CPU_CAPABILITY_AVX512)
+  auto vec_size = 16; // 512/32
+  auto attn_w_vec = _mm512_set1_ps(scaled_attn_w);
+  for (auto hsi = 0; hsi < head_size; hsi += vec_size) {
+    __mmask16 mask = hsi + vec_size <= head_size
+        ? 0xFFFF
+        : (1 << (head_size - hsi)) - 1;
+    auto v_vec = _maskz_loadu_dequant(v_cache_start + hsi, mask);
+    auto attn_out_vec = _mm512_maskz_loadu_ps(mask, attn_out_start + hsi);
+    attn_out_vec = _mm512_fmadd_ps(attn_w_vec, v_vec, attn_out_vec);
+    _mm512_mask_storeu_ps(attn_out_start + hsi, mask, attn_out_vec);
+  }
+#else
+  for (auto hsi = 0; hsi < head_size; hsi++) {
+    attn_out_start[hsi] += scaled_attn_w *
+        KVCacheQuantTraits<CT>::dequantize(v_cache_start[hsi]);
+  }
+#endif
+}
+
+/*
+ *reduce the attention_weights with the value of the current token quantized
+ *to the cache type CT, and store the quantized value and its scale to the
+ *value cache if store_value like mul_attenion_weights_and_value_of_head does.
+ */
+template <typename VT, typename CT>
+void mul_attenion_weights_and_value_of_head_quantized(
+    const float attn_w,
+    const VT* v_ptr_start,
+    float* attn_out_start,
+    int64_t head_size,
+    bool store_value,
+    CT* v_cache_start,
+    float* v_scale) {
+  auto scale = quant_scale_of_head<VT, CT>(v_ptr_start, head_size);
+  auto inv_scale = scale > 0.0f ? 1.0f / scale : 0.0f;
+  auto scaled_attn_w = attn_w * scale;
+  for (auto hsi = 0; hsi < head_size; hsi++) {
+    auto quantized =
+        KVCacheQuantTraits<CT>::quantize((float)v_ptr_start[hsi] * inv_scale);
+    if (store_value) {
+      v_cache_start[hsi] = quantized;
+    }
+    attn_out_start[hsi] +=
+        scaled_attn_w * KVCacheQuantTraits<CT>::dequantize(quantized);
+  }
+  if (store_value) {
+    v_scale[0] = scale;
+  }
+}
+
+/*
+ *Locate the cache entry of the token `ti` stored by the beam row `beam`.
+ *The contiguous layout is [max_len, beam_size*batch, head_num, head_size].
+ */
+struct ContiguousKVCacheIndexer {
+  int64_t token_stride;
+  int64_t beam_stride;
+  inline int64_t operator()(int64_t ti, int64_t beam) const {
+    return ti * token_stride + beam * beam_stride;
+  }
+};
+
+/*
+ *The paged layout is a pool of [num_blocks, block_size, head_num, head_size]
+ *and every beam row owns a list of blocks in the block table
+ *[beam_size*batch, max_blocks_per_seq]. The token `ti` lives in the block
+ *block_table[beam][ti / block_size] at slot ti % block_size.
+ */
+struct PagedKVCacheIndexer {
+  const long* block_table;
+  int64_t max_blocks_per_seq;
+  int64_t block_size;
+  int64_t token_stride;
+  inline int64_t operator()(int64_t ti, int64_t beam) const {
+    auto block_id = block_table[beam * max_blocks_per_seq + ti / block_size];
+    return (block_id * block_size + ti % block_size) * token_stride;
+  }
+};
+
+/*
+ *Store the key/value of the prompt to the first beam of every batch.
+ */
+template <typename T, typename KVIndexer>
 void copy_key_value(
     at::Tensor key_cache,
     const at::Tensor key,
     at::Tensor value_cache,
     const at::Tensor value,
-    int beam_batch) {
+    int beam_batch,
+    const KVIndexer& kv_index) {
   RECORD_FUNCTION("ipex::copy_key_value", c10::ArrayRef<c10::IValue>({}));
   auto bs = key.size(0);
   auto seq_len = key.size(1); // only process cur_len==1
@@ -396,12 +648,11 @@ void copy_key_value(
   auto key_ptr = key.data_ptr<T>();
   auto value_cache_ptr = value_cache.data_ptr<T>();
   auto value_ptr = value.data_ptr<T>();
-  auto token_stride = beam_batch * hidden_size;
   auto beam_size = beam_batch / bs;
 #pragma omp parallel for collapse(2)
   for (auto si = 0; si < seq_len; si++) {
     for (auto bi = 0; bi < bs; bi++) {
-      auto cache_stride = si * token_stride + bi * beam_size * hidden_size;
+      auto cache_stride = kv_index(si, bi * beam_size);
       auto state_stride = (bi * seq_len + si) * hidden_size;
       auto key_cache_start = key_cache_ptr + cache_stride;
       auto key_ptr_start = key_ptr + state_stride;
@@ -415,6 +666,325 @@ void copy_key_value(
   }
 }
 
+/*
+ *Quantize the key/value of the prompt to the first beam of every batch, the
+ *scales are [num_tokens, head_num] and located by the same kv_index of the
+ *cache divided by head_size.
+ */
+template <typename T, typename CT, typename KVIndexer>
+void copy_key_value_quantized(
+    at::Tensor key_cache,
+    const at::Tensor key,
+    at::Tensor value_cache,
+    const at::Tensor value,
+    at::Tensor key_scale,
+    at::Tensor value_scale,
+    int beam_batch,
+    const KVIndexer& kv_index) {
+  RECORD_FUNCTION(
+      "ipex::copy_key_value_quantized", c10::ArrayRef<c10::IValue>({}));
+  auto bs = key.size(0);
+  auto seq_len = key.size(1);
+  auto head_num = key.size(2);
+  auto head_size = key.size(3);
+  auto hidden_size = head_num * head_size;
+  auto key_cache_ptr = key_cache.data_ptr<CT>();
+  auto key_ptr = key.data_ptr<T>();
+  auto value_cache_ptr = value_cache.data_ptr<CT>();
+  auto value_ptr = value.data_ptr<T>();
+  auto key_scale_ptr = key_scale.data_ptr<float>();
+  auto value_scale_ptr = value_scale.data_ptr<float>();
+  auto beam_size = beam_batch / bs;
+#pragma omp parallel for collapse(3)
+  for (auto si = 0; si < seq_len; si++) {
+    for (auto bi = 0; bi < bs; bi++) {
+      for (auto hi = 0; hi < head_num; hi++) {
+        auto cache_stride = kv_index(si, bi * beam_size) + hi * head_size;
+        auto state_stride = (bi * seq_len + si) * hidden_size + hi * head_size;
+        quantize_head(
+            key_ptr + state_stride,
+            key_cache_ptr + cache_stride,
+            key_scale_ptr + cache_stride / head_size,
+            head_size);
+        quantize_head(
+            value_ptr + state_stride,
+            value_cache_ptr + cache_stride,
+            value_scale_ptr + cache_stride / head_size,
+            head_size);
+      }
+    }
+  }
+}
+
+// the number of tokens processed together by the online softmax
+constexpr int64_t kv_split_block_size = 32;
+// the minimal number of tokens of every kv split
+constexpr int64_t kv_split_min_len = 256;
+
+/*
+ *Flash decoding for the next token (cur_len==1) with the indirect access kv
+ *cache. The kv sequence of every (batch, head) is split into ranges to feed
+ *all the threads even for small batch. Every range runs the online softmax in
+ *a single pass and keeps its running max, sum and weighted value, then the
+ *ranges are merged by the log-sum-exp. The attention weights of the whole
+ *sequence are never materialized.
+ *The arguments are the same as scale_dot_product_for_indirect_access_kv_cache.
+ *With the cache type CT (int8 or fp8-e4m3), the key/value cache is quantized
+ *by head with the scales of k_scale_ptr/v_scale_ptr and dequantized on the
+ *fly when it is read. The key/value of the current token are quantized while
+ *they are attended, and stored by the first query head of their group.
+ */
+template <typename QT, typename VT, typename KVIndexer, typename CT = void>
+std::tuple<at::Tensor, at::Tensor, at::Tensor, at::Tensor, at::Tensor>
+flash_decoding_for_indirect_access_kv_cache(
+    at::Tensor query,
+    at::Tensor key,
+    at::Tensor value,
+    at::Tensor& key_cache,
+    at::Tensor& value_cache,
+    at::Tensor& beam_idx,
+    const int64_t offset,
+    const KVIndexer& kv_index,
+    const double scale_factor,
+    at::Tensor& attention_mask,
+    float* k_scale_ptr = nullptr,
+    float* v_scale_ptr = nullptr) {
+  RECORD_FUNCTION(
+      "ipex::flash_decoding_for_indirect_access_kv_cache",
+      c10::ArrayRef<c10::IValue>({}));
+  auto bs = query.size(0);
+  auto head_num = query.size(2);
+  auto kv_head = key.size(2);
+  auto group_size = head_num / kv_head;
+  auto head_size = query.size(3);
+  auto seq_len = offset + 1;
+  query = query.contiguous();
+  key = key.contiguous();
+  value = value.contiguous();
+  constexpr bool quantized_kv_cache = !std::is_void<CT>::value;
+  using KCT = typename std::conditional<quantized_kv_cache, CT, QT>::type;
+  using VCT = typename std::conditional<quantized_kv_cache, CT, VT>::type;
+  auto q_ptr = query.data_ptr<QT>();
+  auto k_ptr = key.data_ptr<QT>();
+  auto k_cache_ptr = key_cache.data_ptr<KCT>();
+  auto v_ptr = value.data_ptr<VT>();
+  auto v_cache_ptr = value_cache.data_ptr<VCT>();
+  auto mask_ptr = attention_mask.data_ptr<QT>();
+  auto mask_head_num = attention_mask.size(1);
+  auto mask_dim2 = attention_mask.size(2);
+  auto mask_bs_stride = mask_head_num * mask_dim2 * seq_len;
+  // according to the last decoded token to get the target beam for the past
+  // token, the current token is always read from its own beam
+  std::vector<long> new_beam_idx(bs * seq_len);
+  auto b_ptr = beam_idx.data_ptr<long>();
+  for (auto bi = 0; bi < bs; bi++) {
+    new_beam_idx[bi * seq_len + offset] = bi;
+    if (offset > 0) {
+      new_beam_idx[bi * seq_len + offset - 1] = b_ptr[(offset - 1) * bs + bi];
+      for (auto ti = offset - 2; ti >= 0; ti--) {
+        new_beam_idx[bi * seq_len + ti] =
+            b_ptr[ti * bs + new_beam_idx[bi * seq_len + ti + 1]];
+      }
+    }
+  }
+  if constexpr (!quantized_kv_cache) {
+    RECORD_FUNCTION(
+        "ipex::flash_decoding::store_key_value",
+        c10::ArrayRef<c10::IValue>({}));
+#pragma omp parallel for collapse(2)
+    for (auto bi = 0; bi < bs; bi++) {
+      for (auto kv_hi = 0; kv_hi < kv_head; kv_hi++) {
+        auto cache_start = kv_index(offset, bi) + kv_hi * head_size;
+        auto state_start = (bi * kv_head + kv_hi) * head_size;
+        // the head may be in its cache slot already, written there by the
+        // QKV projection (see tpp_linear_qkv_rope)
+        if (k_cache_ptr + cache_start != k_ptr + state_start) {
+          torch_ipex::cpu::kernel::move_ker<QT, QT>(
+              k_cache_ptr + cache_start, k_ptr + state_start, head_size);
+        }
+        if (v_cache_ptr + cache_start != v_ptr + state_start) {
+          torch_ipex::cpu::kernel::move_ker<VT, VT>(
+              v_cache_ptr + cache_start, v_ptr + state_start, head_size);
+        }
+      }
+    }
+  }
+  // split the kv sequence until every thread gets a range
+  int64_t thread_numbers = omp_get_max_threads();
+  auto kv_splits = std::min(
+      (thread_numbers + bs * head_num - 1) / (bs * head_num),
+      (seq_len + kv_split_min_len - 1) / kv_split_min_len);
+  kv_splits = std::max(kv_splits, (int64_t)1);
+  auto split_len = (seq_len + kv_splits - 1) / kv_splits;
+  // every split keeps [max, sum, weighted value with the size of head_size]
+  auto split_stride = head_size + 2;
+  auto split_results =
+      at::empty({bs, head_num, kv_splits, split_stride}, at::kFloat);
+  auto split_ptr = split_results.data_ptr<float>();
+  {
+    RECORD_FUNCTION(
+        "ipex::flash_decoding::split_attention",
+        c10::ArrayRef<c10::IValue>({}));
+#pragma omp parallel for collapse(3)
+    for (auto bi = 0; bi < bs; bi++) {
+      for (auto hi = 0; hi < head_num; hi++) {
+        for (auto split = 0; split < kv_splits; split++) {
+          auto kv_hi = hi / group_size; // maping the query head to key/value
+                                        // head to support MGA/MQA
+          auto q_ptr_start = q_ptr + (bi * head_num + hi) * head_size;
+          // the key/value of the current token
+          auto state_start = (bi * kv_head + kv_hi) * head_size;
+          auto store_kv = hi % group_size == 0;
+          auto mask_ptr_start = mask_ptr + bi * mask_bs_stride +
+              (hi % mask_head_num) * mask_dim2 * seq_len;
+          auto result_start = split_ptr +
+              ((bi * head_num + hi) * kv_splits + split) * split_stride;
+          auto max_val = std::numeric_limits<float>::lowest();
+          auto sum = 0.0f;
+          auto attn_out_start = result_start + 2;
+          torch_ipex::cpu::kernel::zero_ker(attn_out_start, head_size);
+          auto split_start = split * split_len;
+          auto split_end = std::min(split_start + split_len, seq_len);
+          float attn_w[kv_split_block_size];
+          for (auto ti_start = split_start; ti_start < split_end;
+               ti_start += kv_split_block_size) {
+            auto block_len =
+                std::min(kv_split_block_size, split_end - ti_start);
+            auto block_max = std::numeric_limits<float>::lowest();
+            for (auto bti = 0; bti < block_len; bti++) {
+              auto ti = ti_start + bti;
+              auto beam = new_beam_idx[bi * seq_len + ti];
+              auto cache_start = kv_index(ti, beam) + kv_hi * head_size;
+              attn_w[bti] = 0.0f;
+              if constexpr (quantized_kv_cache) {
+                if (ti == offset) {
+                  reduce_head_quantized(
+                      q_ptr_start,
+                      k_ptr + state_start,
+                      attn_w + bti,
+                      head_size,
+                      store_kv,
+                      k_cache_ptr + cache_start,
+                      k_scale_ptr + cache_start / head_size);
+                } else {
+                  reduce_head_quantized(
+                      q_ptr_start,
+                      k_cache_ptr + cache_start,
+                      k_scale_ptr[cache_start / head_size],
+                      attn_w + bti,
+                      head_size);
+                }
+              } else {
+                reduce_head(
+                    q_ptr_start,
+                    k_cache_ptr + cache_start,
+                    attn_w + bti,
+                    head_size,
+                    false,
+                    (QT*)nullptr);
+              }
+              attn_w[bti] =
+                  attn_w[bti] / scale_factor + (float)mask_ptr_start[ti];
+              block_max = std::max(block_max, attn_w[bti]);
+            }
+            // rescale the past result to the new max
+            auto new_max = std::max(max_val, block_max);
+            auto correction = std::exp(max_val - new_max);
+            sum = sum * correction;
+#pragma omp simd
+            for (auto hsi = 0; hsi < head_size; hsi++) {
+              attn_out_start[hsi] = attn_out_start[hsi] * correction;
+            }
+            max_val = new_max;
+            for (auto bti = 0; bti < block_len; bti++) {
+              auto ti = ti_start + bti;
+              auto beam = new_beam_idx[bi * seq_len + ti];
+              auto cache_start = kv_index(ti, beam) + kv_hi * head_size;
+              attn_w[bti] = std::exp(attn_w[bti] - max_val);
+              sum += attn_w[bti];
+              if constexpr (quantized_kv_cache) {
+                if (ti == offset) {
+                  mul_attenion_weights_and_value_of_head_quantized(
+                      attn_w[bti],
+                      v_ptr + state_start,
+                      attn_out_start,
+                      head_size,
+                      store_kv,
+                      v_cache_ptr + cache_start,
+                      v_scale_ptr + cache_start / head_size);
+                } else {
+                  mul_attenion_weights_and_value_of_head_quantized(
+                      attn_w[bti],
+                      v_cache_ptr + cache_start,
+                      v_scale_ptr[cache_start / head_size],
+                      attn_out_start,
+                      head_size);
+                }
+              } else {
+                mul_attenion_weights_and_value_of_head<VT, float>(
+                    attn_w[bti],
+                    v_cache_ptr + cache_start,
+                    attn_out_start,
+                    head_size,
+                    false,
+                    nullptr);
+              }
+            }
+          }
+          result_start[0] = max_val;
+          result_start[1] = sum;
+        }
+      }
+    }
+  }
+  auto attn_outs = at::empty({bs, head_num, 1, head_size}, value.options());
+  auto attn_out_ptr = attn_outs.data_ptr<VT>();
+  {
+    RECORD_FUNCTION(
+        "ipex::flash_decoding::reduction_split_result",
+        c10::ArrayRef<c10::IValue>({}));
+#pragma omp parallel for collapse(2)
+    for (auto bi = 0; bi < bs; bi++) {
+      for (auto hi = 0; hi < head_num; hi++) {
+        auto head_results =
+            split_ptr + (bi * head_num + hi) * kv_splits * split_stride;
+        auto global_max = std::numeric_limits<float>::lowest();
+        for (auto split = 0; split < kv_splits; split++) {
+          global_max = std::max(global_max, head_results[split * split_stride]);
+        }
+        // merge all the splits to the first one by the log-sum-exp
+        auto attn_out_start = head_results + 2;
+        auto correction = std::exp(head_results[0] - global_max);
+        auto global_sum = head_results[1] * correction;
+#pragma omp simd
+        for (auto hsi = 0; hsi < head_size; hsi++) {
+          attn_out_start[hsi] = attn_out_start[hsi] * correction;
+        }
+        for (auto split = 1; split < kv_splits; split++) {
+          auto split_result = head_results + split * split_stride;
+          correction = std::exp(split_result[0] - global_max);
+          global_sum += split_result[1] * correction;
+#pragma omp simd
+          for (auto hsi = 0; hsi < head_size; hsi++) {
+            attn_out_start[hsi] += split_result[2 + hsi] * correction;
+          }
+        }
+        auto inv_sum = 1.0f / global_sum;
+#pragma omp simd
+        for (auto hsi = 0; hsi < head_size; hsi++) {
+          attn_out_start[hsi] = attn_out_start[hsi] * inv_sum;
+        }
+        torch_ipex::cpu::kernel::move_ker<VT, float>(
+            attn_out_ptr + (bi * head_num + hi) * head_size,
+            attn_out_start,
+            head_size);
+      }
+    }
+  }
+  return std::make_tuple(
+      attn_outs, at::Tensor(), key_cache, value_cache, beam_idx);
+}
+
 /*
  *The scale-dot product for indirect access kv chache and fuse
  *matmul+div+add+softmax to improve data reuse
@@ -430,13 +1000,15 @@ void copy_key_value(
  *beam_size*batch, head_num, head_size]
  *@param  beam_idx Beam info for every token [max_len, beam_size*batch]
  *@param  offset  The length of decoded(past) token.
+ *@param  kv_index Locate the cache entry of a token for a beam row, see
+ *ContiguousKVCacheIndexer and PagedKVCacheIndexer.
  *@param  scale_factor the sqrt(head_dim).
  *@param  head_mask Which is not used by our kernel now.
  *@param  attention_mask Which is combined mask for padding mask and casual
  *mask.
  *@return attn_outs, None, key_cache, value_cache, beam_idx
  */
-template <typename QT, typename VT>
+template <typename QT, typename VT, typename KVIndexer>
 std::tuple<at::Tensor, at::Tensor, at::Tensor, at::Tensor, at::Tensor>
 scale_dot_product_for_indirect_access_kv_cache(
     at::Tensor query,
@@ -446,11 +1018,25 @@ scale_dot_product_for_indirect_access_kv_cache(
     at::Tensor& value_cache,
     at::Tensor& beam_idx,
     const int64_t offset,
+    const KVIndexer& kv_index,
     const double scale_factor,
     at::Tensor& attention_mask) {
   RECORD_FUNCTION(
       "ipex::scale_dot_product_for_indirect_access_kv_cache",
       c10::ArrayRef<c10::IValue>({}));
+  if (query.size(1) == 1) {
+    return flash_decoding_for_indirect_access_kv_cache<QT, VT>(
+        query,
+        key,
+        value,
+        key_cache,
+        value_cache,
+        beam_idx,
+        offset,
+        kv_index,
+        scale_factor,
+        attention_mask);
+  }
   int beam_batch = beam_idx.size(1);
   auto bs = query.size(0);
   auto cur_len = query.size(1); // only process cur_len==1
@@ -459,7 +1045,7 @@ scale_dot_product_for_indirect_access_kv_cache(
   auto group_size = head_num / kv_head;
   auto head_size = query.size(3);
   auto seq_len = offset + cur_len;
-  auto kc_token_stride = beam_batch * kv_head * head_size;
+  auto beam_size = beam_batch / bs;
   auto attn_weights = at::empty({bs, head_num, cur_len, seq_len}, at::kFloat);
   query = query.contiguous();
   key = key.contiguous();
@@ -509,24 +1095,19 @@ scale_dot_product_for_indirect_access_kv_cache(
             auto attn_w_pos =
                 attn_w_ptr + attn_w_stride + query_ti * seq_len + ti;
             attn_w_pos[0] = 0.0f;
-            auto kc_token_start = ti * kc_token_stride;
-            auto kc_t_beam_start = kc_token_start;
             if (ti > query_ti + offset) { // only caculate the innerproduct for
-                                          // the past token and current token
-              attn_w_pos[0] = -10000.0f;
-            } else if (ti == query_ti + offset) { // caculate the innerproduct
+                                          // the past token and current token,
+                                          // the later tokens are out of the
+                                          // softmax range of this query
+              continue;
+            }
+            if (ti == query_ti + offset) { // caculate the innerproduct
                                                   // for the current token and
                                                   // store the key
-              if (cur_len > 1) { // this may occur for processing the promt
-                auto beam_size = beam_batch / bs;
-                // need to store key accross beam
-                kc_t_beam_start =
-                    kc_t_beam_start + bi * beam_size * kv_head * head_size;
-              } else {
-                kc_t_beam_start = kc_t_beam_start + bi * kv_head * head_size;
-              }
+              // need to store key accross beam while processing the promt
+              auto beam = cur_len > 1 ? bi * beam_size : bi;
               auto kc_head_start =
-                  k_cache_ptr + kc_t_beam_start + kv_hi * head_size;
+                  k_cache_ptr + kv_index(ti, beam) + kv_hi * head_size;
               auto k_ptr_start = k_ptr +
                   (bi * cur_len + ti - offset) * kv_head * head_size +
                   kv_hi * head_size;
@@ -550,15 +1131,12 @@ scale_dot_product_for_indirect_access_kv_cache(
                     false,
                     nullptr);
               } else {
-                kc_t_beam_start = kc_t_beam_start +
-                    new_beam_idx[bi][ti] * kv_head * head_size;
+                auto beam = new_beam_idx[bi][ti];
                 if (cur_len > 1) {
-                  auto beam_size = beam_batch / bs;
-                  kc_t_beam_start =
-                      kc_t_beam_start + bi * beam_size * kv_head * head_size;
+                  beam = beam + bi * beam_size;
                 }
                 auto kc_head_start =
-                    k_cache_ptr + kc_t_beam_start + kv_hi * head_size;
+                    k_cache_ptr + kv_index(ti, beam) + kv_hi * head_size;
                 reduce_head<QT>(
                     q_ptr_start,
                     kc_head_start,
@@ -585,6 +1163,8 @@ scale_dot_product_for_indirect_access_kv_cache(
           auto attn_w_stride = (bi * head_num + hi) * cur_len * seq_len;
           auto attn_w_query_start =
               attn_w_ptr + attn_w_stride + query_ti * seq_len;
+          // skip the later tokens instead of masking them
+          int valid_len = query_ti + offset + 1;
 // div+add+softmax
 #if defined(CPU_CAPABILITY_AVX512)
           for (auto qi = 0; qi < 1; qi++) {
@@ -594,20 +1174,20 @@ scale_dot_product_for_indirect_access_kv_cache(
                     attn_w_query_start,
                     mask_ptr_start + (query_ti % mask_dim2) * seq_len,
                     scale_factor,
-                    seq_len,
+                    valid_len,
                     attn_w_query_start,
                     max_val);
 
             torch_ipex::cpu::kernel::_dil_exp_reduce_sum_fusion_kernel(
-                attn_w_query_start, seq_len, attn_w_query_start, max_val);
+                attn_w_query_start, valid_len, attn_w_query_start, max_val);
             torch_ipex::cpu::kernel::_dil_normalization_kernel<float>(
-                attn_w_query_start, max_val, seq_len, attn_w_query_start);
+                attn_w_query_start, max_val, valid_len, attn_w_query_start);
           }
 #else
           for (auto qi = 0; qi < 1; qi++) {
             auto max_val = -100000.0f;
             // div+add and find max
-            for (auto si = 0; si < seq_len; si++) {
+            for (auto si = 0; si < valid_len; si++) {
               attn_w_query_start[si] = attn_w_query_start[si] / scale_factor +
                   mask_ptr_start[(query_ti % mask_dim2) * seq_len + si];
               if (attn_w_query_start[si] > max_val) {
@@ -617,12 +1197,12 @@ scale_dot_product_for_indirect_access_kv_cache(
             // softmax
             float sum = 0.0f;
             // exp and sum
-            for (auto si = 0; si < seq_len; si++) {
+            for (auto si = 0; si < valid_len; si++) {
               attn_w_query_start[si] = exp(attn_w_query_start[si] - max_val);
               sum += attn_w_query_start[si];
             }
             // normalization
-            for (auto si = 0; si < seq_len; si++) {
+            for (auto si = 0; si < valid_len; si++) {
               attn_w_query_start[si] = attn_w_query_start[si] / sum;
             }
           }
@@ -663,21 +1243,13 @@ scale_dot_product_for_indirect_access_kv_cache(
             auto attn_out_start = private_attn_out_ptr + attn_out_head_stride +
                 query_ti * head_size;
 
-            auto vc_token_start = vi * kc_token_stride;
             if (vi == query_ti + offset) { // caculate the attention values
                                            // for the current token
-              auto vc_t_beam_start = vc_token_start;
-              if (cur_len > 1) { // this may occur for processing the promt
-                auto beam_size = beam_batch / bs;
-                // removed the redundant computation, need to store key accross
-                // beam
-                vc_t_beam_start =
-                    vc_t_beam_start + bi * beam_size * kv_head * head_size;
-              } else {
-                vc_t_beam_start = vc_t_beam_start + bi * kv_head * head_size;
-              }
+              // removed the redundant computation, need to store value
+              // accross beam while processing the promt
+              auto beam = cur_len > 1 ? bi * beam_size : bi;
               auto v_cache_head_start =
-                  v_cache_ptr + vc_t_beam_start + kv_hi * head_size;
+                  v_cache_ptr + kv_index(vi, beam) + kv_hi * head_size;
               auto v_ptr_start = v_ptr +
                   (bi * cur_len + vi - offset) * kv_head * head_size +
                   kv_hi * head_size;
@@ -703,15 +1275,12 @@ scale_dot_product_for_indirect_access_kv_cache(
                     false,
                     nullptr);
               } else {
-                auto vc_t_beam_start =
-                    vc_token_start + new_beam_idx[bi][vi] * kv_head * head_size;
+                auto beam = new_beam_idx[bi][vi];
                 if (cur_len > 1) {
-                  auto beam_size = beam_batch / bs;
-                  vc_t_beam_start =
-                      vc_t_beam_start + bi * beam_size * kv_head * head_size;
+                  beam = beam + bi * beam_size;
                 }
                 auto v_cache_head_start =
-                    v_cache_ptr + vc_t_beam_start + kv_hi * head_size;
+                    v_cache_ptr + kv_index(vi, beam) + kv_hi * head_size;
                 mul_attenion_weights_and_value_of_head<VT, float>(
                     attn_w_query_start[vi],
                     v_cache_head_start,
@@ -757,6 +1326,7 @@ scale_dot_product_for_indirect_access_kv_cache(
 }
 
 #if defined(CPU_CAPABILITY_AVX512_FP16)
+template <typename KVIndexer>
 std::tuple<at::Tensor, at::Tensor, at::Tensor, at::Tensor, at::Tensor>
 scale_dot_product_for_indirect_access_kv_cache_half(
     at::Tensor query,
@@ -766,11 +1336,25 @@ scale_dot_product_for_indirect_access_kv_cache_half(
     at::Tensor& value_cache,
     at::Tensor& beam_idx,
     const int64_t offset,
+    const KVIndexer& kv_index,
     const double scale_factor,
     at::Tensor& attention_mask) {
   RECORD_FUNCTION(
       "ipex::scale_dot_product_for_indirect_access_kv_cache_half",
       c10::ArrayRef<c10::IValue>({}));
+  if (query.size(1) == 1) {
+    return flash_decoding_for_indirect_access_kv_cache<at::Half, at::Half>(
+        query,
+        key,
+        value,
+        key_cache,
+        value_cache,
+        beam_idx,
+        offset,
+        kv_index,
+        scale_factor,
+        attention_mask);
+  }
   int beam_batch = beam_idx.size(1);
   auto bs = query.size(0);
   auto cur_len = query.size(1); // only process cur_len==1
@@ -779,7 +1363,7 @@ scale_dot_product_for_indirect_access_kv_cache_half(
   auto group_size = head_num / kv_head;
   auto head_size = query.size(3);
   auto seq_len = offset + cur_len;
-  auto kc_token_stride = beam_batch * kv_head * head_size;
+  auto beam_size = beam_batch / bs;
   auto attn_weights =
       at::empty({bs, head_num, cur_len, seq_len}, key.options());
   query = query.contiguous();
@@ -830,24 +1414,19 @@ scale_dot_product_for_indirect_access_kv_cache_half(
             auto attn_w_pos =
                 attn_w_ptr + attn_w_stride + query_ti * seq_len + ti;
             attn_w_pos[0] = 0.0f;
-            auto kc_token_start = ti * kc_token_stride;
-            auto kc_t_beam_start = kc_token_start;
             if (ti > query_ti + offset) { // only caculate the innerproduct for
-                                          // the past token and current token
-              attn_w_pos[0] = -10000.0f;
-            } else if (ti == query_ti + offset) { // caculate the innerproduct
+                                          // the past token and current token,
+                                          // the later tokens are out of the
+                                          // softmax range of this query
+              continue;
+            }
+            if (ti == query_ti + offset) { // caculate the innerproduct
                                                   // for the current token and
                                                   // store the key
-              if (cur_len > 1) { // this may occur for processing the promt
-                auto beam_size = beam_batch / bs;
-                // need to store key accross beam
-                kc_t_beam_start =
-                    kc_t_beam_start + bi * beam_size * kv_head * head_size;
-              } else {
-                kc_t_beam_start = kc_t_beam_start + bi * kv_head * head_size;
-              }
+              // need to store key accross beam while processing the promt
+              auto beam = cur_len > 1 ? bi * beam_size : bi;
               auto kc_head_start =
-                  k_cache_ptr + kc_t_beam_start + kv_hi * head_size;
+                  k_cache_ptr + kv_index(ti, beam) + kv_hi * head_size;
               auto k_ptr_start = k_ptr +
                   (bi * cur_len + ti - offset) * kv_head * head_size +
                   kv_hi * head_size;
@@ -871,15 +1450,12 @@ scale_dot_product_for_indirect_access_kv_cache_half(
                     false,
                     nullptr);
               } else {
-                kc_t_beam_start = kc_t_beam_start +
-                    new_beam_idx[bi][ti] * kv_head * head_size;
+                auto beam = new_beam_idx[bi][ti];
                 if (cur_len > 1) {
-                  auto beam_size = beam_batch / bs;
-                  kc_t_beam_start =
-                      kc_t_beam_start + bi * beam_size * kv_head * head_size;
+                  beam = beam + bi * beam_size;
                 }
                 auto kc_head_start =
-                    k_cache_ptr + kc_t_beam_start + kv_hi * head_size;
+                    k_cache_ptr + kv_index(ti, beam) + kv_hi * head_size;
                 reduce_head_half(
                     q_ptr_start,
                     kc_head_start,
@@ -906,6 +1482,8 @@ scale_dot_product_for_indirect_access_kv_cache_half(
           auto attn_w_stride = (bi * head_num + hi) * cur_len * seq_len;
           auto attn_w_query_start =
               attn_w_ptr + attn_w_stride + query_ti * seq_len;
+          // skip the later tokens instead of masking them
+          int valid_len = query_ti + offset + 1;
           // div+add+softmax
           for (auto qi = 0; qi < 1; qi++) {
             at::Half max_val = -100000.0f;
@@ -913,14 +1491,14 @@ scale_dot_product_for_indirect_access_kv_cache_half(
                 attn_w_query_start,
                 mask_ptr_start + (query_ti % mask_dim2) * seq_len,
                 scale_factor,
-                seq_len,
+                valid_len,
                 attn_w_query_start,
                 max_val);
 
             torch_ipex::cpu::kernel::_dil_exp_reduce_sum_fusion_kernel_half(
-                attn_w_query_start, seq_len, attn_w_query_start, max_val);
+                attn_w_query_start, valid_len, attn_w_query_start, max_val);
             torch_ipex::cpu::kernel::_dil_normalization_kernel_half(
-                attn_w_query_start, max_val, seq_len, attn_w_query_start);
+                attn_w_query_start, max_val, valid_len, attn_w_query_start);
           }
         }
       }
@@ -958,21 +1536,13 @@ scale_dot_product_for_indirect_access_kv_cache_half(
             auto attn_out_start = private_attn_out_ptr + attn_out_head_stride +
                 query_ti * head_size;
 
-            auto vc_token_start = vi * kc_token_stride;
             if (vi == query_ti + offset) { // caculate the attention values
                                            // for the current token
-              auto vc_t_beam_start = vc_token_start;
-              if (cur_len > 1) { // this may occur for processing the promt
-                auto beam_size = beam_batch / bs;
-                // removed the redundant computation, need to store key accross
-                // beam
-                vc_t_beam_start =
-                    vc_t_beam_start + bi * beam_size * kv_head * head_size;
-              } else {
-                vc_t_beam_start = vc_t_beam_start + bi * kv_head * head_size;
-              }
+              // removed the redundant computation, need to store value
+              // accross beam while processing the promt
+              auto beam = cur_len > 1 ? bi * beam_size : bi;
               auto v_cache_head_start =
-                  v_cache_ptr + vc_t_beam_start + kv_hi * head_size;
+                  v_cache_ptr + kv_index(vi, beam) + kv_hi * head_size;
               auto v_ptr_start = v_ptr +
                   (bi * cur_len + vi - offset) * kv_head * head_size +
                   kv_hi * head_size;
@@ -998,15 +1568,12 @@ scale_dot_product_for_indirect_access_kv_cache_half(
                     false,
                     nullptr);
               } else {
-                auto vc_t_beam_start =
-                    vc_token_start + new_beam_idx[bi][vi] * kv_head * head_size;
+                auto beam = new_beam_idx[bi][vi];
                 if (cur_len > 1) {
-                  auto beam_size = beam_batch / bs;
-                  vc_t_beam_start =
-                      vc_t_beam_start + bi * beam_size * kv_head * head_size;
+                  beam = beam + bi * beam_size;
                 }
                 auto v_cache_head_start =
-                    v_cache_ptr + vc_t_beam_start + kv_hi * head_size;
+                    v_cache_ptr + kv_index(vi, beam) + kv_hi * head_size;
                 mul_attenion_weights_and_value_of_head_half(
                     attn_w_query_start[vi],
                     v_cache_head_start,
@@ -1051,6 +1618,7 @@ scale_dot_product_for_indirect_access_kv_cache_half(
 }
 #endif
 
+template <typename KVIndexer>
 std::tuple<at::Tensor, at::Tensor, at::Tensor, at::Tensor, at::Tensor>
 zero_copy_kv_cache_masked_multihead_self_attention_kernel_impl(
     at::Tensor query,
@@ -1060,6 +1628,7 @@ zero_copy_kv_cache_masked_multihead_self_attention_kernel_impl(
     at::Tensor& value_cache,
     at::Tensor& beam_idx,
     const int64_t offset,
+    const KVIndexer& kv_index,
     const double scale_attn,
     at::Tensor& attention_mask) {
   assert(
@@ -1074,6 +1643,7 @@ zero_copy_kv_cache_masked_multihead_self_attention_kernel_impl(
         value_cache,
         beam_idx,
         offset,
+        kv_index,
         scale_attn,
         attention_mask);
   } else if (
@@ -1087,6 +1657,7 @@ zero_copy_kv_cache_masked_multihead_self_attention_kernel_impl(
         value_cache,
         beam_idx,
         offset,
+        kv_index,
         scale_attn,
         attention_mask);
   } else if (
@@ -1099,6 +1670,7 @@ zero_copy_kv_cache_masked_multihead_self_attention_kernel_impl(
         value_cache,
         beam_idx,
         offset,
+        kv_index,
         scale_attn,
         attention_mask);
   } else if (
@@ -1112,6 +1684,7 @@ zero_copy_kv_cache_masked_multihead_self_attention_kernel_impl(
         value_cache,
         beam_idx,
         offset,
+        kv_index,
         scale_attn,
         attention_mask);
 #else
@@ -1123,6 +1696,7 @@ zero_copy_kv_cache_masked_multihead_self_attention_kernel_impl(
         value_cache,
         beam_idx,
         offset,
+        kv_index,
         scale_attn,
         attention_mask);
 #endif
@@ -1136,6 +1710,7 @@ zero_copy_kv_cache_masked_multihead_self_attention_kernel_impl(
         value_cache,
         beam_idx,
         offset,
+        kv_index,
         scale_attn,
         attention_mask);
   } else if (
@@ -1148,6 +1723,7 @@ zero_copy_kv_cache_masked_multihead_self_attention_kernel_impl(
         value_cache,
         beam_idx,
         offset,
+        kv_index,
         scale_attn,
         attention_mask);
   }
@@ -1161,50 +1737,34 @@ zero_copy_kv_cache_masked_multihead_self_attention_kernel_impl(
       value_cache,
       beam_idx,
       offset,
+      kv_index,
       scale_attn,
       attention_mask);
 }
 
-std::tuple<at::Tensor, at::Tensor, at::Tensor, at::Tensor, at::Tensor>
-first_token_masked_mha(
+/*
+ *Caculate the attention for the prompt tokens with the key/value of the
+ *prompt directly, the output keeps the data type of the query.
+ */
+at::Tensor first_token_attention(
     at::Tensor query,
     at::Tensor key,
     at::Tensor value,
-    at::Tensor& key_cache,
-    at::Tensor& value_cache,
-    at::Tensor& beam_idx,
-    const int64_t beam_batch,
     const double scale_attn,
     at::Tensor attention_mask) {
   auto origin_type = query.scalar_type();
-  auto bs = query.size(0);
   auto query_length = query.size(1);
   auto key_lenght = key.size(1);
-  auto kv_head_num = key.size(2);
-  auto head_size = key.size(3);
   if (origin_type == at::kHalf) {
     key = key.to(at::kFloat);
     query = query.to(at::kFloat);
     value = value.to(at::kFloat);
-    key_cache = key_cache.to(at::kFloat);
-    value_cache = value_cache.to(at::kFloat);
   }
   auto casual_mask =
       at::full({query_length, key_lenght}, -1e6, query.options());
   casual_mask = at::triu(casual_mask, 1);
   casual_mask = casual_mask.unsqueeze(0).unsqueeze(0);
   attention_mask = attention_mask + casual_mask;
-  if (key.scalar_type() != at::kBFloat16 && key.scalar_type() != at::kFloat) {
-    TORCH_CHECK(
-        false,
-        "key and value must be float or bfloat16 to use ipex::masked_multihead_self_attention_kernel_impl");
-  }
-  if (key.scalar_type() == at::kFloat) {
-    copy_key_value<float>(key_cache, key, value_cache, value, beam_batch);
-  } else {
-    copy_key_value<at::BFloat16>(
-        key_cache, key, value_cache, value, beam_batch);
-  }
   // support MGQ/MQA
   // expand the head dimensiopn of key/value to be same to the query
   if (query.size(2) != key.size(2)) {
@@ -1212,32 +1772,184 @@ first_token_masked_mha(
     key = key.repeat_interleave(n_req, 2);
     value = value.repeat_interleave(n_req, 2);
   }
-  auto attn_weights = at::Tensor();
   if (key.scalar_type() == at::kBFloat16 && attention_mask.size(1) == 1) {
-    auto attn_outputs = torch_ipex::cpu::flash_attention_kernel_stub(
+    return torch_ipex::cpu::flash_attention_kernel_stub(
         kCPU, query, key, value, scale_attn, attention_mask);
-    return std::make_tuple(
-        attn_outputs, attn_weights, key_cache, value_cache, beam_idx);
+  }
+  key = key.permute({0, 2, 1, 3});
+  query = query.permute({0, 2, 1, 3});
+  value = value.permute({0, 2, 1, 3});
+  auto attn_weights = query.matmul(key.transpose(-1, -2));
+  attn_weights = attn_weights.div(scale_attn);
+  attn_weights = attn_weights + attention_mask;
+  attn_weights = attn_weights.softmax(-1);
+  attn_weights = attn_weights.to(value.dtype());
+  auto attn_outputs = attn_weights.matmul(value);
+  if (origin_type == at::kHalf) {
+    attn_outputs = attn_outputs.to(origin_type);
+  }
+  return attn_outputs;
+}
+
+template <typename KVIndexer>
+std::tuple<at::Tensor, at::Tensor, at::Tensor, at::Tensor, at::Tensor>
+first_token_masked_mha(
+    at::Tensor query,
+    at::Tensor key,
+    at::Tensor value,
+    at::Tensor& key_cache,
+    at::Tensor& value_cache,
+    at::Tensor& beam_idx,
+    const int64_t beam_batch,
+    const KVIndexer& kv_index,
+    const double scale_attn,
+    at::Tensor attention_mask) {
+  if (key.scalar_type() == at::kFloat) {
+    copy_key_value<float>(
+        key_cache, key, value_cache, value, beam_batch, kv_index);
+  } else if (key.scalar_type() == at::kBFloat16) {
+    copy_key_value<at::BFloat16>(
+        key_cache, key, value_cache, value, beam_batch, kv_index);
+  } else if (key.scalar_type() == at::kHalf) {
+    copy_key_value<at::Half>(
+        key_cache, key, value_cache, value, beam_batch, kv_index);
   } else {
-    key = key.permute({0, 2, 1, 3});
-    query = query.permute({0, 2, 1, 3});
-    value = value.permute({0, 2, 1, 3});
-    auto attn_weights = query.matmul(key.transpose(-1, -2));
-    attn_weights = attn_weights.div(scale_attn);
-    attn_weights = attn_weights + attention_mask;
-    attn_weights = attn_weights.softmax(-1);
-    attn_weights = attn_weights.to(value.dtype());
-    auto attn_outputs = attn_weights.matmul(value);
-    if (origin_type == at::kHalf) {
-      attn_outputs = attn_outputs.to(origin_type);
-      attn_weights = attn_weights.to(origin_type);
-      key_cache = key_cache.to(origin_type);
-      value_cache = value_cache.to(origin_type);
+    TORCH_CHECK(
+        false,
+        "key and value must be float, bfloat16 or half to use ipex::masked_multihead_self_attention_kernel_impl");
+  }
+  auto attn_outputs =
+      first_token_attention(query, key, value, scale_attn, attention_mask);
+  return std::make_tuple(
+      attn_outputs, at::Tensor(), key_cache, value_cache, beam_idx);
+}
+
+/*
+ *The masked multihead attention with the quantized kv cache of the cache type
+ *CT (int8 or fp8-e4m3), in the contiguous or the paged layout of KVIndexer.
+ *The prompt is quantized to the cache and attended with its original
+ *key/value, the next token is served by the flash decoding which dequantizes
+ *the cache on the fly.
+ */
+template <typename CT, typename KVIndexer>
+std::tuple<at::Tensor, at::Tensor, at::Tensor, at::Tensor, at::Tensor>
+quantized_kv_cache_masked_mha(
+    at::Tensor query,
+    at::Tensor key,
+    at::Tensor value,
+    at::Tensor& key_cache,
+    at::Tensor& value_cache,
+    at::Tensor& key_scale,
+    at::Tensor& value_scale,
+    at::Tensor& beam_idx,
+    const int64_t offset,
+    const int64_t beam_batch,
+    const KVIndexer& kv_index,
+    const double scale_attn,
+    at::Tensor& attention_mask) {
+  TORCH_CHECK(
+      query.scalar_type() == at::kFloat ||
+          query.scalar_type() == at::kBFloat16 ||
+          query.scalar_type() == at::kHalf,
+      "query, key and value must be float, bfloat16 or half for the int8/fp8 kv cache in ipex::masked_multihead_self_attention");
+  if (offset == 0) {
+    if (key.scalar_type() == at::kFloat) {
+      copy_key_value_quantized<float, CT>(
+          key_cache,
+          key,
+          value_cache,
+          value,
+          key_scale,
+          value_scale,
+          beam_batch,
+          kv_index);
+    } else if (key.scalar_type() == at::kBFloat16) {
+      copy_key_value_quantized<at::BFloat16, CT>(
+          key_cache,
+          key,
+          value_cache,
+          value,
+          key_scale,
+          value_scale,
+          beam_batch,
+          kv_index);
+    } else if (key.scalar_type() == at::kHalf) {
+      copy_key_value_quantized<at::Half, CT>(
+          key_cache,
+          key,
+          value_cache,
+          value,
+          key_scale,
+          value_scale,
+          beam_batch,
+          kv_index);
     }
+    auto attn_outputs =
+        first_token_attention(query, key, value, scale_attn, attention_mask);
     return std::make_tuple(
         attn_outputs, at::Tensor(), key_cache, value_cache, beam_idx);
   }
+  TORCH_CHECK(
+      query.size(1) == 1,
+      "The quantized kv cache only supports one query token per step after the prompt in ipex::masked_multihead_self_attention");
+  auto k_scale_ptr = key_scale.data_ptr<float>();
+  auto v_scale_ptr = value_scale.data_ptr<float>();
+  if (query.scalar_type() == at::kFloat) {
+    return flash_decoding_for_indirect_access_kv_cache<
+        float,
+        float,
+        KVIndexer,
+        CT>(
+        query,
+        key,
+        value,
+        key_cache,
+        value_cache,
+        beam_idx,
+        offset,
+        kv_index,
+        scale_attn,
+        attention_mask,
+        k_scale_ptr,
+        v_scale_ptr);
+  } else if (query.scalar_type() == at::kBFloat16) {
+    return flash_decoding_for_indirect_access_kv_cache<
+        at::BFloat16,
+        at::BFloat16,
+        KVIndexer,
+        CT>(
+        query,
+        key,
+        value,
+        key_cache,
+        value_cache,
+        beam_idx,
+        offset,
+        kv_index,
+        scale_attn,
+        attention_mask,
+        k_scale_ptr,
+        v_scale_ptr);
+  }
+  return flash_decoding_for_indirect_access_kv_cache<
+      at::Half,
+      at::Half,
+      KVIndexer,
+      CT>(
+      query,
+      key,
+      value,
+      key_cache,
+      value_cache,
+      beam_idx,
+      offset,
+      kv_index,
+      scale_attn,
+      attention_mask,
+      k_scale_ptr,
+      v_scale_ptr);
 }
+
 std::tuple<at::Tensor, at::Tensor, at::Tensor, at::Tensor, at::Tensor>
 masked_multihead_self_attention_kernel_impl(
     at::Tensor& query,
@@ -1250,7 +1962,9 @@ masked_multihead_self_attention_kernel_impl(
     const double scale_attn,
     int64_t max_positions,
     const c10::optional<at::Tensor>& head_mask /* optional */,
-    const c10::optional<at::Tensor>& attention_mask /* optional */) {
+    const c10::optional<at::Tensor>& attention_mask /* optional */,
+    const c10::optional<at::Tensor>& key_scale /* optional */,
+    const c10::optional<at::Tensor>& value_scale /* optional */) {
   TORCH_CHECK(
       attention_mask.has_value(),
       "Attention mask is necessary for ipex::masked_multihead_self_attention_kernel_impl");
@@ -1264,6 +1978,24 @@ masked_multihead_self_attention_kernel_impl(
   TORCH_CHECK(
       query.dtype() == key.dtype(),
       "query and key must have the same data type to use ipex::masked_multihead_self_attention_kernel_impl");
+  // the cache is quantized if it is passed in int8 or fp8-e4m3, the scales are
+  // resized in place with the cache
+  auto quantized_kv_cache = key_cache.scalar_type() == at::kChar ||
+      key_cache.scalar_type() == at::kFloat8_e4m3fn;
+  if (quantized_kv_cache) {
+    TORCH_CHECK(
+        value.dtype() == key.dtype() &&
+            value_cache.dtype() == key_cache.dtype() &&
+            key_scale.has_value() && value_scale.has_value() &&
+            key_scale.value().scalar_type() == at::kFloat &&
+            value_scale.value().scalar_type() == at::kFloat,
+        "key_cache/value_cache must have the same quantized data type and key_scale/value_scale must be float for the int8/fp8 kv cache in ipex::masked_multihead_self_attention_kernel_impl");
+  }
+  auto cache_options = quantized_kv_cache
+      ? key.options().dtype(key_cache.scalar_type())
+      : key.options();
+  auto value_cache_options =
+      quantized_kv_cache ? cache_options : value.options();
 
   query = query.contiguous();
   key = key.contiguous();
@@ -1279,10 +2011,16 @@ masked_multihead_self_attention_kernel_impl(
     max_positions =
         max_positions > cur_len ? max_positions : max_positions + cur_len;
     key_cache = at::empty(
-        {max_positions, beam_batch, key.size(2), key.size(3)}, key.options());
+        {max_positions, beam_batch, key.size(2), key.size(3)}, cache_options);
     value_cache = at::empty(
         {max_positions, beam_batch, value.size(2), value.size(3)},
-        value.options());
+        value_cache_options);
+    if (quantized_kv_cache) {
+      key_scale.value().set_(
+          at::empty({max_positions, beam_batch, key.size(2)}, at::kFloat));
+      value_scale.value().set_(
+          at::empty({max_positions, beam_batch, value.size(2)}, at::kFloat));
+    }
     beam_idx = at::empty({max_positions, beam_batch}, beam_idx.options());
     auto beam_idx_access = beam_idx.accessor<long, 2>();
     for (auto i = 0; i < max_positions; i++) {
@@ -1298,10 +2036,21 @@ masked_multihead_self_attention_kernel_impl(
   } else if (offset > 0 && offset + cur_len > cache_size) {
     auto new_cache_size = cache_size * 2;
     auto new_key_cache = at::empty(
-        {new_cache_size, beam_batch, key.size(2), key.size(3)}, key.options());
+        {new_cache_size, beam_batch, key.size(2), key.size(3)},
+        cache_options);
     auto new_value_cache = at::empty(
         {new_cache_size, beam_batch, value.size(2), value.size(3)},
-        value.options());
+        value_cache_options);
+    if (quantized_kv_cache) {
+      auto new_key_scale =
+          at::empty({new_cache_size, beam_batch, key.size(2)}, at::kFloat);
+      auto new_value_scale =
+          at::empty({new_cache_size, beam_batch, value.size(2)}, at::kFloat);
+      new_key_scale.slice(0, 0, cache_size).copy_(key_scale.value());
+      new_value_scale.slice(0, 0, cache_size).copy_(value_scale.value());
+      key_scale.value().set_(new_key_scale);
+      value_scale.value().set_(new_value_scale);
+    }
     auto new_beam_idx =
         at::empty({new_cache_size, beam_batch}, beam_idx.options());
     new_key_cache.slice(0, 0, cache_size).copy_(key_cache);
@@ -1318,6 +2067,44 @@ masked_multihead_self_attention_kernel_impl(
     value_cache = new_value_cache;
     beam_idx = new_beam_idx;
   }
+  auto kv_head = key.size(2);
+  auto head_size = key.size(3);
+  ContiguousKVCacheIndexer kv_index{
+      beam_batch * kv_head * head_size, kv_head * head_size};
+  if (quantized_kv_cache) {
+    auto key_scale_v = key_scale.value();
+    auto value_scale_v = value_scale.value();
+    if (key_cache.scalar_type() == at::kChar) {
+      return quantized_kv_cache_masked_mha<int8_t>(
+          query,
+          key,
+          value,
+          key_cache,
+          value_cache,
+          key_scale_v,
+          value_scale_v,
+          beam_idx,
+          offset,
+          beam_batch,
+          kv_index,
+          scale_attn,
+          attention_mask_v);
+    }
+    return quantized_kv_cache_masked_mha<c10::Float8_e4m3fn>(
+        query,
+        key,
+        value,
+        key_cache,
+        value_cache,
+        key_scale_v,
+        value_scale_v,
+        beam_idx,
+        offset,
+        beam_batch,
+        kv_index,
+        scale_attn,
+        attention_mask_v);
+  }
   if (offset > 0) {
     return zero_copy_kv_cache_masked_multihead_self_attention_kernel_impl(
         query,
@@ -1327,6 +2114,7 @@ masked_multihead_self_attention_kernel_impl(
         value_cache,
         beam_idx,
         offset,
+        kv_index,
         scale_attn,
         attention_mask_v);
   } else {
@@ -1338,15 +2126,592 @@ masked_multihead_self_attention_kernel_impl(
         value_cache,
         beam_idx,
         beam_batch,
+        kv_index,
         scale_attn,
         attention_mask_v);
   }
 }
+
+/*
+ *Make sure the beam row `beam` owns the block which holds the token `ti`, a
+ *block is poped from the free list of the pool if the row does not own it
+ *yet. See paged_kv_cache_init_free_blocks for the layout of the free list.
+ */
+void allocate_kv_cache_block(
+    long* block_table,
+    int64_t max_blocks_per_seq,
+    long* free_blocks,
+    int64_t num_blocks,
+    int64_t block_size,
+    int64_t beam,
+    int64_t ti) {
+  auto block_entry = block_table + beam * max_blocks_per_seq + ti / block_size;
+  if (block_entry[0] >= 0) {
+    return;
+  }
+  TORCH_CHECK(
+      free_blocks[0] > 0,
+      "The kv cache block pool is exhausted in ipex::paged_masked_multihead_self_attention");
+  auto block_id = free_blocks[free_blocks[0]];
+  auto ref_counts = free_blocks + num_blocks + 1;
+  TORCH_CHECK(
+      block_id >= 0 && block_id < num_blocks && ref_counts[block_id] == 0,
+      "The free list of the kv cache block pool is corrupted in ipex::paged_masked_multihead_self_attention");
+  free_blocks[0] -= 1;
+  ref_counts[block_id] = 1;
+  block_entry[0] = block_id;
+}
+
+/*
+ *Check that every past token reached by the beam rows through beam_idx is in
+ *a block still owned by its row, so that a row freed by
+ *paged_kv_cache_free_blocks while another row still reaches it is reported
+ *instead of read after its blocks are returned to the pool.
+ */
+void check_reached_kv_cache_blocks(
+    const long* block_table,
+    int64_t max_blocks_per_seq,
+    int64_t block_size,
+    const at::Tensor& beam_idx,
+    int64_t offset) {
+  auto beam_batch = beam_idx.size(1);
+  auto b_ptr = beam_idx.data_ptr<long>();
+  for (auto i = 0; i < beam_batch; i++) {
+    auto beam = i;
+    for (auto ti = offset - 1; ti >= 0; ti--) {
+      beam = b_ptr[ti * beam_batch + beam];
+      TORCH_CHECK(
+          beam >= 0 && beam < beam_batch &&
+              block_table[beam * max_blocks_per_seq + ti / block_size] >= 0,
+          "The token ",
+          ti,
+          " of the beam row ",
+          i,
+          " is in a freed kv cache block in ipex::paged_masked_multihead_self_attention");
+    }
+  }
+}
+
+/*
+ *Let the other beams of every batch reference the blocks which are fully
+ *filled by the prompt of the first beam, so that a prompt block is returned
+ *to the pool by the last beam freeing it. The last block of the prompt is
+ *partially filled and stays owned by the first beam, since the other beams
+ *store their next tokens to their own blocks.
+ */
+void share_prompt_kv_cache_blocks(
+    long* block_table,
+    int64_t max_blocks_per_seq,
+    long* free_blocks,
+    int64_t num_blocks,
+    int64_t bs,
+    int64_t beam_size,
+    int64_t num_prompt_blocks) {
+  auto ref_counts = free_blocks + num_blocks + 1;
+  for (auto bi = 0; bi < bs; bi++) {
+    auto first_beam = block_table + bi * beam_size * max_blocks_per_seq;
+    for (auto beam = 1; beam < beam_size; beam++) {
+      auto beam_entries = first_beam + beam * max_blocks_per_seq;
+      for (auto i = 0; i < num_prompt_blocks; i++) {
+        if (beam_entries[i] < 0) {
+          beam_entries[i] = first_beam[i];
+          ref_counts[first_beam[i]] += 1;
+        }
+      }
+    }
+  }
+}
+
+std::tuple<at::Tensor, at::Tensor, at::Tensor, at::Tensor, at::Tensor>
+paged_masked_multihead_self_attention_kernel_impl(
+    at::Tensor& query,
+    at::Tensor& key,
+    at::Tensor& value,
+    at::Tensor& key_cache,
+    at::Tensor& value_cache,
+    at::Tensor& block_table,
+    at::Tensor& free_blocks,
+    at::Tensor& beam_idx,
+    at::Tensor seq_info,
+    const double scale_attn,
+    const c10::optional<at::Tensor>& head_mask /* optional */,
+    const c10::optional<at::Tensor>& attention_mask /* optional */,
+    const c10::optional<at::Tensor>& key_scale /* optional */,
+    const c10::optional<at::Tensor>& value_scale /* optional */) {
+  TORCH_CHECK(
+      attention_mask.has_value(),
+      "Attention mask is necessary for ipex::paged_masked_multihead_self_attention_kernel_impl");
+  TORCH_CHECK(
+      attention_mask.value().dim() == 4,
+      "Attention mask must be 4D for ipex::paged_masked_multihead_self_attention_kernel_impl");
+  TORCH_CHECK(
+      head_mask.has_value() != true,
+      "Head mask is not supported in ipex::paged_masked_multihead_self_attention_kernel_impl");
+  auto quantized_kv_cache = key_cache.scalar_type() == at::kChar ||
+      key_cache.scalar_type() == at::kFloat8_e4m3fn;
+  if (quantized_kv_cache) {
+    TORCH_CHECK(
+        query.dtype() == key.dtype() && value.dtype() == key.dtype() &&
+            value_cache.dtype() == key_cache.dtype(),
+        "query, key and value must have the same data type and key_cache/value_cache must have the same quantized data type to use ipex::paged_masked_multihead_self_attention_kernel_impl");
+    TORCH_CHECK(
+        key_scale.has_value() && value_scale.has_value() &&
+            key_scale.value().scalar_type() == at::kFloat &&
+            value_scale.value().scalar_type() == at::kFloat &&
+            key_scale.value().is_contiguous() &&
+            value_scale.value().is_contiguous() &&
+            key_scale.value().sizes() ==
+                key_cache.sizes().slice(0, key_cache.dim() - 1) &&
+            value_scale.value().sizes() == key_scale.value().sizes(),
+        "key_scale/value_scale must be float [num_blocks, block_size, kv_head] for the int8/fp8 kv cache in ipex::paged_masked_multihead_self_attention_kernel_impl");
+  } else {
+    TORCH_CHECK(
+        query.dtype() == key.dtype() && key_cache.dtype() == key.dtype() &&
+            value_cache.dtype() == value.dtype(),
+        "query, key and key_cache must have the same data type to use ipex::paged_masked_multihead_self_attention_kernel_impl");
+  }
+  TORCH_CHECK(
+      key_cache.dim() == 4 && key_cache.size(2) == key.size(2) &&
+          key_cache.size(3) == key.size(3) &&
+          value_cache.sizes() == key_cache.sizes(),
+      "key_cache/value_cache must be [num_blocks, block_size, kv_head, head_size] for ipex::paged_masked_multihead_self_attention_kernel_impl");
+  TORCH_CHECK(
+      block_table.dim() == 2 && block_table.scalar_type() == at::kLong &&
+          free_blocks.scalar_type() == at::kLong &&
+          free_blocks.numel() == 2 * key_cache.size(0) + 1,
+      "block_table must be [beam_size*batch, max_blocks_per_seq] and free_blocks must be made by paged_kv_cache_init_free_blocks for ipex::paged_masked_multihead_self_attention_kernel_impl");
+
+  query = query.contiguous();
+  key = key.contiguous();
+  value = value.contiguous();
+  auto attention_mask_v = attention_mask.value().contiguous();
+  attention_mask_v = attention_mask_v.to(query.dtype());
+  auto beam_batch = block_table.size(0);
+  auto bs = key.size(0);
+  auto beam_size = beam_batch / bs;
+  auto block_size = key_cache.size(1);
+  auto max_blocks_per_seq = block_table.size(1);
+  auto max_positions = max_blocks_per_seq * block_size;
+  auto offset = seq_info.data_ptr<long>()[0];
+  auto cur_len = query.size(1);
+  TORCH_CHECK(
+      offset + cur_len <= max_positions,
+      "The sequence length exceeds the capacity of the block table in ipex::paged_masked_multihead_self_attention_kernel_impl");
+  if (offset == 0) {
+    // the beam info is sized by the capacity of the block table once, so that
+    // it never grows during the generation
+    beam_idx = at::empty({max_positions, beam_batch}, beam_idx.options());
+    auto beam_idx_access = beam_idx.accessor<long, 2>();
+    for (auto i = 0; i < max_positions; i++) {
+      for (auto j = 0; j < beam_batch; j++) {
+        beam_idx_access[i][j] = j / beam_size * beam_size;
+      }
+    }
+  }
+  // grow the cache of every beam row by blocks, the prompt is only stored to
+  // the first beam of every batch and shared by the other beams
+  auto block_table_ptr = block_table.data_ptr<long>();
+  auto free_blocks_ptr = free_blocks.data_ptr<long>();
+  auto num_blocks = key_cache.size(0);
+  for (auto bi = 0; bi < bs; bi++) {
+    auto beam = cur_len > 1 ? bi * beam_size : bi;
+    for (auto ti = offset; ti < offset + cur_len; ti += block_size) {
+      allocate_kv_cache_block(
+          block_table_ptr,
+          max_blocks_per_seq,
+          free_blocks_ptr,
+          num_blocks,
+          block_size,
+          beam,
+          ti);
+    }
+    allocate_kv_cache_block(
+        block_table_ptr,
+        max_blocks_per_seq,
+        free_blocks_ptr,
+        num_blocks,
+        block_size,
+        beam,
+        offset + cur_len - 1);
+  }
+  if (offset == 0 && cur_len > 1 && beam_size > 1) {
+    share_prompt_kv_cache_blocks(
+        block_table_ptr,
+        max_blocks_per_seq,
+        free_blocks_ptr,
+        num_blocks,
+        bs,
+        beam_size,
+        cur_len / block_size);
+  }
+  if (offset > 0) {
+    check_reached_kv_cache_blocks(
+        block_table_ptr, max_blocks_per_seq, block_size, beam_idx, offset);
+  }
+  PagedKVCacheIndexer kv_index{
+      block_table_ptr,
+      max_blocks_per_seq,
+      block_size,
+      key.size(2) * key.size(3)};
+  if (quantized_kv_cache) {
+    auto key_scale_v = key_scale.value();
+    auto value_scale_v = value_scale.value();
+    if (key_cache.scalar_type() == at::kChar) {
+      return quantized_kv_cache_masked_mha<int8_t>(
+          query,
+          key,
+          value,
+          key_cache,
+          value_cache,
+          key_scale_v,
+          value_scale_v,
+          beam_idx,
+          offset,
+          beam_batch,
+          kv_index,
+          scale_attn,
+          attention_mask_v);
+    }
+    return quantized_kv_cache_masked_mha<c10::Float8_e4m3fn>(
+        query,
+        key,
+        value,
+        key_cache,
+        value_cache,
+        key_scale_v,
+        value_scale_v,
+        beam_idx,
+        offset,
+        beam_batch,
+        kv_index,
+        scale_attn,
+        attention_mask_v);
+  }
+  if (offset > 0) {
+    return zero_copy_kv_cache_masked_multihead_self_attention_kernel_impl(
+        query,
+        key,
+        value,
+        key_cache,
+        value_cache,
+        beam_idx,
+        offset,
+        kv_index,
+        scale_attn,
+        attention_mask_v);
+  } else {
+    return first_token_masked_mha(
+        query,
+        key,
+        value,
+        key_cache,
+        value_cache,
+        beam_idx,
+        beam_batch,
+        kv_index,
+        scale_attn,
+        attention_mask_v);
+  }
+}
+
+/*
+ *The scale-dot product for the continuous batching, every sequence has its
+ *own past length and its own slot in the block table, so the prompt of the
+ *new sequences and the next token of the running sequences are processed in
+ *one batch. The tokens of all the sequences are packed without padding and
+ *every query only visits the tokens of its own sequence.
+ *@param  query Query embeeding with the of [num_tokens, head_num, head_size]
+ *@param  key Key embeeding with the of [num_tokens, kv_head, head_size]
+ *@param  value Value embeeding with the of [num_tokens, kv_head, head_size]
+ *@param  key_cache The pool of key blocks [num_blocks, block_size, kv_head,
+ *head_size]
+ *@param  value_cache The pool of value blocks [num_blocks, block_size,
+ *kv_head, head_size]
+ *@param  block_table The blocks owned by every slot [num_slots,
+ *max_blocks_per_seq]
+ *@param  free_blocks The free list of the pool made by
+ *paged_kv_cache_init_free_blocks
+ *@param  query_start_loc The start of every sequence in the packed tokens
+ *[num_seqs + 1]
+ *@param  past_lens The length of the decoded(past) tokens of every sequence
+ *[num_seqs]
+ *@param  slot_ids The slot of every sequence in the block table [num_seqs]
+ *@param  scale_factor the sqrt(head_dim).
+ *@return attn_outs with the shape of [num_tokens, head_num, head_size]
+ */
+template <typename T>
+at::Tensor varlen_scale_dot_product_for_paged_kv_cache(
+    at::Tensor query,
+    at::Tensor key,
+    at::Tensor value,
+    at::Tensor& key_cache,
+    at::Tensor& value_cache,
+    at::Tensor& block_table,
+    at::Tensor& free_blocks,
+    at::Tensor& query_start_loc,
+    at::Tensor& past_lens,
+    at::Tensor& slot_ids,
+    const double scale_factor) {
+  RECORD_FUNCTION(
+      "ipex::varlen_scale_dot_product_for_paged_kv_cache",
+      c10::ArrayRef<c10::IValue>({}));
+  auto num_seqs = past_lens.size(0);
+  auto num_tokens = query.size(0);
+  auto head_num = query.size(1);
+  auto kv_head = key.size(1);
+  auto group_size = head_num / kv_head;
+  auto head_size = query.size(2);
+  auto num_blocks = key_cache.size(0);
+  auto block_size = key_cache.size(1);
+  auto max_blocks_per_seq = block_table.size(1);
+  auto q_ptr = query.data_ptr<T>();
+  auto k_ptr = key.data_ptr<T>();
+  auto v_ptr = value.data_ptr<T>();
+  auto k_cache_ptr = key_cache.data_ptr<T>();
+  auto v_cache_ptr = value_cache.data_ptr<T>();
+  auto block_table_ptr = block_table.data_ptr<long>();
+  auto free_blocks_ptr = free_blocks.data_ptr<long>();
+  auto start_ptr = query_start_loc.data_ptr<long>();
+  auto past_lens_ptr = past_lens.data_ptr<long>();
+  auto slot_ptr = slot_ids.data_ptr<long>();
+  // map every packed token to its sequence and grow the cache of every slot
+  std::vector<int64_t> token_seq(num_tokens);
+  int64_t max_ctx_len = 0;
+  for (auto si = 0; si < num_seqs; si++) {
+    auto new_len = start_ptr[si + 1] - start_ptr[si];
+    auto ctx_len = past_lens_ptr[si] + new_len;
+    TORCH_CHECK(
+        ctx_len <= max_blocks_per_seq * block_size,
+        "The sequence length exceeds the capacity of the block table in ipex::continuous_batching_masked_multihead_self_attention");
+    for (auto ti = start_ptr[si]; ti < start_ptr[si + 1]; ti++) {
+      token_seq[ti] = si;
+    }
+    for (auto ti = past_lens_ptr[si]; ti < ctx_len; ti += block_size) {
+      allocate_kv_cache_block(
+          block_table_ptr,
+          max_blocks_per_seq,
+          free_blocks_ptr,
+          num_blocks,
+          block_size,
+          slot_ptr[si],
+          ti);
+    }
+    if (new_len > 0) {
+      allocate_kv_cache_block(
+          block_table_ptr,
+          max_blocks_per_seq,
+          free_blocks_ptr,
+          num_blocks,
+          block_size,
+          slot_ptr[si],
+          ctx_len - 1);
+    }
+    max_ctx_len = std::max(max_ctx_len, ctx_len);
+  }
+  PagedKVCacheIndexer kv_index{
+      block_table_ptr, max_blocks_per_seq, block_size, kv_head * head_size};
+  {
+    RECORD_FUNCTION(
+        "ipex::varlen_sdp::store_key_value", c10::ArrayRef<c10::IValue>({}));
+#pragma omp parallel for
+    for (auto ti = 0; ti < num_tokens; ti++) {
+      auto si = token_seq[ti];
+      auto pos = past_lens_ptr[si] + ti - start_ptr[si];
+      auto cache_start = kv_index(pos, slot_ptr[si]);
+      torch_ipex::cpu::kernel::move_ker<T, T>(
+          k_cache_ptr + cache_start,
+          k_ptr + ti * kv_head * head_size,
+          kv_head * head_size);
+      torch_ipex::cpu::kernel::move_ker<T, T>(
+          v_cache_ptr + cache_start,
+          v_ptr + ti * kv_head * head_size,
+          kv_head * head_size);
+    }
+  }
+  auto attn_outs =
+      at::empty({num_tokens, head_num, head_size}, query.options());
+  auto attn_out_ptr = attn_outs.data_ptr<T>();
+  auto thread_numbers = omp_get_max_threads();
+  auto attn_weights = at::empty({thread_numbers, max_ctx_len}, at::kFloat);
+  auto attn_w_ptr = attn_weights.data_ptr<float>();
+  auto private_attn_outs = at::empty({thread_numbers, head_size}, at::kFloat);
+  auto private_attn_out_ptr = private_attn_outs.data_ptr<float>();
+  {
+    RECORD_FUNCTION(
+        "ipex::varlen_sdp::attention", c10::ArrayRef<c10::IValue>({}));
+#pragma omp parallel for collapse(2)
+    for (auto ti = 0; ti < num_tokens; ti++) {
+      for (auto hi = 0; hi < head_num; hi++) {
+        auto thread_id = omp_get_thread_num();
+        auto si = token_seq[ti];
+        // the causal range of this query, no work for the padding
+        int ctx_len = past_lens_ptr[si] + ti - start_ptr[si] + 1;
+        auto kv_hi = hi / group_size; // maping the query head to key/value
+                                      // head to support MGA/MQA
+        auto q_ptr_start = q_ptr + (ti * head_num + hi) * head_size;
+        auto attn_w_start = attn_w_ptr + thread_id * max_ctx_len;
+        for (auto ki = 0; ki < ctx_len; ki++) {
+          auto k_cache_head_start =
+              k_cache_ptr + kv_index(ki, slot_ptr[si]) + kv_hi * head_size;
+          attn_w_start[ki] = 0.0f;
+          reduce_head(
+              q_ptr_start,
+              k_cache_head_start,
+              attn_w_start + ki,
+              head_size,
+              false,
+              (T*)nullptr);
+        }
+#if defined(CPU_CAPABILITY_AVX512)
+        auto max_val = -100000.0f;
+        torch_ipex::cpu::kernel::_dil_mul_reduce_max_fusion_kernel(
+            attn_w_start, 1.0 / scale_factor, ctx_len, attn_w_start, max_val);
+        torch_ipex::cpu::kernel::_dil_exp_reduce_sum_fusion_kernel(
+            attn_w_start, ctx_len, attn_w_start, max_val);
+        torch_ipex::cpu::kernel::_dil_normalization_kernel<float>(
+            attn_w_start, max_val, ctx_len, attn_w_start);
+#else
+        auto max_val = -100000.0f;
+        for (auto ki = 0; ki < ctx_len; ki++) {
+          attn_w_start[ki] = attn_w_start[ki] / scale_factor;
+          if (attn_w_start[ki] > max_val) {
+            max_val = attn_w_start[ki];
+          }
+        }
+        float sum = 0.0f;
+        for (auto ki = 0; ki < ctx_len; ki++) {
+          attn_w_start[ki] = exp(attn_w_start[ki] - max_val);
+          sum += attn_w_start[ki];
+        }
+        for (auto ki = 0; ki < ctx_len; ki++) {
+          attn_w_start[ki] = attn_w_start[ki] / sum;
+        }
+#endif
+        auto attn_out_start = private_attn_out_ptr + thread_id * head_size;
+        torch_ipex::cpu::kernel::zero_ker(attn_out_start, head_size);
+        for (auto vi = 0; vi < ctx_len; vi++) {
+          auto v_cache_head_start =
+              v_cache_ptr + kv_index(vi, slot_ptr[si]) + kv_hi * head_size;
+          mul_attenion_weights_and_value_of_head<T, float>(
+              attn_w_start[vi],
+              v_cache_head_start,
+              attn_out_start,
+              head_size,
+              false,
+              nullptr);
+        }
+        torch_ipex::cpu::kernel::move_ker<T, float>(
+            attn_out_ptr + (ti * head_num + hi) * head_size,
+            attn_out_start,
+            head_size);
+      }
+    }
+  }
+  return attn_outs;
+}
+
+std::tuple<at::Tensor, at::Tensor, at::Tensor>
+continuous_batching_masked_multihead_self_attention_kernel_impl(
+    at::Tensor& query,
+    at::Tensor& key,
+    at::Tensor& value,
+    at::Tensor& key_cache,
+    at::Tensor& value_cache,
+    at::Tensor& block_table,
+    at::Tensor& free_blocks,
+    at::Tensor& query_start_loc,
+    at::Tensor& past_lens,
+    at::Tensor& slot_ids,
+    const double scale_attn) {
+  TORCH_CHECK(
+      query.dim() == 3 && key.dim() == 3 && value.dim() == 3,
+      "query, key and value must be packed as [num_tokens, head_num, head_size] for ipex::continuous_batching_masked_multihead_self_attention_kernel_impl");
+  TORCH_CHECK(
+      query.dtype() == key.dtype() && key.dtype() == value.dtype() &&
+          key_cache.dtype() == key.dtype() &&
+          value_cache.dtype() == value.dtype(),
+      "query, key, value and the kv cache must have the same data type to use ipex::continuous_batching_masked_multihead_self_attention_kernel_impl");
+  TORCH_CHECK(
+      key_cache.dim() == 4 && key_cache.size(2) == key.size(1) &&
+          key_cache.size(3) == key.size(2) &&
+          value_cache.sizes() == key_cache.sizes(),
+      "key_cache/value_cache must be [num_blocks, block_size, kv_head, head_size] for ipex::continuous_batching_masked_multihead_self_attention_kernel_impl");
+  TORCH_CHECK(
+      query_start_loc.scalar_type() == at::kLong &&
+          past_lens.scalar_type() == at::kLong &&
+          slot_ids.scalar_type() == at::kLong &&
+          query_start_loc.numel() == past_lens.numel() + 1 &&
+          slot_ids.numel() == past_lens.numel(),
+      "query_start_loc must be [num_seqs + 1], past_lens and slot_ids must be [num_seqs] of int64 for ipex::continuous_batching_masked_multihead_self_attention_kernel_impl");
+  TORCH_CHECK(
+      block_table.dim() == 2 && block_table.scalar_type() == at::kLong &&
+          free_blocks.scalar_type() == at::kLong &&
+          free_blocks.numel() == 2 * key_cache.size(0) + 1,
+      "block_table must be [num_slots, max_blocks_per_seq] and free_blocks must be made by paged_kv_cache_init_free_blocks for ipex::continuous_batching_masked_multihead_self_attention_kernel_impl");
+  query = query.contiguous();
+  key = key.contiguous();
+  value = value.contiguous();
+  query_start_loc = query_start_loc.contiguous();
+  past_lens = past_lens.contiguous();
+  slot_ids = slot_ids.contiguous();
+  at::Tensor attn_outs;
+  if (query.scalar_type() == at::kFloat) {
+    attn_outs = varlen_scale_dot_product_for_paged_kv_cache<float>(
+        query,
+        key,
+        value,
+        key_cache,
+        value_cache,
+        block_table,
+        free_blocks,
+        query_start_loc,
+        past_lens,
+        slot_ids,
+        scale_attn);
+  } else if (query.scalar_type() == at::kBFloat16) {
+    attn_outs = varlen_scale_dot_product_for_paged_kv_cache<at::BFloat16>(
+        query,
+        key,
+        value,
+        key_cache,
+        value_cache,
+        block_table,
+        free_blocks,
+        query_start_loc,
+        past_lens,
+        slot_ids,
+        scale_attn);
+  } else if (query.scalar_type() == at::kHalf) {
+    attn_outs = varlen_scale_dot_product_for_paged_kv_cache<at::Half>(
+        query,
+        key,
+        value,
+        key_cache,
+        value_cache,
+        block_table,
+        free_blocks,
+        query_start_loc,
+        past_lens,
+        slot_ids,
+        scale_attn);
+  } else {
+    TORCH_CHECK(
+        false,
+        "query, key and value must be float, bfloat16 or half to use ipex::continuous_batching_masked_multihead_self_attention_kernel_impl");
+  }
+  return std::make_tuple(attn_outs, key_cache, value_cache);
+}
 } // anonymous namespace
 
 REGISTER_DISPATCH(
     masked_multihead_self_attention_kernel_stub,
     &masked_multihead_self_attention_kernel_impl);
+REGISTER_DISPATCH(
+    paged_masked_multihead_self_attention_kernel_stub,
+    &paged_masked_multihead_self_attention_kernel_impl);
+REGISTER_DISPATCH(
+    continuous_batching_masked_multihead_self_attention_kernel_stub,
+    &continuous_batching_masked_multihead_self_attention_kernel_impl);
 
 } // namespace cpu
 } // namespace torch_ipex
\ No newline at end of file
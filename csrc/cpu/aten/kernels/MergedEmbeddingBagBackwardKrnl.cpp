@@ -2,6 +2,11 @@
 #include <aten/MergedEmbeddingBag.h>
 #include <c10/core/CPUAllocator.h>
 #include <omp.h>
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include "aten/utils/embedding_hot_rows.h"
 #include "vec/unroll_helper.hpp"
 #include "vec/vec.h"
 
@@ -15,269 +20,306 @@ using namespace torch_ipex::cpu::kernel;
 
 template <typename data_t, typename acc_t>
 typename std::enable_if<
-    std::is_same<data_t, Half>::value || std::is_same<data_t, BFloat16>::value,
+    std::is_same<data_t, float>::value || std::is_same<data_t, double>::value,
     void>::
-    type inline copy_from_grad_cache(
-        data_t* wgrad,
-        const EmbeddingGradCache<acc_t>& egc,
+    type inline accumulate_grad(
+        acc_t* acc,
+        const data_t* grad,
+        acc_t scale,
         int64_t emb_dim) {
-#if defined(CPU_CAPABILITY_AVX512_BF16)
-  if (emb_dim == 128) {
-    __m512 cache_vec[8];
-    for (auto& [k, v] : egc.cache) {
-      compile_time_for<8>::op(load_fp32, cache_vec, v.data);
-      if (std::is_same<data_t, BFloat16>::value)
-        compile_time_for<8>::op(
-            cast_bf16_and_store, cache_vec, &wgrad[k * emb_dim]);
-      else
-        compile_time_for<8>::op(
-            cast_fp16_and_store, cache_vec, &wgrad[k * emb_dim]);
-    }
-    return;
+  using Vec = at::vec::Vectorized<data_t>;
+  const auto vec_size = Vec::size();
+  Vec scale_vec = Vec(scale);
+  int64_t i = 0;
+  for (; i + vec_size <= emb_dim; i += vec_size) {
+    Vec acc_vec = Vec::loadu(&acc[i]) + Vec::loadu(&grad[i]) * scale_vec;
+    acc_vec.store(&acc[i]);
   }
-#endif
-  using lpVec = at::vec::Vectorized<data_t>;
-  using fVec = at::vec::Vectorized<float>;
-  auto vec_size = lpVec::size();
-  auto fvec_size = fVec::size();
-  for (auto& [k, v] : egc.cache) {
-    int64_t i = 0;
-    for (; i + vec_size <= emb_dim; i += vec_size) {
-      fVec cache_vec1 = fVec::loadu(&v.data[i]);
-      fVec cache_vec2 = fVec::loadu(&v.data[i + fvec_size]);
-      lpVec out_vec =
-          at::vec::convert_from_float<data_t>(cache_vec1, cache_vec2);
-      out_vec.store(&wgrad[k * emb_dim + i]);
-    }
-    for (; i < emb_dim; i++) {
-      wgrad[k * emb_dim + i] = data_t(v.data[i]);
-    }
+  for (; i < emb_dim; i++) {
+    acc[i] += grad[i] * scale;
   }
 }
 
 template <typename data_t, typename acc_t>
 typename std::enable_if<
-    std::is_same<data_t, float>::value || std::is_same<data_t, double>::value,
+    std::is_same<data_t, Half>::value || std::is_same<data_t, BFloat16>::value,
     void>::
-    type inline copy_from_grad_cache(
-        data_t* wgrad,
-        const EmbeddingGradCache<acc_t>& egc,
+    type inline accumulate_grad(
+        acc_t* acc,
+        const data_t* grad,
+        acc_t scale,
         int64_t emb_dim) {
-  // do nothing but just make compiler happy
-  return;
+  // Low precision grad have to accumulate with acc_t
+  using lpVec = at::vec::Vectorized<data_t>;
+  using fVec = at::vec::Vectorized<float>;
+  const auto vec_size = lpVec::size();
+  const auto fvec_size = fVec::size();
+  fVec scale_vec = fVec(scale);
+  int64_t i = 0;
+  for (; i + vec_size <= emb_dim; i += vec_size) {
+    fVec fgrad_vec1, fgrad_vec2;
+    std::tie(fgrad_vec1, fgrad_vec2) =
+        at::vec::convert_to_float<data_t>(lpVec::loadu(&grad[i]));
+    fVec facc_vec1 = fVec::loadu(&acc[i]) + fgrad_vec1 * scale_vec;
+    fVec facc_vec2 = fVec::loadu(&acc[i + fvec_size]) + fgrad_vec2 * scale_vec;
+    facc_vec1.store(&acc[i]);
+    facc_vec2.store(&acc[i + fvec_size]);
+  }
+  for (; i < emb_dim; i++) {
+    acc[i] += float(grad[i]) * scale;
+  }
 }
 
-template <typename data_t, typename index_t, typename acc_t, bool use_cache>
+template <typename data_t, typename acc_t>
 typename std::enable_if<
     std::is_same<data_t, float>::value || std::is_same<data_t, double>::value,
-    void>::
-    type inline embeddingbag_bwd_acc_kern(
-        const int64_t bs_begin,
-        const int64_t bs_end,
-        const int64_t num_emb,
-        const int64_t emb_dim,
-        const int64_t last_offset,
-        const index_t* indices,
-        const index_t* offsets,
-        const data_t* grad,
-        data_t* result,
-        const int64_t pooling_mode,
-        EmbeddingGradCache<acc_t>& egc) {
-  using Vec = at::vec::Vectorized<data_t>;
-  const auto vec_size = Vec::size();
-  auto find = egc.cache.end();
-  // only accumulate wid % numthd == thdidx
-  const int32_t thdidx = omp_get_thread_num();
-  const int32_t numthd = omp_get_num_threads();
-
-  for (int32_t b = bs_begin; b < bs_end; ++b) {
-    int64_t start_idx = offsets[b];
-    int64_t end_idx =
-        ((b + 1) == bs_end && last_offset != -1) ? last_offset : offsets[b + 1];
-    bool grad_loaded = false;
-    Vec grad_vec, wgrad_vec;
-    for (int64_t j = start_idx; j < end_idx; ++j) {
-      int i = 0;
-      int64_t wid = indices[j];
-      data_t scale = 1.0 / (end_idx - start_idx);
-      if (wid % numthd == thdidx) {
-        if (use_cache) {
-          find = egc.cache.find(wid);
-          if (find == egc.cache.end()) {
-            egc.cache.emplace(wid, emb_dim);
-            find = egc.cache.find(wid);
-          }
-        }
-        for (; i + vec_size <= emb_dim; i += vec_size) {
-          if (!grad_loaded) {
-            grad_loaded = true;
-            grad_vec = Vec::loadu(&grad[b * emb_dim + i]);
-            if (pooling_mode == MEAN && (end_idx - start_idx) > 1) {
-              grad_vec = grad_vec * Vec(scale);
-            }
-          }
-          auto acc_ptr =
-              use_cache ? &find->second.data[i] : &result[wid * emb_dim + i];
-          wgrad_vec = Vec::loadu(acc_ptr);
-          wgrad_vec += grad_vec;
-          wgrad_vec.store(acc_ptr);
-        }
-        auto acc_ptr =
-            use_cache ? &find->second.data[0] : &result[wid * emb_dim];
-        for (; i < emb_dim; i++) {
-          auto grad_value = grad[b * emb_dim + i];
-          if (pooling_mode == MEAN && (end_idx - start_idx) > 1) {
-            grad_value = grad_value * scale;
-          }
-          acc_ptr[i] += grad_value;
-        }
-      }
-    }
-  }
+    void>::type inline store_grad(
+    data_t* wgrad,
+    const acc_t* acc,
+    int64_t emb_dim) {
+  std::memcpy(wgrad, acc, emb_dim * sizeof(data_t));
 }
 
-template <typename data_t, typename index_t, typename acc_t, bool use_cache>
+template <typename data_t, typename acc_t>
 typename std::enable_if<
     std::is_same<data_t, Half>::value || std::is_same<data_t, BFloat16>::value,
-    void>::
-    type inline embeddingbag_bwd_acc_kern(
-        const int64_t bs_begin,
-        const int64_t bs_end,
-        const int64_t num_emb,
-        const int64_t emb_dim,
-        const int64_t last_offset,
-        const index_t* indices,
-        const index_t* offsets,
-        const data_t* grad,
-        data_t* result,
-        const int64_t pooling_mode,
-        EmbeddingGradCache<acc_t>& egc) {
-  // Low precision grad have to accumulate to cache with acc_t
-  assert(use_cache);
-#if defined(CPU_CAPABILITY_AVX512_BF16)
-  __m512i lp_grad[4];
-  __m512 fp32_grad[8], fp32_acc_buffer[8];
-#endif
+    void>::type inline store_grad(
+    data_t* wgrad,
+    const acc_t* acc,
+    int64_t emb_dim) {
   using lpVec = at::vec::Vectorized<data_t>;
   using fVec = at::vec::Vectorized<float>;
-  auto vec_size = lpVec::size();
-  auto fvec_size = fVec::size();
-  // only accumulate wid % numthd == thdidx
-  const int32_t thdidx = omp_get_thread_num();
-  const int32_t numthd = omp_get_num_threads();
-
-  for (int32_t b = bs_begin; b < bs_end; ++b) {
-    int64_t start_idx = offsets[b];
-    int64_t end_idx =
-        ((b + 1) == bs_end && last_offset != -1) ? last_offset : offsets[b + 1];
-    bool grad_loaded = false;
-    lpVec lpgrad_vec;
-    fVec fgrad_vec1, fgrad_vec2, fwgrad_vec1, fwgrad_vec2;
-    for (int64_t j = start_idx; j < end_idx; ++j) {
-      int i = 0;
-      int32_t wid = indices[j];
-      float scale = 1.0 / (end_idx - start_idx);
-      if (wid % numthd == thdidx) {
-        auto find = egc.cache.find(wid);
-        if (find == egc.cache.end()) {
-          egc.cache.emplace(wid, emb_dim);
-          find = egc.cache.find(wid);
-        }
-#if defined(CPU_CAPABILITY_AVX512_BF16)
-        if (emb_dim == 128) {
-          __m512 vec_l = _mm512_set1_ps(scale);
-          if (!grad_loaded) {
-            grad_loaded = true;
-            if (std::is_same<data_t, BFloat16>::value)
-              compile_time_for<4>::op(
-                  load_bf16_cast_fp32, lp_grad, fp32_grad, &grad[b * emb_dim]);
-            else
-              compile_time_for<4>::op(
-                  load_fp16_cast_fp32, lp_grad, fp32_grad, &grad[b * emb_dim]);
-            if (pooling_mode == MEAN && (end_idx - start_idx) > 1) {
-              compile_time_for<8>::op(mul_fp32_constant_b, fp32_grad, vec_l);
-            }
-          }
-          compile_time_for<8>::op(
-              load_fp32, fp32_acc_buffer, find->second.data);
-          compile_time_for<8>::op(add_fp32, fp32_acc_buffer, fp32_grad);
-          compile_time_for<8>::op(
-              store_fp32, fp32_acc_buffer, find->second.data);
-          continue;
-        }
-#endif
-        for (; i + vec_size <= emb_dim; i += vec_size) {
-          if (!grad_loaded) {
-            grad_loaded = true;
-            lpgrad_vec = lpVec::loadu(&grad[b * emb_dim + i]);
-            std::tie(fgrad_vec1, fgrad_vec2) =
-                at::vec::convert_to_float<data_t>(lpgrad_vec);
-            if (pooling_mode == MEAN && (end_idx - start_idx) > 1) {
-              fgrad_vec1 = fgrad_vec1 * fVec(scale);
-              fgrad_vec2 = fgrad_vec2 * fVec(scale);
-            }
-          }
-          fwgrad_vec1 = fVec::loadu(&find->second.data[i]);
-          fwgrad_vec2 = fVec::loadu(&find->second.data[i + fvec_size]);
-          fwgrad_vec1 += fgrad_vec1;
-          fwgrad_vec2 += fgrad_vec2;
-          fwgrad_vec1.store(&find->second.data[i]);
-          fwgrad_vec2.store(&find->second.data[i + fvec_size]);
-        }
-        for (; i < emb_dim; i++) {
-          float grad_value = grad[b * emb_dim + i];
-          if (pooling_mode == MEAN && (end_idx - start_idx) > 1) {
-            grad_value = grad_value * scale;
+  const auto vec_size = lpVec::size();
+  const auto fvec_size = fVec::size();
+  int64_t i = 0;
+  for (; i + vec_size <= emb_dim; i += vec_size) {
+    lpVec out_vec = at::vec::convert_from_float<data_t>(
+        fVec::loadu(&acc[i]), fVec::loadu(&acc[i + fvec_size]));
+    out_vec.store(&wgrad[i]);
+  }
+  for (; i < emb_dim; i++) {
+    wgrad[i] = data_t(acc[i]);
+  }
+}
+
+// Stable LSD radix sort of the key-value pairs with 8 bits per pass. In every
+// pass, each thread counts the digits of its chunk, and then scatters the
+// chunk to the offsets given by the prefix sum over (digit, thread). Return
+// the buffers holding the sorted pairs, which are either the inputs or the
+// temporary ones.
+template <typename key_t, typename value_t>
+std::pair<key_t*, value_t*> radix_sort_parallel(
+    key_t* keys,
+    value_t* values,
+    key_t* tmp_keys,
+    value_t* tmp_values,
+    int64_t n,
+    key_t max_key) {
+  constexpr int kBits = 8;
+  constexpr int kBuckets = 1 << kBits;
+  int num_passes = 0;
+  while (num_passes * kBits < static_cast<int>(sizeof(key_t) * 8) &&
+         (max_key >> (num_passes * kBits)) > 0) {
+    num_passes++;
+  }
+  if (num_passes == 0) {
+    return {keys, values};
+  }
+
+  std::vector<int64_t> histogram(kBuckets * omp_get_max_threads());
+#pragma omp parallel
+  {
+    const int32_t thdidx = omp_get_thread_num();
+    const int32_t numthd = omp_get_num_threads();
+    const int64_t chunk = (n + numthd - 1) / numthd;
+    const int64_t begin = std::min(n, thdidx * chunk);
+    const int64_t end = std::min(n, begin + chunk);
+    int64_t* local_histogram = &histogram[thdidx * kBuckets];
+    key_t* in_keys = keys;
+    value_t* in_values = values;
+    key_t* out_keys = tmp_keys;
+    value_t* out_values = tmp_values;
+    for (int pass = 0; pass < num_passes; pass++) {
+      const int shift = pass * kBits;
+      std::fill(local_histogram, local_histogram + kBuckets, 0);
+      for (int64_t i = begin; i < end; i++) {
+        local_histogram[(in_keys[i] >> shift) & (kBuckets - 1)]++;
+      }
+#pragma omp barrier
+#pragma omp single
+      {
+        int64_t sum = 0;
+        for (int d = 0; d < kBuckets; d++) {
+          for (int t = 0; t < numthd; t++) {
+            auto count = histogram[t * kBuckets + d];
+            histogram[t * kBuckets + d] = sum;
+            sum += count;
           }
-          find->second.data[i] += grad_value;
         }
       }
+      for (int64_t i = begin; i < end; i++) {
+        auto pos = local_histogram[(in_keys[i] >> shift) & (kBuckets - 1)]++;
+        out_keys[pos] = in_keys[i];
+        out_values[pos] = in_values[i];
+      }
+#pragma omp barrier
+      std::swap(in_keys, out_keys);
+      std::swap(in_values, out_values);
     }
   }
+  if (num_passes % 2) {
+    return {tmp_keys, tmp_values};
+  }
+  return {keys, values};
 }
 
-template <typename data_t, typename index_t>
-typename std::enable_if<
-    std::is_same<data_t, Half>::value || std::is_same<data_t, BFloat16>::value,
-    void>::type
-merged_embeddingbag_dense_backward(
-    data_t** o_ptr,
+template <
+    typename key_t,
+    typename data_t,
+    typename index_t,
+    typename acc_t,
+    typename row_fn_t>
+void embeddingbag_bwd_sorted_reduce_impl(
     data_t** grads_ptr,
     index_t** indices_ptr,
     index_t** offsets_ptr,
     int64_t num_batch,
     int64_t num_emb,
     int64_t emb_dim,
-    std::vector<int64_t> last_offsets,
-    int64_t pooling_mode) {
-  using acc_t = acc_type<data_t, true>; // if use_cuda = False, float's acc type
-                                        // will be double
+    const std::vector<int64_t>& index_base,
+    const std::vector<int64_t>& row_base,
+    const std::vector<int64_t>& last_offsets,
+    int64_t pooling_mode,
+    const row_fn_t& row_fn) {
+  const int64_t total = index_base[num_emb];
+  std::unique_ptr<key_t[]> keys(new key_t[total]);
+  std::unique_ptr<key_t[]> tmp_keys(new key_t[total]);
+  std::unique_ptr<int32_t[]> bags(new int32_t[total]);
+  std::unique_ptr<int32_t[]> tmp_bags(new int32_t[total]);
+
+  // the rows of the tables are numbered one after another, so that the pairs
+  // of all the tables are sorted at once
+#pragma omp parallel for collapse(2)
+  for (int64_t n = 0; n < num_emb; ++n) {
+    for (int64_t b = 0; b < num_batch; ++b) {
+      int64_t start_idx = offsets_ptr[n][b];
+      int64_t end_idx =
+          (b + 1) == num_batch ? last_offsets[n] : offsets_ptr[n][b + 1];
+      for (int64_t j = start_idx; j < end_idx; ++j) {
+        keys[index_base[n] + j] = row_base[n] + indices_ptr[n][j];
+        bags[index_base[n] + j] = n * num_batch + b;
+      }
+    }
+  }
+
+  key_t* sorted_keys;
+  int32_t* sorted_bags;
+  std::tie(sorted_keys, sorted_bags) = radix_sort_parallel<key_t, int32_t>(
+      keys.get(),
+      bags.get(),
+      tmp_keys.get(),
+      tmp_bags.get(),
+      total,
+      static_cast<key_t>(row_base[num_emb] - 1));
+
 #pragma omp parallel
   {
-    for (int32_t n = 0; n < num_emb; ++n) {
-      EmbeddingGradCache<acc_t> egc;
-      embeddingbag_bwd_acc_kern<data_t, index_t, acc_t, /*use_cache=*/true>(
-          /*bs_begin=*/0,
-          num_batch,
-          num_emb,
-          emb_dim,
-          last_offsets[n],
-          indices_ptr[n],
-          offsets_ptr[n],
-          grads_ptr[n],
-          o_ptr[n],
-          pooling_mode,
-          egc);
-      copy_from_grad_cache(o_ptr[n], egc, emb_dim);
+    const int32_t thdidx = omp_get_thread_num();
+    const int32_t numthd = omp_get_num_threads();
+    const int64_t chunk = (total + numthd - 1) / numthd;
+    int64_t begin = std::min(total, thdidx * chunk);
+    int64_t end = std::min(total, begin + chunk);
+    // move both ends of the chunk to the starts of the segments, so that
+    // every row is reduced by exactly one thread
+    while (begin > 0 && begin < total &&
+           sorted_keys[begin] == sorted_keys[begin - 1]) {
+      begin++;
+    }
+    while (end > 0 && end < total && sorted_keys[end] == sorted_keys[end - 1]) {
+      end++;
+    }
+    std::unique_ptr<acc_t[]> acc(new acc_t[emb_dim]);
+    for (int64_t i = begin; i < end;) {
+      const key_t key = sorted_keys[i];
+      const int64_t n = sorted_bags[i] / num_batch;
+      std::fill(acc.get(), acc.get() + emb_dim, acc_t(0));
+      for (; i < end && sorted_keys[i] == key; ++i) {
+        const int64_t b = sorted_bags[i] % num_batch;
+        int64_t start_idx = offsets_ptr[n][b];
+        int64_t end_idx =
+            (b + 1) == num_batch ? last_offsets[n] : offsets_ptr[n][b + 1];
+        acc_t scale = 1.0;
+        if (pooling_mode == MEAN && (end_idx - start_idx) > 1) {
+          scale = acc_t(1.0) / (end_idx - start_idx);
+        }
+        accumulate_grad<data_t, acc_t>(
+            acc.get(), &grads_ptr[n][b * emb_dim], scale, emb_dim);
+      }
+      row_fn(n, static_cast<int64_t>(key) - row_base[n], acc.get());
     }
   }
 }
 
+// Aggregate the grads of the bags by rows, and call row_fn(table, row, grad)
+// once for every row used by the bags. Instead of letting every thread scan
+// all the indices, the (row, bag) pairs of all the tables are sorted by row
+// once, then the threads reduce the segments of different rows in parallel.
+template <typename data_t, typename index_t, typename acc_t, typename row_fn_t>
+void embeddingbag_bwd_sorted_reduce(
+    data_t** grads_ptr,
+    index_t** indices_ptr,
+    index_t** offsets_ptr,
+    int64_t num_batch,
+    int64_t num_emb,
+    int64_t emb_dim,
+    const std::vector<int64_t>& num_rows,
+    const std::vector<int64_t>& last_offsets,
+    int64_t pooling_mode,
+    const row_fn_t& row_fn) {
+  TORCH_CHECK(
+      num_emb * num_batch <= std::numeric_limits<int32_t>::max(),
+      "merged_embeddingbag_backward: too many bags");
+  std::vector<int64_t> index_base(num_emb + 1, 0);
+  std::vector<int64_t> row_base(num_emb + 1, 0);
+  for (int64_t n = 0; n < num_emb; ++n) {
+    index_base[n + 1] = index_base[n] + last_offsets[n];
+    row_base[n + 1] = row_base[n] + num_rows[n];
+  }
+  if (index_base[num_emb] == 0) {
+    return;
+  }
+  // 32-bit keys take half of the passes of the 64-bit ones
+  if (row_base[num_emb] <= std::numeric_limits<uint32_t>::max()) {
+    embeddingbag_bwd_sorted_reduce_impl<uint32_t, data_t, index_t, acc_t>(
+        grads_ptr,
+        indices_ptr,
+        offsets_ptr,
+        num_batch,
+        num_emb,
+        emb_dim,
+        index_base,
+        row_base,
+        last_offsets,
+        pooling_mode,
+        row_fn);
+  } else {
+    embeddingbag_bwd_sorted_reduce_impl<uint64_t, data_t, index_t, acc_t>(
+        grads_ptr,
+        indices_ptr,
+        offsets_ptr,
+        num_batch,
+        num_emb,
+        emb_dim,
+        index_base,
+        row_base,
+        last_offsets,
+        pooling_mode,
+        row_fn);
+  }
+}
+
 template <typename data_t, typename index_t>
-typename std::enable_if<
-    std::is_same<data_t, double>::value || std::is_same<data_t, float>::value,
-    void>::type
-merged_embeddingbag_dense_backward(
+void merged_embeddingbag_dense_backward(
     data_t** o_ptr,
     data_t** grads_ptr,
     index_t** indices_ptr,
@@ -285,27 +327,24 @@ merged_embeddingbag_dense_backward(
     int64_t num_batch,
     int64_t num_emb,
     int64_t emb_dim,
-    std::vector<int64_t> last_offsets,
+    const std::vector<int64_t>& num_rows,
+    const std::vector<int64_t>& last_offsets,
     int64_t pooling_mode) {
-  // For float/double, do not need egc to accumulate grad
-  EmbeddingGradCache<data_t> dummy_egc;
-#pragma omp parallel
-  {
-    for (int32_t n = 0; n < num_emb; ++n) {
-      embeddingbag_bwd_acc_kern<data_t, index_t, data_t, /*use_cache=*/false>(
-          /*bs_begin=*/0,
-          num_batch,
-          num_emb,
-          emb_dim,
-          last_offsets[n],
-          indices_ptr[n],
-          offsets_ptr[n],
-          grads_ptr[n],
-          o_ptr[n],
-          pooling_mode,
-          dummy_egc);
-    }
-  }
+  using acc_t = acc_type<data_t, true>; // if use_cuda = False, float's acc type
+                                        // will be double
+  embeddingbag_bwd_sorted_reduce<data_t, index_t, acc_t>(
+      grads_ptr,
+      indices_ptr,
+      offsets_ptr,
+      num_batch,
+      num_emb,
+      emb_dim,
+      num_rows,
+      last_offsets,
+      pooling_mode,
+      [&](int64_t n, int64_t row, const acc_t* grad) {
+        store_grad<data_t, acc_t>(&o_ptr[n][row * emb_dim], grad, emb_dim);
+      });
 }
 
 std::vector<Tensor> merged_embeddingbag_backward_cpu_kernel_impl(
@@ -329,6 +368,7 @@ std::vector<Tensor> merged_embeddingbag_backward_cpu_kernel_impl(
   auto data_type = weights[0].scalar_type();
 
   std::vector<int64_t> last_offsets(num_emb, -1);
+  std::vector<int64_t> num_rows(num_emb, 0);
   std::vector<Tensor> contiguous_grad;
   std::vector<Tensor> outputs;
 
@@ -343,6 +383,7 @@ std::vector<Tensor> merged_embeddingbag_backward_cpu_kernel_impl(
         contiguous_grad[i].scalar_type() == data_type);
     // handle last offsets
     last_offsets[i] = indices[i].numel();
+    num_rows[i] = weights[i].size(0);
     outputs.emplace_back(zeros_like(weights[i], weights[i].options()));
   }
 
@@ -374,6 +415,7 @@ std::vector<Tensor> merged_embeddingbag_backward_cpu_kernel_impl(
                   batch_size,
                   num_emb,
                   emb_dim,
+                  num_rows,
                   last_offsets,
                   pooling_mode);
             });
@@ -570,45 +612,39 @@ inline void adagrad_update<at::BFloat16, float>(
 template <typename data_t, typename acc_t>
 void inline EmbeddingGradUpdate<data_t, acc_t, SGDArgs>::update(
     data_t* weight,
-    const EmbeddingGradCache<acc_t>& egc,
+    const int64_t idx,
+    acc_t* grad,
     const SGDArgs& args,
     const int32_t table_id,
     const int64_t emb_dim) {
   BFloat16* bf16_trail_ptr = args.bf16_trail[table_id].data_ptr<BFloat16>();
-  for (auto& it : egc.cache) {
-    size_t idx = it.first;
-    auto& grad = it.second.data;
-    sgd_update<data_t, acc_t>(
-        &weight[idx * emb_dim],
-        &bf16_trail_ptr[idx * emb_dim],
-        grad,
-        args.weight_decay,
-        args.lr,
-        emb_dim);
-  }
+  sgd_update<data_t, acc_t>(
+      &weight[idx * emb_dim],
+      &bf16_trail_ptr[idx * emb_dim],
+      grad,
+      args.weight_decay,
+      args.lr,
+      emb_dim);
 }
 
 template <typename data_t, typename acc_t>
 void inline EmbeddingGradUpdate<data_t, acc_t, AdaGradArgs>::update(
     data_t* weight,
-    const EmbeddingGradCache<acc_t>& egc,
+    const int64_t idx,
+    acc_t* grad,
     const AdaGradArgs& args,
     const int32_t table_id,
     const int64_t emb_dim) {
   BFloat16* bf16_trail_ptr = args.bf16_trail[table_id].data_ptr<BFloat16>();
   acc_t* hessian_ptr = args.hessian[table_id].data_ptr<acc_t>();
-  for (auto& it : egc.cache) {
-    size_t idx = it.first;
-    auto& grad = it.second.data;
-    adagrad_update<data_t, acc_t>(
-        &weight[idx * emb_dim],
-        &bf16_trail_ptr[idx * emb_dim],
-        &hessian_ptr[idx * emb_dim],
-        grad,
-        args.eps,
-        args.lr,
-        emb_dim);
-  }
+  adagrad_update<data_t, acc_t>(
+      &weight[idx * emb_dim],
+      &bf16_trail_ptr[idx * emb_dim],
+      &hessian_ptr[idx * emb_dim],
+      grad,
+      args.eps,
+      args.lr,
+      emb_dim);
 }
 
 template <typename data_t, typename index_t, typename optimizer_arg_t>
@@ -620,32 +656,38 @@ void merged_embeddingbag_backward_update(
     int64_t num_batch,
     int64_t num_emb,
     int64_t emb_dim,
-    std::vector<int64_t> last_offsets,
+    const std::vector<int64_t>& num_rows,
+    const std::vector<int64_t>& last_offsets,
     int64_t pooling_mode,
-    optimizer_arg_t& args) {
+    optimizer_arg_t& args,
+    const HotRowSet* hot_row_sets,
+    data_t** caches_ptr) {
   using acc_t =
       acc_type<data_t, /*use_cuda=*/true>; // if use_cuda = False, float's acc
                                            // type will be double
-#pragma omp parallel
-  {
-    for (int32_t n = 0; n < num_emb; ++n) {
-      EmbeddingGradCache<acc_t> egc;
-      embeddingbag_bwd_acc_kern<data_t, index_t, acc_t, /*use_cache=*/true>(
-          /*bs_begin=*/0,
-          num_batch,
-          num_emb,
-          emb_dim,
-          last_offsets[n],
-          indices_ptr[n],
-          offsets_ptr[n],
-          grads_ptr[n],
-          /*outout_ptr=*/nullptr,
-          pooling_mode,
-          egc);
-      EmbeddingGradUpdate<data_t, acc_t, optimizer_arg_t>::update(
-          w_ptr[n], egc, args, n, emb_dim);
-    }
-  }
+  // every row is updated once with its aggregated grad
+  embeddingbag_bwd_sorted_reduce<data_t, index_t, acc_t>(
+      grads_ptr,
+      indices_ptr,
+      offsets_ptr,
+      num_batch,
+      num_emb,
+      emb_dim,
+      num_rows,
+      last_offsets,
+      pooling_mode,
+      [&](int64_t n, int64_t row, acc_t* grad) {
+        EmbeddingGradUpdate<data_t, acc_t, optimizer_arg_t>::update(
+            w_ptr[n], row, grad, args, n, emb_dim);
+        // write the updated row through to its copy in the hot row cache
+        const int64_t slot = hot_row_sets[n].find(row);
+        if (slot >= 0) {
+          std::memcpy(
+              &caches_ptr[n][slot * emb_dim],
+              &w_ptr[n][row * emb_dim],
+              emb_dim * sizeof(data_t));
+        }
+      });
 }
 
 void merged_embeddingbag_backward_sgd_cpu_kernel_impl(
@@ -657,7 +699,9 @@ void merged_embeddingbag_backward_sgd_cpu_kernel_impl(
     const bool include_last_offsets,
     const TensorList& bf16_trail,
     const double weight_decay,
-    const double lr) {
+    const double lr,
+    const TensorList& hot_row_sets,
+    const TensorList& hot_row_caches) {
   RECORD_FUNCTION(__FUNCTION__, c10::ArrayRef<c10::IValue>({}));
 
   int64_t num_emb = weights.size();
@@ -672,6 +716,7 @@ void merged_embeddingbag_backward_sgd_cpu_kernel_impl(
   auto data_type = weights[0].scalar_type();
 
   std::vector<int64_t> last_offsets(num_emb, -1);
+  std::vector<int64_t> num_rows(num_emb, 0);
   std::vector<Tensor> contiguous_grad;
   std::vector<Tensor> outputs;
 
@@ -686,6 +731,16 @@ void merged_embeddingbag_backward_sgd_cpu_kernel_impl(
         contiguous_grad[i].scalar_type() == data_type);
     // handle last offsets
     last_offsets[i] = indices[i].numel();
+    num_rows[i] = weights[i].size(0);
+  }
+  TORCH_INTERNAL_ASSERT_DEBUG_ONLY(
+      hot_row_sets.size() == hot_row_caches.size() &&
+      (hot_row_sets.empty() || hot_row_sets.size() == num_emb));
+  // the empty hot row sets of the tables without a hot row cache
+  std::vector<HotRowSet> sets(num_emb);
+  for (int i = 0; i < num_emb && !hot_row_sets.empty(); i++) {
+    sets[i] = HotRowSet(
+        hot_row_sets[i].data_ptr<int64_t>(), hot_row_sets[i].size(1));
   }
 
   AT_DISPATCH_FLOATING_TYPES_AND(
@@ -701,11 +756,15 @@ void merged_embeddingbag_backward_sgd_cpu_kernel_impl(
               scalar_t* weights_ptr[num_emb];
               index_t* indices_ptr[num_emb];
               index_t* offsets_ptr[num_emb];
+              scalar_t* caches_ptr[num_emb];
               for (int i = 0; i < num_emb; i++) {
                 weights_ptr[i] = weights[i].data_ptr<scalar_t>();
                 grads_ptr[i] = contiguous_grad[i].data_ptr<scalar_t>();
                 indices_ptr[i] = indices[i].data_ptr<index_t>();
                 offsets_ptr[i] = offsets[i].data_ptr<index_t>();
+                caches_ptr[i] = hot_row_caches.empty()
+                    ? nullptr
+                    : hot_row_caches[i].data_ptr<scalar_t>();
               }
               SGDArgs args = SGDArgs(bf16_trail, weight_decay, lr);
               merged_embeddingbag_backward_update<scalar_t, index_t, SGDArgs>(
@@ -716,9 +775,12 @@ void merged_embeddingbag_backward_sgd_cpu_kernel_impl(
                   batch_size,
                   num_emb,
                   emb_dim,
+                  num_rows,
                   last_offsets,
                   pooling_mode,
-                  args);
+                  args,
+                  sets.data(),
+                  caches_ptr);
             });
       });
 }
@@ -733,7 +795,9 @@ void merged_embeddingbag_backward_adagrad_cpu_kernel_impl(
     const TensorList& hessian,
     const TensorList& bf16_trail,
     const double eps,
-    const double lr) {
+    const double lr,
+    const TensorList& hot_row_sets,
+    const TensorList& hot_row_caches) {
   RECORD_FUNCTION(__FUNCTION__, c10::ArrayRef<c10::IValue>({}));
 
   int64_t num_emb = weights.size();
@@ -748,6 +812,7 @@ void merged_embeddingbag_backward_adagrad_cpu_kernel_impl(
   auto data_type = weights[0].scalar_type();
 
   std::vector<int64_t> last_offsets(num_emb, -1);
+  std::vector<int64_t> num_rows(num_emb, 0);
   std::vector<Tensor> contiguous_grad;
   std::vector<Tensor> outputs;
 
@@ -762,6 +827,16 @@ void merged_embeddingbag_backward_adagrad_cpu_kernel_impl(
         contiguous_grad[i].scalar_type() == data_type);
     // handle last offsets
     last_offsets[i] = indices[i].numel();
+    num_rows[i] = weights[i].size(0);
+  }
+  TORCH_INTERNAL_ASSERT_DEBUG_ONLY(
+      hot_row_sets.size() == hot_row_caches.size() &&
+      (hot_row_sets.empty() || hot_row_sets.size() == num_emb));
+  // the empty hot row sets of the tables without a hot row cache
+  std::vector<HotRowSet> sets(num_emb);
+  for (int i = 0; i < num_emb && !hot_row_sets.empty(); i++) {
+    sets[i] = HotRowSet(
+        hot_row_sets[i].data_ptr<int64_t>(), hot_row_sets[i].size(1));
   }
 
   AT_DISPATCH_FLOATING_TYPES_AND(
@@ -777,11 +852,15 @@ void merged_embeddingbag_backward_adagrad_cpu_kernel_impl(
               scalar_t* weights_ptr[num_emb];
               index_t* indices_ptr[num_emb];
               index_t* offsets_ptr[num_emb];
+              scalar_t* caches_ptr[num_emb];
               for (int i = 0; i < num_emb; i++) {
                 weights_ptr[i] = weights[i].data_ptr<scalar_t>();
                 grads_ptr[i] = contiguous_grad[i].data_ptr<scalar_t>();
                 indices_ptr[i] = indices[i].data_ptr<index_t>();
                 offsets_ptr[i] = offsets[i].data_ptr<index_t>();
+                caches_ptr[i] = hot_row_caches.empty()
+                    ? nullptr
+                    : hot_row_caches[i].data_ptr<scalar_t>();
               }
               AdaGradArgs args = AdaGradArgs(bf16_trail, hessian, eps, lr);
               merged_embeddingbag_backward_update<
@@ -795,9 +874,12 @@ void merged_embeddingbag_backward_adagrad_cpu_kernel_impl(
                   batch_size,
                   num_emb,
                   emb_dim,
+                  num_rows,
                   last_offsets,
                   pooling_mode,
-                  args);
+                  args,
+                  sets.data(),
+                  caches_ptr);
             });
       });
 }
@@ -1,10 +1,19 @@
 #include <ATen/AccumulateType.h>
+#include <ATen/MapAllocator.h>
 #include <ATen/Tensor.h>
 #include <ATen/cpu/vec/functional.h>
 #include <ATen/cpu/vec/vec.h>
+#include <algorithm>
 #include <aten/MergedEmbCat.h>
 #include <aten/MergedEmbeddingBag.h>
+#include <chrono>
+#include <fcntl.h>
+#include <limits>
+#include <sys/mman.h>
 #include <torch/all.h>
+#include <unistd.h>
+#include "aten/utils/embedding_hot_rows.h"
+#include "aten/utils/embedding_prefetch.h"
 #include "autocast/autocast_mode.h"
 #include "vec/unroll_helper.hpp"
 #include "vec/vec.h"
@@ -32,7 +41,59 @@ inline void copy_dense(
   }
 }
 
-template <typename data_t, typename index_t>
+// The rows of a table looked up by the pooling kernels.
+template <typename data_t>
+struct TableRows {
+  const data_t* weight;
+  int64_t emb_dim;
+
+  inline const data_t* operator()(const int64_t row) const {
+    return &weight[row * emb_dim];
+  }
+
+  template <typename index_t>
+  inline void prefetch(
+      const index_t* indices,
+      const int64_t j,
+      const int64_t last_idx,
+      const int64_t distance) const {
+    prefetch_embedding_row_ahead(
+        indices, j, last_idx, distance, weight, emb_dim * sizeof(data_t));
+  }
+};
+
+// The rows of a table with a hot row cache. The lookups of the hot rows are
+// found in the hot row set and read from their copies in the cache, which are
+// packed together instead of scattered over the table.
+template <typename data_t>
+struct CachedTableRows {
+  const data_t* weight;
+  const data_t* cache;
+  int64_t emb_dim;
+  HotRowSet hot_rows;
+
+  inline const data_t* operator()(const int64_t row) const {
+    const int64_t slot = hot_rows.find(row);
+    return slot >= 0 ? &cache[slot * emb_dim] : &weight[row * emb_dim];
+  }
+
+  // The row of the lookup j + distance is looked up in the hot row set, so
+  // that the copy of a hot row is prefetched instead of its row in the table.
+  template <typename index_t>
+  inline void prefetch(
+      const index_t* indices,
+      const int64_t j,
+      const int64_t last_idx,
+      const int64_t distance) const {
+    if (distance > 0 && j + distance < last_idx) {
+      prefetch_embedding_row(
+          reinterpret_cast<const char*>((*this)(indices[j + distance])),
+          emb_dim * sizeof(data_t));
+    }
+  }
+};
+
+template <typename data_t, typename index_t, typename rows_t>
 typename std::enable_if<
     std::is_same<data_t, float>::value || std::is_same<data_t, double>::value,
     void>::
@@ -44,12 +105,15 @@ typename std::enable_if<
         const index_t last_offset,
         const index_t* indices,
         const index_t* offsets,
-        const data_t* weight,
+        const rows_t& rows,
         data_t* result,
         int64_t result_stride,
-        int64_t pooling_mode) {
+        int64_t pooling_mode,
+        int64_t prefetch_distance) {
   using Vec = at::vec::Vectorized<data_t>;
   auto vec_size = Vec::size();
+  // the end of the lookups of the bags
+  const int64_t last_idx = last_offset != -1 ? last_offset : offsets[bs_end];
   for (int64_t b = bs_begin; b < bs_end; ++b) {
     int64_t start_idx = offsets[b];
     int64_t end_idx =
@@ -58,11 +122,16 @@ typename std::enable_if<
     Vec w_vec;
     int64_t i = 0;
     for (; i + vec_size <= emb_dim; i += vec_size) {
-      int64_t idx = indices[start_idx] * emb_dim;
-      w_vec = Vec::loadu(&weight[idx + i]);
+      // the rows are prefetched by the first pass over the lookups
+      if (i == 0) {
+        rows.prefetch(indices, start_idx, last_idx, prefetch_distance);
+      }
+      w_vec = Vec::loadu(rows(indices[start_idx]) + i);
       for (int64_t j = start_idx + 1; j < end_idx; ++j) {
-        idx = indices[j] * emb_dim;
-        Vec w_next_vec = Vec::loadu(&weight[idx + i]);
+        if (i == 0) {
+          rows.prefetch(indices, j, last_idx, prefetch_distance);
+        }
+        Vec w_next_vec = Vec::loadu(rows(indices[j]) + i);
         w_vec += w_next_vec;
       }
       if (pooling_mode == MEAN) {
@@ -73,11 +142,15 @@ typename std::enable_if<
     // scalar tail
     data_t w;
     for (; i < emb_dim; i++) {
-      int64_t idx = indices[start_idx] * emb_dim;
-      w = weight[idx + i];
+      if (i == 0) {
+        rows.prefetch(indices, start_idx, last_idx, prefetch_distance);
+      }
+      w = rows(indices[start_idx])[i];
       for (int64_t j = start_idx + 1; j < end_idx; ++j) {
-        idx = indices[j] * emb_dim;
-        data_t w_next = weight[idx + i];
+        if (i == 0) {
+          rows.prefetch(indices, j, last_idx, prefetch_distance);
+        }
+        data_t w_next = rows(indices[j])[i];
         w += w_next;
       }
       if (pooling_mode == MEAN) {
@@ -89,7 +162,7 @@ typename std::enable_if<
   }
 }
 
-template <typename data_t, typename index_t>
+template <typename data_t, typename index_t, typename rows_t>
 typename std::enable_if<
     std::is_same<data_t, Half>::value || std::is_same<data_t, BFloat16>::value,
     void>::
@@ -101,13 +174,16 @@ typename std::enable_if<
         const index_t last_offset,
         const index_t* indices,
         const index_t* offsets,
-        const data_t* weight,
+        const rows_t& rows,
         data_t* result,
         int64_t result_stride,
-        int64_t pooling_mode) {
+        int64_t pooling_mode,
+        int64_t prefetch_distance) {
   using lpVec = at::vec::Vectorized<data_t>;
   using fVec = at::vec::Vectorized<float>;
   auto vec_size = lpVec::size();
+  // the end of the lookups of the bags
+  const int64_t last_idx = last_offset != -1 ? last_offset : offsets[bs_end];
   for (int64_t b = bs_begin; b < bs_end; ++b) {
     int64_t start_idx = offsets[b];
     int64_t end_idx =
@@ -116,13 +192,18 @@ typename std::enable_if<
     fVec f_w_vec1, f_w_vec2;
     int64_t i = 0;
     for (; i + vec_size <= emb_dim; i += vec_size) {
-      int64_t idx = indices[start_idx] * emb_dim;
-      lpVec lp_w_vec = lpVec::loadu(&weight[idx + i]);
+      // the rows are prefetched by the first pass over the lookups
+      if (i == 0) {
+        rows.prefetch(indices, start_idx, last_idx, prefetch_distance);
+      }
+      lpVec lp_w_vec = lpVec::loadu(rows(indices[start_idx]) + i);
       std::tie(f_w_vec1, f_w_vec2) =
           at::vec::convert_to_float<data_t>(lp_w_vec);
       for (int64_t j = start_idx + 1; j < end_idx; ++j) {
-        idx = indices[j] * emb_dim;
-        lpVec lp_w_next_vec = lpVec::loadu(&weight[idx + i]);
+        if (i == 0) {
+          rows.prefetch(indices, j, last_idx, prefetch_distance);
+        }
+        lpVec lp_w_next_vec = lpVec::loadu(rows(indices[j]) + i);
         fVec f_w_next_vec1, f_w_next_vec2;
         std::tie(f_w_next_vec1, f_w_next_vec2) =
             at::vec::convert_to_float<data_t>(lp_w_next_vec);
@@ -139,11 +220,15 @@ typename std::enable_if<
     // scalar tail
     float w;
     for (; i < emb_dim; i++) {
-      int64_t idx = indices[start_idx] * emb_dim;
-      w = float(weight[idx + i]);
+      if (i == 0) {
+        rows.prefetch(indices, start_idx, last_idx, prefetch_distance);
+      }
+      w = float(rows(indices[start_idx])[i]);
       for (int64_t j = start_idx + 1; j < end_idx; ++j) {
-        idx = indices[j] * emb_dim;
-        float w_next = float(weight[idx + i]);
+        if (i == 0) {
+          rows.prefetch(indices, j, last_idx, prefetch_distance);
+        }
+        float w_next = float(rows(indices[j])[i]);
         w += w_next;
       }
       if (pooling_mode == MEAN) {
@@ -155,70 +240,152 @@ typename std::enable_if<
   }
 }
 
-template <typename data_t, typename index_t>
-typename std::enable_if<std::is_same<data_t, float>::value, void>::
-    type inline embeddingbag_kern(
-        const int64_t bs_begin,
-        const int64_t bs_end,
-        const int64_t num_emb,
-        const int64_t emb_dim,
-        const index_t last_offset,
-        const index_t* indices,
-        const index_t* offsets,
-        const data_t* weight,
-        data_t* result,
-        const int64_t result_stride,
-        const int64_t pooling_mode) {
 #if defined(CPU_CAPABILITY_AVX512)
-  // FP32 avx512 fast path for emb_dim=128
-  // ~7% improvement while benchmarking on SPR 56C/S with 1 S.
-  // benchmark config: num_emb=26, emb_dim=128, batch_size=32768
-  // num_bags = [3,2,1,2,6,1,1,1,1,7,3,8,1,6,9,5,1,1,1,12,100,27,10,3,1,1] for
-  // each table
-  if (emb_dim == 128) {
-    for (int64_t b = bs_begin; b < bs_end; ++b) {
-      __m512 w0[8];
-      __m512 wj[8];
-      int64_t start_idx = offsets[b];
-      int64_t end_idx = ((b + 1) == bs_end && last_offset != -1)
-          ? last_offset
-          : offsets[b + 1];
-      // load first indices
-      int64_t idx = indices[start_idx] * emb_dim;
-      compile_time_for<8>::op(load_fp32, w0, &weight[idx]);
-      for (int64_t j = start_idx + 1; j < end_idx; ++j) {
-        // add following idx
-        idx = indices[j] * emb_dim;
-        compile_time_for<8>::op(load_fp32, wj, &weight[idx]);
-        compile_time_for<8>::op(add_fp32, w0, wj);
+inline __m512 load_masked_as_fp32(const float* src, __mmask16 mask) {
+  return _mm512_maskz_loadu_ps(mask, src);
+}
+
+inline __m512 load_masked_as_fp32(const BFloat16* src, __mmask16 mask) {
+  return cvt_bf16_to_fp32(_mm256_maskz_loadu_epi16(mask, src));
+}
+
+inline __m512 load_masked_as_fp32(const Half* src, __mmask16 mask) {
+  return cvt_fp16_to_fp32(_mm256_maskz_loadu_epi16(mask, src));
+}
+
+inline void store_masked_from_fp32(float* dst, __mmask16 mask, __m512 v) {
+  _mm512_mask_storeu_ps(dst, mask, v);
+}
+
+inline void store_masked_from_fp32(BFloat16* dst, __mmask16 mask, __m512 v) {
+  _mm256_mask_storeu_epi16(dst, mask, cvt_fp32_to_bf16(v));
+}
+
+inline void store_masked_from_fp32(Half* dst, __mmask16 mask, __m512 v) {
+  _mm256_mask_storeu_epi16(dst, mask, cvt_fp32_to_fp16(v));
+}
+
+inline __mmask16 tail_mask(int64_t len) {
+  return len >= 16 ? 0xffff : (1 << len) - 1;
+}
+
+// The accumulators of up to 256 values of a bag are kept in 16 registers, so
+// that a row of up to 256 values is accumulated in registers as a whole, and
+// a longer one by chunks of 256 values.
+constexpr int64_t kEmbeddingBagBlockSize = 256;
+
+// Pool the bags with the emb_dim known at compile time (kEmbDim) or at runtime
+// (kEmbDim == 0). The compile time emb_dim lets the compiler fully unroll the
+// vector loops, drop the masks and keep the accumulators in registers, the
+// runtime one handles any emb_dim with a masked tail.
+template <
+    typename data_t,
+    typename index_t,
+    typename rows_t,
+    int64_t kEmbDim,
+    bool kMean>
+void embeddingbag_kern_fixed_dim(
+    const int64_t bs_begin,
+    const int64_t bs_end,
+    const int64_t runtime_emb_dim,
+    const index_t last_offset,
+    const index_t* indices,
+    const index_t* offsets,
+    const rows_t& rows,
+    data_t* result,
+    const int64_t result_stride,
+    const int64_t prefetch_distance) {
+  const int64_t emb_dim = kEmbDim > 0 ? kEmbDim : runtime_emb_dim;
+  // the end of the lookups of the bags
+  const int64_t last_idx = last_offset != -1 ? last_offset : offsets[bs_end];
+  for (int64_t b = bs_begin; b < bs_end; ++b) {
+    int64_t start_idx = offsets[b];
+    int64_t end_idx =
+        ((b + 1) == bs_end && last_offset != -1) ? last_offset : offsets[b + 1];
+    for (int64_t i = 0; i < emb_dim; i += kEmbeddingBagBlockSize) {
+      const int64_t n = (kEmbDim > 0 && kEmbDim % kEmbeddingBagBlockSize == 0)
+          ? kEmbeddingBagBlockSize
+          : std::min(kEmbeddingBagBlockSize, emb_dim - i);
+      const int64_t num_vecs = (n + 15) / 16;
+      __m512 acc[kEmbeddingBagBlockSize / 16];
+      for (int64_t v = 0; v < num_vecs; ++v) {
+        acc[v] = _mm512_setzero_ps();
       }
-      if (pooling_mode == MEAN) {
+      for (int64_t j = start_idx; j < end_idx; ++j) {
+        // the rows are prefetched by the first block of the bag
+        if (i == 0) {
+          rows.prefetch(indices, j, last_idx, prefetch_distance);
+        }
+        const data_t* row = rows(indices[j]) + i;
+        for (int64_t v = 0; v < num_vecs; ++v) {
+          acc[v] = _mm512_add_ps(
+              acc[v],
+              load_masked_as_fp32(row + v * 16, tail_mask(n - v * 16)));
+        }
+      }
+      if (kMean && end_idx > start_idx) {
         __m512 vec_l = _mm512_set1_ps(1.0 / (end_idx - start_idx));
-        compile_time_for<8>::op(mul_fp32_constant_b, w0, vec_l);
+        for (int64_t v = 0; v < num_vecs; ++v) {
+          acc[v] = _mm512_mul_ps(acc[v], vec_l);
+        }
+      }
+      for (int64_t v = 0; v < num_vecs; ++v) {
+        store_masked_from_fp32(
+            result + i + v * 16, tail_mask(n - v * 16), acc[v]);
       }
-      // store
-      compile_time_for<8>::op(store_fp32, w0, result);
-      result += result_stride;
     }
-    return;
+    result += result_stride;
   }
-#endif
-  embeddingbag_kern_general(
-      bs_begin,
-      bs_end,
-      num_emb,
-      emb_dim,
-      last_offset,
-      indices,
-      offsets,
-      weight,
-      result,
-      result_stride,
-      pooling_mode);
 }
 
-template <typename data_t, typename index_t>
-typename std::enable_if<std::is_same<data_t, Half>::value, void>::
+template <typename data_t, typename index_t, typename rows_t>
+using embeddingbag_kern_fn = void (*)(
+    const int64_t,
+    const int64_t,
+    const int64_t,
+    const index_t,
+    const index_t*,
+    const index_t*,
+    const rows_t&,
+    data_t*,
+    const int64_t,
+    const int64_t);
+
+#define EMBEDDINGBAG_KERN_CASE(DIM)                                          \
+  case DIM:                                                                  \
+    return pooling_mode == MEAN                                              \
+        ? &embeddingbag_kern_fixed_dim<data_t, index_t, rows_t, DIM, true>   \
+        : &embeddingbag_kern_fixed_dim<data_t, index_t, rows_t, DIM, false>;
+
+// Pick the kernel specialized for emb_dim, or the runtime emb_dim one for the
+// uncommon emb_dims.
+template <typename data_t, typename index_t, typename rows_t>
+embeddingbag_kern_fn<data_t, index_t, rows_t> get_embeddingbag_kern(
+    const int64_t emb_dim,
+    const int64_t pooling_mode) {
+  switch (emb_dim) {
+    EMBEDDINGBAG_KERN_CASE(16)
+    EMBEDDINGBAG_KERN_CASE(32)
+    EMBEDDINGBAG_KERN_CASE(64)
+    EMBEDDINGBAG_KERN_CASE(96)
+    EMBEDDINGBAG_KERN_CASE(128)
+    EMBEDDINGBAG_KERN_CASE(256)
+    EMBEDDINGBAG_KERN_CASE(512)
+    default:
+      return pooling_mode == MEAN
+          ? &embeddingbag_kern_fixed_dim<data_t, index_t, rows_t, 0, true>
+          : &embeddingbag_kern_fixed_dim<data_t, index_t, rows_t, 0, false>;
+  }
+}
+
+#undef EMBEDDINGBAG_KERN_CASE
+#endif
+
+template <typename data_t, typename index_t, typename rows_t>
+typename std::enable_if<
+    std::is_same<data_t, float>::value || std::is_same<data_t, Half>::value ||
+        std::is_same<data_t, BFloat16>::value,
+    void>::
     type inline embeddingbag_kern(
         const int64_t bs_begin,
         const int64_t bs_end,
@@ -227,110 +394,26 @@ typename std::enable_if<std::is_same<data_t, Half>::value, void>::
         const index_t last_offset,
         const index_t* indices,
         const index_t* offsets,
-        const data_t* weight,
+        const rows_t& rows,
         data_t* result,
         const int64_t result_stride,
-        const int64_t pooling_mode) {
+        const int64_t pooling_mode,
+        const int64_t prefetch_distance) {
 #if defined(CPU_CAPABILITY_AVX512)
-  // FP16 avx512_fp16 fast path for emb_dim=128
-  // only ~1.5% improvement while benchmarking on SPR 56C/S with 1 S.
-  // benchmark config: num_emb=26, emb_dim=128, batch_size=32768
-  // num_bags = [3,2,1,2,6,1,1,1,1,7,3,8,1,6,9,5,1,1,1,12,100,27,10,3,1,1] for
-  // each table
-  if (emb_dim == 128) {
-    for (int64_t b = bs_begin; b < bs_end; ++b) {
-      __m512i fp16_w0[4], fp16_wj[4];
-      __m512 fp32_w0[8], fp32_wj[8];
-      int64_t start_idx = offsets[b];
-      int64_t end_idx = ((b + 1) == bs_end && last_offset != -1)
-          ? last_offset
-          : offsets[b + 1];
-      // load first indices
-      int64_t idx = indices[start_idx] * emb_dim;
-      compile_time_for<4>::op(
-          load_fp16_cast_fp32, fp16_w0, fp32_w0, &weight[idx]);
-      for (int64_t j = start_idx + 1; j < end_idx; ++j) {
-        // add following idx
-        idx = indices[j] * emb_dim;
-        compile_time_for<4>::op(
-            load_fp16_cast_fp32, fp16_wj, fp32_wj, &weight[idx]);
-        compile_time_for<8>::op(add_fp32, fp32_w0, fp32_wj);
-      }
-      if (pooling_mode == MEAN) {
-        __m512 vec_l = _mm512_set1_ps(1.0 / (end_idx - start_idx));
-        compile_time_for<8>::op(mul_fp32_constant_b, fp32_w0, vec_l);
-      }
-      // store
-      compile_time_for<8>::op(cast_fp16_and_store, fp32_w0, result);
-      result += result_stride;
-    }
-    return;
-  }
-#endif
-  embeddingbag_kern_general(
+  auto kern =
+      get_embeddingbag_kern<data_t, index_t, rows_t>(emb_dim, pooling_mode);
+  kern(
       bs_begin,
       bs_end,
-      num_emb,
       emb_dim,
       last_offset,
       indices,
       offsets,
-      weight,
+      rows,
       result,
       result_stride,
-      pooling_mode);
-}
-
-template <typename data_t, typename index_t>
-typename std::enable_if<std::is_same<data_t, BFloat16>::value, void>::
-    type inline embeddingbag_kern(
-        const int64_t bs_begin,
-        const int64_t bs_end,
-        const int64_t num_emb,
-        const int64_t emb_dim,
-        const index_t last_offset,
-        const index_t* indices,
-        const index_t* offsets,
-        const data_t* weight,
-        data_t* result,
-        const int64_t result_stride,
-        const int64_t pooling_mode) {
-#if defined(CPU_CAPABILITY_AVX512_BF16)
-  // BF16 avx512_bf16 fast path for emb_dim=128
-  // ~30% improvement while benchmarking on SPR 56C/S with 1 S.
-  // benchmark config: num_emb=26, emb_dim=128, batch_size=32768
-  // num_bags = [3,2,1,2,6,1,1,1,1,7,3,8,1,6,9,5,1,1,1,12,100,27,10,3,1,1] for
-  // each table
-  if (emb_dim == 128) {
-    for (int64_t b = bs_begin; b < bs_end; ++b) {
-      __m512i bf16_w0[4], bf16_wj[4];
-      __m512 fp32_w0[8], fp32_wj[8];
-      int64_t start_idx = offsets[b];
-      int64_t end_idx = ((b + 1) == bs_end && last_offset != -1)
-          ? last_offset
-          : offsets[b + 1];
-      // load first indices
-      int64_t idx = indices[start_idx] * emb_dim;
-      compile_time_for<4>::op(
-          load_bf16_cast_fp32, bf16_w0, fp32_w0, &weight[idx]);
-      for (int64_t j = start_idx + 1; j < end_idx; ++j) {
-        // add following idx
-        idx = indices[j] * emb_dim;
-        compile_time_for<4>::op(
-            load_bf16_cast_fp32, bf16_wj, fp32_wj, &weight[idx]);
-        compile_time_for<8>::op(add_fp32, fp32_w0, fp32_wj);
-      }
-      if (pooling_mode == MEAN) {
-        __m512 vec_l = _mm512_set1_ps(1.0 / (end_idx - start_idx));
-        compile_time_for<8>::op(mul_fp32_constant_b, fp32_w0, vec_l);
-      }
-      // store
-      compile_time_for<8>::op(cast_bf16_and_store, fp32_w0, result);
-      result += result_stride;
-    }
-    return;
-  }
-#endif
+      prefetch_distance);
+#else
   embeddingbag_kern_general(
       bs_begin,
       bs_end,
@@ -339,13 +422,15 @@ typename std::enable_if<std::is_same<data_t, BFloat16>::value, void>::
       last_offset,
       indices,
       offsets,
-      weight,
+      rows,
       result,
       result_stride,
-      pooling_mode);
+      pooling_mode,
+      prefetch_distance);
+#endif
 }
 
-template <typename data_t, typename index_t>
+template <typename data_t, typename index_t, typename rows_t>
 typename std::enable_if<std::is_same<data_t, double>::value, void>::
     type inline embeddingbag_kern(
         const int64_t bs_begin,
@@ -355,10 +440,11 @@ typename std::enable_if<std::is_same<data_t, double>::value, void>::
         const index_t last_offset,
         const index_t* indices,
         const index_t* offsets,
-        const data_t* weight,
+        const rows_t& rows,
         data_t* result,
         const int64_t result_stride,
-        const int64_t pooling_mode) {
+        const int64_t pooling_mode,
+        const int64_t prefetch_distance) {
   embeddingbag_kern_general(
       bs_begin,
       bs_end,
@@ -367,10 +453,11 @@ typename std::enable_if<std::is_same<data_t, double>::value, void>::
       last_offset,
       indices,
       offsets,
-      weight,
+      rows,
       result,
       result_stride,
-      pooling_mode);
+      pooling_mode,
+      prefetch_distance);
 }
 
 template <typename data_t, typename index_t>
@@ -383,7 +470,8 @@ void merged_embeddingbag_cat(
     int64_t num_batch,
     int64_t num_emb,
     int64_t emb_dim,
-    std::vector<int64_t> last_offsets) {
+    std::vector<int64_t> last_offsets,
+    std::vector<int64_t> prefetch_distances) {
   constexpr int64_t b_block = 128;
   const int64_t n_b_blocks = (num_batch - 1) / b_block + 1;
 #pragma omp parallel for collapse(2)
@@ -412,10 +500,11 @@ void merged_embeddingbag_cat(
             last_offset,
             indices_ptr[m],
             offsets_ptr[m],
-            w_ptr[m],
+            TableRows<data_t>{w_ptr[m], emb_dim},
             r,
             /*result_stride=*/(num_emb + 1) * emb_dim,
-            SUM);
+            SUM,
+            prefetch_distances[m]);
       }
     }
   }
@@ -440,6 +529,7 @@ Tensor merged_embedding_cat_fw_impl(
   auto data_type = dense.scalar_type();
 
   std::vector<int64_t> last_offsets(num_emb, -1);
+  std::vector<int64_t> prefetch_distances(num_emb, 0);
 
   for (int i = 0; i < num_emb; i++) {
     TORCH_INTERNAL_ASSERT_DEBUG_ONLY(
@@ -452,6 +542,8 @@ Tensor merged_embedding_cat_fw_impl(
         weights[i].dim() == 2 && weights[i].size(1) == emb_dim);
     // handle last offsets
     last_offsets[i] = indices[i].numel();
+    prefetch_distances[i] = embedding_prefetch_distance(
+        emb_dim * weights[i].element_size(), weights[i].nbytes());
   }
 
   Tensor output = zeros({batch_size, (num_emb + 1) * emb_dim}, dense.options());
@@ -483,22 +575,24 @@ Tensor merged_embedding_cat_fw_impl(
                   batch_size,
                   num_emb,
                   emb_dim,
-                  last_offsets);
+                  last_offsets,
+                  prefetch_distances);
             });
       });
   return output;
 }
 
-template <typename data_t, typename index_t>
+template <typename data_t, typename index_t, typename rows_t>
 void merged_embeddingbag(
     data_t** o_ptr,
-    data_t** w_ptr,
+    const rows_t* rows,
     index_t** indices_ptr,
     index_t** offsets_ptr,
     int64_t num_batch,
     int64_t num_emb,
     int64_t emb_dim,
     std::vector<int64_t> last_offsets,
+    std::vector<int64_t> prefetch_distances,
     int64_t pooling_mode) {
   constexpr int64_t b_block = 128;
   const int64_t n_b_blocks = (num_batch - 1) / b_block + 1;
@@ -518,22 +612,25 @@ void merged_embeddingbag(
           last_offset,
           indices_ptr[m],
           offsets_ptr[m],
-          w_ptr[m],
+          rows[m],
           r,
           /*result_stride=*/emb_dim,
-          pooling_mode);
+          pooling_mode,
+          prefetch_distances[m]);
     }
   }
 }
 
-std::vector<Tensor> merged_embeddingbag_forward_cpu_kernel_impl(
+// Pool the bags of all the tables. make_rows(i, weight) returns the rows of
+// the table i looked up by the pooling, weight is the data of the table.
+template <typename make_rows_t>
+std::vector<Tensor> merged_embeddingbag_forward(
     const std::vector<Tensor>& weights,
     const TensorList& indices,
     const TensorList& offsets,
     const int64_t pooling_mode,
-    const bool include_last_offsets) {
-  RECORD_FUNCTION(__FUNCTION__, c10::ArrayRef<c10::IValue>({}));
-
+    const bool include_last_offsets,
+    const make_rows_t& make_rows) {
   int64_t num_emb = weights.size();
 
   TORCH_INTERNAL_ASSERT_DEBUG_ONLY(num_emb > 0);
@@ -549,6 +646,7 @@ std::vector<Tensor> merged_embeddingbag_forward_cpu_kernel_impl(
   auto data_type = weights[0].scalar_type();
 
   std::vector<int64_t> last_offsets(num_emb, -1);
+  std::vector<int64_t> prefetch_distances(num_emb, 0);
   std::vector<Tensor> outputs;
 
   for (int i = 0; i < num_emb; i++) {
@@ -562,6 +660,8 @@ std::vector<Tensor> merged_embeddingbag_forward_cpu_kernel_impl(
         weights[i].dim() == 2 && weights[i].size(1) == emb_dim);
     // handle last offsets
     last_offsets[i] = indices[i].numel();
+    prefetch_distances[i] = embedding_prefetch_distance(
+        emb_dim * weights[i].element_size(), weights[i].nbytes());
     outputs.emplace_back(empty({batch_size, emb_dim}, weights[i].options()));
   }
 
@@ -573,25 +673,28 @@ std::vector<Tensor> merged_embeddingbag_forward_cpu_kernel_impl(
       [&] {
         AT_DISPATCH_INDEX_TYPES(
             indices[0].scalar_type(), "merged_embeddingbag", [&] {
-              scalar_t* weights_ptr[num_emb];
+              using rows_t = decltype(make_rows(0, (scalar_t*)nullptr));
+              std::vector<rows_t> rows;
               scalar_t* outputs_ptr[num_emb];
               index_t* indices_ptr[num_emb];
               index_t* offsets_ptr[num_emb];
               for (int i = 0; i < num_emb; i++) {
-                weights_ptr[i] = weights[i].data_ptr<scalar_t>();
+                rows.emplace_back(
+                    make_rows(i, weights[i].data_ptr<scalar_t>()));
                 outputs_ptr[i] = outputs[i].data_ptr<scalar_t>();
                 indices_ptr[i] = indices[i].data_ptr<index_t>();
                 offsets_ptr[i] = offsets[i].data_ptr<index_t>();
               }
-              merged_embeddingbag<scalar_t, index_t>(
+              merged_embeddingbag<scalar_t, index_t, rows_t>(
                   outputs_ptr,
-                  weights_ptr,
+                  rows.data(),
                   indices_ptr,
                   offsets_ptr,
                   batch_size,
                   num_emb,
                   emb_dim,
                   last_offsets,
+                  prefetch_distances,
                   pooling_mode);
             });
       });
@@ -599,11 +702,626 @@ std::vector<Tensor> merged_embeddingbag_forward_cpu_kernel_impl(
   return outputs;
 }
 
+std::vector<Tensor> merged_embeddingbag_forward_cpu_kernel_impl(
+    const std::vector<Tensor>& weights,
+    const TensorList& indices,
+    const TensorList& offsets,
+    const int64_t pooling_mode,
+    const bool include_last_offsets) {
+  RECORD_FUNCTION(__FUNCTION__, c10::ArrayRef<c10::IValue>({}));
+
+  const int64_t emb_dim = weights[0].size(1);
+  return merged_embeddingbag_forward(
+      weights,
+      indices,
+      offsets,
+      pooling_mode,
+      include_last_offsets,
+      [&](int64_t i, auto* weight) {
+        using data_t = std::remove_pointer_t<decltype(weight)>;
+        return TableRows<data_t>{weight, emb_dim};
+      });
+}
+
+// Sample every sample_stride lookups into the counts of the rows. stats holds
+// the hits of the sampled lookups in the hot row set, the sampled lookups and
+// the nanoseconds of the sampling of the table.
+template <typename index_t>
+void sample_hot_rows(
+    const index_t* indices,
+    const int64_t num_indices,
+    const HotRowSet& hot_rows,
+    int32_t* counts,
+    const int64_t sample_stride,
+    int64_t* stats) {
+  if (sample_stride <= 0) {
+    return;
+  }
+  auto start = std::chrono::steady_clock::now();
+  int64_t hits = 0;
+  int64_t samples = 0;
+  // start from another lookup in every call, so that the samples do not keep
+  // hitting the same positions of the bags
+  for (int64_t j = stats[1] % sample_stride; j < num_indices;
+       j += sample_stride) {
+    int32_t& count = counts[indices[j]];
+    if (count < std::numeric_limits<int32_t>::max()) {
+      count++;
+    }
+    hits += hot_rows.find(indices[j]) >= 0;
+    samples++;
+  }
+  stats[0] += hits;
+  stats[1] += samples;
+  stats[2] += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                  std::chrono::steady_clock::now() - start)
+                  .count();
+}
+
+std::vector<Tensor> merged_embeddingbag_cached_forward_cpu_kernel_impl(
+    const std::vector<Tensor>& weights,
+    const TensorList& indices,
+    const TensorList& offsets,
+    const int64_t pooling_mode,
+    const bool include_last_offsets,
+    const TensorList& hot_row_caches,
+    const TensorList& hot_row_sets,
+    const TensorList& hot_row_counts,
+    const Tensor& hot_row_stats,
+    const int64_t sample_stride) {
+  RECORD_FUNCTION(__FUNCTION__, c10::ArrayRef<c10::IValue>({}));
+
+  const int64_t num_emb = weights.size();
+  const int64_t emb_dim = weights[0].size(1);
+  int64_t* stats_ptr = hot_row_stats.data_ptr<int64_t>();
+  std::vector<HotRowSet> sets;
+  for (int i = 0; i < num_emb; i++) {
+    sets.emplace_back(
+        hot_row_sets[i].data_ptr<int64_t>(), hot_row_sets[i].size(1));
+  }
+
+  AT_DISPATCH_INDEX_TYPES(indices[0].scalar_type(), "sample_hot_rows", [&] {
+    for (int i = 0; i < num_emb; i++) {
+      sample_hot_rows<index_t>(
+          indices[i].data_ptr<index_t>(),
+          indices[i].numel(),
+          sets[i],
+          hot_row_counts[i].data_ptr<int32_t>(),
+          sample_stride,
+          &stats_ptr[i * 3]);
+    }
+  });
+
+  return merged_embeddingbag_forward(
+      weights,
+      indices,
+      offsets,
+      pooling_mode,
+      include_last_offsets,
+      [&](int64_t i, auto* weight) {
+        using data_t = std::remove_pointer_t<decltype(weight)>;
+        return CachedTableRows<data_t>{
+            weight, hot_row_caches[i].data_ptr<data_t>(), emb_dim, sets[i]};
+      });
+}
+
+// Fill the hot row set of every table with its hot rows, the copy of the hot
+// row j is the row j of the cache.
+void merged_embeddingbag_build_hot_row_sets_cpu_kernel_impl(
+    const TensorList& hot_rows,
+    const TensorList& hot_row_sets) {
+  const int64_t num_emb = hot_rows.size();
+  for (int64_t i = 0; i < num_emb; i++) {
+    const int64_t* rows = hot_rows[i].data_ptr<int64_t>();
+    int64_t* hash = hot_row_sets[i].data_ptr<int64_t>();
+    const int64_t num_buckets = hot_row_sets[i].size(1);
+    const HotRowSet set(hash, num_buckets);
+    std::fill(hash, hash + 2 * num_buckets, kHotRowEmptyBucket);
+    for (int64_t j = 0; j < hot_rows[i].numel(); j++) {
+      int64_t b = HotRowSet::bucket(rows[j], set.shift);
+      while (hash[b] != kHotRowEmptyBucket) {
+        b = (b + 1) & set.mask;
+      }
+      hash[b] = rows[j];
+      hash[num_buckets + b] = j;
+    }
+  }
+}
+
+// The resident pages of a table in a doubly linked list from the least to the
+// most recently used one, so that a lookup moves its page to the end and an
+// eviction pops the pages from the front, without scanning all the pages.
+// prev and next are the rows of the page_lru of the table, and the sentinel
+// num_pages is both the head and the tail of the list. A page which is not
+// resident has no next page (-1).
+struct PageLRU {
+  int64_t* prev;
+  int64_t* next;
+  int64_t sentinel;
+
+  bool resident(const int64_t p) const {
+    return next[p] >= 0;
+  }
+
+  int64_t front() const {
+    return next[sentinel];
+  }
+
+  void unlink(const int64_t p) {
+    next[prev[p]] = next[p];
+    prev[next[p]] = prev[p];
+    prev[p] = -1;
+    next[p] = -1;
+  }
+
+  void push_back(const int64_t p) {
+    const int64_t tail = prev[sentinel];
+    next[tail] = p;
+    prev[p] = tail;
+    next[p] = sentinel;
+    prev[sentinel] = p;
+  }
+};
+
+// Collect the pages of the rows looked up by the indices, once per step, and
+// count the hits of the resident pages. Every page looked up becomes the most
+// recently used one, and the pages which are not resident are returned in
+// order, to be fetched.
+template <typename index_t>
+std::vector<int64_t> collect_missing_pages(
+    const index_t* indices,
+    const int64_t num_indices,
+    const int64_t num_rows,
+    const int64_t row_bytes,
+    const int64_t page_offset,
+    const int64_t page_size,
+    const int64_t step,
+    int64_t* last_use,
+    PageLRU lru,
+    int64_t* stats) {
+  std::vector<int64_t> missing;
+  int64_t hits = 0;
+  for (int64_t j = 0; j < num_indices; ++j) {
+    const int64_t row = indices[j];
+    if (row < 0 || row >= num_rows) {
+      continue;
+    }
+    const int64_t first = (page_offset + row * row_bytes) / page_size;
+    const int64_t last = (page_offset + (row + 1) * row_bytes - 1) / page_size;
+    for (int64_t p = first; p <= last; ++p) {
+      if (last_use[p] == step) {
+        continue;
+      }
+      last_use[p] = step;
+      if (lru.resident(p)) {
+        hits++;
+        lru.unlink(p);
+      } else {
+        missing.push_back(p);
+      }
+      lru.push_back(p);
+    }
+  }
+  std::sort(missing.begin(), missing.end());
+  stats[0] += hits;
+  stats[1] += missing.size();
+  stats[3] += missing.size();
+  return missing;
+}
+
+// Call fn(begin, end) on the runs of the consecutive pages in order.
+template <typename F>
+void for_each_page_run(const std::vector<int64_t>& pages, const F& fn) {
+  for (size_t begin = 0; begin < pages.size();) {
+    size_t end = begin + 1;
+    while (end < pages.size() && pages[end] == pages[end - 1] + 1) {
+      end++;
+    }
+    fn(pages[begin], pages[end - 1] + 1);
+    begin = end;
+  }
+}
+
+// Drop the pages from the memory. madvise(MADV_DONTNEED) alone only unmaps
+// the pages of a shared file mapping, they stay in the page cache. So the
+// dirty pages are written back to the file first, then unmapped, and then
+// dropped from the page cache by posix_fadvise(POSIX_FADV_DONTNEED), which
+// only drops the clean pages mapped by no process. All of them are advices,
+// so a failure only leaves the pages in the memory.
+void drop_pages(
+    char* base,
+    const at::MapAllocator* map,
+    const std::vector<int64_t>& pages,
+    const int64_t page_size) {
+  const int fd = open(map->filename(), O_RDONLY);
+  const auto map_base = static_cast<char*>(map->data());
+  for_each_page_run(pages, [&](int64_t begin, int64_t end) {
+    char* addr = base + begin * page_size;
+    const int64_t len = (end - begin) * page_size;
+    msync(addr, len, MS_SYNC);
+    madvise(addr, len, MADV_DONTNEED);
+    if (fd >= 0) {
+      posix_fadvise(fd, addr - map_base, len, POSIX_FADV_DONTNEED);
+    }
+  });
+  if (fd >= 0) {
+    close(fd);
+  }
+}
+
+// Evict the least recently used pages of a table which has more than
+// max_resident_pages, from the front of its LRU. The pages looked up in this
+// step are at the end of the LRU and are kept, even if they are more than the
+// budget.
+void evict_lru_pages(
+    char* base,
+    const at::MapAllocator* map,
+    const int64_t page_size,
+    const int64_t step,
+    const int64_t max_resident_pages,
+    const int64_t* last_use,
+    PageLRU lru,
+    int64_t* stats) {
+  if (max_resident_pages == 0 || stats[3] <= max_resident_pages) {
+    return;
+  }
+  std::vector<int64_t> pages;
+  while (stats[3] - static_cast<int64_t>(pages.size()) > max_resident_pages) {
+    const int64_t p = lru.front();
+    if (p == lru.sentinel || last_use[p] == step) {
+      break;
+    }
+    lru.unlink(p);
+    pages.push_back(p);
+  }
+  std::sort(pages.begin(), pages.end());
+  drop_pages(base, map, pages, page_size);
+  stats[2] += pages.size();
+  stats[3] -= pages.size();
+}
+
+void merged_embeddingbag_fetch_rows_cpu_kernel_impl(
+    const TensorList& weights,
+    const TensorList& indices,
+    const TensorList& page_last_use,
+    const TensorList& page_lru,
+    const Tensor& fetch_stats,
+    const int64_t step,
+    const int64_t max_resident_pages) {
+  RECORD_FUNCTION(__FUNCTION__, c10::ArrayRef<c10::IValue>({}));
+
+  int64_t num_emb = weights.size();
+  const int64_t page_size = sysconf(_SC_PAGESIZE);
+  int64_t* stats_ptr = fetch_stats.data_ptr<int64_t>();
+  std::vector<char*> bases(num_emb);
+  std::vector<const at::MapAllocator*> maps(num_emb);
+  std::vector<PageLRU> lrus(num_emb);
+  std::vector<std::vector<int64_t>> missing(num_emb);
+  for (int64_t i = 0; i < num_emb; i++) {
+    maps[i] = at::MapAllocator::fromDataPtr(weights[i].storage().data_ptr());
+    const int64_t num_pages = page_last_use[i].numel();
+    int64_t* lru = page_lru[i].data_ptr<int64_t>();
+    lrus[i] = {lru, lru + num_pages + 1, num_pages};
+    // The pages are only read by the fetches, the readahead of the faults
+    // would bring the pages around them to the memory behind the LRU.
+    madvise(maps[i]->data(), maps[i]->size(), MADV_RANDOM);
+  }
+
+  // the deduplication of the lookups into the pages of every table
+  AT_DISPATCH_INDEX_TYPES(indices[0].scalar_type(), "fetch_rows", [&] {
+#pragma omp parallel for
+    for (int64_t i = 0; i < num_emb; i++) {
+      char* data = static_cast<char*>(weights[i].data_ptr());
+      const int64_t page_offset = reinterpret_cast<uintptr_t>(data) % page_size;
+      bases[i] = data - page_offset;
+      missing[i] = collect_missing_pages<index_t>(
+          indices[i].data_ptr<index_t>(),
+          indices[i].numel(),
+          weights[i].size(0),
+          weights[i].stride(0) * weights[i].element_size(),
+          page_offset,
+          page_size,
+          step,
+          page_last_use[i].data_ptr<int64_t>(),
+          lrus[i],
+          &stats_ptr[i * 4]);
+    }
+  });
+
+  // Issue the reads of the missing pages of all the tables before waiting for
+  // any of them, so that they are in flight together on the device. Then touch
+  // the pages from all the threads, which returns once they are resident, so
+  // that the pooling reads them from the memory.
+  std::vector<const char*> pages;
+  for (int64_t i = 0; i < num_emb; i++) {
+    for_each_page_run(missing[i], [&](int64_t begin, int64_t end) {
+      madvise(
+          bases[i] + begin * page_size,
+          (end - begin) * page_size,
+          MADV_WILLNEED);
+    });
+    const char* data = static_cast<const char*>(weights[i].data_ptr());
+    for (auto p : missing[i]) {
+      pages.push_back(std::max<const char*>(bases[i] + p * page_size, data));
+    }
+  }
+#pragma omp parallel for
+  for (int64_t k = 0; k < static_cast<int64_t>(pages.size()); k++) {
+    const char value = *static_cast<const volatile char*>(pages[k]);
+    (void)value;
+  }
+
+#pragma omp parallel for
+  for (int64_t i = 0; i < num_emb; i++) {
+    evict_lru_pages(
+        bases[i],
+        maps[i],
+        page_size,
+        step,
+        max_resident_pages,
+        page_last_use[i].data_ptr<int64_t>(),
+        lrus[i],
+        &stats_ptr[i * 4]);
+  }
+}
+
+// A row of a row-wise quantized table holds the 8-bit or 4-bit values of the
+// row, followed by its fp16 scale and bias.
+constexpr int64_t kRowwiseQParamsBytes = 2 * sizeof(Half);
+
+#if defined(CPU_CAPABILITY_AVX512)
+// Load and dequantize n (<= 16) values of a row from the value i, which is a
+// multiple of 16, so that the 4-bit values start at a byte boundary.
+template <int64_t bit_width>
+inline __m512 load_rowwise_quantized(
+    const uint8_t* row,
+    const int64_t i,
+    const int64_t n,
+    const __m512 scale,
+    const __m512 bias) {
+  __m128i q;
+  if (bit_width == 8) {
+    q = _mm_maskz_loadu_epi8((1 << n) - 1, row + i);
+  } else {
+    __m128i packed =
+        _mm_maskz_loadu_epi8((1 << ((n + 1) / 2)) - 1, row + i / 2);
+    __m128i nibble = _mm_set1_epi8(0x0f);
+    __m128i lo = _mm_and_si128(packed, nibble);
+    __m128i hi = _mm_and_si128(_mm_srli_epi16(packed, 4), nibble);
+    q = _mm_unpacklo_epi8(lo, hi);
+  }
+  __m512 w = _mm512_cvtepi32_ps(_mm512_cvtepu8_epi32(q));
+  return _mm512_fmadd_ps(w, scale, bias);
+}
+#endif
+
+template <typename out_t, typename index_t, int64_t bit_width>
+inline void rowwise_quantized_embeddingbag_kern(
+    const int64_t bs_begin,
+    const int64_t bs_end,
+    const int64_t emb_dim,
+    const index_t last_offset,
+    const index_t* indices,
+    const index_t* offsets,
+    const uint8_t* weight,
+    const int64_t row_bytes,
+    out_t* result,
+    const int64_t pooling_mode,
+    const int64_t prefetch_distance) {
+  const int64_t data_bytes = row_bytes - kRowwiseQParamsBytes;
+  // the end of the lookups of the bags
+  const int64_t last_idx = last_offset != -1 ? last_offset : offsets[bs_end];
+  for (int64_t b = bs_begin; b < bs_end; ++b) {
+    int64_t start_idx = offsets[b];
+    int64_t end_idx =
+        ((b + 1) == bs_end && last_offset != -1) ? last_offset : offsets[b + 1];
+    float alpha = (pooling_mode == MEAN && end_idx > start_idx)
+        ? 1.0f / (end_idx - start_idx)
+        : 1.0f;
+#if defined(CPU_CAPABILITY_AVX512)
+    // Dequantize and pool 64 values of the bag at a time in registers, the
+    // rows are read once in total.
+    constexpr int64_t block_size = 64;
+    for (int64_t i = 0; i < emb_dim; i += block_size) {
+      const int64_t n = std::min(block_size, emb_dim - i);
+      const int64_t num_vecs = (n + 15) / 16;
+      __m512 acc[4];
+      compile_time_for<4>::op(set_zero, acc);
+      for (int64_t j = start_idx; j < end_idx; ++j) {
+        // the rows are prefetched by the first block of the bag
+        if (i == 0) {
+          prefetch_embedding_row_ahead(
+              indices, j, last_idx, prefetch_distance, weight, row_bytes);
+        }
+        const uint8_t* row = &weight[indices[j] * row_bytes];
+        const Half* qparams = reinterpret_cast<const Half*>(row + data_bytes);
+        __m512 scale = _mm512_set1_ps(float(qparams[0]));
+        __m512 bias = _mm512_set1_ps(float(qparams[1]));
+#pragma unroll(4)
+        for (int64_t v = 0; v < num_vecs; ++v) {
+          int64_t len = std::min<int64_t>(16, n - v * 16);
+          acc[v] = _mm512_add_ps(
+              acc[v],
+              load_rowwise_quantized<bit_width>(
+                  row, i + v * 16, len, scale, bias));
+        }
+      }
+      __m512 vec_alpha = _mm512_set1_ps(alpha);
+#pragma unroll(4)
+      for (int64_t v = 0; v < num_vecs; ++v) {
+        int64_t len = std::min<int64_t>(16, n - v * 16);
+        store_masked_from_fp32(
+            result + i + v * 16,
+            (1 << len) - 1,
+            _mm512_mul_ps(acc[v], vec_alpha));
+      }
+    }
+#else
+    float acc[emb_dim];
+    zero_ker(acc, emb_dim);
+    for (int64_t j = start_idx; j < end_idx; ++j) {
+      prefetch_embedding_row_ahead(
+          indices, j, last_idx, prefetch_distance, weight, row_bytes);
+      const uint8_t* row = &weight[indices[j] * row_bytes];
+      const Half* qparams = reinterpret_cast<const Half*>(row + data_bytes);
+      float scale = float(qparams[0]);
+      float bias = float(qparams[1]);
+      for (int64_t i = 0; i < emb_dim; ++i) {
+        int32_t q = bit_width == 8 ? row[i] : (row[i / 2] >> (i % 2 * 4)) & 0xf;
+        acc[i] += q * scale + bias;
+      }
+    }
+    for (int64_t i = 0; i < emb_dim; ++i) {
+      result[i] = out_t(acc[i] * alpha);
+    }
+#endif
+    result += emb_dim;
+  }
+}
+
+template <typename out_t, typename index_t>
+void rowwise_quantized_merged_embeddingbag(
+    const std::vector<Tensor>& outputs,
+    const TensorList& weights,
+    const TensorList& indices,
+    const TensorList& offsets,
+    int64_t num_batch,
+    int64_t emb_dim,
+    int64_t row_bytes,
+    int64_t bit_width,
+    std::vector<int64_t> last_offsets,
+    std::vector<int64_t> prefetch_distances,
+    int64_t pooling_mode) {
+  const int64_t num_emb = weights.size();
+  out_t* o_ptr[num_emb];
+  uint8_t* w_ptr[num_emb];
+  index_t* indices_ptr[num_emb];
+  index_t* offsets_ptr[num_emb];
+  for (int i = 0; i < num_emb; i++) {
+    o_ptr[i] = outputs[i].data_ptr<out_t>();
+    w_ptr[i] = weights[i].data_ptr<uint8_t>();
+    indices_ptr[i] = indices[i].data_ptr<index_t>();
+    offsets_ptr[i] = offsets[i].data_ptr<index_t>();
+  }
+  auto kern = bit_width == 8
+      ? &rowwise_quantized_embeddingbag_kern<out_t, index_t, 8>
+      : &rowwise_quantized_embeddingbag_kern<out_t, index_t, 4>;
+  constexpr int64_t b_block = 128;
+  const int64_t n_b_blocks = (num_batch - 1) / b_block + 1;
+#pragma omp parallel for collapse(2)
+  for (int64_t b = 0; b < n_b_blocks; ++b) {
+    for (int64_t m = 0; m < num_emb; ++m) {
+      const int64_t bs_begin = b * b_block;
+      const int64_t bs_end = std::min(num_batch, (b + 1) * b_block);
+      out_t* r = &o_ptr[m][b * b_block * emb_dim];
+      // avoid offsets not include last batch
+      const index_t last_offset = bs_end == num_batch ? last_offsets[m] : -1;
+      kern(
+          bs_begin,
+          bs_end,
+          emb_dim,
+          last_offset,
+          indices_ptr[m],
+          offsets_ptr[m],
+          w_ptr[m],
+          row_bytes,
+          r,
+          pooling_mode,
+          prefetch_distances[m]);
+    }
+  }
+}
+
+std::vector<Tensor> rowwise_quantized_merged_embeddingbag_kernel_impl(
+    const TensorList& weights,
+    const TensorList& indices,
+    const TensorList& offsets,
+    const int64_t pooling_mode,
+    const bool include_last_offsets,
+    const int64_t bit_width,
+    const ScalarType output_dtype) {
+  RECORD_FUNCTION(__FUNCTION__, c10::ArrayRef<c10::IValue>({}));
+
+  int64_t num_emb = weights.size();
+
+  TORCH_INTERNAL_ASSERT_DEBUG_ONLY(num_emb > 0);
+  int64_t batch_size = offsets[0].size(0);
+  if (include_last_offsets) {
+    batch_size -= 1;
+  }
+  int64_t row_bytes = weights[0].size(1);
+  int64_t emb_dim = (row_bytes - kRowwiseQParamsBytes) * 8 / bit_width;
+
+  auto index_type = indices[0].scalar_type();
+
+  std::vector<int64_t> last_offsets(num_emb, -1);
+  std::vector<int64_t> prefetch_distances(num_emb, 0);
+  std::vector<Tensor> outputs;
+
+  for (int i = 0; i < num_emb; i++) {
+    TORCH_INTERNAL_ASSERT_DEBUG_ONLY(
+        indices[i].is_contiguous() && indices[i].scalar_type() == index_type);
+    TORCH_INTERNAL_ASSERT_DEBUG_ONLY(
+        offsets[i].is_contiguous() && offsets[i].scalar_type() == index_type);
+    // handle last offsets
+    last_offsets[i] = indices[i].numel();
+    prefetch_distances[i] =
+        embedding_prefetch_distance(row_bytes, weights[i].nbytes());
+    outputs.emplace_back(empty(
+        {batch_size, emb_dim}, weights[i].options().dtype(output_dtype)));
+  }
+
+  AT_DISPATCH_INDEX_TYPES(
+      index_type, "rowwise_quantized_merged_embeddingbag", [&] {
+        if (output_dtype == kBFloat16) {
+          rowwise_quantized_merged_embeddingbag<BFloat16, index_t>(
+              outputs,
+              weights,
+              indices,
+              offsets,
+              batch_size,
+              emb_dim,
+              row_bytes,
+              bit_width,
+              last_offsets,
+              prefetch_distances,
+              pooling_mode);
+        } else {
+          rowwise_quantized_merged_embeddingbag<float, index_t>(
+              outputs,
+              weights,
+              indices,
+              offsets,
+              batch_size,
+              emb_dim,
+              row_bytes,
+              bit_width,
+              last_offsets,
+              prefetch_distances,
+              pooling_mode);
+        }
+      });
+
+  return outputs;
+}
+
 } // anonymous namespace
 
 REGISTER_DISPATCH(
     merged_embeddingbag_forward_cpu_kernel_stub,
     &merged_embeddingbag_forward_cpu_kernel_impl);
+REGISTER_DISPATCH(
+    merged_embeddingbag_cached_forward_cpu_kernel_stub,
+    &merged_embeddingbag_cached_forward_cpu_kernel_impl);
+REGISTER_DISPATCH(
+    merged_embeddingbag_build_hot_row_sets_cpu_kernel_stub,
+    &merged_embeddingbag_build_hot_row_sets_cpu_kernel_impl);
+REGISTER_DISPATCH(
+    merged_embeddingbag_fetch_rows_cpu_kernel_stub,
+    &merged_embeddingbag_fetch_rows_cpu_kernel_impl);
+REGISTER_DISPATCH(
+    rowwise_quantized_merged_embeddingbag_kernel_stub,
+    &rowwise_quantized_merged_embeddingbag_kernel_impl);
 REGISTER_DISPATCH(
     merged_embeddingbag_cat_fw_stub,
     &merged_embedding_cat_fw_impl);
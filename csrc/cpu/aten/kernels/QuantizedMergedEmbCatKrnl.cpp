@@ -4,6 +4,7 @@
 #include <aten/MergedEmbCat.h>
 #include <torch/all.h>
 #include <torch/csrc/autograd/function.h>
+#include "aten/utils/embedding_prefetch.h"
 #include "vec/vec.h"
 
 namespace torch_ipex {
@@ -153,6 +154,115 @@ inline void scalecopy_dense(
   }
 }
 
+#if defined(CPU_CAPABILITY_AVX512)
+inline __mmask16 tail_mask(int64_t len) {
+  return len >= 16 ? 0xffff : (1 << len) - 1;
+}
+
+// The int32 accumulators of up to 256 values of a bag are kept in 16
+// registers, so that a row of up to 256 values is accumulated in registers as
+// a whole, and a longer one by chunks of 256 values.
+constexpr int64_t kQEmbeddingBagBlockSize = 256;
+
+// Pool the bags with the emb_dim known at compile time (kEmbDim), whose vector
+// loops are fully unrolled, or at runtime (kEmbDim == 0) with a masked tail.
+template <typename index_t, int64_t kEmbDim>
+void qembeddingbag_kern_fixed_dim(
+    const int64_t bs_begin,
+    const int64_t bs_end,
+    const int64_t num_emb,
+    const int64_t runtime_emb_dim,
+    const index_t last_offset,
+    const index_t* indices,
+    const index_t* offsets,
+    const int8_t* weight,
+    const double scale,
+    int8_t* result,
+    const int64_t prefetch_distance) {
+  const int64_t emb_dim = kEmbDim > 0 ? kEmbDim : runtime_emb_dim;
+  __m512 scale_v = _mm512_set1_ps(scale);
+  // the end of the lookups of the bags
+  const int64_t last_idx = last_offset != -1 ? last_offset : offsets[bs_end];
+  for (int64_t b = bs_begin; b < bs_end; ++b) {
+    int64_t start_idx = offsets[b];
+    int64_t end_idx =
+        ((b + 1) == bs_end && last_offset != -1) ? last_offset : offsets[b + 1];
+    for (int64_t i = 0; i < emb_dim; i += kQEmbeddingBagBlockSize) {
+      const int64_t n = (kEmbDim > 0 && kEmbDim % kQEmbeddingBagBlockSize == 0)
+          ? kQEmbeddingBagBlockSize
+          : std::min(kQEmbeddingBagBlockSize, emb_dim - i);
+      const int64_t num_vecs = (n + 15) / 16;
+      __m512i acc[kQEmbeddingBagBlockSize / 16];
+      for (int64_t v = 0; v < num_vecs; ++v) {
+        acc[v] = _mm512_setzero_si512();
+      }
+      for (int64_t j = start_idx; j < end_idx; ++j) {
+        // the rows are prefetched by the first block of the bag
+        if (i == 0) {
+          prefetch_embedding_row_ahead(
+              indices, j, last_idx, prefetch_distance, weight, emb_dim);
+        }
+        const int8_t* row = &weight[indices[j] * emb_dim + i];
+        for (int64_t v = 0; v < num_vecs; ++v) {
+          __m128i x = _mm_maskz_loadu_epi8(tail_mask(n - v * 16), row + v * 16);
+          acc[v] = _mm512_add_epi32(acc[v], _mm512_cvtepi8_epi32(x));
+        }
+      }
+      for (int64_t v = 0; v < num_vecs; ++v) {
+        __m512 f = _mm512_cvt_roundepi32_ps(
+            acc[v], (_MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
+        f = _mm512_mul_ps(f, scale_v);
+        __m512i y = _mm512_cvt_roundps_epi32(
+            f, (_MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
+        _mm_mask_storeu_epi8(
+            result + i + v * 16,
+            tail_mask(n - v * 16),
+            _mm512_cvtsepi32_epi8(y));
+      }
+    }
+    result += (num_emb + 1) * emb_dim;
+  }
+}
+
+template <typename index_t>
+using qembeddingbag_kern_fn = void (*)(
+    const int64_t,
+    const int64_t,
+    const int64_t,
+    const int64_t,
+    const index_t,
+    const index_t*,
+    const index_t*,
+    const int8_t*,
+    const double,
+    int8_t*,
+    const int64_t);
+
+// Pick the kernel specialized for emb_dim, or the runtime emb_dim one for the
+// uncommon emb_dims.
+template <typename index_t>
+qembeddingbag_kern_fn<index_t> get_qembeddingbag_kern(const int64_t emb_dim) {
+  switch (emb_dim) {
+    case 16:
+      return &qembeddingbag_kern_fixed_dim<index_t, 16>;
+    case 32:
+      return &qembeddingbag_kern_fixed_dim<index_t, 32>;
+    case 64:
+      return &qembeddingbag_kern_fixed_dim<index_t, 64>;
+    case 96:
+      return &qembeddingbag_kern_fixed_dim<index_t, 96>;
+    case 128:
+      return &qembeddingbag_kern_fixed_dim<index_t, 128>;
+    case 256:
+      return &qembeddingbag_kern_fixed_dim<index_t, 256>;
+    case 512:
+      return &qembeddingbag_kern_fixed_dim<index_t, 512>;
+    default:
+      return &qembeddingbag_kern_fixed_dim<index_t, 0>;
+  }
+}
+#endif
+
 template <typename index_t>
 inline void qembeddingbag_kern(
     const int64_t bs_begin,
@@ -164,7 +274,10 @@ inline void qembeddingbag_kern(
     const index_t* offsets,
     const int8_t* weight,
     const double scale,
-    int8_t* result) {
+    int8_t* result,
+    const int64_t prefetch_distance) {
+  // the end of the lookups of the bags
+  const int64_t last_idx = last_offset != -1 ? last_offset : offsets[bs_end];
 #if defined(CPU_CAPABILITY_AVX512_FP16)
   if (emb_dim == 128) {
     __m512h scale_v = (__m512h)_mm512_broadcast_f32x8((__m256)_mm512_cvtps_ph(
@@ -177,6 +290,8 @@ inline void qembeddingbag_kern(
       int64_t end_idx = ((b + 1) == bs_end && last_offset != -1)
           ? last_offset
           : offsets[b + 1];
+      prefetch_embedding_row_ahead(
+          indices, start_idx, last_idx, prefetch_distance, weight, emb_dim);
       int64_t idx = indices[start_idx] * emb_dim;
       x00 = _mm512_load_si512(&weight[idx]);
       x64 = _mm512_load_si512(&weight[idx + 64]);
@@ -185,6 +300,8 @@ inline void qembeddingbag_kern(
       y64 = _mm512_cvtepi8_epi16(_mm512_extracti32x8_epi32(x64, 0));
       y96 = _mm512_cvtepi8_epi16(_mm512_extracti32x8_epi32(x64, 1));
       for (int64_t j = start_idx + 1; j < end_idx; ++j) {
+        prefetch_embedding_row_ahead(
+            indices, j, last_idx, prefetch_distance, weight, emb_dim);
         idx = indices[j] * emb_dim;
         x00 = _mm512_load_si512(&weight[idx]);
         x64 = _mm512_load_si512(&weight[idx + 64]);
@@ -229,112 +346,38 @@ inline void qembeddingbag_kern(
   }
 #endif
 #if defined(CPU_CAPABILITY_AVX512)
-  if (emb_dim == 128) {
-    __m512 scale_v = _mm512_set1_ps(scale);
-    for (int64_t b = bs_begin; b < bs_end; ++b) {
-      __m512i x00, x64;
-      __m512i y0, y1, y2, y3, y4, y5, y6, y7;
-      __m512 f0, f1, f2, f3, f4, f5, f6, f7;
-      int64_t start_idx = offsets[b];
-      int64_t end_idx = ((b + 1) == bs_end && last_offset != -1)
-          ? last_offset
-          : offsets[b + 1];
-      // load first indices
-      int64_t idx = indices[start_idx] * emb_dim;
-      x00 = _mm512_load_si512(&weight[idx]);
-      x64 = _mm512_load_si512(&weight[idx + 64]);
-      y0 = _mm512_cvtepi8_epi32(_mm512_extracti32x4_epi32(x00, 0));
-      y1 = _mm512_cvtepi8_epi32(_mm512_extracti32x4_epi32(x00, 1));
-      y2 = _mm512_cvtepi8_epi32(_mm512_extracti32x4_epi32(x00, 2));
-      y3 = _mm512_cvtepi8_epi32(_mm512_extracti32x4_epi32(x00, 3));
-      y4 = _mm512_cvtepi8_epi32(_mm512_extracti32x4_epi32(x64, 0));
-      y5 = _mm512_cvtepi8_epi32(_mm512_extracti32x4_epi32(x64, 1));
-      y6 = _mm512_cvtepi8_epi32(_mm512_extracti32x4_epi32(x64, 2));
-      y7 = _mm512_cvtepi8_epi32(_mm512_extracti32x4_epi32(x64, 3));
-      for (int64_t j = start_idx + 1; j < end_idx; ++j) {
-        idx = indices[j] * emb_dim;
-        x00 = _mm512_load_si512(&weight[idx]);
-        x64 = _mm512_load_si512(&weight[idx + 64]);
-        y0 = _mm512_add_epi32(
-            y0, _mm512_cvtepi8_epi32(_mm512_extracti32x4_epi32(x00, 0)));
-        y1 = _mm512_add_epi32(
-            y1, _mm512_cvtepi8_epi32(_mm512_extracti32x4_epi32(x00, 1)));
-        y2 = _mm512_add_epi32(
-            y2, _mm512_cvtepi8_epi32(_mm512_extracti32x4_epi32(x00, 2)));
-        y3 = _mm512_add_epi32(
-            y3, _mm512_cvtepi8_epi32(_mm512_extracti32x4_epi32(x00, 3)));
-        y4 = _mm512_add_epi32(
-            y4, _mm512_cvtepi8_epi32(_mm512_extracti32x4_epi32(x64, 0)));
-        y5 = _mm512_add_epi32(
-            y5, _mm512_cvtepi8_epi32(_mm512_extracti32x4_epi32(x64, 1)));
-        y6 = _mm512_add_epi32(
-            y6, _mm512_cvtepi8_epi32(_mm512_extracti32x4_epi32(x64, 2)));
-        y7 = _mm512_add_epi32(
-            y7, _mm512_cvtepi8_epi32(_mm512_extracti32x4_epi32(x64, 3)));
-      }
-      f0 = _mm512_cvt_roundepi32_ps(
-          y0, (_MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
-      f1 = _mm512_cvt_roundepi32_ps(
-          y1, (_MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
-      f2 = _mm512_cvt_roundepi32_ps(
-          y2, (_MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
-      f3 = _mm512_cvt_roundepi32_ps(
-          y3, (_MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
-      f4 = _mm512_cvt_roundepi32_ps(
-          y4, (_MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
-      f5 = _mm512_cvt_roundepi32_ps(
-          y5, (_MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
-      f6 = _mm512_cvt_roundepi32_ps(
-          y6, (_MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
-      f7 = _mm512_cvt_roundepi32_ps(
-          y7, (_MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
-      f0 = _mm512_mul_ps(f0, scale_v);
-      f1 = _mm512_mul_ps(f1, scale_v);
-      f2 = _mm512_mul_ps(f2, scale_v);
-      f3 = _mm512_mul_ps(f3, scale_v);
-      f4 = _mm512_mul_ps(f4, scale_v);
-      f5 = _mm512_mul_ps(f5, scale_v);
-      f6 = _mm512_mul_ps(f6, scale_v);
-      f7 = _mm512_mul_ps(f7, scale_v);
-      y0 = _mm512_cvt_roundps_epi32(
-          f0, (_MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
-      y1 = _mm512_cvt_roundps_epi32(
-          f1, (_MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
-      y2 = _mm512_cvt_roundps_epi32(
-          f2, (_MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
-      y3 = _mm512_cvt_roundps_epi32(
-          f3, (_MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
-      y4 = _mm512_cvt_roundps_epi32(
-          f4, (_MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
-      y5 = _mm512_cvt_roundps_epi32(
-          f5, (_MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
-      y6 = _mm512_cvt_roundps_epi32(
-          f6, (_MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
-      y7 = _mm512_cvt_roundps_epi32(
-          f7, (_MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
-      x00 = _mm512_inserti32x4(x00, _mm512_cvtsepi32_epi8(y0), 0);
-      x00 = _mm512_inserti32x4(x00, _mm512_cvtsepi32_epi8(y1), 1);
-      x00 = _mm512_inserti32x4(x00, _mm512_cvtsepi32_epi8(y2), 2);
-      x00 = _mm512_inserti32x4(x00, _mm512_cvtsepi32_epi8(y3), 3);
-      x64 = _mm512_inserti32x4(x64, _mm512_cvtsepi32_epi8(y4), 0);
-      x64 = _mm512_inserti32x4(x64, _mm512_cvtsepi32_epi8(y5), 1);
-      x64 = _mm512_inserti32x4(x64, _mm512_cvtsepi32_epi8(y6), 2);
-      x64 = _mm512_inserti32x4(x64, _mm512_cvtsepi32_epi8(y7), 3);
-      _mm512_store_si512(result, x00);
-      _mm512_store_si512(result + 64, x64);
-      result += (num_emb + 1) * emb_dim;
-    }
-    return;
-  }
+  auto kern = get_qembeddingbag_kern<index_t>(emb_dim);
+  kern(
+      bs_begin,
+      bs_end,
+      num_emb,
+      emb_dim,
+      last_offset,
+      indices,
+      offsets,
+      weight,
+      scale,
+      result,
+      prefetch_distance);
+  return;
 #endif
   for (int64_t b = bs_begin; b < bs_end; ++b) {
     int64_t start_idx = offsets[b];
     int64_t end_idx =
         ((b + 1) == bs_end && last_offset != -1) ? last_offset : offsets[b + 1];
     for (int32_t d = 0; d < emb_dim; d++) {
+      // the rows are prefetched by the first pass over the lookups
+      if (d == 0) {
+        prefetch_embedding_row_ahead(
+            indices, start_idx, last_idx, prefetch_distance, weight, emb_dim);
+      }
       int64_t idx = indices[start_idx] * emb_dim;
       int32_t value = int32_t(weight[idx + d]);
       for (int64_t j = start_idx + 1; j < end_idx; ++j) {
+        if (d == 0) {
+          prefetch_embedding_row_ahead(
+              indices, j, last_idx, prefetch_distance, weight, emb_dim);
+        }
         idx = indices[j] * emb_dim;
         value += int32_t(weight[idx + d]);
       }
@@ -356,6 +399,7 @@ void qembeddingbagcat(
     int64_t num_emb,
     int64_t emb_dim,
     std::vector<int64_t> last_offsets,
+    std::vector<int64_t> prefetch_distances,
     std::vector<double> w_scale,
     double d_scale,
     double o_scale) {
@@ -394,7 +438,8 @@ void qembeddingbagcat(
             offsets_ptr[m],
             w_ptr[m],
             w_scale[m],
-            r);
+            r,
+            prefetch_distances[m]);
       }
     }
   }
@@ -419,6 +464,7 @@ Tensor qmerged_embedding_cat_fw_impl(
   auto int8_type = qdense.scalar_type();
 
   std::vector<int64_t> last_offsets(num_emb, -1);
+  std::vector<int64_t> prefetch_distances(num_emb, 0);
   std::vector<double> w_scale(num_emb, -1);
 
   for (int i = 0; i < num_emb; i++) {
@@ -432,6 +478,8 @@ Tensor qmerged_embedding_cat_fw_impl(
         qweights[i].dim() == 2 && qweights[i].size(1) == emb_dim);
     // handle last offsets
     last_offsets[i] = indices[i].numel();
+    prefetch_distances[i] =
+        embedding_prefetch_distance(emb_dim, qweights[i].nbytes());
     w_scale[i] = native::q_scale_quant(qweights[i]);
   }
 
@@ -463,6 +511,7 @@ Tensor qmerged_embedding_cat_fw_impl(
         num_emb,
         emb_dim,
         last_offsets,
+        prefetch_distances,
         w_scale,
         dense_scale,
         o_scale);
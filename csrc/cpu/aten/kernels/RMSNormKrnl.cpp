@@ -1,5 +1,6 @@
 #include <aten/RMSNorm.h>
 
+#include <memory>
 #include <torch/csrc/autograd/function.h>
 #include "vec/vec.h"
 
@@ -30,6 +31,50 @@ void RMSNormKernelImpl(
     }
   });
 }
+
+template <typename T, typename T1, typename TOut>
+void AddRMSNormKernelImpl(
+    const at::Tensor& input,
+    at::Tensor& residual,
+    const at::Tensor& gamma,
+    int64_t M,
+    int64_t N,
+    float eps,
+    at::Tensor& output,
+    at::Tensor& scales,
+    at::Tensor& zero_points) {
+  const T* input_data = input.data_ptr<T>();
+  T* residual_data = residual.data_ptr<T>();
+  const T1* gamma_data = gamma.defined() ? gamma.data_ptr<T1>() : nullptr;
+  TOut* output_data = output.data_ptr<TOut>();
+  at::parallel_for(0, M, 1, [&](int64_t start, int64_t end) {
+    // the normalized row before it is quantized
+    std::unique_ptr<float[]> buf;
+    if constexpr (std::is_same<TOut, uint8_t>::value) {
+      buf.reset(new float[N]);
+    }
+    for (const auto i : c10::irange(start, end)) {
+      T* residual_ptr = residual_data + i * N;
+      float sum = kernel::_add_residual_and_compute_sum_of_squares<T>(
+          input_data + i * N, residual_ptr, N);
+      float scale = float(1.0) / std::sqrt(sum / N + eps);
+      if constexpr (std::is_same<TOut, uint8_t>::value) {
+        kernel::_compute_rmsnorm_quantized<T, T1>(
+            residual_ptr,
+            N,
+            scale,
+            gamma_data,
+            buf.get(),
+            output_data + i * N,
+            scales.data_ptr<float>() + i,
+            zero_points.data_ptr<int32_t>() + i);
+      } else {
+        kernel::_normalize_rmsnorm<T, T1, TOut>(
+            residual_ptr, N, scale, gamma_data, output_data + i * N);
+      }
+    }
+  });
+}
 #endif
 
 at::Tensor rmsnorm_kernel_impl(
@@ -74,8 +119,73 @@ at::Tensor rmsnorm_kernel_impl(
 #endif
 }
 
+void add_rmsnorm_kernel_impl(
+    const at::Tensor& input,
+    at::Tensor& residual,
+    const at::Tensor& b,
+    float eps,
+    at::Tensor& output,
+    at::Tensor& scales,
+    at::Tensor& zero_points) {
+  const int64_t N = residual.size(-1);
+  const int64_t M = residual.numel() / N;
+#if defined(CPU_CAPABILITY_AVX512)
+  auto X = input.contiguous();
+  auto dispatch_output = [&](auto residual_dtype, auto gamma_dtype) {
+    using T = decltype(residual_dtype);
+    using T1 = decltype(gamma_dtype);
+    if (output.scalar_type() == at::kByte) {
+      AddRMSNormKernelImpl<T, T1, uint8_t>(
+          X, residual, b, M, N, eps, output, scales, zero_points);
+    } else if (output.scalar_type() == at::kBFloat16) {
+      AddRMSNormKernelImpl<T, T1, at::BFloat16>(
+          X, residual, b, M, N, eps, output, scales, zero_points);
+    } else {
+      AddRMSNormKernelImpl<T, T1, float>(
+          X, residual, b, M, N, eps, output, scales, zero_points);
+    }
+  };
+  if (residual.scalar_type() == at::ScalarType::Float) {
+    dispatch_output(float(), float());
+  } else if (
+      residual.scalar_type() == at::ScalarType::BFloat16 &&
+      b.scalar_type() == at::ScalarType::Float) {
+    dispatch_output(at::BFloat16(), float());
+  } else if (
+      residual.scalar_type() == at::ScalarType::BFloat16 &&
+      b.scalar_type() == at::ScalarType::BFloat16) {
+    dispatch_output(at::BFloat16(), at::BFloat16());
+  } else {
+    TORCH_CHECK(false, "Unsupported input type");
+  }
+#else
+  residual.add_(input);
+  auto residual1 = residual.to(at::kFloat);
+  auto variance = at::mean(at::pow(residual1, 2), -1, true);
+  auto hidden_states =
+      at::mul(b, at::mul(residual1, at::rsqrt(at::add(variance, eps))));
+  if (output.scalar_type() == at::kByte) {
+    auto rows = hidden_states.view({M, N});
+    auto zeros = at::zeros({M}, rows.options());
+    auto min = at::minimum(std::get<0>(rows.min(-1)), zeros);
+    auto max = at::maximum(std::get<0>(rows.max(-1)), zeros);
+    auto q_scales = (max - min) / 255.0f;
+    q_scales.masked_fill_(q_scales == 0, 1.0f);
+    auto q_zps = -at::round(min / q_scales);
+    auto q = at::clamp(
+        at::round(rows / q_scales.unsqueeze(1)) + q_zps.unsqueeze(1), 0, 255);
+    output.copy_(q.view(output.sizes()));
+    scales.copy_(q_scales);
+    zero_points.copy_(q_zps);
+  } else {
+    output.copy_(hidden_states);
+  }
+#endif
+}
+
 } // namespace
 
 REGISTER_DISPATCH(rmsnorm_kernel_stub, &rmsnorm_kernel_impl);
+REGISTER_DISPATCH(add_rmsnorm_kernel_stub, &add_rmsnorm_kernel_impl);
 } // namespace cpu
 } // namespace torch_ipex
@@ -1,5 +1,6 @@
 #include <ATen/Tensor.h>
 #include <aten/RotaryPositionEmbedding.h>
+#include <aten/utils/rope.h>
 #include <torch/all.h>
 #include <torch/csrc/autograd/function.h>
 #include "vec/vec.h"
@@ -9,165 +10,6 @@ namespace cpu {
 
 namespace {
 
-template <typename T_in, typename T_emb>
-void apply_rope_along_head(
-    T_in* in_ptr_start,
-    T_emb* cos_start,
-    T_emb* sin_start,
-    int64_t rotary_ndims,
-    int64_t offset) {
-  for (int h = 0; h < rotary_ndims / 2;
-       h++) { // used by lamma, ToDo:vectorization
-    float in0 = in_ptr_start[h];
-    float in1 = in_ptr_start[h + offset];
-    float sin = sin_start[h];
-    float cos = cos_start[h];
-    float out0 = in0 * cos - in1 * sin;
-    float out1 = in1 * cos + in0 * sin;
-    in_ptr_start[h] = out0;
-    in_ptr_start[h + offset] = out1;
-  }
-}
-
-template <>
-void apply_rope_along_head(
-    at::BFloat16* in_ptr_start,
-    float* cos_start,
-    float* sin_start,
-    int64_t rotary_ndims,
-    int64_t offset) {
-  auto vec_size = 16;
-  auto h = 0;
-#if defined(CPU_CAPABILITY_AVX512)
-  for (h = 0; h <= rotary_ndims / 2 - vec_size; h += vec_size) {
-    auto in0 = torch_ipex::cpu::kernel::convert_bf16_to_fp32(
-        _mm256_loadu_si256((__m256i*)(in_ptr_start + h)));
-    auto in1 = torch_ipex::cpu::kernel::convert_bf16_to_fp32(
-        _mm256_loadu_si256((__m256i*)(in_ptr_start + h + offset)));
-    auto sin = _mm512_loadu_ps(sin_start + h);
-    auto cos = _mm512_loadu_ps(cos_start + h);
-    auto out0 = _mm512_sub_ps(_mm512_mul_ps(in0, cos), _mm512_mul_ps(in1, sin));
-    auto out1 = _mm512_add_ps(_mm512_mul_ps(in1, cos), _mm512_mul_ps(in0, sin));
-    _mm256_storeu_si256((__m256i*)(in_ptr_start + h), cvt_fp32_to_bf16(out0));
-    _mm256_storeu_si256(
-        (__m256i*)(in_ptr_start + h + offset), cvt_fp32_to_bf16(out1));
-  }
-  for (; h < rotary_ndims / 2; h++) {
-    float in0 = in_ptr_start[h];
-    float in1 = in_ptr_start[h + offset];
-    float sin = sin_start[h];
-    float cos = cos_start[h];
-    float out0 = in0 * cos - in1 * sin;
-    float out1 = in1 * cos + in0 * sin;
-    in_ptr_start[h] = out0;
-    in_ptr_start[h + offset] = out1;
-  }
-#else
-  for (h = 0; h < rotary_ndims / 2; h++) {
-    float in0 = in_ptr_start[h];
-    float in1 = in_ptr_start[h + offset];
-    float sin = sin_start[h];
-    float cos = cos_start[h];
-    float out0 = in0 * cos - in1 * sin;
-    float out1 = in1 * cos + in0 * sin;
-    in_ptr_start[h] = out0;
-    in_ptr_start[h + offset] = out1;
-  }
-#endif
-}
-
-template <>
-void apply_rope_along_head(
-    at::BFloat16* in_ptr_start,
-    at::BFloat16* cos_start,
-    at::BFloat16* sin_start,
-    int64_t rotary_ndims,
-    int64_t offset) {
-  auto vec_size = 16;
-  auto h = 0;
-#if defined(CPU_CAPABILITY_AVX512)
-  for (h = 0; h <= rotary_ndims / 2 - vec_size; h += vec_size) {
-    auto in0 = torch_ipex::cpu::kernel::convert_bf16_to_fp32(
-        _mm256_loadu_si256((__m256i*)(in_ptr_start + h)));
-    auto in1 = torch_ipex::cpu::kernel::convert_bf16_to_fp32(
-        _mm256_loadu_si256((__m256i*)(in_ptr_start + h + offset)));
-    auto sin = torch_ipex::cpu::kernel::convert_bf16_to_fp32(
-        _mm256_loadu_si256((__m256i*)(sin_start + h)));
-    auto cos = torch_ipex::cpu::kernel::convert_bf16_to_fp32(
-        _mm256_loadu_si256((__m256i*)(cos_start + h)));
-    auto out0 = _mm512_sub_ps(_mm512_mul_ps(in0, cos), _mm512_mul_ps(in1, sin));
-    auto out1 = _mm512_add_ps(_mm512_mul_ps(in1, cos), _mm512_mul_ps(in0, sin));
-    _mm256_storeu_si256((__m256i*)(in_ptr_start + h), cvt_fp32_to_bf16(out0));
-    _mm256_storeu_si256(
-        (__m256i*)(in_ptr_start + h + offset), cvt_fp32_to_bf16(out1));
-  }
-  for (; h < rotary_ndims / 2; h++) {
-    float in0 = in_ptr_start[h];
-    float in1 = in_ptr_start[h + offset];
-    float sin = sin_start[h];
-    float cos = cos_start[h];
-    float out0 = in0 * cos - in1 * sin;
-    float out1 = in1 * cos + in0 * sin;
-    in_ptr_start[h] = out0;
-    in_ptr_start[h + offset] = out1;
-  }
-#else
-  for (h = 0; h < rotary_ndims / 2; h++) {
-    float in0 = in_ptr_start[h];
-    float in1 = in_ptr_start[h + offset];
-    float sin = sin_start[h];
-    float cos = cos_start[h];
-    float out0 = in0 * cos - in1 * sin;
-    float out1 = in1 * cos + in0 * sin;
-    in_ptr_start[h] = out0;
-    in_ptr_start[h + offset] = out1;
-  }
-#endif
-}
-
-template <>
-void apply_rope_along_head(
-    float* in_ptr_start,
-    float* cos_start,
-    float* sin_start,
-    int64_t rotary_ndims,
-    int64_t offset) {
-  auto vec_size = 16;
-  auto h = 0;
-#if defined(CPU_CAPABILITY_AVX512)
-  for (h = 0; h <= rotary_ndims / 2 - vec_size; h += vec_size) {
-    auto in0 = _mm512_loadu_ps(in_ptr_start + h);
-    auto in1 = _mm512_loadu_ps(in_ptr_start + h + offset);
-    auto sin = _mm512_loadu_ps(sin_start + h);
-    auto cos = _mm512_loadu_ps(cos_start + h);
-    auto out0 = _mm512_sub_ps(_mm512_mul_ps(in0, cos), _mm512_mul_ps(in1, sin));
-    auto out1 = _mm512_add_ps(_mm512_mul_ps(in1, cos), _mm512_mul_ps(in0, sin));
-    _mm512_storeu_ps(in_ptr_start + h, out0);
-    _mm512_storeu_ps(in_ptr_start + h + offset, out1);
-  }
-  for (; h < rotary_ndims / 2; h++) {
-    float in0 = in_ptr_start[h];
-    float in1 = in_ptr_start[h + offset];
-    float sin = sin_start[h];
-    float cos = cos_start[h];
-    float out0 = in0 * cos - in1 * sin;
-    float out1 = in1 * cos + in0 * sin;
-    in_ptr_start[h] = out0;
-    in_ptr_start[h + offset] = out1;
-  }
-#else
-  for (h = 0; h < rotary_ndims / 2; h++) {
-    float in0 = in_ptr_start[h];
-    float in1 = in_ptr_start[h + offset];
-    float sin = sin_start[h];
-    float cos = cos_start[h];
-    float out0 = in0 * cos - in1 * sin;
-    float out1 = in1 * cos + in0 * sin;
-    in_ptr_start[h] = out0;
-    in_ptr_start[h + offset] = out1;
-  }
-#endif
-}
 template <typename T>
 void ApplyROPEKernel(
     at::Tensor& t_in,
@@ -178,11 +20,9 @@ void ApplyROPEKernel(
     int64_t offset,
     int64_t rotary_ndims) {
   auto in_sizes = t_in.sizes(); // in[B][S][F]
-  auto MP = t_emb_pos.size(0); // Max Pos
   auto HR = t_emb_pos.size(1); // rotary_dim
   auto B = in_sizes[0];
   auto S = in_sizes[1];
-  auto COFF = HR / 2;
   t_in = t_in.contiguous();
   t_emb_pos = t_emb_pos.contiguous();
   t_pos = t_pos.contiguous();
@@ -191,41 +31,78 @@ void ApplyROPEKernel(
   auto in_stride_s = N * H;
   auto emb_pos_ptr = t_emb_pos.data_ptr<float>(); // [MP][HR]
   auto pos_ptr = t_pos.data_ptr<long>(); // [MB][S]
+  auto pos_numel = t_pos.numel();
   {
 #pragma omp parallel for collapse(3)
     for (int b = 0; b < B; b++) {
       for (int s = 0; s < S; s++) {
         for (int n = 0; n < N; n++) {
-          if (1 == offset) { // used by GPT-J 6B
-            for (int h = 0, h2 = 0; h < HR; h += 2, h2++) {
-              auto in_offset = b * in_stride_b + s * in_stride_s + n * H + h;
-              float in0 = in_ptr[in_offset];
-              float in1 = in_ptr[in_offset + 1];
-              long p = pos_ptr[b * S + s];
-              float sin = emb_pos_ptr[p * HR + h2];
-              float cos = emb_pos_ptr[p * HR + COFF + h2];
-              float out0 = in0 * cos - in1 * sin;
-              float out1 = in1 * cos + in0 * sin;
-              in_ptr[in_offset] = out0;
-              in_ptr[in_offset + 1] = out1;
-            }
-          } else if (t_pos.numel() == 1) { // used by Falcon
-            auto in_ptr_start =
-                in_ptr + b * in_stride_b + s * in_stride_s + n * H;
-            long p = pos_ptr[0];
-            auto sin_start = emb_pos_ptr + (p + s) * HR;
-            auto cos_start = emb_pos_ptr + (p + s) * HR + COFF;
-            apply_rope_along_head<T, float>(
-                in_ptr_start, cos_start, sin_start, rotary_ndims, offset);
+          auto in_ptr_start =
+              in_ptr + b * in_stride_b + s * in_stride_s + n * H;
+          long p = get_rope_position(pos_ptr, pos_numel, offset, b, S, s);
+          apply_rope_on_head<T>(
+              in_ptr_start, emb_pos_ptr, p, HR, offset, rotary_ndims);
+        }
+      }
+    }
+  }
+}
+
+// Apply the rotary embedding to query and key in one launch instead of one
+// launch per tensor. The heads are read from the (possibly strided) outputs of
+// the QKV projection, e.g. the views of a concat QKV linear, and written
+// rotated to new contiguous outputs, which replaces the contiguous copies of
+// the two in-place launches. This is the path of the projections which are not
+// TPP GEMMs; with the fused TPP weight, tpp_linear_qkv_rope rotates the heads
+// in the epilogue of the QKV GEMM instead.
+template <typename T>
+void ApplyROPEQKKernel(
+    at::Tensor& t_q,
+    at::Tensor& t_k,
+    at::Tensor& t_q_out,
+    at::Tensor& t_k_out,
+    at::Tensor& t_emb_pos,
+    at::Tensor& t_pos,
+    int64_t N, // N: number of query head, KVN: number of key head
+    int64_t KVN,
+    int64_t H,
+    int64_t offset,
+    int64_t rotary_ndims) {
+  auto B = t_q.size(0);
+  auto S = t_q.size(1);
+  auto HR = t_emb_pos.size(1); // rotary_dim
+  t_emb_pos = t_emb_pos.contiguous();
+  t_pos = t_pos.contiguous();
+  auto q_ptr = t_q.data_ptr<T>(); // [B][S][N][H], strided along B and S
+  auto k_ptr = t_k.data_ptr<T>(); // [B][S][KVN][H], strided along B and S
+  auto q_out_ptr = t_q_out.data_ptr<T>();
+  auto k_out_ptr = t_k_out.data_ptr<T>();
+  auto q_stride_b = t_q.stride(0);
+  auto q_stride_s = t_q.stride(1);
+  auto k_stride_b = t_k.stride(0);
+  auto k_stride_s = t_k.stride(1);
+  auto emb_pos_ptr = t_emb_pos.data_ptr<float>(); // [MP][HR]
+  auto pos_ptr = t_pos.data_ptr<long>(); // [MB][S]
+  auto pos_numel = t_pos.numel();
+  {
+#pragma omp parallel for collapse(3)
+    for (int b = 0; b < B; b++) {
+      for (int s = 0; s < S; s++) {
+        for (int n = 0; n < N + KVN; n++) {
+          T* in_ptr_start;
+          T* out_ptr_start;
+          if (n < N) {
+            in_ptr_start = q_ptr + b * q_stride_b + s * q_stride_s + n * H;
+            out_ptr_start = q_out_ptr + ((b * S + s) * N + n) * H;
           } else {
-            auto in_ptr_start =
-                in_ptr + b * in_stride_b + s * in_stride_s + n * H;
-            long p = pos_ptr[b * S + s];
-            auto sin_start = emb_pos_ptr + p * HR;
-            auto cos_start = emb_pos_ptr + p * HR + COFF;
-            apply_rope_along_head<T, float>(
-                in_ptr_start, cos_start, sin_start, rotary_ndims, offset);
+            in_ptr_start =
+                k_ptr + b * k_stride_b + s * k_stride_s + (n - N) * H;
+            out_ptr_start = k_out_ptr + ((b * S + s) * KVN + n - N) * H;
           }
+          std::memcpy(out_ptr_start, in_ptr_start, H * sizeof(T));
+          long p = get_rope_position(pos_ptr, pos_numel, offset, b, S, s);
+          apply_rope_on_head<T>(
+              out_ptr_start, emb_pos_ptr, p, HR, offset, rotary_ndims);
         }
       }
     }
@@ -253,11 +130,83 @@ void rotary_position_embedding_kernel_impl(
   }
 }
 
+std::tuple<at::Tensor, at::Tensor> rotary_position_embedding_qk_kernel_impl(
+    at::Tensor& t_q,
+    at::Tensor& t_k,
+    at::Tensor& t_emb_pos,
+    at::Tensor& t_pos,
+    int64_t N, // N: number of query head, KVN: number of key head
+    int64_t KVN,
+    int64_t H,
+    int64_t offset,
+    int64_t rotary_ndims) {
+  // the heads are read in place, only the batch and sequence dims can be
+  // strided
+  if (t_q.stride(3) != 1 || t_q.stride(2) != H) {
+    t_q = t_q.contiguous();
+  }
+  if (t_k.stride(3) != 1 || t_k.stride(2) != H) {
+    t_k = t_k.contiguous();
+  }
+  auto t_q_out = at::empty({t_q.size(0), t_q.size(1), N, H}, t_q.options());
+  auto t_k_out = at::empty({t_k.size(0), t_k.size(1), KVN, H}, t_k.options());
+  if (t_q.scalar_type() == at::kFloat) {
+    ApplyROPEQKKernel<float>(
+        t_q,
+        t_k,
+        t_q_out,
+        t_k_out,
+        t_emb_pos,
+        t_pos,
+        N,
+        KVN,
+        H,
+        offset,
+        rotary_ndims);
+  } else if (t_q.scalar_type() == at::kBFloat16) {
+    ApplyROPEQKKernel<at::BFloat16>(
+        t_q,
+        t_k,
+        t_q_out,
+        t_k_out,
+        t_emb_pos,
+        t_pos,
+        N,
+        KVN,
+        H,
+        offset,
+        rotary_ndims);
+  } else if (t_q.scalar_type() == at::kHalf) {
+    ApplyROPEQKKernel<at::Half>(
+        t_q,
+        t_k,
+        t_q_out,
+        t_k_out,
+        t_emb_pos,
+        t_pos,
+        N,
+        KVN,
+        H,
+        offset,
+        rotary_ndims);
+  } else {
+    TORCH_CHECK(
+        false,
+        "rotary_position_embedding_qk: unsupported data type ",
+        t_q.scalar_type());
+  }
+  return std::make_tuple(t_q_out, t_k_out);
+}
+
 } // anonymous namespace
 
 REGISTER_DISPATCH(
     rotary_position_embedding_kernel_stub,
     &rotary_position_embedding_kernel_impl);
 
+REGISTER_DISPATCH(
+    rotary_position_embedding_qk_kernel_stub,
+    &rotary_position_embedding_qk_kernel_impl);
+
 } // namespace cpu
 } // namespace torch_ipex
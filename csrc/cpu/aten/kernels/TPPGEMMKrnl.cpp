@@ -24,9 +24,21 @@ at::Tensor tpp_linear_bias_kernel_impl(
   auto t_out = t_in.new_empty(sizes);
   auto dt = t_wt.dtype();
   if (dt == at::kFloat) {
-    torch_ipex::tpp::tpp_linear_bias<float>(t_in, t_wt, t_bias, t_out);
+    torch_ipex::tpp::tpp_gemm_tuned<float>(
+        t_in,
+        t_wt,
+        [&](const torch_ipex::tpp::GemmTuneConfig& cfg) {
+          torch_ipex::tpp::tpp_linear_bias<float>(
+              t_in, t_wt, t_bias, t_out, cfg);
+        });
   } else if (dt == at::kBFloat16) {
-    torch_ipex::tpp::tpp_linear_bias<at::BFloat16>(t_in, t_wt, t_bias, t_out);
+    torch_ipex::tpp::tpp_gemm_tuned<at::BFloat16>(
+        t_in,
+        t_wt,
+        [&](const torch_ipex::tpp::GemmTuneConfig& cfg) {
+          torch_ipex::tpp::tpp_linear_bias<at::BFloat16>(
+              t_in, t_wt, t_bias, t_out, cfg);
+        });
   } else {
     AT_ASSERT(
         0,
@@ -47,9 +59,20 @@ at::Tensor tpp_linear_nobias_kernel_impl(at::Tensor& t_in, at::Tensor& t_wt) {
 
   auto dt = t_wt.dtype();
   if (dt == at::kFloat) {
-    torch_ipex::tpp::tpp_linear_no_bias<float>(t_in, t_wt, t_out);
+    torch_ipex::tpp::tpp_gemm_tuned<float>(
+        t_in,
+        t_wt,
+        [&](const torch_ipex::tpp::GemmTuneConfig& cfg) {
+          torch_ipex::tpp::tpp_linear_no_bias<float>(t_in, t_wt, t_out, cfg);
+        });
   } else if (dt == at::kBFloat16) {
-    torch_ipex::tpp::tpp_linear_no_bias<at::BFloat16>(t_in, t_wt, t_out);
+    torch_ipex::tpp::tpp_gemm_tuned<at::BFloat16>(
+        t_in,
+        t_wt,
+        [&](const torch_ipex::tpp::GemmTuneConfig& cfg) {
+          torch_ipex::tpp::tpp_linear_no_bias<at::BFloat16>(
+              t_in, t_wt, t_out, cfg);
+        });
   } else {
     AT_ASSERT(
         0,
@@ -72,9 +95,21 @@ at::Tensor tpp_linear_gelu_kernel_impl(
 
   auto dt = t_wt.dtype();
   if (dt == at::kFloat) {
-    torch_ipex::tpp::tpp_linear_gelu<float>(t_in, t_wt, t_bias, t_out);
+    torch_ipex::tpp::tpp_gemm_tuned<float>(
+        t_in,
+        t_wt,
+        [&](const torch_ipex::tpp::GemmTuneConfig& cfg) {
+          torch_ipex::tpp::tpp_linear_gelu<float>(
+              t_in, t_wt, t_bias, t_out, cfg);
+        });
   } else if (dt == at::kBFloat16) {
-    torch_ipex::tpp::tpp_linear_gelu<at::BFloat16>(t_in, t_wt, t_bias, t_out);
+    torch_ipex::tpp::tpp_gemm_tuned<at::BFloat16>(
+        t_in,
+        t_wt,
+        [&](const torch_ipex::tpp::GemmTuneConfig& cfg) {
+          torch_ipex::tpp::tpp_linear_gelu<at::BFloat16>(
+              t_in, t_wt, t_bias, t_out, cfg);
+        });
   } else {
     AT_ASSERT(
         0,
@@ -85,6 +120,122 @@ at::Tensor tpp_linear_gelu_kernel_impl(
   return t_out;
 }
 
+at::Tensor tpp_linear_silu_mul_kernel_impl(
+    at::Tensor& t_in,
+    at::Tensor& t_wt,
+    at::Tensor& t_bias) {
+  auto sizes = t_in.sizes().vec();
+  auto wt_sizes = t_wt.sizes();
+  // the gate and up weights are interleaved along dim 0
+  sizes[2] = wt_sizes[0] / 2 * wt_sizes[3];
+
+  auto t_out = t_in.new_empty(sizes);
+
+  auto dt = t_wt.dtype();
+  if (dt == at::kFloat) {
+    torch_ipex::tpp::tpp_gemm_tuned<float>(
+        t_in,
+        t_wt,
+        [&](const torch_ipex::tpp::GemmTuneConfig& cfg) {
+          torch_ipex::tpp::tpp_linear_silu_mul<float>(
+              t_in, t_wt, t_bias, t_out, cfg);
+        },
+        false);
+  } else if (dt == at::kBFloat16) {
+    torch_ipex::tpp::tpp_gemm_tuned<at::BFloat16>(
+        t_in,
+        t_wt,
+        [&](const torch_ipex::tpp::GemmTuneConfig& cfg) {
+          torch_ipex::tpp::tpp_linear_silu_mul<at::BFloat16>(
+              t_in, t_wt, t_bias, t_out, cfg);
+        },
+        false);
+  } else {
+    AT_ASSERT(
+        0,
+        "TPP does not support current weight dtype %s:%d\n",
+        __FILE__,
+        __LINE__);
+  }
+  return t_out;
+}
+
+at::Tensor tpp_linear_qkv_rope_kernel_impl(
+    at::Tensor& t_in,
+    at::Tensor& t_wt,
+    at::Tensor& t_bias,
+    at::Tensor& t_emb_pos,
+    at::Tensor& t_pos,
+    at::Tensor& t_key,
+    at::Tensor& t_value,
+    int64_t num_head,
+    int64_t num_kv_head,
+    int64_t head_dim,
+    int64_t offset,
+    int64_t rotary_ndims) {
+  auto t_query =
+      t_in.new_empty({t_in.size(0), t_in.size(1), num_head, head_dim});
+  t_emb_pos = t_emb_pos.contiguous();
+  t_pos = t_pos.contiguous();
+  // the first token weight reorder merges two output blocks, which keeps the
+  // blocks of a head together only if a head holds an even number of them
+  auto can_merge_wt = head_dim % (2 * t_wt.size(3)) == 0;
+
+  auto dt = t_wt.dtype();
+  if (dt == at::kFloat) {
+    torch_ipex::tpp::tpp_gemm_tuned<float>(
+        t_in,
+        t_wt,
+        [&](const torch_ipex::tpp::GemmTuneConfig& cfg) {
+          torch_ipex::tpp::tpp_linear_qkv_rope<float>(
+              t_in,
+              t_wt,
+              t_bias,
+              t_emb_pos,
+              t_pos,
+              t_query,
+              t_key,
+              t_value,
+              num_head,
+              num_kv_head,
+              head_dim,
+              offset,
+              rotary_ndims,
+              cfg);
+        },
+        can_merge_wt);
+  } else if (dt == at::kBFloat16) {
+    torch_ipex::tpp::tpp_gemm_tuned<at::BFloat16>(
+        t_in,
+        t_wt,
+        [&](const torch_ipex::tpp::GemmTuneConfig& cfg) {
+          torch_ipex::tpp::tpp_linear_qkv_rope<at::BFloat16>(
+              t_in,
+              t_wt,
+              t_bias,
+              t_emb_pos,
+              t_pos,
+              t_query,
+              t_key,
+              t_value,
+              num_head,
+              num_kv_head,
+              head_dim,
+              offset,
+              rotary_ndims,
+              cfg);
+        },
+        can_merge_wt);
+  } else {
+    AT_ASSERT(
+        0,
+        "TPP does not support current weight dtype %s:%d\n",
+        __FILE__,
+        __LINE__);
+  }
+  return t_query;
+}
+
 at::Tensor tpp_linear_silu_kernel_impl(
     at::Tensor& t_in,
     at::Tensor& t_wt,
@@ -97,9 +248,21 @@ at::Tensor tpp_linear_silu_kernel_impl(
 
   auto dt = t_wt.dtype();
   if (dt == at::kFloat) {
-    torch_ipex::tpp::tpp_linear_silu<float>(t_in, t_wt, t_bias, t_out);
+    torch_ipex::tpp::tpp_gemm_tuned<float>(
+        t_in,
+        t_wt,
+        [&](const torch_ipex::tpp::GemmTuneConfig& cfg) {
+          torch_ipex::tpp::tpp_linear_silu<float>(
+              t_in, t_wt, t_bias, t_out, cfg);
+        });
   } else if (dt == at::kBFloat16) {
-    torch_ipex::tpp::tpp_linear_silu<at::BFloat16>(t_in, t_wt, t_bias, t_out);
+    torch_ipex::tpp::tpp_gemm_tuned<at::BFloat16>(
+        t_in,
+        t_wt,
+        [&](const torch_ipex::tpp::GemmTuneConfig& cfg) {
+          torch_ipex::tpp::tpp_linear_silu<at::BFloat16>(
+              t_in, t_wt, t_bias, t_out, cfg);
+        });
   } else {
     AT_ASSERT(
         0,
@@ -122,9 +285,21 @@ at::Tensor tpp_linear_relu_kernel_impl(
 
   auto dt = t_wt.dtype();
   if (dt == at::kFloat) {
-    torch_ipex::tpp::tpp_linear_relu<float>(t_in, t_wt, t_bias, t_out);
+    torch_ipex::tpp::tpp_gemm_tuned<float>(
+        t_in,
+        t_wt,
+        [&](const torch_ipex::tpp::GemmTuneConfig& cfg) {
+          torch_ipex::tpp::tpp_linear_relu<float>(
+              t_in, t_wt, t_bias, t_out, cfg);
+        });
   } else if (dt == at::kBFloat16) {
-    torch_ipex::tpp::tpp_linear_relu<at::BFloat16>(t_in, t_wt, t_bias, t_out);
+    torch_ipex::tpp::tpp_gemm_tuned<at::BFloat16>(
+        t_in,
+        t_wt,
+        [&](const torch_ipex::tpp::GemmTuneConfig& cfg) {
+          torch_ipex::tpp::tpp_linear_relu<at::BFloat16>(
+              t_in, t_wt, t_bias, t_out, cfg);
+        });
   } else {
     AT_ASSERT(
         0,
@@ -145,11 +320,21 @@ at::Tensor tpp_linear_add_add_kernel_impl(
   auto t_out = at::empty_like(t_in1);
   auto dt = t_wt.dtype();
   if (dt == at::kFloat) {
-    torch_ipex::tpp::tpp_linear_add_add<float>(
-        t_in, t_in1, t_in2, t_wt, t_bias, t_out, scale);
+    torch_ipex::tpp::tpp_gemm_tuned<float>(
+        t_in,
+        t_wt,
+        [&](const torch_ipex::tpp::GemmTuneConfig& cfg) {
+          torch_ipex::tpp::tpp_linear_add_add<float>(
+              t_in, t_in1, t_in2, t_wt, t_bias, t_out, scale, cfg);
+        });
   } else if (dt == at::kBFloat16) {
-    torch_ipex::tpp::tpp_linear_add_add<at::BFloat16>(
-        t_in, t_in1, t_in2, t_wt, t_bias, t_out, scale);
+    torch_ipex::tpp::tpp_gemm_tuned<at::BFloat16>(
+        t_in,
+        t_wt,
+        [&](const torch_ipex::tpp::GemmTuneConfig& cfg) {
+          torch_ipex::tpp::tpp_linear_add_add<at::BFloat16>(
+              t_in, t_in1, t_in2, t_wt, t_bias, t_out, scale, cfg);
+        });
   } else {
     AT_ASSERT(
         0,
@@ -169,11 +354,21 @@ at::Tensor tpp_linear_add_kernel_impl(
   auto t_out = at::empty_like(t_in1);
   auto dt = t_wt.dtype();
   if (dt == at::kFloat) {
-    torch_ipex::tpp::tpp_linear_add<float>(
-        t_in, t_in1, t_wt, t_bias, t_out, scale);
+    torch_ipex::tpp::tpp_gemm_tuned<float>(
+        t_in,
+        t_wt,
+        [&](const torch_ipex::tpp::GemmTuneConfig& cfg) {
+          torch_ipex::tpp::tpp_linear_add<float>(
+              t_in, t_in1, t_wt, t_bias, t_out, scale, cfg);
+        });
   } else if (dt == at::kBFloat16) {
-    torch_ipex::tpp::tpp_linear_add<at::BFloat16>(
-        t_in, t_in1, t_wt, t_bias, t_out, scale);
+    torch_ipex::tpp::tpp_gemm_tuned<at::BFloat16>(
+        t_in,
+        t_wt,
+        [&](const torch_ipex::tpp::GemmTuneConfig& cfg) {
+          torch_ipex::tpp::tpp_linear_add<at::BFloat16>(
+              t_in, t_in1, t_wt, t_bias, t_out, scale, cfg);
+        });
   } else {
     AT_ASSERT(
         0,
@@ -192,10 +387,21 @@ at::Tensor tpp_linear_mul_kernel_impl(
   auto t_out = at::empty_like(t_in1);
   auto dt = t_wt.dtype();
   if (dt == at::kFloat) {
-    torch_ipex::tpp::tpp_linear_mul<float>(t_in, t_in1, t_wt, t_bias, t_out);
+    torch_ipex::tpp::tpp_gemm_tuned<float>(
+        t_in,
+        t_wt,
+        [&](const torch_ipex::tpp::GemmTuneConfig& cfg) {
+          torch_ipex::tpp::tpp_linear_mul<float>(
+              t_in, t_in1, t_wt, t_bias, t_out, cfg);
+        });
   } else if (dt == at::kBFloat16) {
-    torch_ipex::tpp::tpp_linear_mul<at::BFloat16>(
-        t_in, t_in1, t_wt, t_bias, t_out);
+    torch_ipex::tpp::tpp_gemm_tuned<at::BFloat16>(
+        t_in,
+        t_wt,
+        [&](const torch_ipex::tpp::GemmTuneConfig& cfg) {
+          torch_ipex::tpp::tpp_linear_mul<at::BFloat16>(
+              t_in, t_in1, t_wt, t_bias, t_out, cfg);
+        });
   } else {
     AT_ASSERT(
         0,
@@ -215,6 +421,12 @@ REGISTER_DISPATCH(tpp_linear_bias_kernel_stub, &tpp_linear_bias_kernel_impl);
 REGISTER_DISPATCH(tpp_linear_gelu_kernel_stub, &tpp_linear_gelu_kernel_impl);
 REGISTER_DISPATCH(tpp_linear_relu_kernel_stub, &tpp_linear_relu_kernel_impl);
 REGISTER_DISPATCH(tpp_linear_silu_kernel_stub, &tpp_linear_silu_kernel_impl);
+REGISTER_DISPATCH(
+    tpp_linear_silu_mul_kernel_stub,
+    &tpp_linear_silu_mul_kernel_impl);
+REGISTER_DISPATCH(
+    tpp_linear_qkv_rope_kernel_stub,
+    &tpp_linear_qkv_rope_kernel_impl);
 REGISTER_DISPATCH(tpp_linear_mul_kernel_stub, &tpp_linear_mul_kernel_impl);
 REGISTER_DISPATCH(tpp_linear_add_kernel_stub, &tpp_linear_add_kernel_impl);
 REGISTER_DISPATCH(
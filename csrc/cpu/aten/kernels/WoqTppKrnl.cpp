@@ -5,6 +5,7 @@
 #include <ATen/cpu/vec/functional.h>
 #include <ATen/cpu/vec/vec.h>
 #include <aten/Linear.h>
+#include "csrc/cpu/tpp/weight_prefetch.h"
 #include "csrc/cpu/tpp/woq/tla.h"
 
 #ifdef __GNUC__
@@ -21,6 +22,15 @@ namespace {
 using namespace tpp;
 using TensorList = std::vector<at::Tensor>;
 
+#define LOWP_MODE_NONE 0
+#define LOWP_MODE_FP16 1
+#define LOWP_MODE_BF16 2
+#define LOWP_MODE_INT8 3
+
+constexpr int get_n_group_size(int N) {
+  return N == 16 ? 16 : (N == 32 ? 32 : 64);
+}
+
 // We only build optimized kernels if AVX512_FP16 is supported and gcc>=12.3
 // Otherwise we just return empty results
 // TODO(Weiwen) Merge WoqTppKrnl.cpp and WoqLinearKrnl.cpp and put the latter in
@@ -29,8 +39,38 @@ using TensorList = std::vector<at::Tensor>;
 
 #define SMALL_BATCH_THRESHOLD 32
 #define PARALLEL_M_THRESHOLD 128
-constexpr long PREFETCH_K_DIST = 64; // TODO(jgong5): do not hard-code
+// The bytes of B to prefetch ahead of the current row, enough to cover the
+// DRAM latency of a core streaming the weight.
+constexpr long PREFETCH_K_BYTES = 4096;
 constexpr long LOOP_K_UNROLL = 4; // TODO(jgong5): do not hard-code
+// The least K a split of split-K covers, so that the reduction of the partial
+// outputs stays cheap compared with the GEMM.
+constexpr long K_SPLIT_MIN_K = 256;
+
+// A scratch kept per thread which only grows, so that the GEMMs of the layers
+// of a model reuse it instead of allocating it on every call. The scratches of
+// different uses have different ids.
+template <int kScratchId>
+inline void* get_thread_scratch(size_t bytes) {
+  thread_local std::unique_ptr<void, decltype(&std::free)> scratch(
+      nullptr, &std::free);
+  thread_local size_t scratch_bytes = 0;
+  if (bytes > scratch_bytes) {
+    scratch_bytes = (bytes + 63) / 64 * 64;
+    scratch.reset(std::aligned_alloc(64, scratch_bytes));
+  }
+  return scratch.get();
+}
+
+// The partial outputs of split-K, kept by the calling thread
+inline void* get_split_k_scratch(size_t bytes) {
+  return get_thread_scratch<0>(bytes);
+}
+
+// The int8 weight unpacked from an int4 weight, kept by each worker thread
+inline void* get_unpacked_weight_scratch(size_t bytes) {
+  return get_thread_scratch<1>(bytes);
+}
 
 #define UNQUANT_A -1
 #define QUANT_A_PER_TENSOR 0
@@ -380,10 +420,6 @@ struct load_dequant_int8 {
   }
 };
 
-constexpr int get_n_group_size(int N) {
-  return N == 16 ? 16 : (N == 32 ? 32 : 64);
-}
-
 // TODO(jgong5): move to tpp.h
 // TODO(jgong5): add pre/post op fusion
 template <
@@ -1323,7 +1359,9 @@ class DequantGemmTPP<
       bool no_tile_cfg = true,
       float* scale_a = nullptr,
       int32_t* zp_a = nullptr,
-      int32_t k_groups = -1) {
+      int32_t k_groups = -1,
+      int8_t* unpacked_B = nullptr,
+      int32_t* unpacked_compensation = nullptr) {
     auto qA = GetVLAPtr<uint8_t>(A, {lda});
 #ifdef __AVX512VNNI__
     if (M < SMALL_BATCH_THRESHOLD) {
@@ -1406,13 +1444,21 @@ class DequantGemmTPP<
 #endif
     {
       constexpr const int N_GROUP_SIZE = 16;
-      int8_t B[K / 4][N][4];
+      int8_t B_buf[K / 4][N][4];
       int32_t qC[M][N];
-      int32_t compensation[N];
-      // TODO(jgong5): add prefetch
-      Dequantize<int8_t, ldb, N_GROUP_SIZE, /*is_int4*/ true>::call(
-          qB, K, N, zps, B[0][0], compensation);
-      (*pgemm)((int8_t*)qA[0], B[0][0], qC[0], 1, no_tile_cfg);
+      int32_t compensation_buf[N];
+      int8_t* B = B_buf[0][0];
+      int32_t* compensation = compensation_buf;
+      if (unpacked_B) {
+        // the tile of qB already unpacked by unpack_int4_to_int8
+        B = unpacked_B;
+        compensation = unpacked_compensation;
+      } else {
+        // TODO(jgong5): add prefetch
+        Dequantize<int8_t, ldb, N_GROUP_SIZE, /*is_int4*/ true>::call(
+            qB, K, N, zps, B, compensation);
+      }
+      (*pgemm)((int8_t*)qA[0], B, qC[0], 1, no_tile_cfg);
       // post-op and convert back to C
       for (long m = 0; m < M; ++m) {
 #pragma omp simd
@@ -1460,9 +1506,46 @@ class DequantGemmTPP<
   long ldc;
 };
 
+/**
+ * @brief Unpack the int4 weight of the K blocks [kc_begin, kc_end) of an N
+ * block to int8 VNNI tiles for the int8 compute, and compute the compensation
+ * of the zero points of each tile.
+ * @param qw int4 weight of the N block in [Kc, Kb, Nb/2], packed for
+ * LOWP_MODE_INT8
+ * @param zps zero points of the N block in [G, Nb] for G groups along K
+ * @param unpacked int8 weight in [Kc, Kb/4, Nb, 4]
+ * @param compensation compensation in [Kc, Nb]
+ */
+template <long ldb>
+void unpack_int4_to_int8(
+    uint8_t* qw,
+    int8_t* zps,
+    long kc_begin,
+    long kc_end,
+    long Kb,
+    long kc_per_group,
+    int8_t* unpacked,
+    int32_t* compensation) {
+  auto pw = GetVLAPtr<uint8_t>(qw, {Kb * ldb / 2});
+  auto pzps = GetVLAPtr<int8_t>(zps, {ldb});
+  auto punpacked = GetVLAPtr<int8_t>(unpacked, {Kb * ldb});
+  auto pcompensation = GetVLAPtr<int32_t>(compensation, {ldb});
+  for (long kc = kc_begin; kc < kc_end; kc++) {
+    Dequantize<int8_t, ldb, /*N_GROUP_SIZE*/ 16, /*is_int4*/ true>::call(
+        pw[kc],
+        Kb,
+        ldb,
+        pzps[kc / kc_per_group],
+        punpacked[kc],
+        pcompensation[kc]);
+  }
+}
+
 #define FUSE_GELU 1
 #define FUSE_ADD 2
 #define FUSE_ADD_ADD 3
+// silu(gate) * up where the weight is the concat of the gate and up weights
+#define FUSE_SILU_MUL 4
 
 // If T != TComp
 //   T -> TComp -> GEMM -> TComp -> bias/PostOp -> Tout
@@ -1505,6 +1588,13 @@ void qlinear_woq_affine_impl(
   TLA_ASSERT(
       num_concats <= 1 || Nc % num_concats == 0,
       "Nc must be a multiple of num_concats");
+  TLA_ASSERT(
+      fusion_type != FUSE_SILU_MUL || num_concats == 2,
+      "FUSE_SILU_MUL requires the gate and up weights as 2 concats");
+  // The N blocks computed by an iteration of the N loop are nc, nc + Nc_loop,
+  // ..., i.e. a gate block and the up block of the same columns for
+  // FUSE_SILU_MUL, so that the post op reads both blocks while they are hot.
+  auto Nc_loop = fusion_type == FUSE_SILU_MUL ? Nc / 2 : Nc;
 
   // select BLOCK_M according to M
   // TODO(jgong5): improve the heuristic
@@ -1520,9 +1610,25 @@ void qlinear_woq_affine_impl(
 
   auto BLOCK_M_rem = M % BLOCK_M;
 
-  // TODO(jgong5): use heuristics to decide k_splits
-  if (k_splits <= 0 || num_concats > 1 || M >= 32 || BLOCK_M_rem) {
+  // Split K when there are too few output blocks to keep the threads busy,
+  // e.g. the k/v projections of GQA at a small batch. The splits are capped so
+  // that every thread computes at most one split of one N block, i.e. the
+  // partial outputs of a thread are the M x Nb block it computes, and the
+  // largest split under the cap is taken since it minimizes the K of the
+  // busiest thread.
+  if (k_splits <= 0) {
     k_splits = 1;
+    long num_threads = omp_get_max_threads();
+    // M is not parallelized below PARALLEL_M_THRESHOLD, see the loop schemes
+    if (M < PARALLEL_M_THRESHOLD) {
+      for (long splits = 2;
+           Nc_loop * splits <= num_threads && K / splits >= K_SPLIT_MIN_K;
+           splits++) {
+        if (Kc % splits == 0) {
+          k_splits = splits;
+        }
+      }
+    }
   }
   TLA_ASSERT(Kc % k_splits == 0, "Kc must be a multiple of k_splits");
   TLA_ASSERT(
@@ -1542,11 +1648,21 @@ void qlinear_woq_affine_impl(
   auto px = GetVLAPtr<T>(x, {Kc, Kb});
   auto pw = GetVLAPtr<uint8_t>(
       (uint8_t*)qw_packed.data_ptr(), {Kc, Kb * (is_int4 ? Nb / 2 : Nb)});
+  auto next_wt = next_weight_to_prefetch(qw_packed, M);
   auto py = GetVLAPtr<Tout>(y, {Nc, Nb}); /*[M, Nc, Nb]*/
   auto py_concat = GetVLAPtr<Tout>(
       y, {M, Nc / num_concats, Nb}); /*[num_concats, M, Nc/num_concats, Nb]*/
-  auto pscales = GetVLAPtr<TScale>(scales, {Nb});
-  auto pzps = GetVLAPtr<TZero>(zps, {Nb});
+  // scales and zps are in [Nc, G, Nb] for G groups along K, G == 1 for
+  // per-channel quantization. Kb divides the group size so that a K block
+  // never crosses groups and the kernels only take the qparams of its group.
+  auto G = std::max<long>(scales.numel() / N, 1);
+  auto group_size = K / G;
+  TLA_ASSERT(
+      K % G == 0 && group_size % Kb == 0,
+      "group size must be a multiple of Kb");
+  auto kc_per_group = group_size / Kb;
+  auto pscales = GetVLAPtr<TScale>(scales, {G, Nb});
+  auto pzps = GetVLAPtr<TZero>(zps, {G, Nb});
   auto pb = GetVLAPtr<TGemmOut>(b, {Nb});
   auto tin0 = others_list.size() > 0 ? others_list[0] : at::Tensor{};
   auto pin0 = GetVLAPtr<Tout>(tin0, {Nc, Nb}); /*[M, Nc, Nb]*/
@@ -1569,16 +1685,44 @@ void qlinear_woq_affine_impl(
   auto gelu_fwd_rem_tpp = GeluFwdTPP<Tout>(BLOCK_M_rem, Nb, ldy, ldy);
   auto add_tpp = AddTPP<Tout>(BLOCK_M, Nb, ldy, ldy);
   auto add_rem_tpp = AddTPP<Tout>(BLOCK_M_rem, Nb, ldy, ldy);
+  auto silu_fwd_tpp = SiLUFwdTPP<Tout>(BLOCK_M, Nb, ldy, Nb);
+  auto silu_fwd_rem_tpp = SiLUFwdTPP<Tout>(BLOCK_M_rem, Nb, ldy, Nb);
+  auto mul_tpp = BinaryTPP(
+      BLOCK_M, /*row*/
+      Nb, /*col*/
+      Nb, /*ldi0*/
+      ldy, /*ldi1*/
+      ldy, /*ldo*/
+      XsmmDtype<Tout>(), /*dt_in0*/
+      XsmmDtype<Tout>(), /*dt_in1*/
+      XsmmDtype<Tout>(), /*dt_out*/
+      XsmmDtype<float>(), /*dt_compute*/
+      LIBXSMM_MELTW_FLAG_BINARY_NONE,
+      LIBXSMM_MELTW_TYPE_BINARY_MUL);
+  auto mul_rem_tpp = BinaryTPP(
+      BLOCK_M_rem, /*row*/
+      Nb, /*col*/
+      Nb, /*ldi0*/
+      ldy, /*ldi1*/
+      ldy, /*ldo*/
+      XsmmDtype<Tout>(), /*dt_in0*/
+      XsmmDtype<Tout>(), /*dt_in1*/
+      XsmmDtype<Tout>(), /*dt_out*/
+      XsmmDtype<float>(), /*dt_compute*/
+      LIBXSMM_MELTW_FLAG_BINARY_NONE,
+      LIBXSMM_MELTW_TYPE_BINARY_MUL);
+  bool with_in0 = fusion_type == FUSE_ADD || fusion_type == FUSE_ADD_ADD;
+  bool with_in1 = fusion_type == FUSE_ADD_ADD;
   auto post_ops_fn = [&](int m, int nc) {
     Tout* y_ptr = num_concats <= 1
         ? (Tout*)py[m][nc]
         : (Tout*)py_concat[nc / (Nc / num_concats)][m][nc % (Nc / num_concats)];
-    Tout* tin0_ptr = fusion_type > 1 ? num_concats <= 1
+    Tout* tin0_ptr = with_in0 ? num_concats <= 1
             ? (Tout*)pin0[m][nc]
             : (Tout*)pin0_concat[nc / (Nc / num_concats)][m]
                                 [nc % (Nc / num_concats)]
                                      : nullptr;
-    Tout* tin1_ptr = fusion_type > 2 ? num_concats <= 1
+    Tout* tin1_ptr = with_in1 ? num_concats <= 1
             ? (Tout*)pin1[m][nc]
             : (Tout*)pin1_concat[nc / (Nc / num_concats)][m]
                                 [nc % (Nc / num_concats)]
@@ -1590,18 +1734,25 @@ void qlinear_woq_affine_impl(
     } else if (fusion_type == FUSE_ADD_ADD) {
       add_tpp(y_ptr, tin0_ptr, y_ptr);
       add_tpp(y_ptr, tin1_ptr, y_ptr);
+    } else if (fusion_type == FUSE_SILU_MUL && nc >= Nc_loop) {
+      // y_ptr is the up block, the result goes to the gate block so that
+      // the first concat of y holds silu(gate) * up
+      Tout* gate_ptr = (Tout*)py_concat[0][m][nc - Nc_loop];
+      alignas(64) Tout gate_buf[BLOCK_M * Nb];
+      silu_fwd_tpp(gate_ptr, gate_buf);
+      mul_tpp(gate_buf, y_ptr, gate_ptr);
     }
   };
   auto post_ops_rem_fn = [&](int m, int nc) {
     Tout* y_ptr = num_concats <= 1
         ? (Tout*)py[m][nc]
         : (Tout*)py_concat[nc / (Nc / num_concats)][m][nc % (Nc / num_concats)];
-    Tout* tin0_ptr = fusion_type > 1 ? num_concats <= 1
+    Tout* tin0_ptr = with_in0 ? num_concats <= 1
             ? (Tout*)pin0[m][nc]
             : (Tout*)pin0_concat[nc / (Nc / num_concats)][m]
                                 [nc % (Nc / num_concats)]
                                      : nullptr;
-    Tout* tin1_ptr = fusion_type > 2 ? num_concats <= 1
+    Tout* tin1_ptr = with_in1 ? num_concats <= 1
             ? (Tout*)pin1[m][nc]
             : (Tout*)pin1_concat[nc / (Nc / num_concats)][m]
                                 [nc % (Nc / num_concats)]
@@ -1613,20 +1764,42 @@ void qlinear_woq_affine_impl(
     } else if (fusion_type == FUSE_ADD_ADD) {
       add_rem_tpp(y_ptr, tin0_ptr, y_ptr);
       add_rem_tpp(y_ptr, tin1_ptr, y_ptr);
+    } else if (fusion_type == FUSE_SILU_MUL && nc >= Nc_loop) {
+      Tout* gate_ptr = (Tout*)py_concat[0][m][nc - Nc_loop];
+      alignas(64) Tout gate_buf[BLOCK_M_rem * Nb];
+      silu_fwd_rem_tpp(gate_ptr, gate_buf);
+      mul_rem_tpp(gate_buf, y_ptr, gate_ptr);
     }
   };
 
+  // the prefetch distance in rows of B, which shrinks as the rows get wider
+  auto prefetch_k_dist = [&]() -> long {
+    auto dist = PREFETCH_K_BYTES / (is_int4 ? Nb / 2 : Nb);
+    if (dist <= 32) {
+      return 32;
+    } else if (dist <= 64) {
+      return 64;
+    } else {
+      return 128;
+    }
+  }();
+
   constexpr long MICRO_BLOCK_M = 8;
   product_dispatcher<
-      std::tuple</*BLOCK_N*/ long, /*is_int4*/ bool>,
+      std::tuple<
+          /*BLOCK_N*/ long,
+          /*is_int4*/ bool,
+          /*PREFETCH_K_DIST*/ long>,
       std::tuple<
           enumerate_dispatcher<long, 16, 32, 64, 128>,
-          boolean_dispatcher>>::
+          boolean_dispatcher,
+          enumerate_dispatcher<long, 32, 64, 128>>>::
       call(
-          std::make_tuple(Nb, is_int4),
+          std::make_tuple(Nb, is_int4, prefetch_k_dist),
           [&](auto tuple) {
             auto BLOCK_N = std::get<0>(tuple);
             auto is_int4 = std::get<1>(tuple);
+            auto PREFETCH_K_DIST = std::get<2>(tuple);
             // TODO(jgong5): design API to avoid duplicate code of defining
             // similar kernel object
             auto dequant_gemm_tpp = DequantGemmTPP<
@@ -1697,6 +1870,94 @@ void qlinear_woq_affine_impl(
                 /*K*/ Kb,
                 /*lda*/ lda,
                 /*ldc*/ ldc);
+            // With int8 compute and a large M, a thread unpacks the int4
+            // weight of the K blocks it computes of an N block to int8 once
+            // into its scratch, and computes all of its M blocks of the N
+            // block from the unpacked tiles instead of unpacking a tile per M
+            // block. The loop schemes below give a thread consecutive M blocks
+            // of the same N block for this. The scratch of a thread holds the
+            // N blocks of an iteration of the N loop, about 1.06 * K * Nb
+            // bytes per N block.
+            bool unpack_n_block = false;
+            if constexpr (std::is_same<TComp, uint8_t>() && is_int4) {
+              unpack_n_block = M >= PARALLEL_M_THRESHOLD;
+            }
+            // the unpacked weight in [Kc, Kb/4, Nb, 4] and the compensation in
+            // [Kc, Nb] of an N block
+            long unpacked_block_bytes =
+                Kc * Kb * Nb + Kc * Nb * sizeof(int32_t);
+            // the first N block and K block unpacked by each thread
+            std::vector<std::pair<long, long>> unpacked_blocks_of_thread(
+                unpack_n_block ? omp_get_max_threads() : 0,
+                std::make_pair(-1l, -1l));
+            // Get the N blocks of the iteration from nc unpacked for the K
+            // blocks [kc_begin, kc_end), unpacking them if they are not
+            // unpacked by the calling thread yet.
+            auto get_unpacked_blocks =
+                [&](long nc, long kc_begin, long kc_end) -> int8_t* {
+              int8_t* unpacked_blocks = nullptr;
+              if constexpr (std::is_same<TComp, uint8_t>() && is_int4) {
+                unpacked_blocks = (int8_t*)get_unpacked_weight_scratch(
+                    Nc / Nc_loop * unpacked_block_bytes);
+                auto& blocks = unpacked_blocks_of_thread[omp_get_thread_num()];
+                if (blocks != std::make_pair(nc, kc_begin)) {
+                  for (long i = 0; i < Nc / Nc_loop; i++) {
+                    auto unpacked = unpacked_blocks + i * unpacked_block_bytes;
+                    unpack_int4_to_int8<BLOCK_N>(
+                        pw[nc + i * Nc_loop][0],
+                        pzps[nc + i * Nc_loop][0],
+                        kc_begin,
+                        kc_end,
+                        Kb,
+                        kc_per_group,
+                        unpacked,
+                        (int32_t*)(unpacked + Kc * Kb * Nb));
+                  }
+                  blocks = std::make_pair(nc, kc_begin);
+                }
+              }
+              return unpacked_blocks;
+            };
+            // Run a dequant GEMM TPP on the weight tile (nc, kc), on its
+            // unpacked tile if unpacked_blocks is given.
+            auto dequant_gemm = [&](auto& tpp,
+                                    TComp* x_ptr,
+                                    int8_t* unpacked_blocks,
+                                    long nc,
+                                    long kc,
+                                    TGemmOut* y_ptr,
+                                    bool no_tile_cfg,
+                                    float* scale_a,
+                                    int32_t* zp_a,
+                                    int32_t k_groups) {
+              if constexpr (std::is_same<TComp, uint8_t>() && is_int4) {
+                if (unpacked_blocks) {
+                  auto unpacked =
+                      unpacked_blocks + nc / Nc_loop * unpacked_block_bytes;
+                  tpp(x_ptr,
+                      pw[nc][kc],
+                      pscales[nc][kc / kc_per_group],
+                      pzps[nc][kc / kc_per_group],
+                      y_ptr,
+                      no_tile_cfg,
+                      scale_a,
+                      zp_a,
+                      k_groups,
+                      unpacked + kc * Kb * Nb,
+                      (int32_t*)(unpacked + Kc * Kb * Nb) + kc * Nb);
+                  return;
+                }
+              }
+              tpp(x_ptr,
+                  pw[nc][kc],
+                  pscales[nc][kc / kc_per_group],
+                  pzps[nc][kc / kc_per_group],
+                  y_ptr,
+                  no_tile_cfg,
+                  scale_a,
+                  zp_a,
+                  k_groups);
+            };
 
             auto pcvt_x_tpp = std::is_same<T, uint8_t>()
                 ? nullptr
@@ -1708,14 +1969,29 @@ void qlinear_woq_affine_impl(
             auto cvt_y_tpp = ConvertTPP<TGemmOut, Tout>(BLOCK_M, Nb, Nb, ldy);
             auto cvt_y_rem_tpp =
                 ConvertTPP<TGemmOut, Tout>(BLOCK_M_rem, Nb, Nb, ldy);
+            // the partial outputs of split-K have the layout of y
             auto cvt_y_private_tpp =
-                ConvertTPP<TGemmOut, Tout>(BLOCK_M, Nb, N, N);
+                ConvertTPP<TGemmOut, Tout>(BLOCK_M, Nb, ldy, ldy);
+            auto cvt_y_private_rem_tpp =
+                ConvertTPP<TGemmOut, Tout>(BLOCK_M_rem, Nb, ldy, ldy);
             auto add_y_tpp = BinaryTPP(
                 BLOCK_M, /*row*/
                 Nb, /*col*/
-                N, /*ldi0*/
-                N, /*ldi1*/
-                N, /*ldo*/
+                ldy, /*ldi0*/
+                ldy, /*ldi1*/
+                ldy, /*ldo*/
+                XsmmDtype<TGemmOut>(), /*dt_in0*/
+                XsmmDtype<Tout>(), /*dt_in1*/
+                XsmmDtype<Tout>(), /*dt_out*/
+                XsmmDtype<float>(), /*dt_compute*/
+                LIBXSMM_MELTW_FLAG_BINARY_NONE,
+                LIBXSMM_MELTW_TYPE_BINARY_ADD);
+            auto add_y_rem_tpp = BinaryTPP(
+                BLOCK_M_rem, /*row*/
+                Nb, /*col*/
+                ldy, /*ldi0*/
+                ldy, /*ldi1*/
+                ldy, /*ldo*/
                 XsmmDtype<TGemmOut>(), /*dt_in0*/
                 XsmmDtype<Tout>(), /*dt_in1*/
                 XsmmDtype<Tout>(), /*dt_out*/
@@ -1725,181 +2001,23 @@ void qlinear_woq_affine_impl(
 
             // TODO(jgong5): parallelize over M on large BS
             if (no_y_buf) {
-              auto loop_scheme = M >= PARALLEL_M_THRESHOLD ? "ACb" : "aCb";
+              // a thread computes its M blocks of an N block in turn if the N
+              // block is unpacked
+              auto loop_scheme = M >= PARALLEL_M_THRESHOLD
+                  ? (unpack_n_block ? "CAb" : "ACb")
+                  : "aCb";
               auto gemm_loop = ThreadedLoop<3>(
-                  {{0, M, BLOCK_M, false}, {Kc}, {Nc}}, loop_scheme);
+                  {{0, M, BLOCK_M, false}, {Kc}, {Nc_loop}}, loop_scheme);
               gemm_loop(
                   [&](int* idx) {
                     int m = idx[0];
                     int kc = idx[1];
-                    int nc = idx[2];
-                    float* scale_a = nullptr;
-                    int32_t* zp_a = nullptr;
-                    int32_t k_groups = -1;
-                    if constexpr (std::is_same<TComp, uint8_t>()) {
-                      if constexpr (quant_a_mode == QUANT_A_PER_TENSOR) {
-                        scale_a = scales_a_ptr;
-                        zp_a = zps_a_ptr;
-                      } else if constexpr (
-                          quant_a_mode == QUANT_A_PER_K_BLOCK) {
-                        scale_a = scales_a_ptr + kc;
-                        zp_a = zps_a_ptr + kc;
-                      } else if constexpr (quant_a_mode == QUANT_A_PER_M) {
-                        scale_a = scales_a_ptr + m;
-                        zp_a = zps_a_ptr + m;
-                        k_groups = 1;
-                      } else {
-                        scale_a = scales_a_ptr + m * Kc + kc;
-                        zp_a = zps_a_ptr + m * Kc + kc;
-                        k_groups = Kc;
-                      }
-                    }
-                    bool is_rem = (m + BLOCK_M > M);
-                    TGemmOut* y_ptr = num_concats <= 1
-                        ? (TGemmOut*)py[m][nc]
-                        : (TGemmOut*)py_concat[nc / (Nc / num_concats)][m]
-                                              [nc % (Nc / num_concats)];
-                    if (!is_rem) {
-                      if (kc == 0) {
-                        if (b.defined()) {
-                          copy_bias_out_tpp(pb[nc], y_ptr);
-                        } else {
-                          zero_out_tpp(y_ptr);
-                        }
-                      }
-                      TComp* x_ptr = (TComp*)px[m][kc];
-                      if (kc < Kc - 1) {
-                        dequant_gemm_tpp(
-                            x_ptr,
-                            pw[nc][kc],
-                            pscales[nc],
-                            pzps[nc],
-                            y_ptr,
-                            true,
-                            scale_a,
-                            zp_a,
-                            k_groups);
-                      } else {
-                        dequant_gemm_no_prefetch_tpp(
-                            x_ptr,
-                            pw[nc][kc],
-                            pscales[nc],
-                            pzps[nc],
-                            y_ptr,
-                            true,
-                            scale_a,
-                            zp_a,
-                            k_groups);
-                        if (fusion_type > 0) {
-                          post_ops_fn(m, nc);
-                        }
-                      }
-                    } else {
-                      if (kc == 0) {
-                        if (b.defined()) {
-                          copy_bias_out_rem_tpp(pb[nc], y_ptr);
-                        } else {
-                          zero_out_rem_tpp(y_ptr);
-                        }
-                      }
-                      TComp* x_ptr = (TComp*)px[m][kc];
-                      if (kc < Kc - 1) {
-                        dequant_gemm_rem_tpp(
-                            x_ptr,
-                            pw[nc][kc],
-                            pscales[nc],
-                            pzps[nc],
-                            y_ptr,
-                            false,
-                            scale_a,
-                            zp_a,
-                            k_groups);
-                        dequant_gemm_tpp.config();
-                      } else {
-                        dequant_gemm_no_prefetch_rem_tpp(
-                            x_ptr,
-                            pw[nc][kc],
-                            pscales[nc],
-                            pzps[nc],
-                            y_ptr,
-                            false,
-                            scale_a,
-                            zp_a,
-                            k_groups);
-                        dequant_gemm_no_prefetch_tpp.config();
-                        if (fusion_type > 0) {
-                          post_ops_rem_fn(m, nc);
-                        }
-                      }
-                    }
-                    // TODO(jgong5): post-op fusion
-                  },
-                  [&]() { dequant_gemm_tpp.config(); },
-                  [&]() { dequant_gemm_tpp.release(); });
-            } else {
-              auto num_threads = omp_get_max_threads();
-              TGemmOut* y_private = nullptr;
-              bool* y_private_valid = nullptr;
-              if (k_splits > 1) {
-                // TODO(jgong5): if we know the thread decomposition, we can
-                // allocate a smaller buffer
-                y_private = (TGemmOut*)std::aligned_alloc(
-                    64, num_threads * M * N * sizeof(TGemmOut));
-                y_private_valid = (bool*)std::aligned_alloc(
-                    64, num_threads * (M / BLOCK_M) * Nc * sizeof(bool));
-                memset(
-                    y_private_valid,
-                    0,
-                    sizeof(bool) * num_threads * (M / BLOCK_M) * Nc);
-              }
-              auto y_private_ptr = GetVLAPtr<TGemmOut>(y_private, {M, Nc, Nb});
-              auto y_private_valid_ptr =
-                  GetVLAPtr<bool>(y_private_valid, {M / BLOCK_M, Nc});
-              auto loop_scheme = M >= PARALLEL_M_THRESHOLD ? "CAB" : "ABc";
-              auto gemm_loop = ThreadedLoop<3>(
-                  {{Nc}, {0, Kc, Kc / k_splits, true}, {0, M, BLOCK_M, false}},
-                  loop_scheme);
-              gemm_loop(
-                  [&](int* idx) {
-                    int my_id = omp_get_thread_num();
-                    int nc = idx[0];
-                    int kc_start = idx[1];
-                    int kc_end = kc_start + Kc / k_splits;
-                    int m = idx[2];
-                    bool is_rem = (m + BLOCK_M > M);
-                    auto y_out_ptr = num_concats <= 1
-                        ? py[m][nc]
-                        : py_concat[nc / (Nc / num_concats)][m]
-                                   [nc % (Nc / num_concats)];
-                    alignas(64) TGemmOut y_buf[BLOCK_M][Nb];
-                    TGemmOut* y_ptr = y_private_ptr[my_id][m][nc];
-                    if (k_splits > 1) {
-                      if (!y_private_valid_ptr[my_id][m / BLOCK_M][nc]) {
-                        if (kc_start == 0 && b.defined()) {
-                          copy_bias_out_tpp(pb[nc], y_ptr);
-                        } else {
-                          zero_out_tpp(y_ptr);
-                        }
-                        y_private_valid_ptr[my_id][m / BLOCK_M][nc] = true;
-                      }
-                    } else {
-                      y_ptr = y_buf[0];
-                      if (b.defined()) {
-                        if (!is_rem) {
-                          copy_bias_buf_tpp(pb[nc], y_buf[0]);
-                        } else {
-                          copy_bias_buf_rem_tpp(pb[nc], y_buf[0]);
-                        }
-                      } else {
-                        if (!is_rem) {
-                          zero_buf_tpp(y_buf[0]);
-                        } else {
-                          zero_buf_rem_tpp(y_buf[0]);
-                        }
-                      }
-                    }
-                    for (int kc = kc_start; kc < kc_end; kc++) {
-                      TComp* x_ptr = (TComp*)px[m][kc];
+                    int8_t* unpacked_blocks = unpack_n_block
+                        ? get_unpacked_blocks(idx[2], 0, Kc)
+                        : nullptr;
+                    // for FUSE_SILU_MUL, the gate block and its up block
+                    // are computed in turn by the same thread
+                    for (int nc = idx[2]; nc < Nc; nc += Nc_loop) {
                       float* scale_a = nullptr;
                       int32_t* zp_a = nullptr;
                       int32_t k_groups = -1;
@@ -1921,47 +2039,64 @@ void qlinear_woq_affine_impl(
                           k_groups = Kc;
                         }
                       }
+                      bool is_rem = (m + BLOCK_M > M);
+                      TGemmOut* y_ptr = num_concats <= 1
+                          ? (TGemmOut*)py[m][nc]
+                          : (TGemmOut*)py_concat[nc / (Nc / num_concats)][m]
+                                                [nc % (Nc / num_concats)];
                       if (!is_rem) {
-                        alignas(64) TComp x_buf[BLOCK_M][Kb];
-                        if (!no_x_buf) {
-                          (*pcvt_x_tpp)(px[m][kc], x_buf[0]);
-                          x_ptr = x_buf[0];
+                        if (kc == 0) {
+                          if (b.defined()) {
+                            copy_bias_out_tpp(pb[nc], y_ptr);
+                          } else {
+                            zero_out_tpp(y_ptr);
+                          }
                         }
+                        TComp* x_ptr = (TComp*)px[m][kc];
                         if (kc < Kc - 1) {
-                          dequant_gemm_tpp(
+                          dequant_gemm(
+                              dequant_gemm_tpp,
                               x_ptr,
-                              pw[nc][kc],
-                              pscales[nc],
-                              pzps[nc],
+                              unpacked_blocks,
+                              nc,
+                              kc,
                               y_ptr,
                               true,
                               scale_a,
                               zp_a,
                               k_groups);
                         } else {
-                          dequant_gemm_no_prefetch_tpp(
+                          dequant_gemm(
+                              dequant_gemm_no_prefetch_tpp,
                               x_ptr,
-                              pw[nc][kc],
-                              pscales[nc],
-                              pzps[nc],
+                              unpacked_blocks,
+                              nc,
+                              kc,
                               y_ptr,
                               true,
                               scale_a,
                               zp_a,
                               k_groups);
+                          if (fusion_type > 0) {
+                            post_ops_fn(m, nc);
+                          }
                         }
                       } else {
-                        alignas(64) TComp x_buf[BLOCK_M][Kb];
-                        if (!no_x_buf) {
-                          (*pcvt_x_rem_tpp)(px[m][kc], x_buf[0]);
-                          x_ptr = x_buf[0];
+                        if (kc == 0) {
+                          if (b.defined()) {
+                            copy_bias_out_rem_tpp(pb[nc], y_ptr);
+                          } else {
+                            zero_out_rem_tpp(y_ptr);
+                          }
                         }
+                        TComp* x_ptr = (TComp*)px[m][kc];
                         if (kc < Kc - 1) {
-                          dequant_gemm_rem_tpp(
+                          dequant_gemm(
+                              dequant_gemm_rem_tpp,
                               x_ptr,
-                              pw[nc][kc],
-                              pscales[nc],
-                              pzps[nc],
+                              unpacked_blocks,
+                              nc,
+                              kc,
                               y_ptr,
                               false,
                               scale_a,
@@ -1969,94 +2104,289 @@ void qlinear_woq_affine_impl(
                               k_groups);
                           dequant_gemm_tpp.config();
                         } else {
-                          dequant_gemm_no_prefetch_rem_tpp(
+                          dequant_gemm(
+                              dequant_gemm_no_prefetch_rem_tpp,
                               x_ptr,
-                              pw[nc][kc],
-                              pscales[nc],
-                              pzps[nc],
+                              unpacked_blocks,
+                              nc,
+                              kc,
                               y_ptr,
                               false,
                               scale_a,
                               zp_a,
                               k_groups);
                           dequant_gemm_no_prefetch_tpp.config();
+                          if (fusion_type > 0) {
+                            post_ops_rem_fn(m, nc);
+                          }
                         }
                       }
+                      // TODO(jgong5): post-op fusion
                     }
-                    // TODO(jgong5): post-op fusion
-                    if (k_splits <= 1) {
-                      if (!is_rem) {
-                        cvt_y_tpp(y_buf[0], y_out_ptr);
-                        if (fusion_type > 0) {
-                          post_ops_fn(m, nc);
+                  },
+                  [&]() { dequant_gemm_tpp.config(); },
+                  [&]() {
+                    dequant_gemm_tpp.release();
+                    prefetch_weight_slice(next_wt);
+                  });
+            } else {
+              // the partial outputs of every split of K, every block of them
+              // is computed by a single thread
+              TGemmOut* y_private = k_splits > 1
+                  ? (TGemmOut*)get_split_k_scratch(
+                        k_splits * M * N * sizeof(TGemmOut))
+                  : nullptr;
+              auto y_private_ptr = GetVLAPtr<TGemmOut>(
+                  y_private, {M, Nc, Nb}); /*[k_splits, M, Nc, Nb]*/
+              auto y_private_concat_ptr = GetVLAPtr<TGemmOut>(
+                  y_private,
+                  {num_concats,
+                   M,
+                   Nc / num_concats,
+                   Nb}); /*[k_splits, num_concats, M, Nc/num_concats, Nb]*/
+              auto private_block = [&](int ks, int m, int nc) -> TGemmOut* {
+                return num_concats <= 1
+                    ? y_private_ptr[ks][m][nc]
+                    : y_private_concat_ptr[ks][nc / (Nc / num_concats)][m]
+                                          [nc % (Nc / num_concats)];
+              };
+              // a thread computes its M blocks of an N block in turn if the N
+              // block is unpacked
+              auto loop_scheme = M >= PARALLEL_M_THRESHOLD
+                  ? (unpack_n_block ? "ABC" : "CAB")
+                  : "ABc";
+              auto gemm_loop = ThreadedLoop<3>(
+                  {{Nc_loop},
+                   {0, Kc, Kc / k_splits, true},
+                   {0, M, BLOCK_M, false}},
+                  loop_scheme);
+              gemm_loop(
+                  [&](int* idx) {
+                    int kc_start = idx[1];
+                    int kc_end = kc_start + Kc / k_splits;
+                    int ks = kc_start / (Kc / k_splits);
+                    int m = idx[2];
+                    int8_t* unpacked_blocks = unpack_n_block
+                        ? get_unpacked_blocks(idx[0], kc_start, kc_end)
+                        : nullptr;
+                    for (int nc = idx[0]; nc < Nc; nc += Nc_loop) {
+                      bool is_rem = (m + BLOCK_M > M);
+                      auto y_out_ptr = num_concats <= 1
+                          ? py[m][nc]
+                          : py_concat[nc / (Nc / num_concats)][m]
+                                     [nc % (Nc / num_concats)];
+                      alignas(64) TGemmOut y_buf[BLOCK_M][Nb];
+                      TGemmOut* y_ptr = private_block(ks, m, nc);
+                      if (k_splits > 1) {
+                        if (ks == 0 && b.defined()) {
+                          if (!is_rem) {
+                            copy_bias_out_tpp(pb[nc], y_ptr);
+                          } else {
+                            copy_bias_out_rem_tpp(pb[nc], y_ptr);
+                          }
+                        } else {
+                          if (!is_rem) {
+                            zero_out_tpp(y_ptr);
+                          } else {
+                            zero_out_rem_tpp(y_ptr);
+                          }
                         }
                       } else {
-                        cvt_y_rem_tpp(y_buf[0], y_out_ptr);
-                        if (fusion_type > 0) {
-                          post_ops_rem_fn(m, nc);
+                        y_ptr = y_buf[0];
+                        if (b.defined()) {
+                          if (!is_rem) {
+                            copy_bias_buf_tpp(pb[nc], y_buf[0]);
+                          } else {
+                            copy_bias_buf_rem_tpp(pb[nc], y_buf[0]);
+                          }
+                        } else {
+                          if (!is_rem) {
+                            zero_buf_tpp(y_buf[0]);
+                          } else {
+                            zero_buf_rem_tpp(y_buf[0]);
+                          }
+                        }
+                      }
+                      for (int kc = kc_start; kc < kc_end; kc++) {
+                        TComp* x_ptr = (TComp*)px[m][kc];
+                        float* scale_a = nullptr;
+                        int32_t* zp_a = nullptr;
+                        int32_t k_groups = -1;
+                        if constexpr (std::is_same<TComp, uint8_t>()) {
+                          if constexpr (quant_a_mode == QUANT_A_PER_TENSOR) {
+                            scale_a = scales_a_ptr;
+                            zp_a = zps_a_ptr;
+                          } else if constexpr (
+                              quant_a_mode == QUANT_A_PER_K_BLOCK) {
+                            scale_a = scales_a_ptr + kc;
+                            zp_a = zps_a_ptr + kc;
+                          } else if constexpr (quant_a_mode == QUANT_A_PER_M) {
+                            scale_a = scales_a_ptr + m;
+                            zp_a = zps_a_ptr + m;
+                            k_groups = 1;
+                          } else {
+                            scale_a = scales_a_ptr + m * Kc + kc;
+                            zp_a = zps_a_ptr + m * Kc + kc;
+                            k_groups = Kc;
+                          }
+                        }
+                        if (!is_rem) {
+                          alignas(64) TComp x_buf[BLOCK_M][Kb];
+                          if (!no_x_buf) {
+                            (*pcvt_x_tpp)(px[m][kc], x_buf[0]);
+                            x_ptr = x_buf[0];
+                          }
+                          if (kc < Kc - 1) {
+                            dequant_gemm(
+                                dequant_gemm_tpp,
+                                x_ptr,
+                                unpacked_blocks,
+                                nc,
+                                kc,
+                                y_ptr,
+                                true,
+                                scale_a,
+                                zp_a,
+                                k_groups);
+                          } else {
+                            dequant_gemm(
+                                dequant_gemm_no_prefetch_tpp,
+                                x_ptr,
+                                unpacked_blocks,
+                                nc,
+                                kc,
+                                y_ptr,
+                                true,
+                                scale_a,
+                                zp_a,
+                                k_groups);
+                          }
+                        } else {
+                          alignas(64) TComp x_buf[BLOCK_M][Kb];
+                          if (!no_x_buf) {
+                            (*pcvt_x_rem_tpp)(px[m][kc], x_buf[0]);
+                            x_ptr = x_buf[0];
+                          }
+                          if (kc < Kc - 1) {
+                            dequant_gemm(
+                                dequant_gemm_rem_tpp,
+                                x_ptr,
+                                unpacked_blocks,
+                                nc,
+                                kc,
+                                y_ptr,
+                                false,
+                                scale_a,
+                                zp_a,
+                                k_groups);
+                            dequant_gemm_tpp.config();
+                          } else {
+                            dequant_gemm(
+                                dequant_gemm_no_prefetch_rem_tpp,
+                                x_ptr,
+                                unpacked_blocks,
+                                nc,
+                                kc,
+                                y_ptr,
+                                false,
+                                scale_a,
+                                zp_a,
+                                k_groups);
+                            dequant_gemm_no_prefetch_tpp.config();
+                          }
+                        }
+                      }
+                      // TODO(jgong5): post-op fusion
+                      if (k_splits <= 1) {
+                        if (!is_rem) {
+                          cvt_y_tpp(y_buf[0], y_out_ptr);
+                          if (fusion_type > 0) {
+                            post_ops_fn(m, nc);
+                          }
+                        } else {
+                          cvt_y_rem_tpp(y_buf[0], y_out_ptr);
+                          if (fusion_type > 0) {
+                            post_ops_rem_fn(m, nc);
+                          }
                         }
                       }
                     }
                   },
                   [&]() { dequant_gemm_tpp.config(); },
-                  [&]() { dequant_gemm_tpp.release(); });
+                  [&]() {
+                    dequant_gemm_tpp.release();
+                    prefetch_weight_slice(next_wt);
+                  });
               if (k_splits > 1) {
-                TLA_ASSERT(
-                    M % BLOCK_M == 0,
-                    "M must be divisible by BLOCK_M for k_splits > 1");
+                // reduce the partial outputs of the splits block by block in
+                // parallel, the gate block before its up block for
+                // FUSE_SILU_MUL
                 auto reduce_loop =
-                    ThreadedLoop<2>({{0, M, BLOCK_M, true}, {Nc}}, "AB");
+                    ThreadedLoop<2>({{0, M, BLOCK_M, true}, {Nc_loop}}, "AB");
                 reduce_loop([&](int* idx) {
                   int m = idx[0];
-                  int nc = idx[1];
-                  bool init = false;
-                  for (int id = 0; id < num_threads; id++) {
-                    if (y_private_valid_ptr[id][m / BLOCK_M][nc]) {
-                      if (!init) {
-                        cvt_y_private_tpp(y_private_ptr[id][m][nc], py[m][nc]);
-                        init = true;
+                  bool is_rem = (m + BLOCK_M > M);
+                  for (int nc = idx[1]; nc < Nc; nc += Nc_loop) {
+                    auto y_out_ptr = num_concats <= 1
+                        ? py[m][nc]
+                        : py_concat[nc / (Nc / num_concats)][m]
+                                   [nc % (Nc / num_concats)];
+                    for (int ks = 0; ks < k_splits; ks++) {
+                      auto y_ptr = private_block(ks, m, nc);
+                      if (ks == 0) {
+                        if (!is_rem) {
+                          cvt_y_private_tpp(y_ptr, y_out_ptr);
+                        } else {
+                          cvt_y_private_rem_tpp(y_ptr, y_out_ptr);
+                        }
+                      } else {
+                        if (!is_rem) {
+                          add_y_tpp(y_ptr, y_out_ptr, y_out_ptr);
+                        } else {
+                          add_y_rem_tpp(y_ptr, y_out_ptr, y_out_ptr);
+                        }
+                      }
+                    }
+                    if (fusion_type > 0) {
+                      if (!is_rem) {
+                        post_ops_fn(m, nc);
                       } else {
-                        add_y_tpp(
-                            y_private_ptr[id][m][nc], py[m][nc], py[m][nc]);
+                        post_ops_rem_fn(m, nc);
                       }
                     }
                   }
-                  if (fusion_type > 0) {
-                    post_ops_fn(m, nc);
-                  }
                 });
-                std::free(y_private);
-                std::free(y_private_valid);
               }
             }
           },
           [](auto tuple) { failing_fallback(); });
 }
 
-#define LOWP_MODE_NONE 0
-#define LOWP_MODE_FP16 1
-#define LOWP_MODE_BF16 2
-#define LOWP_MODE_INT8 3
-
 /**
  * @brief pack the weight in quantized format.
  * @param qw quantized weight with shape [N, K]
  * @param block_n block size along N, N % block_n == 0, block_n % 16 == 0
  * @param block_k block size along K, K % block_k == 0. block_k % 2 == 0 for
  * bf16 compute_dtype. false if activation is expected to be float32.
+ * @param group_size group size along K of the scales and zero points,
+ * group_size % block_k == 0. -1 for per-channel quantization.
  */
 at::Tensor qlinear_woq_pack(
     const at::Tensor& qw,
     bool is_int4,
     size_t block_n,
     size_t block_k,
-    int64_t lowp_mode) {
+    int64_t lowp_mode,
+    int64_t group_size) {
   TLA_ASSERT(qw.is_contiguous(), "qw must be contiguous");
   auto sizes = qw.sizes();
   auto N = sizes[0];
   auto K = is_int4 ? sizes[1] * 2 : sizes[1];
   TLA_ASSERT(N % block_n == 0, "N must be multiple of block_n");
   TLA_ASSERT(K % block_k == 0, "K must be multiple of block_k");
+  TLA_ASSERT(
+      group_size <= 0 || group_size % block_k == 0,
+      "group_size must be multiple of block_k");
   TLA_ASSERT(block_n % 16 == 0, "block_n must be multiple of 16 for int4");
   if (lowp_mode == LOWP_MODE_INT8) {
     TLA_ASSERT(
@@ -2068,7 +2398,6 @@ at::Tensor qlinear_woq_pack(
   const int Nc = N / block_n;
   const int Kc = K / block_k;
   if (is_int4) {
-    // TODO(jgong5): support lowp_mode == LOWP_MODE_INT8
     auto result = at::empty({Nc, Kc, block_k, block_n / 2}, qw.options());
     // Pack weight in [N,K] to [N/block_n, K/block_k, block_k, block_n]
     // And then, pre-shuffle per 32 or 64 4-bit values to save shuffle at
@@ -2132,80 +2461,6 @@ at::Tensor qlinear_woq_pack(
   }
 }
 
-at::Tensor qlinear_woq_unpack(
-    const at::Tensor& qw_packed,
-    bool is_int4,
-    int64_t lowp_mode) {
-  if (qw_packed.dim() == 4) {
-    auto w_sizes = qw_packed.sizes();
-    auto Nc = w_sizes[0];
-    auto Nb = is_int4 ? w_sizes[3] * 2 : w_sizes[3];
-    auto Kc = w_sizes[1];
-    auto Kb = w_sizes[2];
-    auto N = Nc * Nb;
-    auto K = Kc * Kb;
-    const int N_GROUP_SIZE =
-        lowp_mode != LOWP_MODE_INT8 ? get_n_group_size(Nb) : 16;
-    if (is_int4) {
-      // TODO: support lowp_mode == 3
-      auto result = at::empty({N, K / 2}, qw_packed.options());
-      uint8_t* src_data = (uint8_t*)qw_packed.data_ptr();
-      uint8_t* dst_data = (uint8_t*)result.data_ptr();
-      auto psrc = GetVLAPtr<uint8_t>(src_data, {Kc, Kb, Nb / 2});
-      auto psrc_4vnni = GetVLAPtr<uint8_t>(src_data, {Kc, Kb / 4, Nb / 2, 4});
-      auto pdst = GetVLAPtr<uint8_t>(dst_data, {Nb, Kc, Kb / 2});
-      auto unpack_loop =
-          ThreadedLoop<3>({{Nc}, {Kc}, {0, Nb, N_GROUP_SIZE, false}}, "ABc");
-      unpack_loop([&](int* idx) {
-        int nc = idx[0];
-        int kc = idx[1];
-        int nb = idx[2];
-        for (int kb = 0; kb < Kb; kb += 2) {
-          for (int i = 0; i < N_GROUP_SIZE / 2; i++) {
-            uint8_t src0, src1;
-            if (lowp_mode != LOWP_MODE_INT8) {
-              src0 = psrc[nc][kc][kb][nb / 2 + i];
-              src1 = psrc[nc][kc][kb + 1][nb / 2 + i];
-            } else {
-              src0 = psrc_4vnni[nc][kc][kb / 4][nb / 2 + i][kb % 4];
-              src1 = psrc_4vnni[nc][kc][(kb + 1) / 4][nb / 2 + i][(kb + 1) % 4];
-            }
-            pdst[nc][nb + i][kc][kb / 2] = (src0 & 0xf) | ((src1 & 0xf) << 4);
-            pdst[nc][nb + i + N_GROUP_SIZE / 2][kc][kb / 2] =
-                (src0 >> 4) | ((src1 >> 4) << 4);
-          }
-        }
-      });
-      return result;
-    } else {
-      TLA_ASSERT(
-          lowp_mode != LOWP_MODE_INT8,
-          "lowp mode int8 is not supported yet with int8 weight");
-      auto result = at::empty({N, K}, qw_packed.options());
-      int8_t* src_data = (int8_t*)qw_packed.data_ptr();
-      int8_t* dst_data = (int8_t*)result.data_ptr();
-      auto psrc = GetVLAPtr<int8_t>(src_data, {Kc, Kb, Nb});
-      auto pdst = GetVLAPtr<int8_t>(dst_data, {Nb, Kc, Kb});
-      auto unpack_loop =
-          ThreadedLoop<3>({{Nc}, {Kc}, {0, Nb, N_GROUP_SIZE, false}}, "ABc");
-      unpack_loop([&](int* idx) {
-        int nc = idx[0];
-        int kc = idx[1];
-        int nb = idx[2];
-        for (int kb = 0; kb < Kb; kb++) {
-          for (int i = 0; i < N_GROUP_SIZE; i++) {
-            pdst[nc][nb + i][kc][kb] = psrc[nc][kc][kb][nb + i];
-          }
-        }
-      });
-      return result;
-    }
-  } else {
-    TLA_ASSERT(qw_packed.dim() == 2, "qw_packed must be 2D or 4D");
-    return qw_packed;
-  }
-}
-
 void compute_int8_qparams_per_tensor(
     const at::Tensor& t,
     float* scale,
@@ -2625,6 +2880,9 @@ at::Tensor quantize_per_block<bfloat16>(
  *        LOWP_MODE_NONE: keep activation dtype
  *        LOWP_MODE_FP16: use FP16 or FP32 as compute dtype
  *        LOWP_MODE_BF16: use BF16, FP16 or FP32 as compute dtype
+ * @param num_concats number of linears concatenated along N in `qw`
+ * @param fusion_type the post op, FUSE_SILU_MUL takes `qw` as the concat of
+ * the gate and up weights and returns silu(gate) * up in [M,N/2]
  * @return at::Tensor output activation in same dtype as `x`, 2D plain format
  * [M,N]
  */
@@ -2854,6 +3112,11 @@ at::Tensor qlinear_woq_affine(
               }
             },
             failing_fallback<at::ScalarType>);
+    if (fusion_type == FUSE_SILU_MUL) {
+      // the result is in the first concat of y
+      out_sizes.back() = N / 2;
+      return y.view({2, -1})[0].view(out_sizes);
+    }
     return y;
   } else {
     TLA_ASSERT(
@@ -2896,6 +3159,9 @@ at::Tensor qlinear_woq_affine(
     } else if (fusion_type == FUSE_ADD || fusion_type == FUSE_ADD_ADD) {
       for (auto& tin : others_list)
         y = at::add(y, tin);
+    } else if (fusion_type == FUSE_SILU_MUL) {
+      auto gate_up = y.chunk(2, -1);
+      return (at::silu(gate_up[0]) * gate_up[1]).to(x.scalar_type());
     }
     if (num_concats > 1) {
       y = y.view({-1, num_concats, y.size(-1) / num_concats})
@@ -2907,6 +3173,69 @@ at::Tensor qlinear_woq_affine(
   }
 }
 
+// The INT8 compute with the activation already quantized per row by the op
+// before, e.g., add_rmsnorm_quantize, so that it is not read again to compute
+// its qparams and quantize it. Only the int4 weight in LOWP_MODE_INT8 is
+// supported, an empty tensor is returned otherwise.
+at::Tensor qlinear_woq_affine_quantized_a(
+    const at::Tensor& x_quantized,
+    const at::Tensor& scale_a,
+    const at::Tensor& zp_a,
+    at::ScalarType out_dtype,
+    const at::Tensor& qw,
+    const TensorList& scales_list,
+    const TensorList& zp_list,
+    const TensorList& bias_list,
+    bool is_int4,
+    int64_t lowp_mode,
+    int64_t num_concats) {
+  if (qw.dim() != 4 || !is_int4 || lowp_mode != LOWP_MODE_INT8) {
+    return at::Tensor();
+  }
+  const int64_t k_splits = 0;
+  constexpr size_t fp32_idx = 0, int8_idx = 3;
+  auto biases = bias_list.empty()
+      ? TensorList({at::Tensor(), at::Tensor(), at::Tensor()})
+      : bias_list;
+  auto w_sizes = qw.sizes();
+  auto K = x_quantized.size(-1);
+  auto M = x_quantized.numel() / K;
+  auto N = w_sizes[0] * w_sizes[3] * 2;
+  auto out_sizes = x_quantized.sizes().vec();
+  out_sizes.back() = N;
+  auto y = at::empty(out_sizes, x_quantized.options().dtype(out_dtype));
+  auto x_reshape = x_quantized.reshape({M, K});
+  enumerate_dispatcher<at::ScalarType, at::kFloat, at::kBFloat16>::call(
+      out_dtype,
+      [&](auto out_dtype_) {
+        using out_type =
+            typename c10::impl::ScalarTypeToCPPType<out_dtype_>::type;
+        qlinear_woq_affine_impl<
+            uint8_t,
+            uint8_t,
+            /*TGemmOut*/ float,
+            out_type,
+            float,
+            int8_t,
+            QUANT_A_PER_M>(
+            x_reshape,
+            qw,
+            scales_list[fp32_idx],
+            zp_list[int8_idx],
+            biases[fp32_idx],
+            y,
+            is_int4,
+            k_splits,
+            num_concats,
+            WOQ_FUSE_NONE,
+            TensorList(),
+            scale_a,
+            zp_a);
+      },
+      failing_fallback<at::ScalarType>);
+  return y;
+}
+
 #else // defined(CPU_CAPABILITY_AVX512_FP16) && defined(COMPILER_PREREQ_MET)
 
 static at::Tensor empty_tensor;
@@ -2931,21 +3260,108 @@ at::Tensor qlinear_woq_pack(
     bool is_int4,
     size_t block_n,
     size_t block_k,
-    int64_t lowp_mode) {
+    int64_t lowp_mode,
+    int64_t group_size) {
   return empty_tensor;
 }
 
+at::Tensor qlinear_woq_affine_quantized_a(
+    const at::Tensor& x_quantized,
+    const at::Tensor& scale_a,
+    const at::Tensor& zp_a,
+    at::ScalarType out_dtype,
+    const at::Tensor& qw,
+    const TensorList& scales_list,
+    const TensorList& zp_list,
+    const TensorList& bias_list,
+    bool is_int4,
+    int64_t lowp_mode,
+    int64_t num_concats) {
+  return empty_tensor;
+}
+#endif // defined(CPU_CAPABILITY_AVX512_FP16) && defined(COMPILER_PREREQ_MET)
+
+// The packed layout is unpacked with plain loops, so that a weight packed on
+// another machine can be unpacked and packed again on any ISA.
 at::Tensor qlinear_woq_unpack(
     const at::Tensor& qw_packed,
     bool is_int4,
     int64_t lowp_mode) {
-  return empty_tensor;
+  if (qw_packed.dim() == 4) {
+    auto w_sizes = qw_packed.sizes();
+    auto Nc = w_sizes[0];
+    auto Nb = is_int4 ? w_sizes[3] * 2 : w_sizes[3];
+    auto Kc = w_sizes[1];
+    auto Kb = w_sizes[2];
+    auto N = Nc * Nb;
+    auto K = Kc * Kb;
+    const int N_GROUP_SIZE =
+        lowp_mode != LOWP_MODE_INT8 ? get_n_group_size(Nb) : 16;
+    if (is_int4) {
+      auto result = at::empty({N, K / 2}, qw_packed.options());
+      uint8_t* src_data = (uint8_t*)qw_packed.data_ptr();
+      uint8_t* dst_data = (uint8_t*)result.data_ptr();
+      auto psrc = GetVLAPtr<uint8_t>(src_data, {Kc, Kb, Nb / 2});
+      auto psrc_4vnni = GetVLAPtr<uint8_t>(src_data, {Kc, Kb / 4, Nb / 2, 4});
+      auto pdst = GetVLAPtr<uint8_t>(dst_data, {Nb, Kc, Kb / 2});
+      auto unpack_loop =
+          ThreadedLoop<3>({{Nc}, {Kc}, {0, Nb, N_GROUP_SIZE, false}}, "ABc");
+      unpack_loop([&](int* idx) {
+        int nc = idx[0];
+        int kc = idx[1];
+        int nb = idx[2];
+        for (int kb = 0; kb < Kb; kb += 2) {
+          for (int i = 0; i < N_GROUP_SIZE / 2; i++) {
+            uint8_t src0, src1;
+            if (lowp_mode != LOWP_MODE_INT8) {
+              src0 = psrc[nc][kc][kb][nb / 2 + i];
+              src1 = psrc[nc][kc][kb + 1][nb / 2 + i];
+            } else {
+              src0 = psrc_4vnni[nc][kc][kb / 4][nb / 2 + i][kb % 4];
+              src1 = psrc_4vnni[nc][kc][(kb + 1) / 4][nb / 2 + i][(kb + 1) % 4];
+            }
+            pdst[nc][nb + i][kc][kb / 2] = (src0 & 0xf) | ((src1 & 0xf) << 4);
+            pdst[nc][nb + i + N_GROUP_SIZE / 2][kc][kb / 2] =
+                (src0 >> 4) | ((src1 >> 4) << 4);
+          }
+        }
+      });
+      return result;
+    } else {
+      TLA_ASSERT(
+          lowp_mode != LOWP_MODE_INT8,
+          "lowp mode int8 is not supported yet with int8 weight");
+      auto result = at::empty({N, K}, qw_packed.options());
+      int8_t* src_data = (int8_t*)qw_packed.data_ptr();
+      int8_t* dst_data = (int8_t*)result.data_ptr();
+      auto psrc = GetVLAPtr<int8_t>(src_data, {Kc, Kb, Nb});
+      auto pdst = GetVLAPtr<int8_t>(dst_data, {Nb, Kc, Kb});
+      auto unpack_loop =
+          ThreadedLoop<3>({{Nc}, {Kc}, {0, Nb, N_GROUP_SIZE, false}}, "ABc");
+      unpack_loop([&](int* idx) {
+        int nc = idx[0];
+        int kc = idx[1];
+        int nb = idx[2];
+        for (int kb = 0; kb < Kb; kb++) {
+          for (int i = 0; i < N_GROUP_SIZE; i++) {
+            pdst[nc][nb + i][kc][kb] = psrc[nc][kc][kb][nb + i];
+          }
+        }
+      });
+      return result;
+    }
+  } else {
+    TLA_ASSERT(qw_packed.dim() == 2, "qw_packed must be 2D or 4D");
+    return qw_packed;
+  }
 }
-#endif // defined(CPU_CAPABILITY_AVX512_FP16) && defined(COMPILER_PREREQ_MET)
 
 } // namespace
 
 REGISTER_DISPATCH(woq_tpp_gemm_kernel_stub, &qlinear_woq_affine);
+REGISTER_DISPATCH(
+    woq_tpp_gemm_quantized_a_kernel_stub,
+    &qlinear_woq_affine_quantized_a);
 REGISTER_DISPATCH(woq_tpp_gemm_packB_stub, &qlinear_woq_pack);
 REGISTER_DISPATCH(woq_tpp_gemm_unpackB_stub, &qlinear_woq_unpack);
 
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+
+namespace torch_ipex {
+namespace cpu {
+
+// The hot rows of an embedding table, i.e., the rows with a copy in its hot
+// row cache, are kept in a small open addressing hash with linear probing.
+// The hash is a [2, num_buckets] int64 tensor: the first row holds the row of
+// every bucket (-1 if it is empty), and the second row the row of its copy in
+// the cache. num_buckets is a power of 2 of at least twice the number of the
+// hot rows, so that a lookup of a cold row stops at an empty bucket after a
+// few probes, and the hash stays in L1/L2 however large the table is.
+constexpr int64_t kHotRowEmptyBucket = -1;
+
+struct HotRowSet {
+  const int64_t* rows = nullptr;
+  const int64_t* slots = nullptr;
+  int64_t mask = 0;
+  int shift = 0;
+
+  HotRowSet() = default;
+
+  HotRowSet(const int64_t* hash, const int64_t num_buckets)
+      : rows(hash),
+        slots(hash + num_buckets),
+        mask(num_buckets - 1),
+        shift(64 - __builtin_ctzll(num_buckets)) {}
+
+  // Fibonacci hashing, the high bits of the product depend on all the bits of
+  // the row, so that the rows of a range spread over the buckets.
+  static inline int64_t bucket(const int64_t row, const int shift) {
+    return (uint64_t(row) * 0x9E3779B97F4A7C15ull) >> shift;
+  }
+
+  // Return the row of the copy of row in the cache, or -1 if it is not hot.
+  inline int64_t find(const int64_t row) const {
+    if (rows == nullptr) {
+      return -1;
+    }
+    for (int64_t b = bucket(row, shift);; b = (b + 1) & mask) {
+      if (rows[b] == row) {
+        return slots[b];
+      }
+      if (rows[b] == kHotRowEmptyBucket) {
+        return -1;
+      }
+    }
+  }
+};
+
+} // namespace cpu
+} // namespace torch_ipex
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#ifdef __x86_64__
+#include <immintrin.h>
+#endif
+
+namespace torch_ipex {
+namespace cpu {
+
+// Lookahead prefetch of the rows in the pooling loops of the embedding bags.
+// The lookups of a table far larger than the caches are DRAM misses, so the
+// row of the lookup j + distance is prefetched while the lookup j is pooled.
+//
+// A table which fits in L2 is not prefetched.
+constexpr int64_t kEmbeddingPrefetchMinTableBytes = 2 << 20;
+// The bytes of the rows in flight. The short rows are pooled fast, so they are
+// prefetched further ahead to hide the DRAM latency.
+constexpr int64_t kEmbeddingPrefetchBytesAhead = 4096;
+constexpr int64_t kEmbeddingPrefetchMinDistance = 2;
+constexpr int64_t kEmbeddingPrefetchMaxDistance = 16;
+
+// Return the number of lookups to prefetch the rows ahead, 0 to not prefetch.
+// It is IPEX_EMBEDDINGBAG_PREFETCH_DISTANCE if it is set, so that it can be
+// tuned for a model.
+inline int64_t embedding_prefetch_distance(
+    int64_t row_bytes,
+    int64_t table_bytes) {
+  static int64_t env_distance = []() {
+    auto env = getenv("IPEX_EMBEDDINGBAG_PREFETCH_DISTANCE");
+    return env != nullptr ? std::max(atoi(env), 0) : -1;
+  }();
+  if (env_distance >= 0) {
+    return env_distance;
+  }
+  if (table_bytes <= kEmbeddingPrefetchMinTableBytes || row_bytes <= 0) {
+    return 0;
+  }
+  return std::min(
+      std::max(
+          kEmbeddingPrefetchBytesAhead / row_bytes,
+          kEmbeddingPrefetchMinDistance),
+      kEmbeddingPrefetchMaxDistance);
+}
+
+inline void prefetch_embedding_row(const char* row, int64_t row_bytes) {
+#ifdef __x86_64__
+  const char* line = reinterpret_cast<const char*>(
+      reinterpret_cast<uintptr_t>(row) & ~uintptr_t(63));
+  for (; line < row + row_bytes; line += 64) {
+    _mm_prefetch(line, _MM_HINT_T0);
+  }
+#endif
+}
+
+// Called by the lookup j of a pooling loop, prefetch the row of the lookup
+// j + distance, unless it is at or past last_idx, the end of the lookups
+// pooled by the caller. A single row is issued per lookup, so that the rows in
+// flight stay at distance lookups ahead whatever the pooling factor.
+template <typename index_t>
+inline void prefetch_embedding_row_ahead(
+    const index_t* indices,
+    const int64_t j,
+    const int64_t last_idx,
+    const int64_t distance,
+    const void* weight,
+    const int64_t row_bytes) {
+  if (distance > 0 && j + distance < last_idx) {
+    prefetch_embedding_row(
+        static_cast<const char*>(weight) + indices[j + distance] * row_bytes,
+        row_bytes);
+  }
+}
+
+} // namespace cpu
+} // namespace torch_ipex
@@ -0,0 +1,217 @@
+#pragma once
+
+#include <ATen/Tensor.h>
+#include "vec/vec.h"
+
+// The rotary embedding of one head, shared by the RoPE kernels and the
+// epilogue of the fused QKV projection in TPPGEMMKrnl.h.
+
+namespace torch_ipex {
+namespace cpu {
+namespace {
+
+template <typename T_in, typename T_emb>
+void apply_rope_along_head(
+    T_in* in_ptr_start,
+    T_emb* cos_start,
+    T_emb* sin_start,
+    int64_t rotary_ndims,
+    int64_t offset) {
+  for (int h = 0; h < rotary_ndims / 2;
+       h++) { // used by lamma, ToDo:vectorization
+    float in0 = in_ptr_start[h];
+    float in1 = in_ptr_start[h + offset];
+    float sin = sin_start[h];
+    float cos = cos_start[h];
+    float out0 = in0 * cos - in1 * sin;
+    float out1 = in1 * cos + in0 * sin;
+    in_ptr_start[h] = out0;
+    in_ptr_start[h + offset] = out1;
+  }
+}
+
+template <>
+void apply_rope_along_head(
+    at::BFloat16* in_ptr_start,
+    float* cos_start,
+    float* sin_start,
+    int64_t rotary_ndims,
+    int64_t offset) {
+  auto vec_size = 16;
+  auto h = 0;
+#if defined(CPU_CAPABILITY_AVX512)
+  for (h = 0; h <= rotary_ndims / 2 - vec_size; h += vec_size) {
+    auto in0 = torch_ipex::cpu::kernel::convert_bf16_to_fp32(
+        _mm256_loadu_si256((__m256i*)(in_ptr_start + h)));
+    auto in1 = torch_ipex::cpu::kernel::convert_bf16_to_fp32(
+        _mm256_loadu_si256((__m256i*)(in_ptr_start + h + offset)));
+    auto sin = _mm512_loadu_ps(sin_start + h);
+    auto cos = _mm512_loadu_ps(cos_start + h);
+    auto out0 = _mm512_sub_ps(_mm512_mul_ps(in0, cos), _mm512_mul_ps(in1, sin));
+    auto out1 = _mm512_add_ps(_mm512_mul_ps(in1, cos), _mm512_mul_ps(in0, sin));
+    _mm256_storeu_si256((__m256i*)(in_ptr_start + h), cvt_fp32_to_bf16(out0));
+    _mm256_storeu_si256(
+        (__m256i*)(in_ptr_start + h + offset), cvt_fp32_to_bf16(out1));
+  }
+  for (; h < rotary_ndims / 2; h++) {
+    float in0 = in_ptr_start[h];
+    float in1 = in_ptr_start[h + offset];
+    float sin = sin_start[h];
+    float cos = cos_start[h];
+    float out0 = in0 * cos - in1 * sin;
+    float out1 = in1 * cos + in0 * sin;
+    in_ptr_start[h] = out0;
+    in_ptr_start[h + offset] = out1;
+  }
+#else
+  for (h = 0; h < rotary_ndims / 2; h++) {
+    float in0 = in_ptr_start[h];
+    float in1 = in_ptr_start[h + offset];
+    float sin = sin_start[h];
+    float cos = cos_start[h];
+    float out0 = in0 * cos - in1 * sin;
+    float out1 = in1 * cos + in0 * sin;
+    in_ptr_start[h] = out0;
+    in_ptr_start[h + offset] = out1;
+  }
+#endif
+}
+
+template <>
+void apply_rope_along_head(
+    at::BFloat16* in_ptr_start,
+    at::BFloat16* cos_start,
+    at::BFloat16* sin_start,
+    int64_t rotary_ndims,
+    int64_t offset) {
+  auto vec_size = 16;
+  auto h = 0;
+#if defined(CPU_CAPABILITY_AVX512)
+  for (h = 0; h <= rotary_ndims / 2 - vec_size; h += vec_size) {
+    auto in0 = torch_ipex::cpu::kernel::convert_bf16_to_fp32(
+        _mm256_loadu_si256((__m256i*)(in_ptr_start + h)));
+    auto in1 = torch_ipex::cpu::kernel::convert_bf16_to_fp32(
+        _mm256_loadu_si256((__m256i*)(in_ptr_start + h + offset)));
+    auto sin = torch_ipex::cpu::kernel::convert_bf16_to_fp32(
+        _mm256_loadu_si256((__m256i*)(sin_start + h)));
+    auto cos = torch_ipex::cpu::kernel::convert_bf16_to_fp32(
+        _mm256_loadu_si256((__m256i*)(cos_start + h)));
+    auto out0 = _mm512_sub_ps(_mm512_mul_ps(in0, cos), _mm512_mul_ps(in1, sin));
+    auto out1 = _mm512_add_ps(_mm512_mul_ps(in1, cos), _mm512_mul_ps(in0, sin));
+    _mm256_storeu_si256((__m256i*)(in_ptr_start + h), cvt_fp32_to_bf16(out0));
+    _mm256_storeu_si256(
+        (__m256i*)(in_ptr_start + h + offset), cvt_fp32_to_bf16(out1));
+  }
+  for (; h < rotary_ndims / 2; h++) {
+    float in0 = in_ptr_start[h];
+    float in1 = in_ptr_start[h + offset];
+    float sin = sin_start[h];
+    float cos = cos_start[h];
+    float out0 = in0 * cos - in1 * sin;
+    float out1 = in1 * cos + in0 * sin;
+    in_ptr_start[h] = out0;
+    in_ptr_start[h + offset] = out1;
+  }
+#else
+  for (h = 0; h < rotary_ndims / 2; h++) {
+    float in0 = in_ptr_start[h];
+    float in1 = in_ptr_start[h + offset];
+    float sin = sin_start[h];
+    float cos = cos_start[h];
+    float out0 = in0 * cos - in1 * sin;
+    float out1 = in1 * cos + in0 * sin;
+    in_ptr_start[h] = out0;
+    in_ptr_start[h + offset] = out1;
+  }
+#endif
+}
+
+template <>
+void apply_rope_along_head(
+    float* in_ptr_start,
+    float* cos_start,
+    float* sin_start,
+    int64_t rotary_ndims,
+    int64_t offset) {
+  auto vec_size = 16;
+  auto h = 0;
+#if defined(CPU_CAPABILITY_AVX512)
+  for (h = 0; h <= rotary_ndims / 2 - vec_size; h += vec_size) {
+    auto in0 = _mm512_loadu_ps(in_ptr_start + h);
+    auto in1 = _mm512_loadu_ps(in_ptr_start + h + offset);
+    auto sin = _mm512_loadu_ps(sin_start + h);
+    auto cos = _mm512_loadu_ps(cos_start + h);
+    auto out0 = _mm512_sub_ps(_mm512_mul_ps(in0, cos), _mm512_mul_ps(in1, sin));
+    auto out1 = _mm512_add_ps(_mm512_mul_ps(in1, cos), _mm512_mul_ps(in0, sin));
+    _mm512_storeu_ps(in_ptr_start + h, out0);
+    _mm512_storeu_ps(in_ptr_start + h + offset, out1);
+  }
+  for (; h < rotary_ndims / 2; h++) {
+    float in0 = in_ptr_start[h];
+    float in1 = in_ptr_start[h + offset];
+    float sin = sin_start[h];
+    float cos = cos_start[h];
+    float out0 = in0 * cos - in1 * sin;
+    float out1 = in1 * cos + in0 * sin;
+    in_ptr_start[h] = out0;
+    in_ptr_start[h + offset] = out1;
+  }
+#else
+  for (h = 0; h < rotary_ndims / 2; h++) {
+    float in0 = in_ptr_start[h];
+    float in1 = in_ptr_start[h + offset];
+    float sin = sin_start[h];
+    float cos = cos_start[h];
+    float out0 = in0 * cos - in1 * sin;
+    float out1 = in1 * cos + in0 * sin;
+    in_ptr_start[h] = out0;
+    in_ptr_start[h + offset] = out1;
+  }
+#endif
+}
+// Apply the rotary embedding of position p to one head in place.
+template <typename T>
+inline void apply_rope_on_head(
+    T* in_ptr_start,
+    float* emb_pos_ptr,
+    long p,
+    int64_t HR,
+    int64_t offset,
+    int64_t rotary_ndims) {
+  auto COFF = HR / 2;
+  if (1 == offset) { // used by GPT-J 6B
+    for (int h = 0, h2 = 0; h < HR; h += 2, h2++) {
+      float in0 = in_ptr_start[h];
+      float in1 = in_ptr_start[h + 1];
+      float sin = emb_pos_ptr[p * HR + h2];
+      float cos = emb_pos_ptr[p * HR + COFF + h2];
+      float out0 = in0 * cos - in1 * sin;
+      float out1 = in1 * cos + in0 * sin;
+      in_ptr_start[h] = out0;
+      in_ptr_start[h + 1] = out1;
+    }
+  } else {
+    auto sin_start = emb_pos_ptr + p * HR;
+    auto cos_start = emb_pos_ptr + p * HR + COFF;
+    apply_rope_along_head<T, float>(
+        in_ptr_start, cos_start, sin_start, rotary_ndims, offset);
+  }
+}
+
+// The position of token s of batch b. Falcon passes the start position only.
+inline long get_rope_position(
+    long* pos_ptr,
+    int64_t pos_numel,
+    int64_t offset,
+    int64_t b,
+    int64_t S,
+    int64_t s) {
+  if (1 != offset && pos_numel == 1) {
+    return pos_ptr[0] + s;
+  }
+  return pos_ptr[b * S + s];
+}
+
+} // namespace
+} // namespace cpu
+} // namespace torch_ipex
@@ -0,0 +1,155 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <future>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+namespace torch_ipex {
+namespace jit {
+namespace fuser {
+namespace onednn {
+
+struct CompiledPartitionCacheStats {
+  int64_t hits;
+  int64_t misses;
+  int64_t evictions;
+};
+
+// The LRU cache of compiled partitions shared by all the threads of the
+// process. The keys are striped over shards with their own lock, so that the
+// threads running different partitions do not contend with each other. When
+// several threads miss on the same key at once, only one of them compiles
+// and the others wait for its result.
+template <typename Key, typename Value>
+class CompiledPartitionCache {
+ public:
+  using ValuePtr = std::shared_ptr<const Value>;
+
+  explicit CompiledPartitionCache(size_t capacity) {
+    setCapacity(capacity);
+  }
+
+  CompiledPartitionCache(const CompiledPartitionCache&) = delete;
+  CompiledPartitionCache& operator=(const CompiledPartitionCache&) = delete;
+
+  // Return the cached value of the key, or call compile() to create it.
+  ValuePtr getOrCompile(
+      const Key& key,
+      const std::function<ValuePtr()>& compile) {
+    auto& shard = shards_[std::hash<Key>()(key) % kNumShards];
+    std::promise<ValuePtr> promise;
+    {
+      std::unique_lock<std::mutex> lock(shard.mutex);
+      auto iter = shard.map.find(key);
+      if (iter != shard.map.end()) {
+        shard.items.splice(shard.items.begin(), shard.items, iter->second);
+        hits_++;
+        return iter->second->second;
+      }
+      auto pending = shard.pending.find(key);
+      if (pending != shard.pending.end()) {
+        // another thread is compiling the same key, wait for it
+        auto future = pending->second;
+        lock.unlock();
+        hits_++;
+        return future.get();
+      }
+      shard.pending.emplace(key, promise.get_future().share());
+      misses_++;
+    }
+
+    ValuePtr value;
+    try {
+      value = compile();
+    } catch (...) {
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      shard.pending.erase(key);
+      promise.set_exception(std::current_exception());
+      throw;
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      shard.items.emplace_front(key, value);
+      shard.map[key] = shard.items.begin();
+      shard.pending.erase(key);
+      evict(shard);
+    }
+    promise.set_value(value);
+    return value;
+  }
+
+  void setCapacity(size_t capacity) {
+    capacity_ = capacity;
+    shardCapacity_ =
+        std::max<size_t>((capacity + kNumShards - 1) / kNumShards, 1);
+    for (auto& shard : shards_) {
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      evict(shard);
+    }
+  }
+
+  size_t getCapacity() const {
+    return capacity_;
+  }
+
+  // Drop all the cached values, the values still held by the running threads
+  // are released after they finish.
+  void clear() {
+    for (auto& shard : shards_) {
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      shard.map.clear();
+      shard.items.clear();
+    }
+  }
+
+  CompiledPartitionCacheStats getStats() const {
+    return {hits_.load(), misses_.load(), evictions_.load()};
+  }
+
+  void resetStats() {
+    hits_ = 0;
+    misses_ = 0;
+    evictions_ = 0;
+  }
+
+ private:
+  static constexpr size_t kNumShards = 16;
+
+  using key_value_pair_t = std::pair<Key, ValuePtr>;
+  using list_iterator_t = typename std::list<key_value_pair_t>::iterator;
+
+  struct Shard {
+    std::mutex mutex;
+    std::list<key_value_pair_t> items;
+    std::unordered_map<Key, list_iterator_t> map;
+    std::unordered_map<Key, std::shared_future<ValuePtr>> pending;
+  };
+
+  // must be called with the lock of the shard held
+  void evict(Shard& shard) {
+    while (shard.map.size() > shardCapacity_) {
+      shard.map.erase(shard.items.back().first);
+      shard.items.pop_back();
+      evictions_++;
+    }
+  }
+
+  Shard shards_[kNumShards];
+  std::atomic<size_t> capacity_{1};
+  // every shard keeps at most its part of the capacity
+  std::atomic<size_t> shardCapacity_{1};
+  std::atomic<int64_t> hits_{0};
+  std::atomic<int64_t> misses_{0};
+  std::atomic<int64_t> evictions_{0};
+};
+
+} // namespace onednn
+} // namespace fuser
+} // namespace jit
+} // namespace torch_ipex
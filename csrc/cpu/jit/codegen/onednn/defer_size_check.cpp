@@ -1,5 +1,6 @@
 #include <torch/csrc/jit/ir/alias_analysis.h>
 
+#include "guard_shape.h"
 #include "utils.h"
 
 namespace torch_ipex {
@@ -9,6 +10,56 @@ namespace onednn {
 
 using namespace torch::jit;
 
+namespace {
+
+c10::optional<int64_t> rankOf(Value* v) {
+  auto type = v->type()->cast<TensorType>();
+  auto dim = type ? type->dim() : c10::nullopt;
+  return dim.has_value() ? c10::optional<int64_t>(*dim) : c10::nullopt;
+}
+
+// Return the dim that the aten::size reads if it is the bucketed dim.
+c10::optional<int64_t> bucketedSizeDim(Node* node) {
+  auto bucketing = getShapeBucketing();
+  if (!bucketing.enabled || node->inputs().size() != 2) {
+    return c10::nullopt;
+  }
+  auto dim = toIValue(node->input(1));
+  auto rank = rankOf(node->input(0));
+  if (!dim.has_value() || !dim->isInt() || !rank.has_value()) {
+    return c10::nullopt;
+  }
+  auto d = dim->toInt() < 0 ? dim->toInt() + *rank : dim->toInt();
+  return d == bucketing.dim ? c10::optional<int64_t>(d) : c10::nullopt;
+}
+
+// Return whether the op keeps the size of the bucketed dim of the input. A
+// bucketed partition slices its outputs back to the real size, so the
+// aten::size deferred past such ops still reads the real size.
+bool keepsBucketedDim(const Use& use, int64_t dim) {
+  auto* user = use.user;
+  if (user->outputs().size() != 1) {
+    return false;
+  }
+  auto rank = rankOf(user->input(use.offset));
+  if (!rank.has_value() || rankOf(user->output(0)) != rank) {
+    return false;
+  }
+  switch (user->kind()) {
+    case aten::linear:
+    case aten::matmul:
+      // the dim is not contracted
+      return use.offset == 0 && dim + 1 < *rank;
+    case aten::softmax:
+    case aten::layer_norm:
+      return use.offset == 0;
+    default:
+      return false;
+  }
+}
+
+} // namespace
+
 class SizeCheckMover {
  private:
   Block* block_;
@@ -41,17 +92,26 @@ class SizeCheckMover {
     // %d = aten::quantize_per_tensor(%c, %scale, %zp, %dtype)
     // %sz1 = aten::size(%d, %0) <--defer size after quantize_per_tensor
     // %sz2 = aten::size(%d, %1) <--defer size after quantize_per_tensor
+    //
+    // With shape bucketing, the size of the bucketed dim is also deferred
+    // past the ops which keep the dim, e.g. the projections of an attention
+    // %sz = aten::size(%x, %1)
+    // %q = aten::linear(%x, %weight, %bias)
+    // ->
+    // %q = aten::linear(%x, %weight, %bias)
+    // %sz = aten::size(%q, %1)
     if (node->kind() != aten::size)
       return false;
 
     auto* input = node->input(0);
     auto& uses = input->uses();
+    auto sizeDim = bucketedSizeDim(node);
     bool onlyUsedByShapePreserveOp = uses.size() > 1 &&
-        std::all_of(uses.begin(), uses.end(), [node](auto& u) {
-                                       return u.user == node ||
-                                           u.user->kind() == aten::size ||
-                                           utils::isEltwiseOp(u.user);
-                                     });
+        std::all_of(uses.begin(), uses.end(), [&](auto& u) {
+          return u.user == node || u.user->kind() == aten::size ||
+              utils::isEltwiseOp(u.user) ||
+              (sizeDim.has_value() && keepsBucketedDim(u, *sizeDim));
+        });
 
     if (!onlyUsedByShapePreserveOp)
       return false;
@@ -1,10 +1,18 @@
 #include "guard_shape.h"
 #include "fusion_group_name.h"
+#include "utils.h"
 
+#include <ATen/core/functional.h>
 #include <torch/csrc/jit/jit_log.h>
 #include <torch/csrc/jit/passes/tensorexpr_fuser.h>
 #include <torch/csrc/jit/runtime/graph_executor.h>
 
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <numeric>
+#include <unordered_map>
+
 namespace torch_ipex {
 namespace jit {
 namespace fuser {
@@ -12,8 +20,646 @@ namespace onednn {
 
 using namespace torch::jit;
 
+// convert the type of the input at the offset of the guarded node
 using tensor_type_converter_t =
-    c10::function_ref<TensorTypePtr(const TensorTypePtr& t)>;
+    c10::function_ref<TensorTypePtr(size_t offset, const TensorTypePtr& t)>;
+
+namespace {
+
+std::mutex shapeBucketingMutex;
+ShapeBucketing shapeBucketing;
+
+c10::optional<size_t> rankOf(Value* v) {
+  auto type = v->type()->cast<TensorType>();
+  return type ? type->dim() : c10::nullopt;
+}
+
+// The tensor inputs of these ops other than the first one are the weights,
+// which are never padded.
+bool isParameterInput(Node* node, size_t offset) {
+  if (offset == 0) {
+    return false;
+  }
+  switch (node->kind()) {
+    case aten::matmul:
+    case aten::mm:
+      // the batched operands are not weights, e.g. the keys of an attention
+      return rankOf(node->input(offset)).value_or(0) <= 2;
+    case aten::linear:
+    case aten::conv2d:
+    case aten::_convolution:
+    case aten::conv_transpose2d:
+    case aten::conv_transpose3d:
+    case aten::batch_norm:
+    case aten::layer_norm:
+      return true;
+    default:
+      return false;
+  }
+}
+
+bool isUnaryOrBinaryOp(Node* node) {
+  if (utils::isEltwiseOp(node) || utils::isBinaryOp(node)) {
+    return node->kind() != Symbol::aten("quantize_per_channel") &&
+        (node->kind() != aten::max || node->inputs().size() == 2);
+  }
+  switch (node->kind()) {
+    case aten::sub:
+    case aten::where:
+    case aten::tanh:
+    case aten::elu:
+    case aten::gelu:
+    case aten::mish:
+    case aten::round:
+    case aten::exp:
+    case aten::sqrt:
+    case aten::rsqrt:
+    case aten::abs:
+    case aten::square:
+    case aten::clamp:
+    case aten::hardsigmoid:
+    case aten::hardtanh:
+    case aten::hardswish:
+    case aten::log:
+    case aten::leaky_relu:
+    case aten::pow:
+    case aten::dequantize:
+    case aten::contiguous:
+    case aten::type_as:
+      return true;
+    default:
+      return false;
+  }
+}
+
+c10::optional<std::vector<int64_t>> sizesOf(Value* v) {
+  auto type = v->type()->cast<TensorType>();
+  return type ? type->sizes().concrete_sizes() : c10::nullopt;
+}
+
+int64_t normalizeDim(int64_t dim, int64_t rank) {
+  return dim < 0 ? dim + rank : dim;
+}
+
+// What the padded entries of a value hold along a padded dim, i.e. the entries
+// at the padded indices of the dim and at the real indices of the other padded
+// dims. The real entries are exact whatever the padding is, until a padded dim
+// is reduced, e.g. by the softmax over the keys of an attention or by the
+// matmul of its probabilities and values.
+enum class Padding {
+  // zeros, as the kernel pads the inputs
+  Zero,
+  // the lowest value or -inf, as the kernel pads the additive attention masks
+  Lowest,
+  // finite values computed from the paddings above
+  Finite,
+  // any values, including inf and nan
+  Unknown,
+};
+
+// the padded dims of a value and what they hold
+using PaddedDims = std::map<int64_t, Padding>;
+
+// Return whether the input is an additive attention mask, i.e. it is only
+// added to the input of a softmax, so the kernel pads it with the lowest value
+// to mask the padded keys out.
+bool isAdditiveMask(Value* input) {
+  auto type = input->type()->cast<TensorType>();
+  if (!type || !type->scalarType().has_value() ||
+      !c10::isFloatingType(*type->scalarType()) || input->uses().empty()) {
+    return false;
+  }
+  for (auto& use : input->uses()) {
+    if (use.user->kind() != aten::add) {
+      return false;
+    }
+    for (auto& sum : use.user->output(0)->uses()) {
+      if (sum.user->kind() != aten::softmax) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// the padding of an entry computed from the finite values and the entries of
+// the same row, e.g. by layer_norm
+Padding finiteOf(Padding p) {
+  return p == Padding::Zero || p == Padding::Finite ? Padding::Finite
+                                                    : Padding::Unknown;
+}
+
+// the padding of a row multiplied by finite values, e.g. by a weight
+Padding scaledOf(Padding p) {
+  return p == Padding::Zero ? Padding::Zero : finiteOf(p);
+}
+
+// Return the padding of the output of an elementwise op from the paddings of
+// its operands, nullopt for an operand broadcast to the padded dim, which holds
+// the real values.
+Padding combinePadding(
+    Symbol kind,
+    const std::vector<c10::optional<Padding>>& operands) {
+  auto is = [&](size_t i, Padding p) {
+    return i < operands.size() && operands[i] == p;
+  };
+  auto any = [&](Padding p) {
+    return std::any_of(
+        operands.begin(), operands.end(), [&](auto& o) { return o == p; });
+  };
+  auto all = [&](Padding p) {
+    return std::all_of(
+        operands.begin(), operands.end(), [&](auto& o) { return o == p; });
+  };
+  if (any(Padding::Unknown)) {
+    return Padding::Unknown;
+  }
+  switch (kind) {
+    case aten::add:
+      if (any(Padding::Lowest)) {
+        return Padding::Lowest;
+      }
+      return all(Padding::Zero) ? Padding::Zero : Padding::Finite;
+    case aten::sub:
+      if (is(1, Padding::Lowest)) {
+        return Padding::Unknown;
+      }
+      if (is(0, Padding::Lowest)) {
+        return Padding::Lowest;
+      }
+      return all(Padding::Zero) ? Padding::Zero : Padding::Finite;
+    case aten::mul:
+      if (any(Padding::Lowest)) {
+        return Padding::Unknown;
+      }
+      return any(Padding::Zero) ? Padding::Zero : Padding::Finite;
+    case aten::div:
+      // the padded divisors may be zeros
+      if (any(Padding::Lowest) ||
+          (operands.size() > 1 && operands[1].has_value())) {
+        return Padding::Unknown;
+      }
+      return is(0, Padding::Zero) ? Padding::Zero : Padding::Finite;
+    case aten::relu:
+      return is(0, Padding::Zero) || is(0, Padding::Lowest) ? Padding::Zero
+                                                            : Padding::Finite;
+    case aten::contiguous:
+    case aten::type_as:
+    case aten::to:
+      return operands[0].value_or(Padding::Finite);
+    default:
+      return any(Padding::Lowest) ? Padding::Unknown : Padding::Finite;
+  }
+}
+
+// Propagate the padding of the bucketed inputs through the graph. An op is
+// passed only if the real entries of its output are exact with the padded
+// inputs: the padded dims of its operands match, and a reduction over a padded
+// dim only adds zeros, or takes the softmax of the lowest values.
+class PaddingPropagation {
+ public:
+  PaddingPropagation(const std::shared_ptr<Graph>& graph, int64_t dim)
+      : graph_(graph) {
+    for (auto* input : graph_->inputs()) {
+      auto rank = rankOf(input);
+      auto sizes = sizesOf(input);
+      // the inputs broadcast at the dim are padded at the other dims if any,
+      // e.g. the keys of an attention mask
+      if (!rank.has_value() || *rank <= static_cast<size_t>(dim) ||
+          !isPaddable(input) || (sizes.has_value() && (*sizes)[dim] == 1)) {
+        continue;
+      }
+      inputs_[input][dim] = paddingOfInput(input);
+    }
+  }
+
+  bool run(BucketedShapes& shapes) {
+    // An input found to span a padded dim of the graph at another dim is
+    // padded at that dim too, and the graph is visited again.
+    bool done = false;
+    while (!done) {
+      padded_ = inputs_;
+      promoted_ = c10::nullopt;
+      done = true;
+      for (auto* node : graph_->nodes()) {
+        auto hasPadded = std::any_of(
+            node->inputs().begin(), node->inputs().end(), [&](Value* v) {
+              return padded_.count(v) > 0;
+            });
+        if (!hasPadded || visit(node)) {
+          continue;
+        }
+        if (!promoted_.has_value()) {
+          GRAPH_DEBUG("Padding is not exact on node ", *node);
+          return false;
+        }
+        inputs_[promoted_->first][promoted_->second] =
+            paddingOfInput(promoted_->first);
+        done = false;
+        break;
+      }
+    }
+
+    auto dimsOf = [&](Value* v) {
+      std::vector<int64_t> dims;
+      auto it = padded_.find(v);
+      if (it != padded_.end()) {
+        for (auto& p : it->second) {
+          dims.push_back(p.first);
+        }
+      }
+      return dims;
+    };
+    shapes.inputDims = fmap(graph_->inputs(), dimsOf);
+    shapes.maskedInputs = fmap(graph_->inputs(), [&](Value* v) {
+      return inputs_.count(v) > 0 && isAdditiveMask(v);
+    });
+    shapes.outputDims = fmap(graph_->outputs(), dimsOf);
+    return std::any_of(
+        shapes.outputDims.begin(),
+        shapes.outputDims.end(),
+        [](const std::vector<int64_t>& dims) { return !dims.empty(); });
+  }
+
+ private:
+  static bool isPaddable(Value* input) {
+    auto& uses = input->uses();
+    return std::none_of(uses.begin(), uses.end(), [](const Use& u) {
+      return isParameterInput(u.user, u.offset);
+    });
+  }
+
+  static Padding paddingOfInput(Value* input) {
+    return isAdditiveMask(input) ? Padding::Lowest : Padding::Zero;
+  }
+
+  c10::optional<Padding> paddingAt(Value* v, int64_t dim) const {
+    auto it = padded_.find(v);
+    if (it == padded_.end()) {
+      return c10::nullopt;
+    }
+    auto p = it->second.find(dim);
+    return p == it->second.end() ? c10::nullopt
+                                 : c10::optional<Padding>(p->second);
+  }
+
+  // Ask for the graph input to be padded at the dim, and return false to visit
+  // the graph again. The other values could not be padded.
+  bool promote(Value* v, int64_t dim) {
+    if (v->node()->kind() == prim::Param && isPaddable(v)) {
+      promoted_ = std::make_pair(v, dim);
+    }
+    return false;
+  }
+
+  bool setOutput(Node* node, PaddedDims&& out) {
+    if (!out.empty()) {
+      padded_[node->output(0)] = std::move(out);
+    }
+    return true;
+  }
+
+  bool onlyFirstPadded(Node* node) const {
+    for (size_t i = 1; i < node->inputs().size(); i++) {
+      if (padded_.count(node->input(i))) {
+        return false;
+      }
+    }
+    return padded_.count(node->input(0)) > 0;
+  }
+
+  // Collect the paddings of the operands at a dim of the output, given the
+  // dims of the operands broadcast to it, -1 if an operand has no such dim.
+  // Return false if an operand spans a padded dim unpadded.
+  bool broadcastPadding(
+      const std::vector<std::pair<Value*, int64_t>>& operands,
+      std::vector<c10::optional<Padding>>& paddings,
+      bool& padded) {
+    paddings.assign(operands.size(), c10::nullopt);
+    padded = false;
+    for (size_t i = 0; i < operands.size(); i++) {
+      if (operands[i].second >= 0) {
+        paddings[i] = paddingAt(operands[i].first, operands[i].second);
+        padded |= paddings[i].has_value();
+      }
+    }
+    if (!padded) {
+      return true;
+    }
+    for (size_t i = 0; i < operands.size(); i++) {
+      auto* v = operands[i].first;
+      auto dim = operands[i].second;
+      if (dim < 0 || paddings[i].has_value()) {
+        continue;
+      }
+      auto sizes = sizesOf(v);
+      if (!sizes.has_value() || (*sizes)[dim] != 1) {
+        return promote(v, dim);
+      }
+    }
+    return true;
+  }
+
+  bool visit(Node* node) {
+    if (node->outputs().size() != 1 ||
+        !rankOf(node->output(0)).has_value()) {
+      return false;
+    }
+    switch (node->kind()) {
+      case aten::permute:
+      case aten::transpose:
+        return onlyFirstPadded(node) && visitTranspose(node);
+      case aten::linear:
+        return onlyFirstPadded(node) && visitLinear(node);
+      case aten::matmul:
+      case aten::mm:
+      case aten::bmm:
+        return visitMatmul(node);
+      case aten::softmax:
+        return onlyFirstPadded(node) && visitSoftmax(node);
+      case aten::layer_norm:
+        return onlyFirstPadded(node) && visitLayerNorm(node);
+      case aten::conv2d:
+      case aten::_convolution:
+      case aten::conv_transpose2d:
+      case aten::conv_transpose3d:
+      case aten::batch_norm:
+      case aten::max_pool2d:
+      case aten::avg_pool2d: {
+        // only the samples of a batch are computed independently
+        if (!onlyFirstPadded(node)) {
+          return false;
+        }
+        auto& in = padded_.at(node->input(0));
+        if (in.size() != 1 || !in.count(0)) {
+          return false;
+        }
+        return setOutput(node, {{0, finiteOf(in.at(0))}});
+      }
+      default:
+        return isUnaryOrBinaryOp(node) && visitElementwise(node);
+    }
+  }
+
+  bool visitTranspose(Node* node) {
+    auto* input = node->input(0);
+    auto rank = static_cast<int64_t>(rankOf(input).value_or(0));
+    std::vector<int64_t> order(rank);
+    std::iota(order.begin(), order.end(), 0);
+    if (node->kind() == aten::permute) {
+      auto dims = toIValue(node->input(1));
+      if (!dims.has_value() || !dims->isIntList() ||
+          dims->toIntVector().size() != order.size()) {
+        return false;
+      }
+      order = dims->toIntVector();
+      for (auto& d : order) {
+        d = normalizeDim(d, rank);
+      }
+    } else {
+      auto dim0 = toIValue(node->input(1));
+      auto dim1 = toIValue(node->input(2));
+      if (!dim0.has_value() || !dim0->isInt() || !dim1.has_value() ||
+          !dim1->isInt()) {
+        return false;
+      }
+      std::swap(
+          order[normalizeDim(dim0->toInt(), rank)],
+          order[normalizeDim(dim1->toInt(), rank)]);
+    }
+    auto& in = padded_.at(input);
+    PaddedDims out;
+    for (int64_t i = 0; i < rank; i++) {
+      auto it = in.find(order[i]);
+      if (it != in.end()) {
+        out[i] = it->second;
+      }
+    }
+    return setOutput(node, std::move(out));
+  }
+
+  bool visitLinear(Node* node) {
+    auto* input = node->input(0);
+    auto rank = static_cast<int64_t>(rankOf(input).value_or(0));
+    auto& in = padded_.at(input);
+    // the padded dim must not be contracted with the weight
+    if (rankOf(node->input(1)).value_or(0) != 2 || in.count(rank - 1)) {
+      return false;
+    }
+    bool hasBias = node->inputs().size() > 2 &&
+        node->input(2)->type()->cast<TensorType>() != nullptr;
+    PaddedDims out;
+    for (auto& p : in) {
+      out[p.first] = hasBias ? finiteOf(p.second) : scaledOf(p.second);
+    }
+    return setOutput(node, std::move(out));
+  }
+
+  bool visitMatmul(Node* node) {
+    auto* a = node->input(0);
+    auto* b = node->input(1);
+    auto ra = static_cast<int64_t>(rankOf(a).value_or(0));
+    auto rb = static_cast<int64_t>(rankOf(b).value_or(0));
+    if (ra < 2 || rb < 2) {
+      return false;
+    }
+    auto r = std::max(ra, rb);
+    // A padded dim may be contracted only if the padded products are zeros,
+    // e.g. the probabilities of the padded keys and the padded values.
+    auto ka = paddingAt(a, ra - 1);
+    auto kb = paddingAt(b, rb - 2);
+    bool contracted = ka.has_value() || kb.has_value();
+    if (contracted) {
+      if (!ka.has_value()) {
+        return promote(a, ra - 1);
+      }
+      if (!kb.has_value()) {
+        return promote(b, rb - 2);
+      }
+      auto zeroTimesFinite = [](Padding x, Padding y) {
+        return x == Padding::Zero &&
+            (y == Padding::Zero || y == Padding::Finite);
+      };
+      if (!zeroTimesFinite(*ka, *kb) && !zeroTimesFinite(*kb, *ka)) {
+        return false;
+      }
+    }
+    // The entries padded at both the contracted dim and another dim are not
+    // tracked, and they are summed into the padded entries of the output.
+    PaddedDims out;
+    for (int64_t i = 0; i < r - 2; i++) {
+      std::vector<c10::optional<Padding>> paddings;
+      bool padded = false;
+      if (!broadcastPadding(
+              {{a, i - (r - ra)}, {b, i - (r - rb)}}, paddings, padded)) {
+        return false;
+      }
+      if (padded) {
+        out[i] = contracted ? Padding::Unknown
+                            : combinePadding(aten::mul, paddings);
+      }
+    }
+    auto rows = paddingAt(a, ra - 2);
+    if (rows.has_value()) {
+      out[r - 2] = contracted ? Padding::Unknown : scaledOf(*rows);
+    }
+    auto cols = paddingAt(b, rb - 1);
+    if (cols.has_value()) {
+      out[r - 1] = contracted ? Padding::Unknown : scaledOf(*cols);
+    }
+    return setOutput(node, std::move(out));
+  }
+
+  bool visitSoftmax(Node* node) {
+    auto* input = node->input(0);
+    auto rank = static_cast<int64_t>(rankOf(input).value_or(0));
+    auto softmaxDim = toIValue(node->input(1));
+    if (!softmaxDim.has_value() || !softmaxDim->isInt()) {
+      return false;
+    }
+    auto axis = normalizeDim(softmaxDim->toInt(), rank);
+    auto& in = padded_.at(input);
+    // The softmax of the lowest values are zeros, as long as the real entries
+    // of the row are not masked all.
+    auto reduced = in.find(axis);
+    if (reduced != in.end() && reduced->second != Padding::Lowest) {
+      return false;
+    }
+    PaddedDims out;
+    for (auto& p : in) {
+      if (p.first == axis) {
+        out[p.first] = Padding::Zero;
+      } else {
+        out[p.first] =
+            reduced != in.end() ? Padding::Unknown : finiteOf(p.second);
+      }
+    }
+    return setOutput(node, std::move(out));
+  }
+
+  bool visitLayerNorm(Node* node) {
+    auto* input = node->input(0);
+    auto rank = static_cast<int64_t>(rankOf(input).value_or(0));
+    auto normalizedShape = toIValue(node->input(1));
+    if (!normalizedShape.has_value() || !normalizedShape->isIntList()) {
+      return false;
+    }
+    auto normalized =
+        static_cast<int64_t>(normalizedShape->toIntVector().size());
+    PaddedDims out;
+    for (auto& p : padded_.at(input)) {
+      if (p.first >= rank - normalized) {
+        return false;
+      }
+      out[p.first] = finiteOf(p.second);
+    }
+    return setOutput(node, std::move(out));
+  }
+
+  bool visitElementwise(Node* node) {
+    auto outRank = static_cast<int64_t>(*rankOf(node->output(0)));
+    std::vector<std::pair<Value*, int64_t>> tensors;
+    for (size_t i = 0; i < node->inputs().size(); i++) {
+      auto* v = node->input(i);
+      // only the dtype of the other input of type_as is used
+      if (!v->type()->cast<TensorType>() ||
+          (node->kind() == aten::type_as && i == 1)) {
+        continue;
+      }
+      auto rank = rankOf(v);
+      if (!rank.has_value() || static_cast<int64_t>(*rank) > outRank) {
+        return false;
+      }
+      tensors.emplace_back(v, static_cast<int64_t>(*rank));
+    }
+    PaddedDims out;
+    for (int64_t d = 0; d < outRank; d++) {
+      std::vector<std::pair<Value*, int64_t>> operands;
+      for (auto& t : tensors) {
+        operands.emplace_back(t.first, d - (outRank - t.second));
+      }
+      std::vector<c10::optional<Padding>> paddings;
+      bool padded = false;
+      if (!broadcastPadding(operands, paddings, padded)) {
+        return false;
+      }
+      if (padded) {
+        out[d] = combinePadding(node->kind(), paddings);
+      }
+    }
+    return setOutput(node, std::move(out));
+  }
+
+  std::shared_ptr<Graph> graph_;
+  // the padded dims of the graph inputs
+  std::unordered_map<Value*, PaddedDims> inputs_;
+  // the padded dims of the values visited
+  std::unordered_map<Value*, PaddedDims> padded_;
+  // the graph input and the dim to pad it at, found by the last visit
+  c10::optional<std::pair<Value*, int64_t>> promoted_;
+};
+
+// The kernel pads the bucketed dims of the inputs, so the guard admits any
+// size of them. The strides of the dims before them vary with the sizes, so
+// they are not checked by the guard either. The kernel only pads contiguous
+// inputs and keys the compiled partitions on the strides, see
+// LlgaKernel::padInputs.
+TensorTypePtr relaxBucketedDims(
+    const TensorTypePtr& t,
+    const std::vector<int64_t>& bucketedDims) {
+  auto sizes = t->symbolic_sizes().sizes();
+  if (bucketedDims.empty() || !sizes.has_value()) {
+    return t;
+  }
+  auto dims = *sizes;
+  for (auto dim : bucketedDims) {
+    if (static_cast<size_t>(dim) < dims.size()) {
+      dims[dim] = c10::ShapeSymbol::newSymbol();
+    }
+  }
+  return TensorType::create(
+      t->scalarType(),
+      t->device(),
+      c10::SymbolicShape(dims),
+      c10::VaryingShape<c10::Stride>(dims.size()),
+      t->requires_grad());
+}
+
+} // namespace
+
+void setShapeBucketing(const ShapeBucketing& bucketing) {
+  TORCH_CHECK(bucketing.dim >= 0, "The bucketed dim must be non-negative");
+  TORCH_CHECK(
+      std::is_sorted(bucketing.boundaries.begin(), bucketing.boundaries.end()),
+      "The bucket boundaries must be sorted in ascending order");
+  std::lock_guard<std::mutex> lock(shapeBucketingMutex);
+  shapeBucketing = bucketing;
+}
+
+ShapeBucketing getShapeBucketing() {
+  std::lock_guard<std::mutex> lock(shapeBucketingMutex);
+  return shapeBucketing;
+}
+
+int64_t getBucketSize(const ShapeBucketing& bucketing, int64_t size) {
+  if (bucketing.boundaries.empty()) {
+    int64_t bucketSize = 1;
+    while (bucketSize < size) {
+      bucketSize <<= 1;
+    }
+    return bucketSize;
+  }
+  auto boundary = std::lower_bound(
+      bucketing.boundaries.begin(), bucketing.boundaries.end(), size);
+  return boundary == bucketing.boundaries.end() ? size : *boundary;
+}
+
+bool isShapeBucketable(
+    const std::shared_ptr<Graph>& graph,
+    int64_t dim,
+    BucketedShapes& shapes) {
+  return PaddingPropagation(graph, dim).run(shapes);
+}
 
 void insertTypeGuardForFusionGroup(
     Node* guarded_node,
@@ -25,7 +671,8 @@ void insertTypeGuardForFusionGroup(
   // Fixup types of the subgraph inputs
   std::vector<Value*> inputs_to_check;
   std::vector<TypePtr> guard_types;
-  for (Value* input : guarded_node->inputs()) {
+  for (size_t i = 0; i < guarded_node->inputs().size(); ++i) {
+    Value* input = guarded_node->input(i);
     // We only check inputs of the guarded nodes and expect user to infer
     // intermediates and outputs shapes
     if (!input->type()->cast<TensorType>()) {
@@ -39,7 +686,8 @@ void insertTypeGuardForFusionGroup(
       continue;
     }
     inputs_to_check.push_back(input);
-    guard_types.push_back(type_converter(input->type()->expect<TensorType>()));
+    guard_types.push_back(
+        type_converter(i, input->type()->expect<TensorType>()));
   }
   if (!inputs_to_check.size()) {
     return;
@@ -135,9 +783,25 @@ void prepareFusionGroupAndGuardOutputs(Block* block) {
     // refer to
     // `torch/csrc/jit/passes/tensorexpr_fuser.cpp:removeOutputsUsedOnlyInSize`
     // removeOutputsUsedOnlyInSize(fusion_group);
+    auto bucketing = getShapeBucketing();
+    BucketedShapes shapes;
+    if (bucketing.enabled &&
+        isShapeBucketable(
+            fusion_group->g(attr::Subgraph), bucketing.dim, shapes)) {
+      // one compiled partition serves the whole bucket, and the outputs are
+      // sliced back to the size of the inputs, see LlgaKernel::padInputs.
+      // The other inputs are guarded as usual.
+      insertTypeGuardForFusionGroup(
+          fusion_group,
+          [&](size_t offset, const TensorTypePtr& t) {
+            return relaxBucketedDims(t, shapes.inputDims[offset]);
+          },
+          Symbol::fromQualString(fuser::onednn::LlgaGuardName()));
+      continue;
+    }
     insertTypeGuardForFusionGroup(
         fusion_group,
-        [](const TensorTypePtr& t) { return t; },
+        [](size_t offset, const TensorTypePtr& t) { return t; },
         Symbol::fromQualString(fuser::onednn::LlgaGuardName()));
   }
 }
@@ -7,6 +7,44 @@ namespace jit {
 namespace fuser {
 namespace onednn {
 
+// Shape bucketing pads the dim of the partition inputs up to a bucket
+// boundary, so that one compiled partition serves all the sizes of a bucket
+// and the outputs are sliced back to the real size. Boundaries are sorted in
+// ascending order, the sizes are padded to the next power of 2 if there is no
+// boundary, and the sizes beyond the last boundary are not padded.
+struct ShapeBucketing {
+  bool enabled = false;
+  int64_t dim = 1;
+  std::vector<int64_t> boundaries;
+};
+
+void setShapeBucketing(const ShapeBucketing& bucketing);
+
+ShapeBucketing getShapeBucketing();
+
+// Return the size of the bucket that the size belongs to.
+int64_t getBucketSize(const ShapeBucketing& bucketing, int64_t size);
+
+// The dims of the inputs and outputs of a bucketed partition which carry the
+// bucketed size, empty for the values which do not. The inputs are padded at
+// their dims with zeros, or with the lowest value for the additive attention
+// masks, and the outputs are sliced at theirs.
+struct BucketedShapes {
+  std::vector<std::vector<int64_t>> inputDims;
+  std::vector<bool> maskedInputs;
+  std::vector<std::vector<int64_t>> outputDims;
+};
+
+// Return whether padding the inputs of the graph along the dim leaves the real
+// entries of the outputs exact. The padded rows are computed independently of
+// the real ones, and a padded dim found at another dim of the graph, e.g. the
+// keys of an attention, may only be reduced by a softmax of the masked scores
+// or by a matmul with the zero rows of the padding.
+bool isShapeBucketable(
+    const std::shared_ptr<torch::jit::Graph>& graph,
+    int64_t dim,
+    BucketedShapes& shapes);
+
 void prepareFusionGroupAndGuardOutputs(torch::jit::Block* block);
 
 } // namespace onednn
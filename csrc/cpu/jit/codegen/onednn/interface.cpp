@@ -7,6 +7,7 @@
 #include "kernel.h"
 #include "layout_propagation.h"
 #include "lift_up_quant.h"
+#include "persistent_cache.h"
 #include "prepare_binary.h"
 #include "prepare_dequant.h"
 #include "prepare_silu.h"
@@ -105,6 +106,62 @@ bool getLlgaWeightCacheEnabled() {
   return dnnl::graph::get_constant_tensor_cache();
 }
 
+std::vector<int64_t> getLlgaCompiledPartitionCacheStats() {
+  auto stats = LlgaKernel::getCacheStats();
+  return {stats.hits, stats.misses, stats.evictions};
+}
+
+void resetLlgaCompiledPartitionCacheStats() {
+  LlgaKernel::resetCacheStats();
+}
+
+void clearLlgaCompiledPartitionCache() {
+  LlgaKernel::clearCache();
+}
+
+void setLlgaCompiledPartitionCacheCapacity(int64_t capacity) {
+  LlgaKernel::setCacheCapacity(capacity);
+}
+
+int64_t getLlgaCompiledPartitionCacheCapacity() {
+  return LlgaKernel::getCacheCapacity();
+}
+
+void setLlgaPersistentCacheDir(const std::string& dir) {
+  PersistentPartitionCache::getInstance().setDirectory(dir);
+}
+
+std::string getLlgaPersistentCacheDir() {
+  return PersistentPartitionCache::getInstance().getDirectory();
+}
+
+void waitLlgaPersistentCacheWarmup() {
+  PersistentPartitionCache::getInstance().waitForWarmup();
+}
+
+void setLlgaShapeBucketing(
+    bool enabled,
+    int64_t dim,
+    const std::vector<int64_t>& boundaries) {
+  ShapeBucketing bucketing;
+  bucketing.enabled = enabled;
+  bucketing.dim = dim;
+  bucketing.boundaries = boundaries;
+  setShapeBucketing(bucketing);
+}
+
+bool isLlgaShapeBucketingEnabled() {
+  return getShapeBucketing().enabled;
+}
+
+int64_t getLlgaShapeBucketingDim() {
+  return getShapeBucketing().dim;
+}
+
+std::vector<int64_t> getLlgaShapeBucketingBoundaries() {
+  return getShapeBucketing().boundaries;
+}
+
 } // namespace onednn
 } // namespace fuser
 
@@ -112,6 +169,7 @@ using namespace torch::jit;
 
 Operation createLlgaKernel(const Node* node) {
   auto kernel = std::make_shared<fuser::onednn::LlgaKernel>(node);
+  kernel->warmUpFromPersistentCache();
   return [kernel](Stack* stack) {
     RECORD_FUNCTION(kernel->profileName(), c10::ArrayRef<c10::IValue>());
 
@@ -25,6 +25,38 @@ IPEX_API void setLlgaWeightCacheEnabled(bool enabled);
 
 IPEX_API bool getLlgaWeightCacheEnabled();
 
+// hits, misses and evictions of the process-wide compiled partition cache
+IPEX_API std::vector<int64_t> getLlgaCompiledPartitionCacheStats();
+
+IPEX_API void resetLlgaCompiledPartitionCacheStats();
+
+IPEX_API void clearLlgaCompiledPartitionCache();
+
+IPEX_API void setLlgaCompiledPartitionCacheCapacity(int64_t capacity);
+
+IPEX_API int64_t getLlgaCompiledPartitionCacheCapacity();
+
+// the directory of the on-disk partition cache, empty to disable it
+IPEX_API void setLlgaPersistentCacheDir(const std::string& dir);
+
+IPEX_API std::string getLlgaPersistentCacheDir();
+
+// block until the recorded shapes are compiled in the background
+IPEX_API void waitLlgaPersistentCacheWarmup();
+
+// pad the dim of the partition inputs up to the bucket boundaries, so that a
+// compiled partition serves all the sizes of a bucket, see ShapeBucketing
+IPEX_API void setLlgaShapeBucketing(
+    bool enabled,
+    int64_t dim,
+    const std::vector<int64_t>& boundaries);
+
+IPEX_API bool isLlgaShapeBucketingEnabled();
+
+IPEX_API int64_t getLlgaShapeBucketingDim();
+
+IPEX_API std::vector<int64_t> getLlgaShapeBucketingBoundaries();
+
 } // namespace onednn
 } // namespace fuser
 
@@ -5,10 +5,14 @@
 #include "operator.h"
 #include "runtime.h"
 
+#include <ATen/Dispatch.h>
+#include <ATen/Parallel.h>
 #include <ATen/core/functional.h>
 #include <ATen/quantized/Quantizer.h>
 #include <torch/csrc/jit/jit_log.h>
 
+#include <limits>
+
 namespace torch_ipex {
 namespace jit {
 namespace fuser {
@@ -19,12 +23,57 @@ using namespace dnnl::graph;
 
 using data_type = dnnl::graph::logical_tensor::data_type;
 
-thread_local std::list<LlgaKernel::key_value_pair_t>
-    LlgaKernel::cache_items_list_;
-thread_local std::
-    unordered_map<std::vector<int64_t>, LlgaKernel::list_iterator_t>
-        LlgaKernel::cache_items_map_;
-thread_local int LlgaKernel::capacity_ = 7500;
+namespace {
+
+// mkldnn tensors have no strides, their layout is keyed by the partition
+// which produces them
+std::vector<int64_t> stridesOf(const at::Tensor& t) {
+  return t.is_mkldnn() ? std::vector<int64_t>(t.dim(), 0) : t.strides().vec();
+}
+
+// The debug names of the values and the source ranges depend on the tracing
+// and the process, so the graph is printed without them to key the records of
+// the on-disk cache.
+std::string canonicalGraphString(const std::shared_ptr<Graph>& graph) {
+  auto copy = graph->copy();
+  for (auto* input : copy->inputs()) {
+    input->setDebugName("");
+  }
+  for (auto* node : copy->nodes()) {
+    for (auto* output : node->outputs()) {
+      output->setDebugName("");
+    }
+  }
+  return copy->toString(/* print_source_locations */ false);
+}
+
+} // namespace
+
+LlgaKernel::cp_cache_t& LlgaKernel::getCache() {
+  static cp_cache_t cache(/* capacity */ 7500);
+  return cache;
+}
+
+CompiledPartitionCacheStats LlgaKernel::getCacheStats() {
+  return getCache().getStats();
+}
+
+void LlgaKernel::resetCacheStats() {
+  getCache().resetStats();
+}
+
+void LlgaKernel::clearCache() {
+  getCache().clear();
+}
+
+void LlgaKernel::setCacheCapacity(int64_t capacity) {
+  TORCH_CHECK(capacity > 0, "LLGA cache capacity must be positive");
+  getCache().setCapacity(capacity);
+}
+
+int64_t LlgaKernel::getCacheCapacity() {
+  return getCache().getCapacity();
+}
 
 LlgaKernel::LlgaKernel(const Node* fusionNode)
     : fusionNode_(fusionNode),
@@ -46,6 +95,20 @@ LlgaKernel::LlgaKernel(const Node* fusionNode)
       "LLGA subgraph should contain only one partition");
   partition_ = partitions[0];
   nPartitionInputs_ = partition_.get_input_ports().size();
+
+  bucketing_ = getShapeBucketing();
+  if (bucketing_.enabled &&
+      isShapeBucketable(graph_, bucketing_.dim, bucketedShapes_)) {
+    // opaque outputs could not be sliced
+    for (size_t i = 0; i < nOutputs_; i++) {
+      if (!bucketedShapes_.outputDims[i].empty() && useOpaqueLayout(i)) {
+        bucketedShapes_ = BucketedShapes();
+        break;
+      }
+    }
+  } else {
+    bucketedShapes_ = BucketedShapes();
+  }
   GRAPH_DEBUG("Initialized ", debugName(), "\n", graph_->toString());
 }
 
@@ -89,9 +152,7 @@ std::map<size_t, int64_t> LlgaKernel::initializeTensorIdToOccurence() const {
   return tensorIdToOccurence;
 }
 
-ArgSpecs LlgaKernel::initializeInputSpecs(const TensorArgs& inputs) {
-  ArgSpecs inputSpecs;
-  inputSpecs.reserve(nPartitionInputs_);
+void LlgaKernel::initializeTracedInputs(const TensorArgs& inputs) {
   std::call_once(tracedInputShapesInitialized_, [&]() {
     auto numInputs = inputs.size();
     for (size_t i = 0; i < numInputs; i++) {
@@ -99,6 +160,11 @@ ArgSpecs LlgaKernel::initializeInputSpecs(const TensorArgs& inputs) {
       tracedInputStrides_.push_back(inputs[i].strides().vec());
     }
   });
+}
+
+ArgSpecs LlgaKernel::initializeInputSpecs(const TensorArgs& inputs) {
+  ArgSpecs inputSpecs;
+  inputSpecs.reserve(nPartitionInputs_);
   GRAPH_DEBUG("Initializing graph input logical tensors");
   // initializeTensorIdToOccurence can also be called just once for the first
   // input shape
@@ -190,73 +256,32 @@ bool LlgaKernel::inputValueIsNotUsedLater(size_t offset) const {
   return LlgaNodeWrapper(fusionNode_).inputValueIsNotUsedLater(offset);
 }
 
-void LlgaKernel::prepareAndCacheRunArgs(
-    RunArgs& runInputs,
-    RunArgs& runOutputs,
-    const TensorArgs& inputs,
-    TensorArgs& outputs,
-    ArgSpecs& inputSpecs,
-    ArgSpecs& outputSpecs) {
-  auto sizeOfRunArgsIdx = runArgsIdx_.size();
-  auto numOfConstantInputs = constantInputs_.size();
-  runInputs.reserve(sizeOfRunArgsIdx + numOfConstantInputs);
-  runOutputs.reserve(nOutputs_);
-
-  for (size_t i = 0; i < sizeOfRunArgsIdx; i++) {
-    auto& spec = inputSpecs[i];
-    auto& input = inputs[runArgsIdx_[i]];
-    runInputs.push_back(
-        {spec.logical_tensor(), Engine::getEngine(), input.data_ptr()});
-  }
-
-  for (size_t i = 0; i < numOfConstantInputs; i++) {
-    // constantInputSpecs are placed after graphInputSpecs
-    auto constantInputSpecIdx = nGraphInputs_ + i;
-    auto& constantInputSpec = inputSpecs[constantInputSpecIdx];
-    runInputs.push_back(
-        {constantInputSpec.logical_tensor(),
-         Engine::getEngine(),
-         constantInputs_[i].data_ptr()});
-  }
-
-  outputTensorTypes_.reserve(nOutputs_);
-  std::fill(outputTensorTypes_.begin(), outputTensorTypes_.end(), undefined);
+void LlgaKernel::initializeOutputTensorTypes(
+    cp_entry& entry,
+    const TensorArgs& inputs) {
+  entry.outputTensorTypes_.resize(nOutputs_, undefined);
   for (size_t i = 0; i < nOutputs_; i++) {
-    auto& spec = outputSpecs[i];
-    auto opt = c10::TensorOptions(spec.aten_scalar_type()).device(device_);
-
-    auto outputId = spec.tid();
-    auto inputOffset = inplacePairOffsets_[i];
+    auto& spec = entry.outputSpecs_[i];
+    auto inputOffset = entry.inplacePairOffsets_[i];
     if ((inputOffset != INT16_MIN) && inputValueIsNotUsedLater(inputOffset)) {
       // output reuses one of input tensors
-#ifdef GRAPH_DEBUG_ENABLED
-      GRAPH_DEBUG("Inplace computation");
-#endif
       GRAPH_DEBUG("INPUT INDEX OF INPLACE PAIR IS ", inputOffset);
-      auto inputTensor = inputs[inputOffset];
-      auto dataType = spec.dtype();
-      if (C10_UNLIKELY(!useOpaqueLayout(i) && inputTensor.is_mkldnn())) {
+      if (C10_UNLIKELY(
+              !useOpaqueLayout(i) && inputs[inputOffset].is_mkldnn())) {
         // If the input tensor was between two partitions, it would've been
         // wrapped with LlgaTensorImpl. But if it's being reused as the output
         // tensor, which is not between two partitions, then we'd have to
         // re-wrap it with a sub-class of TensorImpl, as it'd be fed into a
         // PyTorch op.
-#ifdef GRAPH_DEBUG_ENABLED
-        GRAPH_DEBUG("Rewrap tensor");
-#endif
-        auto llgaImpl =
-            static_cast<LlgaTensorImpl*>(inputTensor.unsafeGetTensorImpl());
+        auto dataType = spec.dtype();
         switch (dataType) {
           case data_type::f32:
           case data_type::bf16:
-            inputTensor = LlgaTensorImpl::llga_to_aten_tensor(llgaImpl);
-            outputTensorTypes_[i] = unquantizedInplaceCompute;
+            entry.outputTensorTypes_[i] = unquantizedInplaceCompute;
             break;
           case data_type::s8:
           case data_type::u8:
-            outputTensorTypes_[i] = quantizedInplaceCompute;
-            inputTensor = LlgaTensorImpl::llga_to_aten_tensor(
-                llgaImpl, spec.get_quantizer());
+            entry.outputTensorTypes_[i] = quantizedInplaceCompute;
             break;
           case data_type::s32:
           default:
@@ -264,128 +289,116 @@ void LlgaKernel::prepareAndCacheRunArgs(
                 false, "Invalid data type ", static_cast<size_t>(dataType));
         }
       } else {
-        outputTensorTypes_[i] = unwrappedInplaceCompute;
+        entry.outputTensorTypes_[i] = unwrappedInplaceCompute;
       }
-      outputs.push_back(inputTensor);
-      runOutputs.push_back(
-          {spec.logical_tensor(), Engine::getEngine(), inputTensor.data_ptr()});
     } else if (useOpaqueLayout(i)) {
       // Wrap tensors between partitions with LlgaTensorImpl wrapper, so that we
       // can bypass guard-check, as strides would be different than those
       // expected.
-#ifdef GRAPH_DEBUG_ENABLED
-      GRAPH_DEBUG("Between partitions");
-#endif
-      auto tensor = empty_llga(spec, opt);
-      outputs.push_back(tensor);
-      runOutputs.push_back(llga_from_aten_tensor(tensor));
-      outputTensorTypes_[i] = betweenPartitions;
+      entry.outputTensorTypes_[i] = betweenPartitions;
+    } else if (spec.is_quantized()) {
+      entry.outputTensorTypes_[i] = quantizedInputToFW;
     } else {
-#ifdef GRAPH_DEBUG_ENABLED
-      GRAPH_DEBUG("Neither opaque nor inplace");
-#endif
-      if (spec.is_quantized()) {
-        at::QuantizerPtr quantizer = spec.get_quantizer();
-        auto qtensor = at::new_qtensor(spec.sizes(), opt, quantizer);
-        // TODO: Setting strides is possible only on uniformly quantized tensor.
-        // Currently, only weight will use quantize_per_channel, data will
-        // always use quantize_per_tensor. We will only allocate buffer for data
-        // (output of a LlgaPartition). If in the future, we need allocate
-        // buffer for qensor that is quantized per channel, need implemeted
-        // as_strided_qtensorimpl for PER_CHANNEL QScheme.
-        qtensor.as_strided_(spec.sizes(), spec.strides());
-        outputs.push_back(qtensor);
-        runOutputs.push_back(
-            {spec.logical_tensor(), Engine::getEngine(), qtensor.data_ptr()});
-        outputTensorTypes_[i] = quantizedInputToFW;
-      } else {
-        auto tensor = at::empty_strided(spec.sizes(), spec.strides(), opt);
-        outputs.push_back(tensor);
-        runOutputs.push_back(
-            {spec.logical_tensor(), Engine::getEngine(), tensor.data_ptr()});
-        outputTensorTypes_[i] = unquantizedInputToFW;
-      }
+      entry.outputTensorTypes_[i] = unquantizedInputToFW;
     }
   }
   TORCH_CHECK(
       std::find(
-          outputTensorTypes_.begin(), outputTensorTypes_.end(), undefined) ==
-          outputTensorTypes_.end(),
+          entry.outputTensorTypes_.begin(),
+          entry.outputTensorTypes_.end(),
+          undefined) == entry.outputTensorTypes_.end(),
       "outputTensorTypes_ elements should not be undefined");
 }
 
 void LlgaKernel::prepareRunArgs(
+    const cp_entry& entry,
     RunArgs& runInputs,
     RunArgs& runOutputs,
     const TensorArgs& inputs,
-    TensorArgs& outputs,
-    ArgSpecs& outputSpecs) {
+    TensorArgs& outputs) {
   auto sizeOfRunArgsIdx = runArgsIdx_.size();
+  auto numOfConstantInputs = constantInputs_.size();
+  runInputs.reserve(sizeOfRunArgsIdx + numOfConstantInputs);
+  runOutputs.reserve(nOutputs_);
+
   for (size_t i = 0; i < sizeOfRunArgsIdx; i++) {
     auto& input = inputs[runArgsIdx_[i]];
-    runInputs[i].set_data_handle(input.data_ptr());
+    runInputs.push_back(
+        {entry.inputLogicalTensors_[i],
+         Engine::getEngine(),
+         input.data_ptr()});
+  }
+
+  for (size_t i = 0; i < numOfConstantInputs; i++) {
+    // constant input logical tensors are placed after the graph inputs
+    runInputs.push_back(
+        {entry.inputLogicalTensors_[sizeOfRunArgsIdx + i],
+         Engine::getEngine(),
+         constantInputs_[i].data_ptr()});
   }
 
   for (size_t i = 0; i < nOutputs_; i++) {
-    auto typeOfOutput = static_cast<int64_t>(outputTensorTypes_[i]);
-    auto& spec = outputSpecs[i];
+    auto typeOfOutput = static_cast<int64_t>(entry.outputTensorTypes_[i]);
+    auto& spec = entry.outputSpecs_[i];
     auto opt = c10::TensorOptions(spec.aten_scalar_type()).device(device_);
 
     switch (typeOfOutput) {
       case unwrappedInplaceCompute: {
-        auto inputTensor = inputs[inplacePairOffsets_[i]];
-        runOutputs[i].set_data_handle(inputTensor.data_ptr());
-        outputs.push_back(std::move(inputTensor));
+        outputs.push_back(inputs[entry.inplacePairOffsets_[i]]);
         break;
       }
       case quantizedInplaceCompute: {
-        auto inputTensor = inputs[inplacePairOffsets_[i]];
+        auto inputTensor = inputs[entry.inplacePairOffsets_[i]];
         auto llgaImpl =
             static_cast<LlgaTensorImpl*>(inputTensor.unsafeGetTensorImpl());
-        inputTensor =
-            LlgaTensorImpl::llga_to_aten_tensor(llgaImpl, spec.get_quantizer());
-        runOutputs[i].set_data_handle(inputTensor.data_ptr());
-        outputs.push_back(std::move(inputTensor));
+        outputs.push_back(LlgaTensorImpl::llga_to_aten_tensor(
+            llgaImpl, spec.get_quantizer()));
         break;
       }
       case unquantizedInplaceCompute: {
-        auto inputTensor = inputs[inplacePairOffsets_[i]];
+        auto inputTensor = inputs[entry.inplacePairOffsets_[i]];
         auto llgaImpl =
             static_cast<LlgaTensorImpl*>(inputTensor.unsafeGetTensorImpl());
-        inputTensor = LlgaTensorImpl::llga_to_aten_tensor(llgaImpl);
-        runOutputs[i].set_data_handle(inputTensor.data_ptr());
-        outputs.push_back(std::move(inputTensor));
+        outputs.push_back(LlgaTensorImpl::llga_to_aten_tensor(llgaImpl));
         break;
       }
       case betweenPartitions: {
         outputs.emplace_back(empty_llga(spec, opt));
-        runOutputs[i].set_data_handle(outputs[i].data_ptr());
-        break;
+        runOutputs.push_back(llga_from_aten_tensor(outputs[i]));
+        continue;
       }
       case quantizedInputToFW: {
+        // TODO: Setting strides is possible only on uniformly quantized
+        // tensor. Currently, only weight will use quantize_per_channel, data
+        // will always use quantize_per_tensor. We will only allocate buffer
+        // for data (output of a LlgaPartition). If in the future, we need
+        // allocate buffer for qensor that is quantized per channel, need
+        // implemeted as_strided_qtensorimpl for PER_CHANNEL QScheme.
         at::QuantizerPtr quantizer = spec.get_quantizer();
         outputs.emplace_back(at::new_qtensor(spec.sizes(), opt, quantizer)
                                  .as_strided_(spec.sizes(), spec.strides()));
-        runOutputs[i].set_data_handle(outputs[i].data_ptr());
         break;
       }
       case unquantizedInputToFW: {
         outputs.emplace_back(
             at::empty_strided(spec.sizes(), spec.strides(), opt));
-        runOutputs[i].set_data_handle(outputs[i].data_ptr());
         break;
       }
     }
+    runOutputs.push_back(
+        {spec.logical_tensor(), Engine::getEngine(), outputs[i].data_ptr()});
   }
 }
 
 std::pair<compiled_partition, ArgSpecs> LlgaKernel::compile(
     const partition& partition,
     const TensorArgs& inputs,
-    ArgSpecs& inputSpecs) {
+    ArgSpecs& inputSpecs,
+    std::vector<short>& inplacePairOffsets,
+    bool& unknownOutputDims) {
   RECORD_FUNCTION("LLGA_bridge::compileKernel", c10::ArrayRef<c10::IValue>({}));
   auto inputLogicalTensors = fmap(inputSpecs, toLogicalTensor);
-  auto outputSpecs = initializeOutputSpecs(inputs);
+  auto outputSpecs = initializeOutputSpecs(inputs, unknownOutputDims);
   auto outputLogicalTensors = fmap(outputSpecs, toLogicalTensor);
   compiled_partition compilation;
   try {
@@ -410,6 +423,7 @@ std::pair<compiled_partition, ArgSpecs> LlgaKernel::compile(
       outputLogicalTensors = fmap(outputSpecs, toLogicalTensor);
       compilation = partition.compile(
           inputLogicalTensors, outputLogicalTensors, Engine::getEngine());
+      unknownOutputDims = true;
     } else {
       // there's nothing we can do
       throw;
@@ -424,8 +438,8 @@ std::pair<compiled_partition, ArgSpecs> LlgaKernel::compile(
         outputSpecs[i].update_desc(compilation.query_logical_tensor(tid));
   }
 
-  inplacePairOffsets_.resize(nOutputs_);
-  std::fill(inplacePairOffsets_.begin(), inplacePairOffsets_.end(), INT16_MIN);
+  inplacePairOffsets.resize(nOutputs_);
+  std::fill(inplacePairOffsets.begin(), inplacePairOffsets.end(), INT16_MIN);
 
   // Build static mapping from output offset to input offset
   // in accordance with available inplace options
@@ -445,26 +459,19 @@ std::pair<compiled_partition, ArgSpecs> LlgaKernel::compile(
     TORCH_CHECK(
         outputSpecIter != outputSpecs.end(), "In-place output not found");
     auto outputOffset = outputSpecIter - outputSpecs.begin();
-    inplacePairOffsets_[outputOffset] = inputOffset;
+    inplacePairOffsets[outputOffset] = inputOffset;
   }
 
   return std::make_pair(compilation, outputSpecs);
 }
 
-LlgaKernel::cp_entry& LlgaKernel::compileAndCache(
-    Stack& stack,
-    TensorArgs& outputs) {
-  RECORD_FUNCTION("LLGA_bridge::prepareKernel", c10::ArrayRef<c10::IValue>({}));
-  // Grab input values from stack
-  auto stackInputs = last(stack, nGraphInputs_);
-  auto inputs = fmap(stackInputs, [&](const IValue& v) {
-    TORCH_CHECK(
-        v.isTensor(), "Stack values for LLGA partition must be Tensor type");
-    return v.toTensor();
-  });
+std::vector<int64_t> LlgaKernel::genCacheKey(
+    int64_t numThreads,
+    const std::vector<std::vector<int64_t>>& inputShapes,
+    const std::vector<std::vector<int64_t>>& inputStrides) const {
   std::vector<int64_t> key;
   key.reserve(1024);
-  key.push_back(omp_get_max_threads());
+  key.push_back(numThreads);
   // fusionNode_ may be reassigned to another LlgaFusionGroup after ~LlgaKernel
   // would be called, and another LlgaFusionGroup may be created for another
   // graph. But since JIT graphs have had a memory leak issue for years now,
@@ -472,72 +479,302 @@ LlgaKernel::cp_entry& LlgaKernel::compileAndCache(
   // So we would use 2 pieces of info that make a partition unique.
   key.push_back((uintptr_t)((void*)fusionNode_));
   key.push_back((uintptr_t)((void*)graph_.get()));
-  for (auto& in : inputs) {
-    auto shape_vec = in.sizes().vec();
+  for (auto& shape_vec : inputShapes) {
     key.insert(key.end(), shape_vec.begin(), shape_vec.end());
   }
-  auto iter = cache_items_map_.find(key);
-  if (iter == cache_items_map_.end()) {
-    GRAPH_DEBUG("Compiling partition");
-    cp_entry compiledPartitionEntry;
-    auto input_shape = inputs[0].sizes().vec();
-    auto inputSpecs = initializeInputSpecs(inputs);
-    auto compilationOutput = compile(partition_, inputs, inputSpecs);
-    compiledPartitionEntry.outputSpecs_ = std::move(compilationOutput.second);
-    compiledPartitionEntry.cp_ = std::move(compilationOutput.first);
-    prepareAndCacheRunArgs(
-        compiledPartitionEntry.inputLLGATensors_,
-        compiledPartitionEntry.outputLLGATensors_,
-        inputs,
-        outputs,
-        inputSpecs,
-        compiledPartitionEntry.outputSpecs_);
-    cache_items_list_.push_front(
-        key_value_pair_t(key, std::move(compiledPartitionEntry)));
-    cache_items_map_[key] = cache_items_list_.begin();
-    if (cache_items_map_.size() > capacity_) {
-      auto last = cache_items_list_.end();
-      last--;
-      cache_items_map_.erase(last->first);
-      cache_items_list_.pop_back();
+  // The guard of a bucketed partition does not check the strides, so a
+  // partition compiled for the strides of contiguous inputs must not be hit
+  // by the inputs of the same sizes and other strides.
+  for (auto& stride_vec : inputStrides) {
+    key.insert(key.end(), stride_vec.begin(), stride_vec.end());
+  }
+  return key;
+}
+
+std::shared_ptr<const LlgaKernel::cp_entry> LlgaKernel::compileEntry(
+    const TensorArgs& inputs,
+    int64_t numThreads,
+    bool warmUp) {
+  GRAPH_DEBUG("Compiling partition");
+  auto inputShapes =
+      fmap(inputs, [](const at::Tensor& t) { return t.sizes().vec(); });
+  auto inputStrides = fmap(inputs, stridesOf);
+  bool unknownOutputDims = warmUp;
+  auto persistent =
+      !warmUp && PersistentPartitionCache::getInstance().enabled();
+  if (persistent) {
+    std::lock_guard<std::mutex> lock(persistentMutex_);
+    auto decision = persistentDecisions_.find(
+        genCacheKey(numThreads, inputShapes, inputStrides));
+    if (decision != persistentDecisions_.end()) {
+      // the shape has been compiled and recorded by a previous process
+      unknownOutputDims = decision->second;
+      persistent = false;
     }
-    // If hash computation cost is higher than copying this struct,
-    // then remove std::move above & return compiledPartitionEntry instead
-    return cache_items_map_[key]->second;
-  } else {
-#ifdef GRAPH_DEBUG_ENABLED
-    GRAPH_DEBUG("Cached compiled partition is available");
-#endif
-    cache_items_list_.splice(
-        cache_items_list_.begin(), cache_items_list_, iter->second);
-    prepareRunArgs(
-        iter->second->second.inputLLGATensors_,
-        iter->second->second.outputLLGATensors_,
-        inputs,
-        outputs,
-        iter->second->second.outputSpecs_);
-    return iter->second->second;
+  }
+
+  auto compiledPartitionEntry = std::make_shared<cp_entry>();
+  auto inputSpecs = initializeInputSpecs(inputs);
+  auto compilationOutput = compile(
+      partition_,
+      inputs,
+      inputSpecs,
+      compiledPartitionEntry->inplacePairOffsets_,
+      unknownOutputDims);
+  compiledPartitionEntry->cp_ = std::move(compilationOutput.first);
+  compiledPartitionEntry->outputSpecs_ = std::move(compilationOutput.second);
+  // constant inputs are placed after the graph inputs in inputSpecs
+  for (size_t i = 0; i < runArgsIdx_.size(); i++) {
+    compiledPartitionEntry->inputLogicalTensors_.push_back(
+        inputSpecs[i].logical_tensor());
+  }
+  for (size_t i = 0; i < constantInputs_.size(); i++) {
+    compiledPartitionEntry->inputLogicalTensors_.push_back(
+        inputSpecs[nGraphInputs_ + i].logical_tensor());
+  }
+  initializeOutputTensorTypes(*compiledPartitionEntry, inputs);
+
+  if (persistent) {
+    PartitionRecord record;
+    record.unknownOutputDims = unknownOutputDims;
+    for (auto& input : inputs) {
+      auto opaque = input.is_mkldnn() || input.is_quantized();
+      record.inputs.push_back(
+          {input.scalar_type(),
+           opaque,
+           input.sizes().vec(),
+           stridesOf(input)});
+    }
+    std::lock_guard<std::mutex> lock(persistentMutex_);
+    if (graphStr_.empty()) {
+      graphStr_ = canonicalGraphString(graph_);
+    }
+    if (persistentDecisions_
+            .emplace(
+                genCacheKey(numThreads, inputShapes, inputStrides),
+                unknownOutputDims)
+            .second) {
+      PersistentPartitionCache::getInstance().append(
+          PersistentPartitionCache::getInstance().partitionKey(
+              graphStr_, numThreads),
+          record);
+    }
+  }
+  return compiledPartitionEntry;
+}
+
+void LlgaKernel::warmUpFromPersistentCache() {
+  if (PersistentPartitionCache::getInstance().enabled()) {
+    loadPersistentRecords(omp_get_max_threads());
+  }
+}
+
+void LlgaKernel::loadPersistentRecords(int64_t numThreads) {
+  auto& persistentCache = PersistentPartitionCache::getInstance();
+  std::vector<PartitionRecord> records;
+  {
+    std::lock_guard<std::mutex> lock(persistentMutex_);
+    if (!persistentLoadedThreads_.insert(numThreads).second) {
+      return;
+    }
+    if (graphStr_.empty()) {
+      graphStr_ = canonicalGraphString(graph_);
+    }
+    records = persistentCache.load(
+        persistentCache.partitionKey(graphStr_, numThreads));
+    for (auto& record : records) {
+      auto inputShapes = fmap(record.inputs, [](const auto& input) {
+        return input.sizes;
+      });
+      auto inputStrides = fmap(record.inputs, [](const auto& input) {
+        return input.strides;
+      });
+      persistentDecisions_[genCacheKey(
+          numThreads, inputShapes, inputStrides)] = record.unknownOutputDims;
+    }
+  }
+  // The runs on a shape being compiled in the background wait for it instead
+  // of compiling it again. The tasks keep the kernel alive until they finish.
+  for (auto& record : records) {
+    auto hasOpaqueInput = std::any_of(
+        record.inputs.begin(), record.inputs.end(), [](const auto& input) {
+          return input.opaque;
+        });
+    if (hasOpaqueInput ||
+        static_cast<int64_t>(record.inputs.size()) != nGraphInputs_) {
+      continue;
+    }
+    persistentCache.beginWarmup();
+    at::launch([self = shared_from_this(), record, numThreads]() {
+      // compile for the number of threads of the record, then restore the
+      // setting of the thread in the pool
+      auto poolThreads = omp_get_max_threads();
+      omp_set_num_threads(numThreads);
+      auto recordInputs = fmap(record.inputs, [](const auto& input) {
+        return at::empty_strided(
+            input.sizes, input.strides, at::TensorOptions(input.dtype));
+      });
+      auto inputShapes = fmap(record.inputs, [](const auto& input) {
+        return input.sizes;
+      });
+      auto inputStrides = fmap(record.inputs, [](const auto& input) {
+        return input.strides;
+      });
+      try {
+        getCache().getOrCompile(
+            self->genCacheKey(numThreads, inputShapes, inputStrides),
+            [&]() {
+              return self->compileEntry(
+                  recordInputs, numThreads, /* warmUp */ true);
+            });
+      } catch (std::exception& e) {
+        GRAPH_DEBUG("Failed to compile the recorded shape: ", e.what());
+      }
+      omp_set_num_threads(poolThreads);
+      PersistentPartitionCache::getInstance().endWarmup();
+    });
   }
 }
 
+int64_t LlgaKernel::padInputs(TensorArgs& inputs) const {
+  if (bucketedShapes_.inputDims.empty()) {
+    return -1;
+  }
+  int64_t size = -1;
+  for (size_t i = 0; i < nGraphInputs_; i++) {
+    auto& dims = bucketedShapes_.inputDims[i];
+    if (dims.empty()) {
+      continue;
+    }
+    auto& input = inputs[i];
+    // Opaque and quantized inputs could not be padded by a plain copy. The
+    // guard does not check the strides of the bucketed inputs, so only the
+    // contiguous ones are padded, and the others run at their own strides.
+    if (input.is_mkldnn() || input.is_quantized() || !input.is_contiguous()) {
+      return -1;
+    }
+    // all the bucketed dims have the same size, e.g. the queries and the keys
+    // of a self attention
+    for (auto dim : dims) {
+      if (input.dim() <= dim || (size != -1 && input.size(dim) != size)) {
+        return -1;
+      }
+      size = input.size(dim);
+    }
+  }
+  if (size == -1) {
+    return -1;
+  }
+  auto bucketSize = getBucketSize(bucketing_, size);
+  if (bucketSize == size) {
+    return -1;
+  }
+
+  RECORD_FUNCTION("LLGA_bridge::padInputs", c10::ArrayRef<c10::IValue>({}));
+  for (size_t i = 0; i < nGraphInputs_; i++) {
+    auto& dims = bucketedShapes_.inputDims[i];
+    if (dims.empty()) {
+      continue;
+    }
+    auto sizes = inputs[i].sizes().vec();
+    for (auto dim : dims) {
+      sizes[dim] = bucketSize;
+    }
+    auto padded = at::empty(sizes, inputs[i].options());
+    // The padded rows are computed independently and sliced away. The
+    // reductions over a padded dim only see the zeros, or the masked scores
+    // of the padded keys, see isShapeBucketable.
+    at::Scalar fill = 0;
+    if (bucketedShapes_.maskedInputs[i]) {
+      fill = AT_DISPATCH_FLOATING_TYPES_AND2(
+          at::kBFloat16, at::kHalf, padded.scalar_type(), "padInputs", [] {
+            return at::Scalar(std::numeric_limits<scalar_t>::lowest());
+          });
+    }
+    auto real = padded;
+    for (auto dim : dims) {
+      padded.narrow(dim, size, bucketSize - size).fill_(fill);
+      real = real.narrow(dim, 0, size);
+    }
+    real.copy_(inputs[i]);
+    inputs[i] = std::move(padded);
+  }
+  return size;
+}
+
+void LlgaKernel::sliceOutputs(TensorArgs& outputs, int64_t size) const {
+  for (size_t i = 0; i < nOutputs_; i++) {
+    auto& dims = bucketedShapes_.outputDims[i];
+    if (dims.empty()) {
+      continue;
+    }
+    // The graph has profiled the outputs as contiguous, e.g., a view of them
+    // expects it, so the slices are made contiguous. The slice is contiguous
+    // by itself when the dims before the bucketed one are all 1.
+    for (auto dim : dims) {
+      outputs[i] = outputs[i].narrow(dim, 0, size);
+    }
+    outputs[i] = outputs[i].contiguous();
+  }
+}
+
+std::shared_ptr<const LlgaKernel::cp_entry> LlgaKernel::compileAndCache(
+    const TensorArgs& inputs,
+    TensorArgs& outputs,
+    RunArgs& runInputs,
+    RunArgs& runOutputs) {
+  RECORD_FUNCTION("LLGA_bridge::prepareKernel", c10::ArrayRef<c10::IValue>({}));
+  int64_t numThreads = omp_get_max_threads();
+  initializeTracedInputs(inputs);
+  auto inputShapes =
+      fmap(inputs, [](const at::Tensor& t) { return t.sizes().vec(); });
+  auto key = genCacheKey(numThreads, inputShapes, fmap(inputs, stridesOf));
+  auto entry = getCache().getOrCompile(key, [&]() {
+    // the records of the number of threads when the kernel was created are
+    // loaded by warmUpFromPersistentCache already
+    if (PersistentPartitionCache::getInstance().enabled()) {
+      loadPersistentRecords(numThreads);
+    }
+    return compileEntry(inputs, numThreads);
+  });
+  prepareRunArgs(*entry, runInputs, runOutputs, inputs, outputs);
+  return entry;
+}
+
 void LlgaKernel::run(Stack& stack) {
   GRAPH_DEBUG("In ", debugName(), "\n");
   TensorArgs outputs;
   outputs.reserve(nOutputs_);
+  RunArgs runInputs;
+  RunArgs runOutputs;
+
+  // Grab input values from stack
+  auto stackInputs = last(stack, nGraphInputs_);
+  auto inputs = fmap(stackInputs, [&](const IValue& v) {
+    TORCH_CHECK(
+        v.isTensor(), "Stack values for LLGA partition must be Tensor type");
+    return v.toTensor();
+  });
+  // the padded inputs are held until the execution finishes
+  auto unpaddedSize = padInputs(inputs);
 
-  auto& compiledPartitionEntry = compileAndCache(stack, outputs);
+  // hold the entry until the execution finishes in case it is evicted by
+  // another thread
+  auto compiledPartitionEntry =
+      compileAndCache(inputs, outputs, runInputs, runOutputs);
 
 #ifdef GRAPH_DEBUG_ENABLED
   GRAPH_DEBUG("Executing partition");
 #endif
-  compiledPartitionEntry.cp_.execute(
-      Stream::getStream(),
-      compiledPartitionEntry.inputLLGATensors_,
-      compiledPartitionEntry.outputLLGATensors_);
+  compiledPartitionEntry->cp_.execute(
+      Stream::getStream(), runInputs, runOutputs);
 
 #ifdef GRAPH_DEBUG_ENABLED
   GRAPH_DEBUG("Partition executed");
 #endif
+  if (unpaddedSize != -1) {
+    sliceOutputs(outputs, unpaddedSize);
+  }
   // Update the stack.
   drop(stack, nGraphInputs_);
   for (auto& o : outputs) {
@@ -3,7 +3,10 @@
 #include <unordered_map>
 #include <vector>
 #include "codegen/LlgaTensorImpl.h"
+#include "compiled_partition_cache.h"
 #include "graph_helper.h"
+#include "guard_shape.h"
+#include "persistent_cache.h"
 #include "utils/rw_lock.h"
 
 #include <oneapi/dnnl/dnnl_graph.hpp>
@@ -50,12 +53,19 @@ using RunArg = dnnl::graph::tensor;
 using RunArgs = std::vector<RunArg>;
 using TensorArgs = std::vector<at::Tensor>;
 
-class LlgaKernel {
+// The background compilations of the on-disk cache hold a reference to the
+// kernel, so it is always created by std::make_shared.
+class LlgaKernel : public std::enable_shared_from_this<LlgaKernel> {
  public:
   explicit LlgaKernel(const torch::jit::Node* fusionNode);
 
   void run(torch::jit::Stack& stack);
 
+  // Compile the shapes of the on-disk cache in the background as soon as the
+  // kernel is created, so that all the partitions of a graph compile at the
+  // same time instead of one by one in the first run.
+  void warmUpFromPersistentCache();
+
   const std::string& debugName() const {
     return debugName_;
   }
@@ -64,6 +74,18 @@ class LlgaKernel {
     return profileName_;
   }
 
+  // The compiled partitions of all the kernels are kept in one LRU cache
+  // shared by all the threads of the process.
+  static CompiledPartitionCacheStats getCacheStats();
+
+  static void resetCacheStats();
+
+  static void clearCache();
+
+  static void setCacheCapacity(int64_t capacity);
+
+  static int64_t getCacheCapacity();
+
  private:
   bool useOpaqueLayout(size_t offset) const;
 
@@ -79,13 +101,21 @@ class LlgaKernel {
     unquantizedInputToFW
   };
 
+  // A compiled partition is shared by the threads once it is cached, so it
+  // only holds what is immutable after the compilation. The run args are
+  // created by every run with its own data handles.
   struct cp_entry {
     dnnl::graph::compiled_partition cp_;
-    RunArgs inputLLGATensors_;
-    RunArgs outputLLGATensors_;
+    std::vector<dnnl::graph::logical_tensor> inputLogicalTensors_;
     ArgSpecs outputSpecs_;
+    std::vector<short> inplacePairOffsets_;
+    std::vector<TypeOfOutputTensor> outputTensorTypes_;
   };
 
+  using cp_cache_t = CompiledPartitionCache<std::vector<int64_t>, cp_entry>;
+
+  static cp_cache_t& getCache();
+
   // Get the scale, zp and dtype from the node on the graph
   // and save them in the spec to re-use during runtime to
   // create qtensor for output of public format
@@ -100,31 +130,59 @@ class LlgaKernel {
 
   ArgSpecs initializeInputSpecs(const TensorArgs& inputs);
 
+  // The inputs of the first run, whose profiled output dims are compiled as
+  // known.
+  void initializeTracedInputs(const TensorArgs& inputs);
+
   ArgSpecs initializeOutputSpecs(
       const TensorArgs& inputs,
       bool convertDimsToUnknown);
 
+  // unknownOutputDims is true to compile with unknown output dims at once,
+  // and is set to true if the compilation falls back to unknown output dims
   std::pair<dnnl::graph::compiled_partition, ArgSpecs> compile(
       const dnnl::graph::partition& partition,
       const TensorArgs& inputs,
-      ArgSpecs& inputSpecs);
+      ArgSpecs& inputSpecs,
+      std::vector<short>& inplacePairOffsets,
+      bool& unknownOutputDims);
 
-  cp_entry& compileAndCache(torch::jit::Stack& stack, TensorArgs& outputs);
+  std::vector<int64_t> genCacheKey(
+      int64_t numThreads,
+      const std::vector<std::vector<int64_t>>& inputShapes,
+      const std::vector<std::vector<int64_t>>& inputStrides) const;
 
-  void prepareRunArgs(
-      RunArgs& inputLlgaTensors,
-      RunArgs& outputLlgaTensors,
+  // A warm-up compilation of a recorded shape runs before the traced inputs
+  // are known, so it compiles with unknown output dims and is not recorded.
+  std::shared_ptr<const cp_entry> compileEntry(
+      const TensorArgs& inputs,
+      int64_t numThreads,
+      bool warmUp = false);
+
+  // Load the records of the on-disk cache for the number of threads, and
+  // compile the recorded shapes in the background.
+  void loadPersistentRecords(int64_t numThreads);
+
+  // Pad the bucketed dims of the inputs up to the bucket boundary. Return the
+  // size of the dims before padding, or -1 if the inputs are not padded.
+  int64_t padInputs(TensorArgs& inputs) const;
+
+  void sliceOutputs(TensorArgs& outputs, int64_t size) const;
+
+  std::shared_ptr<const cp_entry> compileAndCache(
       const TensorArgs& inputs,
       TensorArgs& outputs,
-      ArgSpecs& outputSpecs);
+      RunArgs& inputLlgaTensors,
+      RunArgs& outputLlgaTensors);
 
-  void prepareAndCacheRunArgs(
+  void prepareRunArgs(
+      const cp_entry& entry,
       RunArgs& inputLlgaTensors,
       RunArgs& outputLlgaTensors,
       const TensorArgs& inputs,
-      TensorArgs& outputs,
-      ArgSpecs& inputSpecs,
-      ArgSpecs& outputSpecs);
+      TensorArgs& outputs);
+
+  void initializeOutputTensorTypes(cp_entry& entry, const TensorArgs& inputs);
 
   static std::string genDebugName() {
     static size_t debugId = 0;
@@ -165,25 +223,25 @@ class LlgaKernel {
   std::vector<torch::jit::Value*> constantValues_;
   TensorArgs constantInputs_;
 
-  // We'll do LRU without helper functions to minimize calls to the hash
-  // function. Adopted from
-  // https://github.com/lamerman/cpp-lru-cache/blob/master/include/lrucache.hpp
-  // LRU cache is per-thread, so as to enable weight sharing among groups of
-  // threads.
-  using key_value_pair_t = std::pair<std::vector<int64_t>, cp_entry>;
-  using list_iterator_t = std::list<key_value_pair_t>::iterator;
-  static thread_local std::list<key_value_pair_t> cache_items_list_;
-  static thread_local std::unordered_map<std::vector<int64_t>, list_iterator_t>
-      cache_items_map_;
-  static thread_local int capacity_;
   std::vector<std::vector<int64_t>> tracedInputShapes_;
   std::vector<std::vector<int64_t>> tracedInputStrides_;
   std::string debugName_;
   std::string profileName_;
-  std::vector<TypeOfOutputTensor> outputTensorTypes_;
   std::once_flag constantSpecInitializedFlag_;
   std::once_flag tracedInputShapesInitialized_;
-  std::vector<short> inplacePairOffsets_;
+
+  // the shape bucketing setting when the kernel is created, bucketedShapes_
+  // is empty if the partition is not bucketed
+  ShapeBucketing bucketing_;
+  BucketedShapes bucketedShapes_;
+
+  // states of the on-disk cache, guarded by persistentMutex_
+  std::mutex persistentMutex_;
+  // the graph without the names of the values, see canonicalGraphString
+  std::string graphStr_;
+  std::set<int64_t> persistentLoadedThreads_;
+  // the compilation decisions of the recorded cache keys
+  std::map<std::vector<int64_t>, bool> persistentDecisions_;
 };
 
 } // namespace onednn
@@ -0,0 +1,240 @@
+#include "persistent_cache.h"
+#include "aten/utils/isa_help.h"
+
+#include <dnnl.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace torch_ipex {
+namespace jit {
+namespace fuser {
+namespace onednn {
+
+// A record is one line of
+// unknownOutputDims numInputs [dtype opaque ndim sizes... strides...]...
+namespace {
+
+void writeRecord(std::ostream& os, const PartitionRecord& record) {
+  os << record.unknownOutputDims << " " << record.inputs.size();
+  for (auto& input : record.inputs) {
+    os << " " << static_cast<int>(input.dtype) << " " << input.opaque << " "
+       << input.sizes.size();
+    for (auto size : input.sizes) {
+      os << " " << size;
+    }
+    for (auto stride : input.strides) {
+      os << " " << stride;
+    }
+  }
+  os << "\n";
+}
+
+bool readRecord(std::istream& is, PartitionRecord& record) {
+  size_t numInputs = 0;
+  if (!(is >> record.unknownOutputDims >> numInputs)) {
+    return false;
+  }
+  record.inputs.resize(numInputs);
+  for (auto& input : record.inputs) {
+    int dtype = 0;
+    size_t ndim = 0;
+    if (!(is >> dtype >> input.opaque >> ndim) || dtype < 0 ||
+        dtype >= static_cast<int>(at::ScalarType::NumOptions)) {
+      return false;
+    }
+    input.dtype = static_cast<at::ScalarType>(dtype);
+    input.sizes.resize(ndim);
+    input.strides.resize(ndim);
+    for (auto& size : input.sizes) {
+      if (!(is >> size)) {
+        return false;
+      }
+    }
+    for (auto& stride : input.strides) {
+      if (!(is >> stride)) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// std::hash is not specified to be the same across the builds and the runs,
+// while the key must be stable across the processes sharing the directory
+uint64_t fnv1a(const std::string& str) {
+  uint64_t hash = 14695981039346656037ULL;
+  for (unsigned char c : str) {
+    hash ^= c;
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+// the lines of the valid records in the file, the duplicates removed and the
+// order of the first occurrences kept. numLines counts all the lines.
+std::vector<std::string> readRecordLines(
+    const std::string& path,
+    size_t& numLines) {
+  std::vector<std::string> lines;
+  std::ifstream file(path);
+  std::string line;
+  numLines = 0;
+  while (std::getline(file, line)) {
+    numLines++;
+    std::istringstream is(line);
+    PartitionRecord record;
+    // skip the broken line, e.g., written by a process killed halfway
+    if (!readRecord(is, record) ||
+        std::find(lines.begin(), lines.end(), line) != lines.end()) {
+      continue;
+    }
+    lines.push_back(std::move(line));
+  }
+  return lines;
+}
+
+} // namespace
+
+PersistentPartitionCache& PersistentPartitionCache::getInstance() {
+  static PersistentPartitionCache cache;
+  return cache;
+}
+
+PersistentPartitionCache::PersistentPartitionCache() {
+  auto dir = std::getenv("IPEX_LLGA_CACHE_DIR");
+  if (dir != nullptr) {
+    dir_ = dir;
+  }
+  enabled_ = !dir_.empty();
+}
+
+void PersistentPartitionCache::setDirectory(const std::string& dir) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  dir_ = dir;
+  enabled_ = !dir_.empty();
+}
+
+std::string PersistentPartitionCache::getDirectory() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return dir_;
+}
+
+bool PersistentPartitionCache::enabled() {
+  return enabled_;
+}
+
+std::string PersistentPartitionCache::partitionKey(
+    const std::string& graphStr,
+    int64_t numThreads) {
+  auto version = dnnl::version();
+  std::ostringstream setting;
+  setting << graphStr << "|" << numThreads << "|"
+          << torch_ipex::cpu::get_current_onednn_isa_level() << "|"
+          << version->major << "." << version->minor << "."
+          << version->patch << "." << version->hash;
+  std::ostringstream key;
+  key << std::hex << fnv1a(setting.str());
+  return key.str();
+}
+
+std::string PersistentPartitionCache::recordPath(
+    const std::string& partitionKey) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (dir_.empty()) {
+    return "";
+  }
+  return dir_ + "/llga_partition_" + partitionKey + ".txt";
+}
+
+std::vector<PartitionRecord> PersistentPartitionCache::load(
+    const std::string& partitionKey) {
+  std::vector<PartitionRecord> records;
+  auto path = recordPath(partitionKey);
+  if (path.empty()) {
+    return records;
+  }
+  size_t numLines = 0;
+  auto lines = readRecordLines(path, numLines);
+  if (lines.size() > kMaxRecordsPerPartition) {
+    lines.erase(lines.begin(), lines.end() - kMaxRecordsPerPartition);
+  }
+  // The appends never rewrite the file, so the duplicates of the processes
+  // sharing the directory and the dropped records are only removed here, once
+  // the file has grown to twice the cap. The records are written into a file
+  // of the process and renamed over the old one, so that no process reads a
+  // file written halfway. A record appended by another process in between is
+  // lost, it is recorded again by the next process compiling it.
+  if (numLines > 2 * kMaxRecordsPerPartition) {
+    auto tmpPath = path + "." + std::to_string(getpid()) + ".tmp";
+    bool written = false;
+    {
+      std::ofstream file(tmpPath, std::ios::trunc);
+      for (auto& line : lines) {
+        file << line << "\n";
+      }
+      written = static_cast<bool>(file.flush());
+    }
+    if (!written || std::rename(tmpPath.c_str(), path.c_str()) != 0) {
+      std::remove(tmpPath.c_str());
+    }
+  }
+  for (auto& line : lines) {
+    std::istringstream is(line);
+    PartitionRecord record;
+    readRecord(is, record);
+    records.push_back(std::move(record));
+  }
+  return records;
+}
+
+void PersistentPartitionCache::append(
+    const std::string& partitionKey,
+    const PartitionRecord& record) {
+  auto path = recordPath(partitionKey);
+  if (path.empty()) {
+    return;
+  }
+  std::ostringstream line;
+  writeRecord(line, record);
+  auto data = line.str();
+  // The line is appended by a single write to the file opened with O_APPEND,
+  // so the lines of the threads and the processes sharing the directory never
+  // interleave, and the file is not read or rewritten on the compile path.
+  auto fd = ::open(path.c_str(), O_WRONLY | O_APPEND | O_CREAT, 0644);
+  auto written = fd < 0 ? -1 : ::write(fd, data.data(), data.size());
+  if (written != static_cast<ssize_t>(data.size())) {
+    TORCH_WARN_ONCE("Failed to write the LLGA partition cache of ", path);
+  }
+  if (fd >= 0) {
+    ::close(fd);
+  }
+}
+
+void PersistentPartitionCache::beginWarmup() {
+  std::lock_guard<std::mutex> lock(warmupMutex_);
+  warmupTasks_++;
+}
+
+void PersistentPartitionCache::endWarmup() {
+  std::lock_guard<std::mutex> lock(warmupMutex_);
+  if (--warmupTasks_ == 0) {
+    warmupDone_.notify_all();
+  }
+}
+
+void PersistentPartitionCache::waitForWarmup() {
+  std::unique_lock<std::mutex> lock(warmupMutex_);
+  warmupDone_.wait(lock, [this]() { return warmupTasks_ == 0; });
+}
+
+} // namespace onednn
+} // namespace fuser
+} // namespace jit
+} // namespace torch_ipex
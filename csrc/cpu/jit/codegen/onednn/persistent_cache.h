@@ -0,0 +1,91 @@
+#pragma once
+
+#include <ATen/ATen.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace torch_ipex {
+namespace jit {
+namespace fuser {
+namespace onednn {
+
+// What a process learned by compiling a partition for one set of inputs.
+struct PartitionRecord {
+  struct InputDesc {
+    at::ScalarType dtype;
+    // the input is an opaque LLGA tensor or a quantized tensor, which could not
+    // be created again without the producer of it
+    bool opaque;
+    std::vector<int64_t> sizes;
+    std::vector<int64_t> strides;
+  };
+  std::vector<InputDesc> inputs;
+  // the outputs had to be compiled with unknown dims
+  bool unknownOutputDims = false;
+};
+
+// oneDNN Graph could not serialize a compiled partition, so the on-disk cache
+// does not save any compilation. It keeps the input descriptions and the
+// compilation decisions of every partition instead. A restarted process still
+// compiles every recorded shape once, but it starts to compile all of them in
+// the background as soon as the kernel of the partition is created, i.e.
+// when the graph is optimized and before its first run. So the partitions of
+// a graph compile at the same time instead of one by one in the first run,
+// the runs on a recorded shape wait for a compilation in flight or hit a
+// compiled one, and the compilation attempts known to fail are skipped.
+// The records of a partition are keyed by the FNV-1a hash of its canonical
+// graph, the number of threads, the ISA and the oneDNN version, so a record is
+// never used by a different setting. The records are appended to the file of
+// the partition, and a partition keeps at most kMaxRecordsPerPartition
+// distinct records on load, the oldest ones are dropped.
+class PersistentPartitionCache {
+ public:
+  static PersistentPartitionCache& getInstance();
+
+  // An empty directory disables the cache. The default directory is read
+  // from the environment variable IPEX_LLGA_CACHE_DIR.
+  void setDirectory(const std::string& dir);
+
+  std::string getDirectory();
+
+  bool enabled();
+
+  std::string partitionKey(const std::string& graphStr, int64_t numThreads);
+
+  std::vector<PartitionRecord> load(const std::string& partitionKey);
+
+  void append(const std::string& partitionKey, const PartitionRecord& record);
+
+  // count the background compilations of the recorded shapes in flight
+  void beginWarmup();
+
+  void endWarmup();
+
+  // block until all the background compilations are done
+  void waitForWarmup();
+
+  static constexpr size_t kMaxRecordsPerPartition = 256;
+
+ private:
+  PersistentPartitionCache();
+
+  std::string recordPath(const std::string& partitionKey);
+
+  // guards dir_, enabled_ is read on every compilation without the lock
+  std::mutex mutex_;
+  std::string dir_;
+  std::atomic<bool> enabled_{false};
+
+  std::mutex warmupMutex_;
+  std::condition_variable warmupDone_;
+  int64_t warmupTasks_ = 0;
+};
+
+} // namespace onednn
+} // namespace fuser
+} // namespace jit
+} // namespace torch_ipex
@@ -4,10 +4,64 @@
 
 #include <ideep.hpp>
 
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+
 namespace torch_ipex {
 namespace cpu {
 namespace detail {
 
+// The primitive of a convolution created for one input shape and number of
+// threads.
+struct ConvolutionPrimitive final {
+  ideep::convolution_forward_params conv_params_;
+  ideep::convolution_forward::super conv_desc_;
+  // scratchpad_ is shared by the bottleneck runs on the shape, one run at a
+  // time, see convolution_bottleneck_run
+  std::mutex scratchpad_mutex_;
+  dnnl::memory scratchpad_;
+
+  ConvolutionPrimitive(
+      ideep::convolution_forward_params conv_params,
+      ideep::convolution_forward::super conv_desc)
+      : conv_params_(conv_params), conv_desc_(conv_desc) {}
+};
+
+// A small LRU of the primitives of a convolution for the input shapes other
+// than the prepacked one, keyed by the input sizes followed by the format and
+// the number of threads. A nullptr primitive marks a shape whose primitive
+// expects another weight layout than the packed weight, which is run by the
+// fallback path.
+// The capacity is shared by all the contexts, see
+// utils::set_conv_primitive_cache_capacity.
+class ConvolutionPrimitiveCache final {
+ public:
+  using key_t = std::vector<int64_t>;
+  using value_t = std::shared_ptr<ConvolutionPrimitive>;
+
+  explicit ConvolutionPrimitiveCache(value_t prepacked)
+      : prepacked_(std::move(prepacked)) {}
+
+  // The primitive of the shape the context is prepacked for, which is never
+  // evicted.
+  const value_t& prepacked() const {
+    return prepacked_;
+  }
+
+  bool find(const key_t& key, value_t& value);
+
+  void insert(const key_t& key, value_t value);
+
+ private:
+  std::mutex mutex_;
+  value_t prepacked_;
+  // most recently used first
+  std::list<std::pair<key_t, value_t>> lru_;
+  std::map<key_t, std::list<std::pair<key_t, value_t>>::iterator> map_;
+};
+
 struct ContextConvolution final {
   ideep::tensor::desc original_desc_;
   ideep::tensor weight_packed_;
@@ -27,6 +81,7 @@ struct ContextConvolution final {
   bool weight_is_channels_last_;
   ideep::convolution_forward_params conv_params_;
   ideep::convolution_forward::super conv_desc_;
+  std::shared_ptr<ConvolutionPrimitiveCache> primitive_cache_;
 
   ContextConvolution() = delete;
 
@@ -54,7 +109,9 @@ struct ContextConvolution final {
         groups_(groups),
         weight_is_channels_last_(weight_is_channels_last),
         conv_params_(conv_params),
-        conv_desc_(conv_desc) {}
+        conv_desc_(conv_desc),
+        primitive_cache_(std::make_shared<ConvolutionPrimitiveCache>(
+            std::make_shared<ConvolutionPrimitive>(conv_params, conv_desc))) {}
 
   ContextConvolution(ContextConvolution&&) = default;
   ContextConvolution& operator=(ContextConvolution&&) = default;
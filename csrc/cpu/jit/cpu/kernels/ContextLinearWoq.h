@@ -20,6 +20,10 @@ struct ContextLinearWoq final {
   int64_t act_quant_mode_;
   // Original weight shape. Weight may be padded after packing
   c10::optional<std::vector<int64_t>> orig_wei_shape_;
+  // Group size along K of scales and zero points, -1 for per-channel.
+  // Group-wise scales and zero points are in [Nc, G, Nb] with the packed
+  // weight, or in [N, G] with the plain weight.
+  int64_t group_size_;
 
   ContextLinearWoq() = delete;
 
@@ -32,14 +36,16 @@ struct ContextLinearWoq final {
       int64_t lowp_mode = 0,
       int64_t num_concats = 1,
       int64_t act_quant_mode = 0,
-      c10::optional<std::vector<int64_t>>&& orig_wei_shape = c10::nullopt)
+      c10::optional<std::vector<int64_t>>&& orig_wei_shape = c10::nullopt,
+      int64_t group_size = -1)
       : at_weight_(std::move(at_weight)),
         at_bias_(std::move(bias)),
         is_int4_(is_int4),
         lowp_mode_(lowp_mode),
         num_concats_(num_concats),
         act_quant_mode_(act_quant_mode),
-        orig_wei_shape_(std::move(orig_wei_shape)) {
+        orig_wei_shape_(std::move(orig_wei_shape)),
+        group_size_(group_size) {
     // Make three dtype versions of scale, zp and bias
     // There is one more dtype for zp
     auto scales_fp16 = scales_float.to(c10::kHalf);
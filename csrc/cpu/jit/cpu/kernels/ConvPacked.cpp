@@ -7,10 +7,39 @@
 #include "aten/WeightPack.h"
 #include "aten/utils/utils.h"
 #include "ideep/IDeepConversions.h"
+#include "utils/onednn_utils.h"
 
 namespace torch_ipex {
 namespace cpu {
 namespace detail {
+
+bool ConvolutionPrimitiveCache::find(const key_t& key, value_t& value) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = map_.find(key);
+  if (it == map_.end()) {
+    return false;
+  }
+  lru_.splice(lru_.begin(), lru_, it->second);
+  value = it->second->second;
+  return true;
+}
+
+void ConvolutionPrimitiveCache::insert(const key_t& key, value_t value) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = map_.find(key);
+  if (it != map_.end()) {
+    lru_.erase(it->second);
+    map_.erase(it);
+  }
+  lru_.emplace_front(key, std::move(value));
+  map_[key] = lru_.begin();
+  auto capacity = torch_ipex::utils::get_conv_primitive_cache_capacity();
+  while (lru_.size() > static_cast<size_t>(capacity)) {
+    map_.erase(lru_.back().first);
+    lru_.pop_back();
+  }
+}
+
 namespace convolution {
 
 #define DEFINE_CONVOLUTION_UNARY_ELTWISE_RUN(FUSED_OP)              \
@@ -321,6 +350,148 @@ at::Tensor convolution_swish_add_run(
           torch_ipex::fpmath_mode));
 }
 
+static ideep::format_tag get_format_tag(const at::Tensor& input) {
+  // 1d convolution always runs on nwc, same as the prepacked one
+  if (input.dim() == 3) {
+    return ideep::format_tag::nwc;
+  }
+  auto memory_format = input.suggest_memory_format();
+  if (input.dim() == 4) {
+    return memory_format == at::MemoryFormat::ChannelsLast
+        ? ideep::format_tag::nhwc
+        : ideep::format_tag::nchw;
+  }
+  return memory_format == at::MemoryFormat::ChannelsLast3d
+      ? ideep::format_tag::ndhwc
+      : ideep::format_tag::ncdhw;
+}
+
+// Return the primitive of the context for the input sizes and the current
+// number of threads, which is created and cached at the first run of the
+// shape. Return nullptr if the input does not have the dtype of the weight, or
+// the primitive expects another weight layout than the packed weight.
+static ConvolutionPrimitiveCache::value_t get_primitive(
+    const ContextConvolution& context,
+    const std::vector<int64_t>& input_size,
+    at::ScalarType input_type,
+    ideep::format_tag format_tag) {
+  if (input_type != context.at_weight_.scalar_type()) {
+    return nullptr;
+  }
+  int64_t threads = omp_get_max_threads();
+  auto& prepacked = context.primitive_cache_->prepacked();
+  if (input_size == prepacked->conv_params_.pd.src_desc().get_dims() &&
+      threads == prepacked->conv_params_.pd_use_threads) {
+    return prepacked;
+  }
+  if (torch_ipex::utils::get_conv_primitive_cache_capacity() == 0) {
+    return nullptr;
+  }
+  auto key = input_size;
+  key.push_back(static_cast<int64_t>(format_tag));
+  key.push_back(threads);
+  ConvolutionPrimitiveCache::value_t primitive;
+  if (context.primitive_cache_->find(key, primitive)) {
+    return primitive;
+  }
+
+  auto output_sizes = calc_conv_output_size(
+      input_size,
+      context.weight_packed_.get_dims(),
+      context.padding_,
+      context.stride_,
+      context.dilation_);
+  auto data_type = context.weight_packed_.get_data_type();
+  ideep::tensor src = ideep::tensor(
+      {input_size.begin(), input_size.end()}, data_type, format_tag);
+  ideep::tensor dst = ideep::tensor(
+      {output_sizes.begin(), output_sizes.end()}, data_type, format_tag);
+  ideep::convolution_forward_params conv_params;
+  if (context.bias_.is_empty()) {
+    ideep::convolution_forward::prepare(
+        conv_params,
+        src,
+        context.weight_packed_,
+        {output_sizes.begin(), output_sizes.end()},
+        dst,
+        {context.stride_.begin(), context.stride_.end()},
+        {context.dilation_.begin(), context.dilation_.end()},
+        {context.padding_.begin(), context.padding_.end()},
+        {context.padding_.begin(), context.padding_.end()},
+        context.groups_,
+        ideep::scale_t(),
+        ideep::scale_t(),
+        ideep::scale_t(),
+        prepacked->conv_params_.op_attr,
+        ideep::algorithm::convolution_direct,
+        ideep::prop_kind::forward_inference);
+  } else {
+    ideep::convolution_forward::prepare(
+        conv_params,
+        src,
+        context.weight_packed_,
+        context.bias_,
+        {output_sizes.begin(), output_sizes.end()},
+        dst,
+        {context.stride_.begin(), context.stride_.end()},
+        {context.dilation_.begin(), context.dilation_.end()},
+        {context.padding_.begin(), context.padding_.end()},
+        {context.padding_.begin(), context.padding_.end()},
+        context.groups_,
+        ideep::scale_t(),
+        ideep::scale_t(),
+        ideep::scale_t(),
+        prepacked->conv_params_.op_attr,
+        ideep::algorithm::convolution_direct,
+        ideep::prop_kind::forward_inference);
+  }
+  // the weight is packed once for the prepacked shape, repacking it for
+  // another shape costs more than the fallback path
+  if (ideep::tensor::desc(conv_params.pd.weights_desc(), context.groups_) ==
+      context.weight_packed_.get_desc()) {
+    primitive = std::make_shared<ConvolutionPrimitive>(
+        conv_params, ideep::convolution_forward::super(conv_params.pd));
+  }
+  context.primitive_cache_->insert(key, primitive);
+  return primitive;
+}
+
+// Return the scratchpad for the primitives of a bottleneck. The scratchpad is
+// shared by the runs on the shape of the first primitive, and a temporary one
+// is returned if another thread is running on the shape. lock holds the
+// shared scratchpad until the run finishes.
+static dnnl::memory get_scratchpad(
+    const std::vector<ConvolutionPrimitive*>& primitives,
+    std::unique_lock<std::mutex>& lock) {
+  auto desc = primitives[0]->conv_params_.pd.scratchpad_desc();
+  for (auto primitive : primitives) {
+    if (primitive->conv_params_.pd.scratchpad_desc().get_size() >
+        desc.get_size()) {
+      desc = primitive->conv_params_.pd.scratchpad_desc();
+    }
+  }
+  auto& shared = *primitives[0];
+  lock = std::unique_lock<std::mutex>(
+      shared.scratchpad_mutex_, std::try_to_lock);
+  if (!lock.owns_lock()) {
+    return dnnl::memory(desc, ideep::engine::cpu_engine());
+  }
+  if (!shared.scratchpad_ ||
+      shared.scratchpad_.get_desc().get_size() < desc.get_size()) {
+    shared.scratchpad_ = dnnl::memory(desc, ideep::engine::cpu_engine());
+  }
+  return shared.scratchpad_;
+}
+
+// Whether the data of the tensor can be taken as the memory of desc without a
+// reorder. It can't if the strides of the tensor are not the ones of desc,
+// e.g. NCHW strides for an NHWC desc, or if the dtypes differ.
+static bool is_layout_of(
+    const at::Tensor& tensor,
+    const ideep::tensor::desc& desc) {
+  return itensor_view_from_dense(tensor).get_desc() == desc;
+}
+
 at::Tensor& convolution_bottleneck_run(
     at::Tensor& input,
     const c10::intrusive_ptr<ConvolutionOpContext>& op_context1,
@@ -337,44 +508,61 @@ at::Tensor& convolution_bottleneck_run(
   auto& context1 = op_context1->get_context();
   auto& context2 = op_context2->get_context();
   auto& context3 = op_context3->get_context();
-  if (input.sizes().vec() == context1.conv_params_.pd.src_desc().get_dims() &&
-      omp_get_max_threads() == context1.conv_params_.pd_use_threads) {
+  auto format_tag =
+      input.dim() == 4 ? ideep::format_tag::nhwc : ideep::format_tag::ndhwc;
+  auto primitive1 = get_primitive(
+      context1, input.sizes().vec(), input.scalar_type(), format_tag);
+  auto primitive2 = primitive1
+      ? get_primitive(
+            context2,
+            primitive1->conv_params_.pd.dst_desc().get_dims(),
+            input.scalar_type(),
+            format_tag)
+      : nullptr;
+  auto primitive3 = primitive2
+      ? get_primitive(
+            context3,
+            primitive2->conv_params_.pd.dst_desc().get_dims(),
+            input.scalar_type(),
+            format_tag)
+      : nullptr;
+  // the input is run in place, so it must be in the layout of the primitives
+  if (primitive3 &&
+      is_layout_of(input, primitive1->conv_params_.pd.src_desc()) &&
+      primitive2->conv_params_.pd.src_desc() ==
+          primitive1->conv_params_.pd.dst_desc() &&
+      primitive3->conv_params_.pd.src_desc() ==
+          primitive2->conv_params_.pd.dst_desc() &&
+      primitive3->conv_params_.pd.dst_desc() ==
+          primitive1->conv_params_.pd.src_desc()) {
     auto mkldnn_input = dnnl::memory(
-        context1.conv_params_.pd.src_desc(),
+        primitive1->conv_params_.pd.src_desc(),
         ideep::engine::cpu_engine(),
         input.data_ptr());
     auto ouput1 = dnnl::memory(
-        context1.conv_params_.pd.dst_desc(), ideep::engine::cpu_engine());
+        primitive1->conv_params_.pd.dst_desc(), ideep::engine::cpu_engine());
     auto ouput2 = dnnl::memory(
-        context2.conv_params_.pd.dst_desc(), ideep::engine::cpu_engine());
+        primitive2->conv_params_.pd.dst_desc(), ideep::engine::cpu_engine());
 
-    auto desc = context1.conv_params_.pd.scratchpad_desc();
-    if (context2.conv_params_.pd.scratchpad_desc().get_size() >
-        desc.get_size()) {
-      desc = context2.conv_params_.pd.scratchpad_desc();
-    }
-    if (context3.conv_params_.pd.scratchpad_desc().get_size() >
-        desc.get_size()) {
-      desc = context3.conv_params_.pd.scratchpad_desc();
-    }
-
-    auto scratchpad = dnnl::memory(desc, ideep::engine::cpu_engine());
+    std::unique_lock<std::mutex> lock;
+    auto scratchpad = get_scratchpad(
+        {primitive1.get(), primitive2.get(), primitive3.get()}, lock);
 
-    context1.conv_desc_.execute(
+    primitive1->conv_desc_.execute(
         ideep::stream::default_stream(),
         {{DNNL_ARG_SRC, mkldnn_input},
          {DNNL_ARG_WEIGHTS, context1.weight_packed_},
          {DNNL_ARG_BIAS, context1.bias_},
          {DNNL_ARG_DST, ouput1},
          {DNNL_ARG_SCRATCHPAD, scratchpad}});
-    context2.conv_desc_.execute(
+    primitive2->conv_desc_.execute(
         ideep::stream::default_stream(),
         {{DNNL_ARG_SRC, ouput1},
          {DNNL_ARG_WEIGHTS, context2.weight_packed_},
          {DNNL_ARG_BIAS, context2.bias_},
          {DNNL_ARG_DST, ouput2},
          {DNNL_ARG_SCRATCHPAD, scratchpad}});
-    context3.conv_desc_.execute(
+    primitive3->conv_desc_.execute(
         ideep::stream::default_stream(),
         {{DNNL_ARG_SRC, ouput2},
          {DNNL_ARG_WEIGHTS, context3.weight_packed_},
@@ -407,64 +595,94 @@ at::Tensor convolution_bottleneck_run(
   auto& context2 = op_context2->get_context();
   auto& context4 = op_context4->get_context();
   auto& context3 = op_context3->get_context();
-
-  if (input_.sizes().vec() == context1.conv_params_.pd.src_desc().get_dims() &&
-      omp_get_max_threads() == context1.conv_params_.pd_use_threads) {
+  auto format_tag =
+      input.dim() == 4 ? ideep::format_tag::nhwc : ideep::format_tag::ndhwc;
+  auto primitive1 = get_primitive(
+      context1, input_.sizes().vec(), input_.scalar_type(), format_tag);
+  auto primitive2 = primitive1
+      ? get_primitive(
+            context2,
+            primitive1->conv_params_.pd.dst_desc().get_dims(),
+            input_.scalar_type(),
+            format_tag)
+      : nullptr;
+  auto primitive3 = primitive2
+      ? get_primitive(
+            context3, input_.sizes().vec(), input_.scalar_type(), format_tag)
+      : nullptr;
+  auto primitive4 = primitive3
+      ? get_primitive(
+            context4,
+            primitive2->conv_params_.pd.dst_desc().get_dims(),
+            input_.scalar_type(),
+            format_tag)
+      : nullptr;
+
+  // the input and the output are taken as the memory of the primitives, so
+  // they must be in the layout of the primitives
+  if (primitive4 &&
+      is_layout_of(input_, primitive1->conv_params_.pd.src_desc()) &&
+      primitive3->conv_params_.pd.dst_desc() ==
+          ideep::tensor::desc(
+              primitive3->conv_params_.pd.dst_desc().get_dims(),
+              get_mkldnn_dtype(input_.scalar_type()),
+              format_tag) &&
+      primitive2->conv_params_.pd.src_desc() ==
+          primitive1->conv_params_.pd.dst_desc() &&
+      primitive3->conv_params_.pd.src_desc() ==
+          primitive1->conv_params_.pd.src_desc() &&
+      primitive4->conv_params_.pd.src_desc() ==
+          primitive2->conv_params_.pd.dst_desc() &&
+      primitive4->conv_params_.pd.dst_desc() ==
+          primitive3->conv_params_.pd.dst_desc()) {
     auto mkldnn_input = dnnl::memory(
-        context1.conv_params_.pd.src_desc(),
+        primitive1->conv_params_.pd.src_desc(),
         ideep::engine::cpu_engine(),
-        input.data_ptr());
+        input_.data_ptr());
 
     auto ouput1 = dnnl::memory(
-        context1.conv_params_.pd.dst_desc(), ideep::engine::cpu_engine());
+        primitive1->conv_params_.pd.dst_desc(), ideep::engine::cpu_engine());
     auto ouput2 = dnnl::memory(
-        context2.conv_params_.pd.dst_desc(), ideep::engine::cpu_engine());
+        primitive2->conv_params_.pd.dst_desc(), ideep::engine::cpu_engine());
 
     auto result = at::empty(
-        context3.conv_params_.pd.dst_desc().get_dims(),
-        input_.options().memory_format(input_.suggest_memory_format()));
+        primitive3->conv_params_.pd.dst_desc().get_dims(),
+        input_.options().memory_format(memory_format));
 
     auto ouput3 = dnnl::memory(
-        context3.conv_params_.pd.dst_desc(),
+        primitive3->conv_params_.pd.dst_desc(),
         ideep::engine::cpu_engine(),
         result.data_ptr());
 
-    auto desc = context1.conv_params_.pd.scratchpad_desc();
-    if (context2.conv_params_.pd.scratchpad_desc().get_size() >
-        desc.get_size()) {
-      desc = context2.conv_params_.pd.scratchpad_desc();
-    }
-    if (context3.conv_params_.pd.scratchpad_desc().get_size() >
-        desc.get_size()) {
-      desc = context3.conv_params_.pd.scratchpad_desc();
-    }
-    if (context4.conv_params_.pd.scratchpad_desc().get_size() >
-        desc.get_size()) {
-      desc = context4.conv_params_.pd.scratchpad_desc();
-    }
-    auto scratchpad = dnnl::memory(desc, ideep::engine::cpu_engine());
-    context1.conv_desc_.execute(
+    std::unique_lock<std::mutex> lock;
+    auto scratchpad = get_scratchpad(
+        {primitive1.get(),
+         primitive2.get(),
+         primitive3.get(),
+         primitive4.get()},
+        lock);
+    primitive1->conv_desc_.execute(
         ideep::stream::default_stream(),
         {{DNNL_ARG_SRC, mkldnn_input},
          {DNNL_ARG_WEIGHTS, context1.weight_packed_},
          {DNNL_ARG_BIAS, context1.bias_},
          {DNNL_ARG_DST, ouput1},
          {DNNL_ARG_SCRATCHPAD, scratchpad}});
-    context2.conv_desc_.execute(
+    primitive2->conv_desc_.execute(
         ideep::stream::default_stream(),
         {{DNNL_ARG_SRC, ouput1},
          {DNNL_ARG_WEIGHTS, context2.weight_packed_},
          {DNNL_ARG_BIAS, context2.bias_},
          {DNNL_ARG_DST, ouput2},
          {DNNL_ARG_SCRATCHPAD, scratchpad}});
-    context3.conv_desc_.execute(
+    primitive3->conv_desc_.execute(
         ideep::stream::default_stream(),
         {{DNNL_ARG_SRC, mkldnn_input},
          {DNNL_ARG_WEIGHTS, context3.weight_packed_},
          {DNNL_ARG_BIAS, context3.bias_},
          {DNNL_ARG_DST, ouput3},
          {DNNL_ARG_SCRATCHPAD, scratchpad}});
-    context4.conv_desc_.execute(
+    primitive4->conv_desc_.execute(
         ideep::stream::default_stream(),
         {{DNNL_ARG_SRC, ouput2},
          {DNNL_ARG_WEIGHTS, context4.weight_packed_},
@@ -652,11 +870,18 @@ at::Tensor run(
       context.dilation_,
       context.groups_);
 
-  if (input_.sizes().vec() == context.conv_params_.pd.src_desc().get_dims() &&
+  auto primitive =
       attr.has_same_postop_as(context.conv_params_.op_attr) &&
-      attr.get_all_scales() == context.conv_params_.op_attr.get_all_scales() &&
-      omp_get_max_threads() == context.conv_params_.pd_use_threads) {
-    auto output_sizes = context.conv_params_.pd.dst_desc().get_dims();
+          attr.get_all_scales() ==
+              context.conv_params_.op_attr.get_all_scales()
+      ? get_primitive(
+            context,
+            input_.sizes().vec(),
+            input_.scalar_type(),
+            get_format_tag(input_))
+      : nullptr;
+  if (primitive) {
+    auto output_sizes = primitive->conv_params_.pd.dst_desc().get_dims();
     auto output = at::empty(
         output_sizes,
         input_.options().memory_format(input_.suggest_memory_format()));
@@ -671,15 +896,15 @@ at::Tensor run(
     ideep::tensor mkldnn_output = itensor_view_from_dense(output);
     if (context.bias_.is_empty()) {
       ideep::convolution_forward::compute(
-          context.conv_params_,
-          context.conv_desc_,
+          primitive->conv_params_,
+          primitive->conv_desc_,
           mkldnn_input,
           context.weight_packed_,
           mkldnn_output);
     } else {
       ideep::convolution_forward::compute(
-          context.conv_params_,
-          context.conv_desc_,
+          primitive->conv_params_,
+          primitive->conv_desc_,
           mkldnn_input,
           context.weight_packed_,
           context.bias_,
@@ -742,23 +967,28 @@ at::Tensor& run(
       context.dilation_,
       context.groups_);
 
-  if (input_.sizes().vec() == context.conv_params_.pd.src_desc().get_dims() &&
-      attr == context.conv_params_.op_attr &&
-      omp_get_max_threads() == context.conv_params_.pd_use_threads) {
+  auto primitive = attr == context.conv_params_.op_attr
+      ? get_primitive(
+            context,
+            input_.sizes().vec(),
+            input_.scalar_type(),
+            get_format_tag(input_))
+      : nullptr;
+  if (primitive) {
     const ideep::tensor mkldnn_input = itensor_view_from_dense(input_);
     ideep::tensor mkldnn_output = itensor_view_from_dense(accumu);
 
     if (context.bias_.is_empty()) {
       ideep::convolution_forward::compute(
-          context.conv_params_,
-          context.conv_desc_,
+          primitive->conv_params_,
+          primitive->conv_desc_,
           mkldnn_input,
           context.weight_packed_,
           mkldnn_output);
     } else {
       ideep::convolution_forward::compute(
-          context.conv_params_,
-          context.conv_desc_,
+          primitive->conv_params_,
+          primitive->conv_desc_,
           mkldnn_input,
           context.weight_packed_,
           context.bias_,
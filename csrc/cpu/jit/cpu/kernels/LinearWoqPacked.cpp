@@ -1,5 +1,6 @@
 #ifdef USE_LIBXSMM
 #include "LinearWoqPacked.h"
+#include <ATen/quantized/Quantizer.h>
 #include <ideep.hpp>
 #include "aten/Linear.h"
 #include "aten/WeightPack.h"
@@ -30,6 +31,67 @@ c10::intrusive_ptr<WoqLinearOpContext> createWoqLinearPrePackOpContext(
       act_quant_mode);
 }
 
+// A per-channel quantized tensor cannot carry group-wise qparams. So the int4
+// weight is stored in a quantized tensor with dummy qparams, and the real ones
+// are passed to the context directly.
+static c10::intrusive_ptr<WoqLinearOpContext> create_group_wise_context(
+    const at::Tensor& weight,
+    at::Tensor scales,
+    at::Tensor zero_points,
+    c10::optional<at::Tensor>&& bias,
+    c10::optional<int64_t> batch_size,
+    int64_t lowp_mode,
+    int64_t num_concats,
+    int64_t act_quant_mode) {
+  int64_t N = weight.size(0);
+  int64_t K = weight.scalar_type() == c10::kInt ? weight.size(1) * 8
+                                                : weight.size(1);
+  int64_t G = scales.size(1);
+  TORCH_CHECK(
+      scales.size(0) == N && K % G == 0 && K % 2 == 0,
+      "IPEX WOQ INT4: unexpected scales size for group-wise quantization");
+  int64_t group_size = K / G;
+  at::Tensor weight_uint8;
+  if (weight.scalar_type() == c10::kInt) {
+    weight_uint8 = weight.contiguous();
+  } else {
+    // quantize by groups and compress two int4 values into a byte
+    auto grouped = weight.to(c10::kFloat).view({N, G, group_size});
+    auto qweight = at::clamp(
+                       at::round(
+                           grouped / scales.unsqueeze(-1) +
+                           zero_points.unsqueeze(-1)),
+                       0,
+                       15)
+                       .to(c10::kByte)
+                       .view({N, K});
+    using namespace at::indexing;
+    weight_uint8 = qweight.index({Slice(), Slice(None, None, 2)})
+                       .bitwise_or(qweight.index({Slice(), Slice(1, None, 2)})
+                                       .bitwise_left_shift(4))
+                       .contiguous();
+  }
+  auto weight_int4 = at::_empty_per_channel_affine_quantized(
+      {N, K},
+      at::ones({N}, device(c10::kCPU).dtype(c10::kFloat)),
+      at::zeros({N}, device(c10::kCPU).dtype(c10::kFloat)),
+      0,
+      device(c10::kCPU).dtype(c10::kQUInt4x2));
+  std::memcpy(weight_int4.data_ptr(), weight_uint8.data_ptr(), N * K / 2);
+  auto op_context = create(
+      weight_int4,
+      scales,
+      zero_points,
+      bias,
+      batch_size,
+      lowp_mode,
+      num_concats,
+      act_quant_mode,
+      group_size);
+  return c10::make_intrusive<IpexWoqLinearOpContext>(
+      batch_size, std::move(op_context));
+}
+
 c10::intrusive_ptr<WoqLinearOpContext> createWoqLinearPrePackOpContextInt4(
     at::Tensor&& weight,
     at::Tensor&& scales,
@@ -48,7 +110,11 @@ c10::intrusive_ptr<WoqLinearOpContext> createWoqLinearPrePackOpContextInt4(
   // points dtype = fp32 There might be an extra output channel in weight and
   // scales bool extra_o_channel = false; // scales.numel() >
   // zero_points.numel() * 8;
-  auto scales_fp32 = scales.squeeze().to(c10::ScalarType::Float);
+  // Scales in [N, G] with G > 1 are quantized group-wise along K, e.g., by
+  // GPTQ or AWQ, with group size K / G.
+  bool is_group_wise = scales.dim() == 2 && scales.size(1) > 1;
+  auto scales_fp32 = (is_group_wise ? scales : scales.squeeze())
+                         .to(c10::ScalarType::Float);
 
   auto zp_fp32 = zero_points.scalar_type() == c10::kFloat
       ? zero_points.squeeze()
@@ -72,6 +138,17 @@ c10::intrusive_ptr<WoqLinearOpContext> createWoqLinearPrePackOpContextInt4(
       TORCH_CHECK(false, "IPEX WOQ INT4: unexpected zero points size");
     }
   }
+  if (is_group_wise) {
+    return create_group_wise_context(
+        weight,
+        scales_fp32,
+        zp_fp32.reshape(scales_fp32.sizes()),
+        std::move(bias),
+        batch_size,
+        lowp_mode,
+        num_concats,
+        act_quant_mode);
+  }
   // Support two cases here:
   // 1. fp32/bf16 weight after calibration
   // 2. int4 weight after calibration, quantized and compressed, as int32
@@ -111,6 +188,122 @@ c10::intrusive_ptr<WoqLinearOpContext> createWoqLinearPrePackOpContextInt4(
       act_quant_mode);
 }
 
+// Unpack the weight of the context to its plain layout with the qparams and
+// bias of the original N, and pack it again for this machine.
+static c10::intrusive_ptr<WoqLinearOpContext> repack_context(
+    ContextLinearWoq& context,
+    c10::optional<int64_t> batch_size) {
+  auto& packed_weight = context.at_weight_;
+  int64_t N = context.orig_wei_shape_.has_value()
+      ? context.orig_wei_shape_.value()[0]
+      : (packed_weight.dim() == 4
+             ? packed_weight.size(0) * packed_weight.size(3) *
+                 (context.is_int4_ ? 2 : 1)
+             : packed_weight.size(0));
+  // group-wise qparams of the packed weight are in [Nc, G, Nb]
+  auto plain_qparams = [&](const at::Tensor& qparams) -> at::Tensor {
+    auto plain = qparams;
+    if (context.group_size_ > 0 && packed_weight.dim() == 4) {
+      plain = qparams.transpose(1, 2).reshape({-1, qparams.size(1)});
+    }
+    return plain.slice(0, 0, N).contiguous();
+  };
+  auto scales = plain_qparams(context.scales_list_[0]);
+  auto zero_points = plain_qparams(context.zero_points_list_[0]);
+  c10::optional<at::Tensor> bias = c10::nullopt;
+  if (context.at_bias_.has_value() && context.at_bias_.value().defined()) {
+    bias = context.at_bias_.value().slice(0, 0, N).contiguous();
+  }
+  if (context.group_size_ > 0) {
+    // int4 weight compressed in uint8 in [N, K / 2], which is taken as int32
+    auto weight = unpack(context, packed_weight);
+    return create_group_wise_context(
+        weight.view(c10::kInt),
+        scales,
+        zero_points,
+        std::move(bias),
+        batch_size,
+        context.lowp_mode_,
+        context.num_concats_,
+        context.act_quant_mode_);
+  }
+  at::Tensor weight;
+  if (context.is_int4_ && packed_weight.dim() == 4) {
+    // make the quantized weight with the qparams of the original N
+    auto weight_uint8 = woq_linear_unpack_weight(
+        packed_weight, context.is_int4_, context.lowp_mode_);
+    int64_t K = weight_uint8.size(1) * 2;
+    weight = at::_empty_per_channel_affine_quantized(
+        {N, K},
+        scales,
+        zero_points,
+        0,
+        device(c10::kCPU).dtype(c10::kQUInt4x2));
+    std::memcpy(weight.data_ptr(), weight_uint8.data_ptr(), N * K / 2);
+  } else {
+    weight = unpack(context, packed_weight);
+  }
+  return IpexWoqLinearOpContext::create_context(
+      std::move(weight),
+      std::move(bias),
+      batch_size,
+      context.lowp_mode_,
+      context.num_concats_,
+      context.act_quant_mode_);
+}
+
+c10::intrusive_ptr<WoqLinearOpContext>
+createWoqLinearPrePackOpContextFromPacked(
+    at::Tensor&& packed_weight,
+    at::Tensor&& scales,
+    at::Tensor&& zero_points,
+    c10::optional<at::Tensor>&& bias,
+    c10::optional<int64_t> batch_size,
+    bool is_int4,
+    int64_t lowp_mode,
+    int64_t num_concats,
+    int64_t act_quant_mode,
+    c10::optional<std::vector<int64_t>> orig_wei_shape,
+    int64_t group_size,
+    bool repack) {
+  RECORD_FUNCTION(
+      "ipex_prepack::createWoqLinearPrePackOpContextFromPacked",
+      c10::ArrayRef<c10::IValue>({}));
+  // The packed int8 weight is a quantized tensor, whose raw data is read by
+  // the kernels. Wrap the loaded data without a copy, e.g., the weight mapped
+  // from a file, and keep it alive with the quantized tensor.
+  if (!is_int4 && !packed_weight.is_quantized()) {
+    TORCH_CHECK(
+        packed_weight.scalar_type() == c10::kChar &&
+            packed_weight.is_contiguous(),
+        "WOQ linear: expect the packed int8 weight in contiguous int8");
+    auto data = packed_weight;
+    packed_weight = at::from_blob_quantized_per_tensor_affine(
+        data.data_ptr(),
+        data.sizes(),
+        [data](void*) {},
+        1.0,
+        0,
+        data.options().dtype(c10::kQInt8));
+  }
+  auto op_context = ContextLinearWoq(
+      std::move(packed_weight),
+      std::move(scales),
+      std::move(zero_points),
+      std::move(bias),
+      is_int4,
+      lowp_mode,
+      num_concats,
+      act_quant_mode,
+      std::move(orig_wei_shape),
+      group_size);
+  if (repack) {
+    return repack_context(op_context, batch_size);
+  }
+  return c10::make_intrusive<IpexWoqLinearOpContext>(
+      batch_size, std::move(op_context));
+}
+
 at::Tensor woq_linear_run(
     const at::Tensor& input,
     c10::intrusive_ptr<WoqLinearOpContext> op_context) {
@@ -128,9 +321,10 @@ ContextLinearWoq create(
     const c10::optional<int64_t> batch_size,
     int64_t lowp_mode,
     int64_t num_concats,
-    int64_t act_quant_mode) {
-  auto packed_weight =
-      woq_linear_pack_weight(weight, scales, zero_points, lowp_mode);
+    int64_t act_quant_mode,
+    int64_t group_size) {
+  auto packed_weight = woq_linear_pack_weight(
+      weight, scales, zero_points, lowp_mode, group_size);
   bool is_int4 = weight.scalar_type() == c10::kQUInt4x2;
   auto packed_shape = packed_weight.sizes();
   int64_t N = weight.size(0);
@@ -141,14 +335,28 @@ ContextLinearWoq create(
        packed_shape[0] * packed_shape[3] != N) ||
       (packed_shape.size() == 2 && packed_shape[0] != N);
   auto zero_points_float = zero_points.to(c10::kFloat);
+  // Reorder group-wise qparams from [N, G] to [Nc, G, Nb] for the packed
+  // weight, so that a block of N reads the qparams of a group contiguously.
+  auto reorder_qparams = [&](const at::Tensor& qparams) -> at::Tensor {
+    if (group_size <= 0 || packed_shape.size() != 4) {
+      return qparams;
+    }
+    return qparams.view({packed_shape[0], -1, qparams.size(1)})
+        .transpose(1, 2)
+        .contiguous();
+  };
   if (weight_is_padded) {
     int64_t padded_N = packed_shape.size() == 4
         ? (is_int4 ? packed_shape[0] * packed_shape[3] * 2
                    : packed_shape[0] * packed_shape[3])
         : packed_shape[0];
-    auto scales_padded = at::pad(scales, {0, padded_N - N}, "constant", 1.f);
+    // pad along N, which is the first dim of the qparams
+    std::vector<int64_t> pad_n(2 * scales.dim(), 0);
+    pad_n.back() = padded_N - N;
+    auto scales_padded =
+        reorder_qparams(at::pad(scales, pad_n, "constant", 1.f));
     auto zero_points_padded =
-        at::pad(zero_points_float, {0, padded_N - N}, "constant", 0.f);
+        reorder_qparams(at::pad(zero_points_float, pad_n, "constant", 0.f));
     if (bias.has_value()) {
       auto bias_padded =
           at::pad(bias.value(), {0, padded_N - N}, "constant", 0.f);
@@ -161,7 +369,8 @@ ContextLinearWoq create(
           lowp_mode,
           num_concats,
           act_quant_mode,
-          c10::make_optional(weight.sizes().vec()));
+          c10::make_optional(weight.sizes().vec()),
+          group_size);
     } else {
       return ContextLinearWoq(
           std::move(packed_weight),
@@ -172,20 +381,22 @@ ContextLinearWoq create(
           lowp_mode,
           num_concats,
           act_quant_mode,
-          c10::make_optional(weight.sizes().vec()));
+          c10::make_optional(weight.sizes().vec()),
+          group_size);
     }
   }
   return ContextLinearWoq(
       std::move(packed_weight),
-      std::move(scales),
-      std::move(zero_points_float),
+      reorder_qparams(scales),
+      reorder_qparams(zero_points_float),
       bias.has_value() ? c10::make_optional(*bias) : c10::nullopt,
       is_int4,
       lowp_mode,
       num_concats,
       act_quant_mode,
       weight_is_padded ? c10::make_optional(weight.sizes().vec())
-                       : c10::nullopt);
+                       : c10::nullopt,
+      group_size);
 }
 
 at::Tensor run(ContextLinearWoq& context, const at::Tensor& input) {
@@ -406,6 +617,80 @@ at::Tensor run_add_add(
       context.act_quant_mode_);
 }
 
+// Called by IpexWoqLinearOpContext::run_silu_mul
+at::Tensor run_silu_mul(ContextLinearWoq& context, const at::Tensor& input) {
+  // TPP kernel packs weight to 4d (Nc, Kc, block_k, block_n)
+  auto w_k = context.at_weight_.dim() == 2
+      ? context.at_weight_.size(1)
+      : context.at_weight_.size(1) * context.at_weight_.size(2);
+  TORCH_CHECK(
+      input.size(input.dim() - 1) == w_k,
+      "WOQ linear: input and weight shapes do not match, got k = ",
+      input.size(input.dim() - 1),
+      " and ",
+      w_k,
+      " respectively.");
+  TORCH_CHECK(
+      context.num_concats_ == 2,
+      "WOQ linear silu mul: expect the concat of the gate and up weights, got ",
+      context.num_concats_,
+      " concats.");
+  auto input_ = input.contiguous();
+  return woq_linear_silu_mul_kernel(
+      input_,
+      context.at_weight_,
+      context.scales_list_,
+      context.zero_points_list_,
+      context.bias_list_,
+      context.is_int4_,
+      context.lowp_mode_,
+      context.act_quant_mode_);
+}
+
+// Called by IpexWoqLinearOpContext::run_quantized_input
+at::Tensor run_quantized_input(
+    ContextLinearWoq& context,
+    const at::Tensor& input,
+    const at::Tensor& input_scales,
+    const at::Tensor& input_zero_points,
+    at::ScalarType out_dtype) {
+  // TPP kernel packs weight to 4d (Nc, Kc, block_k, block_n)
+  auto w_k = context.at_weight_.dim() == 2
+      ? context.at_weight_.size(1)
+      : context.at_weight_.size(1) * context.at_weight_.size(2);
+  TORCH_CHECK(
+      input.size(input.dim() - 1) == w_k,
+      "WOQ linear: input and weight shapes do not match, got k = ",
+      input.size(input.dim() - 1),
+      " and ",
+      w_k,
+      " respectively.");
+  TORCH_CHECK(
+      input.scalar_type() == at::kByte &&
+          input_scales.numel() * w_k == input.numel() &&
+          input_zero_points.numel() * w_k == input.numel(),
+      "WOQ linear: expect the input quantized to uint8 per row");
+  auto res = woq_linear_quantized_input_kernel(
+      input.contiguous(),
+      input_scales.view(-1),
+      input_zero_points.view(-1),
+      out_dtype,
+      context.at_weight_,
+      context.scales_list_,
+      context.zero_points_list_,
+      context.bias_list_,
+      context.is_int4_,
+      context.lowp_mode_,
+      context.num_concats_,
+      context.act_quant_mode_);
+  // if weight is not padded, context.orig_wei_shape_ has no value
+  if (context.orig_wei_shape_.has_value()) {
+    int64_t N = context.orig_wei_shape_.value()[0];
+    return at::slice(res, /*dim*/ -1, /*start*/ 0, /*end*/ N, /*step*/ 1);
+  }
+  return res;
+}
+
 // Registered as JIT op
 at::Tensor woq_linear_add_run(
     const at::Tensor& input,
@@ -441,6 +726,24 @@ at::Tensor unpack(ContextLinearWoq& context, const at::Tensor& tensor) {
   // Return result directly if dim == 2
   // For dim == 4, make a new quantized tensor and return.
   // For padded weight (int4), make a slice of it.
+  if (context.group_size_ > 0) {
+    // Group-wise qparams cannot be carried by a quantized tensor, return the
+    // int4 weight compressed in uint8 in [N, K / 2] instead.
+    if (tensor.dim() == 2) {
+      auto weight_uint8 =
+          at::empty({tensor.size(0), tensor.size(1) / 2}, at::kByte);
+      std::memcpy(
+          weight_uint8.data_ptr(), tensor.data_ptr(), weight_uint8.numel());
+      return weight_uint8;
+    }
+    auto unpacked_weight =
+        woq_linear_unpack_weight(tensor, context.is_int4_, context.lowp_mode_);
+    if (context.orig_wei_shape_.has_value()) {
+      return unpacked_weight.slice(0, 0, context.orig_wei_shape_.value()[0])
+          .contiguous();
+    }
+    return unpacked_weight;
+  }
   auto unpacked_weight =
       woq_linear_unpack_weight(tensor, context.is_int4_, context.lowp_mode_);
   if (tensor.dim() > 2) {
@@ -28,6 +28,25 @@ c10::intrusive_ptr<WoqLinearOpContext> createWoqLinearPrePackOpContextInt4(
     int64_t num_concats,
     int64_t act_quant_mode);
 
+// Create the context from the state returned by get_packed_state, e.g. loaded
+// from a file, without packing the weight again. The weight is unpacked and
+// packed again if repack is true, i.e. it was packed for another ISA or
+// blocking.
+c10::intrusive_ptr<WoqLinearOpContext>
+createWoqLinearPrePackOpContextFromPacked(
+    at::Tensor&& packed_weight,
+    at::Tensor&& scales,
+    at::Tensor&& zero_points,
+    c10::optional<at::Tensor>&& bias,
+    c10::optional<int64_t> batch_size,
+    bool is_int4,
+    int64_t lowp_mode,
+    int64_t num_concats,
+    int64_t act_quant_mode,
+    c10::optional<std::vector<int64_t>> orig_wei_shape,
+    int64_t group_size,
+    bool repack);
+
 at::Tensor woq_linear_run(
     const at::Tensor& input,
     c10::intrusive_ptr<WoqLinearOpContext> op_context);
@@ -40,7 +59,8 @@ ContextLinearWoq create(
     const c10::optional<int64_t> batch_size,
     int64_t lowp_mode,
     int64_t num_concats,
-    int64_t act_quant_mode);
+    int64_t act_quant_mode,
+    int64_t group_size = -1);
 
 at::Tensor run(ContextLinearWoq& context, const at::Tensor& input);
 
@@ -80,6 +100,15 @@ at::Tensor run_add_add(
     const at::Tensor& input,
     const std::vector<at::Tensor>& others);
 
+at::Tensor run_silu_mul(ContextLinearWoq& context, const at::Tensor& input);
+
+at::Tensor run_quantized_input(
+    ContextLinearWoq& context,
+    const at::Tensor& input,
+    const at::Tensor& input_scales,
+    const at::Tensor& input_zero_points,
+    at::ScalarType out_dtype);
+
 at::Tensor woq_linear_add_run(
     const at::Tensor& input,
     at::Tensor& accumu,
@@ -536,6 +536,19 @@ at::Tensor IpexWoqLinearOpContext::run_add_add(
       op_context_, input, others);
 }
 
+at::Tensor IpexWoqLinearOpContext::run_silu_mul(const at::Tensor& input) {
+  return torch_ipex::cpu::detail::woq_linear::run_silu_mul(op_context_, input);
+}
+
+at::Tensor IpexWoqLinearOpContext::run_quantized_input(
+    const at::Tensor& input,
+    const at::Tensor& input_scales,
+    const at::Tensor& input_zero_points,
+    at::ScalarType out_dtype) {
+  return torch_ipex::cpu::detail::woq_linear::run_quantized_input(
+      op_context_, input, input_scales, input_zero_points, out_dtype);
+}
+
 at::Tensor IpexWoqLinearOpContext::to_public(const at::Tensor& tensor) {
   return torch_ipex::cpu::detail::woq_linear::unpack(op_context_, tensor);
 }
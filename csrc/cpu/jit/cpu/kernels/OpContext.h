@@ -368,6 +368,21 @@ using SerializationTypeWoqLinearPrePack = std::tuple<
     int64_t,
     int64_t>;
 
+// The packed weight, scales, zero points and bias as the kernels use them,
+// followed by is_int4, lowp_mode, num_concats, act_quant_mode, the original
+// weight shape and group_size
+using SerializationTypeWoqLinearPacked = std::tuple<
+    at::Tensor,
+    at::Tensor,
+    at::Tensor,
+    c10::optional<at::Tensor>,
+    bool,
+    int64_t,
+    int64_t,
+    int64_t,
+    c10::optional<std::vector<int64_t>>,
+    int64_t>;
+
 class WoqLinearOpContext : public torch::jit::CustomClassHolder {
  protected:
   c10::optional<int64_t> batch_size_;
@@ -385,6 +400,23 @@ class WoqLinearOpContext : public torch::jit::CustomClassHolder {
         this->get_context().act_quant_mode_);
   }
 
+  // Unlike unpack, keep the weight packed so that the context can be created
+  // again by weight_only_qlinear_prepack_from_packed without packing it.
+  SerializationTypeWoqLinearPacked get_packed_state() {
+    auto& context = this->get_context();
+    return std::make_tuple(
+        context.at_weight_,
+        context.scales_list_[0],
+        context.zero_points_list_[0],
+        context.at_bias_,
+        context.is_int4_,
+        context.lowp_mode_,
+        context.num_concats_,
+        context.act_quant_mode_,
+        context.orig_wei_shape_,
+        context.group_size_);
+  }
+
   virtual at::Tensor get_data_handle() = 0;
 
   virtual at::Tensor run(const at::Tensor& input) = 0;
@@ -413,6 +445,14 @@ class WoqLinearOpContext : public torch::jit::CustomClassHolder {
       const at::Tensor& input,
       const std::vector<at::Tensor>& others) = 0;
 
+  virtual at::Tensor run_silu_mul(const at::Tensor& input) = 0;
+
+  virtual at::Tensor run_quantized_input(
+      const at::Tensor& input,
+      const at::Tensor& input_scales,
+      const at::Tensor& input_zero_points,
+      at::ScalarType out_dtype) = 0;
+
   virtual at::Tensor to_public(const at::Tensor& tensor) = 0;
 
   virtual at::Tensor get_at_packed_weight() = 0;
@@ -473,6 +513,14 @@ class IpexWoqLinearOpContext final : public WoqLinearOpContext {
       const at::Tensor& input,
       const std::vector<at::Tensor>& others) override;
 
+  virtual at::Tensor run_silu_mul(const at::Tensor& input) override;
+
+  virtual at::Tensor run_quantized_input(
+      const at::Tensor& input,
+      const at::Tensor& input_scales,
+      const at::Tensor& input_zero_points,
+      at::ScalarType out_dtype) override;
+
   virtual at::Tensor to_public(const at::Tensor& tensor) override;
 
   virtual at::Tensor get_at_packed_weight() override;
@@ -16,6 +16,7 @@ using detail::linear::createLinearPrePackOpContext;
 using detail::mkl_sgemm::createLinearMKLPrePackOpContext;
 #ifdef USE_LIBXSMM
 using detail::woq_linear::createWoqLinearPrePackOpContext;
+using detail::woq_linear::createWoqLinearPrePackOpContextFromPacked;
 using detail::woq_linear::createWoqLinearPrePackOpContextInt4;
 #endif
 
@@ -148,7 +149,10 @@ TORCH_LIBRARY(ipex_prepack, m) {
           "get_data_handle",
           &torch_ipex::cpu::WoqLinearOpContext::get_data_handle)
       .def(
-          "load_from_ctx", &torch_ipex::cpu::WoqLinearOpContext::load_from_ctx);
+          "load_from_ctx", &torch_ipex::cpu::WoqLinearOpContext::load_from_ctx)
+      .def(
+          "get_packed_state",
+          &torch_ipex::cpu::WoqLinearOpContext::get_packed_state);
 #endif
   m.def(
       "convolution_prepack(Tensor W, Tensor? B, int[] stride, "
@@ -173,6 +177,9 @@ TORCH_LIBRARY(ipex_prepack, m) {
   m.def(
       "weight_only_qlinear_prepack_int4(Tensor W, Tensor scales, Tensor zero_points, Tensor? B, int? batch_size, int lowp_mode, int num_concats, int act_quant_mode) "
       "-> __torch__.torch.classes.ipex_prepack.WoqLinearOpContext");
+  m.def(
+      "weight_only_qlinear_prepack_from_packed(Tensor W, Tensor scales, Tensor zero_points, Tensor? B, int? batch_size, bool is_int4, int lowp_mode, int num_concats, int act_quant_mode, int[]? orig_wei_shape, int group_size, bool repack) "
+      "-> __torch__.torch.classes.ipex_prepack.WoqLinearOpContext");
 #endif
 }
 
@@ -192,6 +199,9 @@ TORCH_LIBRARY_IMPL(ipex_prepack, CPU, m) {
   m.impl(
       "weight_only_qlinear_prepack_int4",
       TORCH_FN(createWoqLinearPrePackOpContextInt4));
+  m.impl(
+      "weight_only_qlinear_prepack_from_packed",
+      TORCH_FN(createWoqLinearPrePackOpContextFromPacked));
 }
 #endif
 } // namespace cpu
@@ -54,21 +54,16 @@ auto Task<F, Args...>::operator()(Args&&... args)
       });
   std::future<return_type> res = task->get_future();
   auto grad_mode = at::GradMode::is_enabled();
-  {
-    std::unique_lock<std::mutex> lock(this->task_executor->get_mutex());
-    // submit task to a stopping the pool is not allowed
-    if (this->task_executor->is_stop())
-      throw std::runtime_error("Task submit on stopped ThreadPool");
-    this->task_executor->get_tasks().emplace([task, grad_mode]() {
-      // set the thread local status, such as the grad mode before execuating
-      // the status
-      at::GradMode::set_enabled(grad_mode);
-      // execuate the task
-      (*task)();
-    });
-  }
-
-  this->task_executor->get_condition().notify_one();
+  // submit task to a stopping the pool is not allowed
+  if (this->task_executor->is_stop())
+    throw std::runtime_error("Task submit on stopped ThreadPool");
+  this->task_executor->submit([task, grad_mode]() {
+    // set the thread local status, such as the grad mode before execuating
+    // the status
+    at::GradMode::set_enabled(grad_mode);
+    // execuate the task
+    (*task)();
+  });
   return res;
 }
 
@@ -1,9 +1,88 @@
 #include "TaskExecutor.h"
 
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string>
+
 namespace torch_ipex {
 namespace runtime {
 
+namespace {
+// The capacity of the task queue of a group. A submit to a full queue waits
+// for the queue to be drained, or runs the task directly if it is submitted
+// by a worker of the executor, which would otherwise wait for itself.
+constexpr size_t kTaskQueueCapacity = 4096;
+// The rounds a worker yields to look for tasks before sleeping.
+constexpr int kSpinRounds = 64;
+
+// The executor the worker thread belongs to, nullptr on the other threads.
+thread_local const TaskExecutor* current_executor = nullptr;
+
+// Read the NUMA node of the core from sysfs, 0 if it is unknown.
+int32_t get_numa_node_of_core(int32_t core_id) {
+#ifdef _WIN32
+  return 0;
+#else
+  for (int32_t node = 0;; node++) {
+    std::ifstream file(
+        "/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+    if (!file) {
+      return 0;
+    }
+    // the list is like 0-27,56-83
+    std::string cpu_list;
+    std::getline(file, cpu_list);
+    std::stringstream ss(cpu_list);
+    std::string range;
+    while (std::getline(ss, range, ',')) {
+      if (range.empty()) {
+        continue;
+      }
+      auto dash = range.find('-');
+      int32_t first = std::stoi(range.substr(0, dash));
+      int32_t last =
+          dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+      if (core_id >= first && core_id <= last) {
+        return node;
+      }
+    }
+  }
+#endif
+}
+} // namespace
+
+struct TaskExecutor::WorkerGroup {
+  explicit WorkerGroup(int32_t numa_node)
+      : tasks(kTaskQueueCapacity), numa_node(numa_node) {}
+
+  TaskQueue<std::function<void()>> tasks;
+  int32_t numa_node;
+  // the groups on the same NUMA node, which the group steals tasks from
+  std::vector<size_t> neighbors;
+
+  // The worker sleeps on the condition when it finds no task. The submitters
+  // only take the mutex to wake it up.
+  std::atomic<bool> sleeping{false};
+  std::mutex mutex;
+  std::condition_variable condition;
+};
+
 TaskExecutor::TaskExecutor(const torch_ipex::runtime::CPUPool& cpu_pool) {
+  this->init({cpu_pool.get_cpu_core_list()});
+}
+
+TaskExecutor::TaskExecutor(
+    const std::vector<torch_ipex::runtime::CPUPool>& cpu_pools) {
+  std::vector<std::vector<int32_t>> cpu_core_lists;
+  for (auto& cpu_pool : cpu_pools) {
+    cpu_core_lists.emplace_back(cpu_pool.get_cpu_core_list());
+  }
+  this->init(cpu_core_lists);
+}
+
+void TaskExecutor::init(
+    const std::vector<std::vector<int32_t>>& cpu_core_lists) {
   // Notice: We shouldn't load iomp symbol in sub_thread, otherwise race
   // condition happens.
   if (!is_runtime_ext_enabled()) {
@@ -11,56 +90,199 @@ TaskExecutor::TaskExecutor(const torch_ipex::runtime::CPUPool& cpu_pool) {
         "Fail to init TaskExecutor. Didn't preload IOMP "
         "before using the runtime API.");
   }
-  this->stop = false;
+  if (cpu_core_lists.empty()) {
+    throw std::runtime_error("Fail to init TaskExecutor without any CPUPool.");
+  }
 
-  this->worker = std::make_shared<std::thread>([&, this] {
-    _pin_cpu_cores(cpu_pool);
-    while (true) {
-      std::function<void()> task;
-      {
-        std::unique_lock<std::mutex> lock(this->worker_mutex);
-        this->worker_condition.wait(
-            lock, [this] { return this->stop || !this->tasks.empty(); });
+  for (auto& cpu_core_list : cpu_core_lists) {
+    // the NUMA node of a group is the one of its first core
+    TORCH_CHECK(
+        !cpu_core_list.empty(),
+        "Fail to init TaskExecutor with a CPUPool without any core.");
+    this->groups.emplace_back(
+        std::make_unique<WorkerGroup>(get_numa_node_of_core(cpu_core_list[0])));
+  }
+  for (size_t i = 0; i < this->groups.size(); i++) {
+    for (size_t j = 0; j < this->groups.size(); j++) {
+      if (i != j && this->groups[i]->numa_node == this->groups[j]->numa_node) {
+        this->groups[i]->neighbors.emplace_back(j);
+      }
+    }
+  }
+  for (size_t i = 0; i < this->groups.size(); i++) {
+    this->workers.emplace_back(
+        &TaskExecutor::run_worker, this, i, cpu_core_lists[i]);
+  }
+}
 
-        if (this->stop && this->tasks.empty())
-          return;
+void TaskExecutor::run_worker(
+    size_t group_id,
+    std::vector<int32_t> cpu_core_list) {
+  _pin_cpu_cores(torch_ipex::runtime::CPUPool(cpu_core_list));
+  current_executor = this;
 
-        task = std::move(this->tasks.front());
-        this->tasks.pop();
-      }
+  auto& group = *this->groups[group_id];
+  std::function<void()> task;
+  int idle_rounds = 0;
+  while (true) {
+    if (group.tasks.pop(task) || this->steal(group, task)) {
       task();
+      task = nullptr;
+      idle_rounds = 0;
+      continue;
     }
-  });
+
+    if (this->stop) {
+      // the tasks pushed before the pending submits finish should still run
+      if (this->pending_submits == 0 && group.tasks.empty())
+        return;
+      std::this_thread::yield();
+      continue;
+    }
+
+    if (++idle_rounds < kSpinRounds) {
+      std::this_thread::yield();
+      continue;
+    }
+    idle_rounds = 0;
+
+    std::unique_lock<std::mutex> lock(group.mutex);
+    group.sleeping = true;
+    // pairs with the fence in wake_up, either the worker finds the task or the
+    // submitter finds the worker sleeping
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!this->has_task(group) && !this->stop) {
+      group.condition.wait(lock);
+    }
+    group.sleeping = false;
+  }
 }
 
-std::mutex& TaskExecutor::get_mutex() {
-  return this->worker_mutex;
+bool TaskExecutor::steal(
+    const WorkerGroup& group,
+    std::function<void()>& task) {
+  for (auto neighbor : group.neighbors) {
+    if (this->groups[neighbor]->tasks.pop(task)) {
+      return true;
+    }
+  }
+  return false;
 }
 
-std::condition_variable& TaskExecutor::get_condition() {
-  return this->worker_condition;
+bool TaskExecutor::has_task(const WorkerGroup& group) {
+  if (!group.tasks.empty()) {
+    return true;
+  }
+  for (auto neighbor : group.neighbors) {
+    if (!this->groups[neighbor]->tasks.empty()) {
+      return true;
+    }
+  }
+  return false;
 }
 
-bool TaskExecutor::is_stop() {
-  return this->stop;
+void TaskExecutor::wake_up(size_t group_id) {
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  auto& group = *this->groups[group_id];
+  if (group.sleeping) {
+    std::lock_guard<std::mutex> lock(group.mutex);
+    group.condition.notify_one();
+    return;
+  }
+  // the group is busy, wake up an idle neighbor to steal the tasks
+  for (auto neighbor : group.neighbors) {
+    auto& neighbor_group = *this->groups[neighbor];
+    if (neighbor_group.sleeping) {
+      std::lock_guard<std::mutex> lock(neighbor_group.mutex);
+      neighbor_group.condition.notify_one();
+      return;
+    }
+  }
 }
 
-std::queue<std::function<void()>>& TaskExecutor::get_tasks() {
-  return this->tasks;
+void TaskExecutor::submit_batch(
+    size_t group_id,
+    std::function<void()>* tasks,
+    size_t num_tasks) {
+  auto& group = *this->groups[group_id];
+  size_t pushed = 0;
+  while (pushed < num_tasks) {
+    pushed += group.tasks.push(tasks + pushed, num_tasks - pushed);
+    if (pushed < num_tasks) {
+      if (current_executor == this) {
+        tasks[pushed++]();
+      } else {
+        this->wake_up(group_id);
+        std::this_thread::yield();
+      }
+    }
+  }
+  this->wake_up(group_id);
+}
+
+void TaskExecutor::submit(std::function<void()>&& task) {
+  this->submit(this->next_group++ % this->groups.size(), std::move(task));
+}
+
+void TaskExecutor::submit(size_t group_id, std::function<void()>&& task) {
+  if (group_id >= this->groups.size()) {
+    throw std::runtime_error(
+        "Fail to submit task to group " + std::to_string(group_id) +
+        " of TaskExecutor with " + std::to_string(this->groups.size()) +
+        " groups.");
+  }
+  this->pending_submits++;
+  // submit task to a stopping the pool is not allowed
+  if (this->stop) {
+    this->pending_submits--;
+    throw std::runtime_error("Task submit on stopped TaskExecutor");
+  }
+  this->submit_batch(group_id, &task, 1);
+  this->pending_submits--;
+}
+
+void TaskExecutor::submit(std::vector<std::function<void()>>&& tasks) {
+  this->pending_submits++;
+  // submit task to a stopping the pool is not allowed
+  if (this->stop) {
+    this->pending_submits--;
+    throw std::runtime_error("Task submit on stopped TaskExecutor");
+  }
+  auto num_groups = this->groups.size();
+  auto batch_size = (tasks.size() + num_groups - 1) / num_groups;
+  auto first_group = this->next_group++;
+  for (size_t i = 0; i < num_groups && i * batch_size < tasks.size(); i++) {
+    auto begin = i * batch_size;
+    auto end = std::min(begin + batch_size, tasks.size());
+    this->submit_batch(
+        (first_group + i) % num_groups, tasks.data() + begin, end - begin);
+  }
+  this->pending_submits--;
+}
+
+size_t TaskExecutor::get_num_groups() const {
+  return this->groups.size();
+}
+
+int32_t TaskExecutor::get_numa_node(size_t group_id) const {
+  return this->groups.at(group_id)->numa_node;
+}
+
+bool TaskExecutor::is_stop() {
+  return this->stop;
 }
 
 void TaskExecutor::stop_executor() {
-  bool should_wait_worker_join = false;
-  {
-    std::unique_lock<std::mutex> lock(this->worker_mutex);
-    if (this->stop == false) {
-      should_wait_worker_join = true;
-      this->stop = true;
-    }
+  bool expected = false;
+  if (!this->stop.compare_exchange_strong(expected, true)) {
+    return;
+  }
+  for (auto& group : this->groups) {
+    std::lock_guard<std::mutex> lock(group->mutex);
+    group->condition.notify_all();
   }
-  if (should_wait_worker_join) {
-    this->worker_condition.notify_all();
-    this->worker->join();
+  for (auto& worker : this->workers) {
+    worker.join();
   }
   return;
 }
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <omp.h>
+#include <atomic>
 #include <cassert>
 #include <condition_variable>
 #include <functional>
@@ -8,7 +9,6 @@
 #include <iostream>
 #include <memory>
 #include <mutex>
-#include <queue>
 #include <stdexcept>
 #include <thread>
 #include <vector>
@@ -18,28 +18,53 @@
 #include <torch/csrc/autograd/profiler.h>
 #include <torch/csrc/jit/api/module.h>
 #include "CPUPool.h"
+#include "TaskQueue.h"
 
 namespace torch_ipex {
 namespace runtime {
 
+/*TaskExecutor runs the submitted tasks on a set of worker groups. Each group
+ * is a worker thread pinned to a CPUPool with a lock-free task queue, and an
+ * idle group steals the tasks of the other groups on the same NUMA node.*/
 class IPEX_API TaskExecutor {
  public:
   explicit TaskExecutor(const torch_ipex::runtime::CPUPool& cpu_pool);
-  std::mutex& get_mutex();
-  std::condition_variable& get_condition();
+  explicit TaskExecutor(
+      const std::vector<torch_ipex::runtime::CPUPool>& cpu_pools);
   bool is_stop();
-  std::queue<std::function<void()>>& get_tasks();
+  // Submit the task to the groups in round-robin order.
+  void submit(std::function<void()>&& task);
+  void submit(size_t group_id, std::function<void()>&& task);
+  // Split the tasks into one batch per group, and push every batch at once
+  // with at most one wake-up of the workers.
+  void submit(std::vector<std::function<void()>>&& tasks);
+  size_t get_num_groups() const;
+  int32_t get_numa_node(size_t group_id) const;
   void stop_executor();
   ~TaskExecutor();
 
  private:
-  std::queue<std::function<void()>> tasks;
-  std::shared_ptr<std::thread> worker;
+  struct WorkerGroup;
+
+  void init(const std::vector<std::vector<int32_t>>& cpu_core_lists);
+  void submit_batch(
+      size_t group_id,
+      std::function<void()>* tasks,
+      size_t num_tasks);
+  bool steal(const WorkerGroup& group, std::function<void()>& task);
+  bool has_task(const WorkerGroup& group);
+  void wake_up(size_t group_id);
+  void run_worker(size_t group_id, std::vector<int32_t> cpu_core_list);
+
+  std::vector<std::unique_ptr<WorkerGroup>> groups;
+  std::vector<std::thread> workers;
+  std::atomic<size_t> next_group{0};
 
   // Synchronization
-  bool stop;
-  std::mutex worker_mutex;
-  std::condition_variable worker_condition;
+  std::atomic<bool> stop{false};
+  // the submits which have checked stop but not finished pushing, the workers
+  // do not exit until they are finished
+  std::atomic<int64_t> pending_submits{0};
 
   // Put the deleted function in the private.
   TaskExecutor(const TaskExecutor& task_executor) =
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+namespace torch_ipex {
+namespace runtime {
+
+// A bounded lock-free queue of tasks which can be pushed by any thread and
+// popped by the worker of the queue and the workers stealing from it, refer
+// to
+// https://www.1024cores.net/home/lock-free-algorithms/queues/bounded-mpmc-queue
+// Each cell carries a sequence number telling whether it is ready to be
+// pushed or popped at the current position, so a push or a pop only needs one
+// CAS on the position.
+template <typename T>
+class TaskQueue {
+ public:
+  // capacity should be a power of 2
+  explicit TaskQueue(size_t capacity)
+      : cells_(new Cell[capacity]), mask_(capacity - 1) {
+    for (size_t i = 0; i < capacity; i++) {
+      cells_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    enqueue_pos_.store(0, std::memory_order_relaxed);
+    dequeue_pos_.store(0, std::memory_order_relaxed);
+  }
+
+  TaskQueue(const TaskQueue& queue) = delete;
+  TaskQueue& operator=(const TaskQueue& queue) = delete;
+
+  // Push values[0, size) at consecutive positions with one CAS. Return the
+  // number of the values pushed, which is less than size if the queue is
+  // full.
+  size_t push(T* values, size_t size) {
+    size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+    size_t count = 0;
+    while (true) {
+      // count the free cells from pos, at most size
+      count = 0;
+      while (count < size) {
+        auto& cell = cells_[(pos + count) & mask_];
+        size_t seq = cell.sequence.load(std::memory_order_acquire);
+        if (seq != pos + count) {
+          break;
+        }
+        count++;
+      }
+      if (count == 0) {
+        auto& cell = cells_[pos & mask_];
+        size_t seq = cell.sequence.load(std::memory_order_acquire);
+        if (static_cast<ptrdiff_t>(seq) - static_cast<ptrdiff_t>(pos) < 0) {
+          // full
+          return 0;
+        }
+        // another producer has taken pos
+        pos = enqueue_pos_.load(std::memory_order_relaxed);
+        continue;
+      }
+      if (enqueue_pos_.compare_exchange_weak(
+              pos, pos + count, std::memory_order_relaxed)) {
+        break;
+      }
+    }
+    for (size_t i = 0; i < count; i++) {
+      auto& cell = cells_[(pos + i) & mask_];
+      cell.data = std::move(values[i]);
+      cell.sequence.store(pos + i + 1, std::memory_order_release);
+    }
+    return count;
+  }
+
+  bool pop(T& value) {
+    size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+    while (true) {
+      auto& cell = cells_[pos & mask_];
+      size_t seq = cell.sequence.load(std::memory_order_acquire);
+      auto diff = static_cast<ptrdiff_t>(seq) - static_cast<ptrdiff_t>(pos + 1);
+      if (diff == 0) {
+        if (dequeue_pos_.compare_exchange_weak(
+                pos, pos + 1, std::memory_order_relaxed)) {
+          value = std::move(cell.data);
+          cell.data = T();
+          cell.sequence.store(pos + mask_ + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (diff < 0) {
+        // empty
+        return false;
+      } else {
+        // another consumer has taken pos
+        pos = dequeue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  // Whether all the values pushed have been popped, which might be stale
+  // when it returns.
+  bool empty() const {
+    return enqueue_pos_.load(std::memory_order_acquire) ==
+        dequeue_pos_.load(std::memory_order_acquire);
+  }
+
+ private:
+  struct Cell {
+    std::atomic<size_t> sequence;
+    T data;
+  };
+
+  std::unique_ptr<Cell[]> cells_;
+  const size_t mask_;
+  // keep the positions on their own cache lines, the producers and the
+  // consumers do not contend with each other
+  alignas(64) std::atomic<size_t> enqueue_pos_;
+  alignas(64) std::atomic<size_t> dequeue_pos_;
+};
+
+} // namespace runtime
+} // namespace torch_ipex
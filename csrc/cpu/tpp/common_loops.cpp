@@ -358,6 +358,35 @@ static void par_nested_loops_ACb(
   }
 }
 
+static void par_nested_loops_CAb(
+    LoopSpecs* loop_rt_spec,
+    std::function<void(int*)> body_func,
+    std::function<void()> init_func,
+    std::function<void()> term_func) {
+#pragma omp parallel
+  {
+    if (init_func)
+      init_func();
+#pragma omp for collapse(2) nowait
+    for (int c0 = loop_rt_spec[2].start; c0 < loop_rt_spec[2].end;
+         c0 += loop_rt_spec[2].step) {
+      for (int a0 = loop_rt_spec[0].start; a0 < loop_rt_spec[0].end;
+           a0 += loop_rt_spec[0].step) {
+        for (int b0 = loop_rt_spec[1].start; b0 < loop_rt_spec[1].end;
+             b0 += loop_rt_spec[1].step) {
+          int idx[3];
+          idx[0] = a0;
+          idx[1] = b0;
+          idx[2] = c0;
+          body_func(idx);
+        }
+      }
+    }
+    if (term_func)
+      term_func();
+  }
+}
+
 std::unordered_map<std::string, par_loop_kernel> pre_defined_loops = {
     {"A", par_nested_loops_A},
     {"AB", par_nested_loops_AB},
@@ -373,6 +402,7 @@ std::unordered_map<std::string, par_loop_kernel> pre_defined_loops = {
     {"ABc", par_nested_loops_ABc},
     {"CAB", par_nested_loops_CAB},
     {"ACb", par_nested_loops_ACb},
+    {"CAb", par_nested_loops_CAb},
 };
 } // namespace tpp
 } // namespace torch_ipex
\ No newline at end of file
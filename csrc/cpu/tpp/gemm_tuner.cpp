@@ -0,0 +1,149 @@
+#include "gemm_tuner.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <fstream>
+#include <sstream>
+
+namespace torch_ipex {
+namespace tpp {
+
+// The schemes of the {nc, s1, nk} loop nest which are pre-defined in
+// common_loops.cpp. nc is kept sequential, so that a thread reduces all the
+// blocks of an output block in order.
+static const char* kLoopSchemes[] = {"aCb", "aCB", "aBC", "acB"};
+
+GemmTuner& GemmTuner::instance() {
+  static GemmTuner tuner;
+  return tuner;
+}
+
+GemmTuner::GemmTuner() {
+  auto autotune = getenv("TPP_GEMM_AUTOTUNE");
+  enabled_ = autotune && atoi(autotune) != 0;
+  auto file = getenv("TPP_GEMM_TUNING_FILE");
+  file_ = file ? file : "";
+  load();
+}
+
+long GemmTuner::get_m_bucket(long M) {
+  // the batch of the next token is small and exact, the batch of the first
+  // token is rounded up to the power of 2
+  if (M <= 16)
+    return M;
+  long bucket = 32;
+  while (bucket < M && bucket < 4096)
+    bucket *= 2;
+  return bucket;
+}
+
+bool GemmTuner::lookup(
+    int dtype_size,
+    long M,
+    long N,
+    long K,
+    int threads,
+    GemmTuneConfig& cfg) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = table_.find(Key(dtype_size, get_m_bucket(M), N, K, threads));
+  if (it == table_.end())
+    return false;
+  cfg = it->second;
+  return true;
+}
+
+void GemmTuner::record(
+    int dtype_size,
+    long M,
+    long N,
+    long K,
+    int threads,
+    const GemmTuneConfig& cfg) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  table_[Key(dtype_size, get_m_bucket(M), N, K, threads)] = cfg;
+  save();
+}
+
+std::vector<GemmTuneConfig> GemmTuner::candidates(
+    long M,
+    long Nc,
+    bool can_merge_wt) const {
+  std::vector<long> BSbs = {64};
+  if (M > 32)
+    BSbs.push_back(32);
+  if (M >= 128)
+    BSbs.push_back(128);
+  std::vector<long> Ncbs = {0};
+  for (long Ncb : {32L, 8L}) {
+    if (Ncb < Nc)
+      Ncbs.push_back(Ncb);
+  }
+  std::vector<bool> merge_wts = {false};
+  if (can_merge_wt)
+    merge_wts.push_back(true);
+
+  std::vector<GemmTuneConfig> cfgs;
+  for (auto scheme : kLoopSchemes) {
+    for (auto BSb : BSbs) {
+      for (auto Ncb : Ncbs) {
+        for (auto merge_wt : merge_wts) {
+          GemmTuneConfig cfg;
+          cfg.loop_scheme = scheme;
+          cfg.BSb = BSb;
+          cfg.Ncb = Ncb;
+          cfg.merge_wt = merge_wt;
+          cfgs.push_back(cfg);
+        }
+      }
+    }
+  }
+  return cfgs;
+}
+
+// One shape per line:
+// dtype_size M_bucket N K threads loop_scheme BSb Ncb merge_wt
+void GemmTuner::load() {
+  if (file_.empty())
+    return;
+  std::ifstream in(file_);
+  std::string line;
+  while (std::getline(in, line)) {
+    if (line.empty() || line[0] == '#')
+      continue;
+    std::istringstream ss(line);
+    int dtype_size, threads, merge_wt;
+    long M, N, K;
+    GemmTuneConfig cfg;
+    if (ss >> dtype_size >> M >> N >> K >> threads >> cfg.loop_scheme >>
+        cfg.BSb >> cfg.Ncb >> merge_wt) {
+      cfg.merge_wt = merge_wt != 0;
+      table_[Key(dtype_size, M, N, K, threads)] = cfg;
+    } else {
+      printf(
+          "GemmTuner: '%s': Ignoring malformed line: '%s'\n",
+          file_.c_str(),
+          line.c_str());
+    }
+  }
+}
+
+void GemmTuner::save() {
+  if (file_.empty())
+    return;
+  std::ofstream out(file_, std::ofstream::trunc);
+  if (!out) {
+    printf("GemmTuner: Failed to write the tuning file '%s'\n", file_.c_str());
+    return;
+  }
+  out << "# dtype_size M_bucket N K threads loop_scheme BSb Ncb merge_wt\n";
+  for (auto& entry : table_) {
+    auto& key = entry.first;
+    auto& cfg = entry.second;
+    out << std::get<0>(key) << " " << std::get<1>(key) << " "
+        << std::get<2>(key) << " " << std::get<3>(key) << " "
+        << std::get<4>(key) << " " << cfg.loop_scheme << " " << cfg.BSb << " "
+        << cfg.Ncb << " " << (cfg.merge_wt ? 1 : 0) << "\n";
+  }
+}
+
+} // namespace tpp
+} // namespace torch_ipex
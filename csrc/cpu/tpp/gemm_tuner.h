@@ -0,0 +1,73 @@
+#ifndef _GEMM_TUNER_H_
+#define _GEMM_TUNER_H_
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <vector>
+
+namespace torch_ipex {
+namespace tpp {
+
+// The blocking of the TPP GEMM kernels, see TPPGEMMKrnl.h
+struct GemmTuneConfig {
+  // LoopingScheme of the {nc, s1, nk} loop nest
+  std::string loop_scheme = "aCb";
+  // rows of the input in one brgemm
+  long BSb = 64;
+  // blocks along C reduced in one brgemm, 0 for all of them
+  long Ncb = 0;
+  // merge pairs of output blocks of the weight for a large batch
+  bool merge_wt = false;
+};
+
+// Autotuner of the TPP GEMM blocking. The best config of each (data type,
+// M bucket, N, K, threads) shape is looked up from a table, which is loaded
+// from and saved to the file given by TPP_GEMM_TUNING_FILE. The missing shapes
+// are benchmarked with the candidates when TPP_GEMM_AUTOTUNE=1, or run with
+// the default config otherwise.
+class GemmTuner {
+ public:
+  static GemmTuner& instance();
+
+  bool enabled() const {
+    return enabled_;
+  }
+  bool lookup(
+      int dtype_size,
+      long M,
+      long N,
+      long K,
+      int threads,
+      GemmTuneConfig& cfg);
+  // Add the config of the shape to the table and save the table.
+  void record(
+      int dtype_size,
+      long M,
+      long N,
+      long K,
+      int threads,
+      const GemmTuneConfig& cfg);
+  std::vector<GemmTuneConfig> candidates(long M, long Nc, bool can_merge_wt)
+      const;
+
+ private:
+  // (dtype size, M bucket, N, K, threads)
+  using Key = std::tuple<int, long, long, long, int>;
+
+  GemmTuner();
+  static long get_m_bucket(long M);
+  void load();
+  void save();
+
+  bool enabled_;
+  std::string file_;
+  std::map<Key, GemmTuneConfig> table_;
+  std::mutex mutex_;
+};
+
+} // namespace tpp
+} // namespace torch_ipex
+
+#endif // _GEMM_TUNER_H_
@@ -1,6 +1,7 @@
 
 #include <ATen/record_function.h>
 #include <aten/TPPGEMM.h>
+#include <aten/utils/rope.h>
 #include <torch/all.h>
 #include <iostream>
 #include <vector>
@@ -9,8 +10,11 @@
 #ifndef NO_PARLOOPER
 #include "tpp/threaded_loops.h"
 #endif
+#include <omp.h>
 #include <cstdint>
+#include "tpp/gemm_tuner.h"
 #include "tpp/tensor_helper.h"
+#include "tpp/weight_prefetch.h"
 #include "tpp/xsmm_functors.h"
 
 namespace torch_ipex {
@@ -42,12 +46,79 @@ REGISTER_LOCAL_SCOPE(
 REGISTER_LOCAL_SCOPE(
     tpp_linear_silu_krnl,
     "tpp_linear_silu_krnl"); // linear bias + silu
+REGISTER_LOCAL_SCOPE(
+    tpp_linear_silu_mul_krnl,
+    "tpp_linear_silu_mul_krnl"); // gate/up linear + silu + mul
+REGISTER_LOCAL_SCOPE(
+    tpp_linear_qkv_rope_krnl,
+    "tpp_linear_qkv_rope_krnl"); // qkv linear + rope + kv store
 REGISTER_LOCAL_SCOPE(
     tpp_linear_relu_krnl,
     "tpp_linear_relu_krnl"); // linear bias + relu
 
 REGISTER_LOCAL_SCOPE(fftkn, "fftkn");
 
+// The blocking of the shapes which are not tuned, which can be set by the env
+// vars.
+inline GemmTuneConfig default_gemm_config(long BS, long Nc) {
+  GemmTuneConfig cfg;
+  cfg.loop_scheme = large_cache_opt ? GEMM_LOOP_SCHEME : "aCb";
+  cfg.BSb = 64;
+  cfg.Ncb = large_cache_opt ? NCB_BLOCK_SIZE : Nc;
+  cfg.merge_wt = BS > FT_OPT_SIZE;
+  return cfg;
+}
+
+// Run the GEMM kernel with the blocking of its shape from GemmTuner. A shape
+// which is not in the table yet is benchmarked with all the candidates when
+// the autotuner is enabled. The candidates compute the same output, so the
+// output of the last run is kept.
+template <typename T, typename F>
+inline void tpp_gemm_tuned(
+    const at::Tensor& t_in,
+    const at::Tensor& t_wt,
+    const F& kernel,
+    bool can_merge_wt = true) {
+  auto in_sizes = t_in.sizes();
+  auto wt_sizes = t_wt.sizes();
+  auto BS = in_sizes[0] * in_sizes[1];
+  auto C = in_sizes[2];
+  auto Nc = wt_sizes[1];
+  auto N = wt_sizes[0] * wt_sizes[3];
+  auto threads = omp_get_max_threads();
+  auto& tuner = GemmTuner::instance();
+  GemmTuneConfig cfg;
+  if (tuner.lookup(sizeof(T), BS, N, C, threads, cfg)) {
+    kernel(cfg);
+    return;
+  }
+  auto default_cfg = default_gemm_config(BS, Nc);
+  if (!can_merge_wt)
+    default_cfg.merge_wt = false;
+  if (!tuner.enabled()) {
+    kernel(default_cfg);
+    return;
+  }
+
+  constexpr int kTuneIters = 3;
+  can_merge_wt = can_merge_wt && t_wt.dim() == 5 && wt_sizes[0] % 2 == 0;
+  auto best_cfg = default_cfg;
+  double best_time = -1.0;
+  for (auto& cand : tuner.candidates(BS, Nc, can_merge_wt)) {
+    kernel(cand); // warm up
+    auto start = getTime();
+    for (int i = 0; i < kTuneIters; i++) {
+      kernel(cand);
+    }
+    auto time = getTime() - start;
+    if (best_time < 0 || time < best_time) {
+      best_time = time;
+      best_cfg = cand;
+    }
+  }
+  tuner.record(sizeof(T), BS, N, C, threads, best_cfg);
+}
+
 template <typename T>
 inline at::Tensor wt_tensor_for_first_token(at::Tensor& t) {
   RECORD_SCOPE(fftkn, {t});
@@ -86,9 +157,10 @@ inline at::Tensor wt_tensor_for_first_token(at::Tensor& t) {
 template <typename T>
 inline void tpp_linear_bias(
     at::Tensor& t_in,
-    at::Tensor& t_wt,
+    at::Tensor t_wt,
     at::Tensor& t_bias,
-    at::Tensor& t_out) {
+    at::Tensor& t_out,
+    const GemmTuneConfig& cfg) {
   auto in_sizes = t_in.sizes();
   auto wt_sizes = t_wt.sizes();
   auto BS = in_sizes[0] * in_sizes[1];
@@ -110,11 +182,9 @@ inline void tpp_linear_bias(
 
   auto out = GetVLAPtr<T>(t_out, {Nk, Hk});
 
-  auto Ncb = Nc;
-  auto BSb = 64L;
-  auto rem = BS % 64;
-  if (large_cache_opt)
-    Ncb = NCB_BLOCK_SIZE;
+  auto Ncb = cfg.Ncb > 0 && cfg.Ncb < Nc ? cfg.Ncb : Nc;
+  auto BSb = cfg.BSb;
+  auto rem = BS % BSb;
 
   bool with_bias = (t_bias.numel() > 0);
   auto copy_bias_tpp = SCOPEIT(CpyBiasTPP<T>(BSb, Hk, K), BIAS);
@@ -128,7 +198,8 @@ inline void tpp_linear_bias(
 
   {
     RECORD_SCOPE(tpp_linear_krnl, {t_in, t_wt_V});
-    auto loop_scheme = large_cache_opt ? GEMM_LOOP_SCHEME : "aCb";
+    auto next_wt = next_weight_to_prefetch(t_wt, BS);
+    auto loop_scheme = cfg.loop_scheme;
     auto ogemm_loop = torch_ipex::tpp::ThreadedLoop<3>(
         {{0, Nc, Ncb, false}, {0L, BS, BSb}, {Nk}}, loop_scheme);
     ogemm_loop(
@@ -158,18 +229,22 @@ inline void tpp_linear_bias(
           }
         },
         [&]() { brgemm_tpp.config(); },
-        [&]() { brgemm_tpp.release(); });
+        [&]() {
+          brgemm_tpp.release();
+          prefetch_weight_slice(next_wt);
+        });
   }
 }
 
 template <typename T, typename Tout = T>
 inline void tpp_linear_no_bias(
     at::Tensor& t_in,
-    at::Tensor& t_wt,
-    at::Tensor& t_out) {
+    at::Tensor t_wt,
+    at::Tensor& t_out,
+    const GemmTuneConfig& cfg) {
   auto in_sizes = t_in.sizes();
   auto BS = in_sizes[0] * in_sizes[1];
-  if (BS > FT_OPT_SIZE) { // first token compute
+  if (cfg.merge_wt) { // first token compute
     t_wt = wt_tensor_for_first_token<T>(t_wt);
   }
   auto wt_sizes = t_wt.sizes();
@@ -186,11 +261,9 @@ inline void tpp_linear_no_bias(
   auto wt_V = GetVLAPtr<T>(t_wt_V, {Nc, Hc * Hk});
   auto out = GetVLAPtr<Tout>(t_out, {Nk, Hk});
 
-  auto Ncb = Nc;
-  auto BSb = 64L;
+  auto Ncb = cfg.Ncb > 0 && cfg.Ncb < Nc ? cfg.Ncb : Nc;
+  auto BSb = cfg.BSb;
   auto rem = BS % BSb;
-  if (large_cache_opt)
-    Ncb = NCB_BLOCK_SIZE;
 
   auto zero_tpp = SCOPEIT(SetZeroTPP<Tout>(BSb, Hk, K), EW_ZERO);
   auto zero_tpp_rem = SCOPEIT(SetZeroTPP<Tout>(rem, Hk, K), EW_ZERO);
@@ -201,7 +274,8 @@ inline void tpp_linear_no_bias(
 
   {
     RECORD_SCOPE(tpp_linear_krnl, {t_in, t_wt_V});
-    auto loop_scheme = large_cache_opt ? GEMM_LOOP_SCHEME : "aCb";
+    auto next_wt = next_weight_to_prefetch(t_wt, BS);
+    auto loop_scheme = cfg.loop_scheme;
     auto gemm_loop = torch_ipex::tpp::ThreadedLoop<3>(
         {{0, Nc, Ncb, false}, {0, BS, BSb}, {Nk}}, loop_scheme);
     gemm_loop(
@@ -223,7 +297,10 @@ inline void tpp_linear_no_bias(
           }
         },
         [&]() { brgemm_tpp.config(); },
-        [&]() { brgemm_tpp.release(); });
+        [&]() {
+          brgemm_tpp.release();
+          prefetch_weight_slice(next_wt);
+        });
   }
 }
 
@@ -233,10 +310,11 @@ inline void tpp_linear_mul(
     at::Tensor t_in1,
     at::Tensor t_wt,
     at::Tensor t_bias,
-    at::Tensor t_out) {
+    at::Tensor t_out,
+    const GemmTuneConfig& cfg) {
   auto in_sizes = t_in.sizes();
   auto BS = in_sizes[0] * in_sizes[1];
-  if (BS > FT_OPT_SIZE) { // first token compute
+  if (cfg.merge_wt) { // first token compute
     t_wt = wt_tensor_for_first_token<T>(t_wt);
   }
   auto wt_sizes = t_wt.sizes();
@@ -256,11 +334,9 @@ inline void tpp_linear_mul(
   auto bias = GetVLAPtr<T>(t_bias, {Hk});
   auto out = GetVLAPtr<T>(t_out, {Nk, Hk});
 
-  auto Ncb = Nc;
-  auto BSb = 64L;
-  auto rem = BS % 64;
-  if (large_cache_opt)
-    Ncb = NCB_BLOCK_SIZE;
+  auto Ncb = cfg.Ncb > 0 && cfg.Ncb < Nc ? cfg.Ncb : Nc;
+  auto BSb = cfg.BSb;
+  auto rem = BS % BSb;
 
   bool with_bias = (t_bias.numel() > 0);
   auto copy_bias_tpp = SCOPEIT(CpyBiasTPP<T>(BSb, Hk, K), BIAS);
@@ -276,8 +352,9 @@ inline void tpp_linear_mul(
 
   {
     RECORD_SCOPE(tpp_linear_mul_krnl, {t_in, t_wt_V});
+    auto next_wt = next_weight_to_prefetch(t_wt, BS);
 
-    auto loop_scheme = large_cache_opt ? GEMM_LOOP_SCHEME : "aCb";
+    auto loop_scheme = cfg.loop_scheme;
     auto ogemm_loop = torch_ipex::tpp::ThreadedLoop<3>(
         {{0, Nc, Ncb, false}, {0L, BS, BSb}, {Nk}}, loop_scheme);
     ogemm_loop(
@@ -313,7 +390,10 @@ inline void tpp_linear_mul(
           }
         },
         [&]() { brgemm_tpp.config(); },
-        [&]() { brgemm_tpp.release(); });
+        [&]() {
+          brgemm_tpp.release();
+          prefetch_weight_slice(next_wt);
+        });
   }
 }
 
@@ -322,13 +402,14 @@ inline void tpp_linear_add_add(
     at::Tensor& t_in,
     at::Tensor& t_in1,
     at::Tensor& t_in2,
-    at::Tensor& t_wt,
+    at::Tensor t_wt,
     at::Tensor& t_bias,
     at::Tensor& t_out,
-    double scale) {
+    double scale,
+    const GemmTuneConfig& cfg) {
   auto in_sizes = t_in.sizes();
   auto BS = in_sizes[0] * in_sizes[1];
-  if (BS > FT_OPT_SIZE) { // first token compute
+  if (cfg.merge_wt) { // first token compute
     t_wt = wt_tensor_for_first_token<T>(t_wt);
   }
   auto wt_sizes = t_wt.sizes();
@@ -349,11 +430,9 @@ inline void tpp_linear_add_add(
   auto bias = GetVLAPtr<T>(t_bias, {Hk});
   auto out = GetVLAPtr<T>(t_out, {Nk, Hk});
 
-  auto Ncb = Nc;
-  auto BSb = 64L;
-  auto rem = BS % 64;
-  if (large_cache_opt)
-    Ncb = NCB_BLOCK_SIZE;
+  auto Ncb = cfg.Ncb > 0 && cfg.Ncb < Nc ? cfg.Ncb : Nc;
+  auto BSb = cfg.BSb;
+  auto rem = BS % BSb;
   bool with_bias = (t_bias.numel() > 0);
   auto copy_bias_tpp = SCOPEIT(CpyBiasTPP<T>(BSb, Hk, K), BIAS);
   auto copy_bias_tpp_rem = SCOPEIT(CpyBiasTPP<T>(rem, Hk, K), BIAS);
@@ -370,8 +449,9 @@ inline void tpp_linear_add_add(
 
   {
     RECORD_SCOPE(tpp_linear_add_add_krnl, {t_in, t_wt_V});
+    auto next_wt = next_weight_to_prefetch(t_wt, BS);
 
-    auto loop_scheme = large_cache_opt ? GEMM_LOOP_SCHEME : "aCb";
+    auto loop_scheme = cfg.loop_scheme;
     auto ogemm_loop = torch_ipex::tpp::ThreadedLoop<3>(
         {{0, Nc, Ncb, false}, {0L, BS, BSb}, {Nk}}, loop_scheme);
     ogemm_loop(
@@ -409,19 +489,23 @@ inline void tpp_linear_add_add(
           }
         },
         [&]() { brgemm_tpp.config(); },
-        [&]() { brgemm_tpp.release(); });
+        [&]() {
+          brgemm_tpp.release();
+          prefetch_weight_slice(next_wt);
+        });
   }
 }
 
 template <typename T>
 inline void tpp_linear_gelu(
     at::Tensor& t_in,
-    at::Tensor& t_wt,
+    at::Tensor t_wt,
     at::Tensor& t_bias,
-    at::Tensor& t_out) {
+    at::Tensor& t_out,
+    const GemmTuneConfig& cfg) {
   auto in_sizes = t_in.sizes();
   auto BS = in_sizes[0] * in_sizes[1];
-  if (BS > FT_OPT_SIZE) { // first token compute
+  if (cfg.merge_wt) { // first token compute
     t_wt = wt_tensor_for_first_token<T>(t_wt);
   }
   auto wt_sizes = t_wt.sizes();
@@ -440,11 +524,9 @@ inline void tpp_linear_gelu(
   auto bias = GetVLAPtr<T>(t_bias, {Hk});
   auto out = GetVLAPtr<T>(t_out, {Nk, Hk});
 
-  auto Ncb = Nc;
-  auto BSb = 64L;
-  auto rem = BS % 64;
-  if (large_cache_opt)
-    Ncb = NCB_BLOCK_SIZE;
+  auto Ncb = cfg.Ncb > 0 && cfg.Ncb < Nc ? cfg.Ncb : Nc;
+  auto BSb = cfg.BSb;
+  auto rem = BS % BSb;
   bool with_bias = (t_bias.numel() > 0);
   auto copy_bias_tpp = SCOPEIT(CpyBiasTPP<T>(BSb, Hk, K), BIAS);
   auto copy_bias_tpp_rem = SCOPEIT(CpyBiasTPP<T>(rem, Hk, K), BIAS);
@@ -459,8 +541,9 @@ inline void tpp_linear_gelu(
 
   {
     RECORD_SCOPE(tpp_linear_gelu_krnl, {t_in, t_wt_V});
+    auto next_wt = next_weight_to_prefetch(t_wt, BS);
 
-    auto loop_scheme = large_cache_opt ? GEMM_LOOP_SCHEME : "aCb";
+    auto loop_scheme = cfg.loop_scheme;
     auto igemm_loop = torch_ipex::tpp::ThreadedLoop<3>(
         {{0, Nc, Ncb, false}, {0, BS, BSb}, {Nk}}, loop_scheme);
     igemm_loop(
@@ -496,7 +579,10 @@ inline void tpp_linear_gelu(
           }
         },
         [&]() { brgemm_tpp.config(); },
-        [&]() { brgemm_tpp.release(); });
+        [&]() {
+          brgemm_tpp.release();
+          prefetch_weight_slice(next_wt);
+        });
   }
 }
 
@@ -507,10 +593,11 @@ inline void tpp_linear_add(
     at::Tensor t_wt,
     at::Tensor t_bias,
     at::Tensor t_out,
-    float scale) {
+    float scale,
+    const GemmTuneConfig& cfg) {
   auto in_sizes = t_in.sizes();
   auto BS = in_sizes[0] * in_sizes[1];
-  if (BS > FT_OPT_SIZE) { // first token compute
+  if (cfg.merge_wt) { // first token compute
     t_wt = wt_tensor_for_first_token<T>(t_wt);
   }
   auto wt_sizes = t_wt.sizes();
@@ -530,11 +617,9 @@ inline void tpp_linear_add(
   auto bias = GetVLAPtr<T>(t_bias, {Hk});
   auto out = GetVLAPtr<T>(t_out, {Nk, Hk});
 
-  auto Ncb = Nc;
-  auto BSb = 64L;
-  auto rem = BS % 64;
-  if (large_cache_opt)
-    Ncb = NCB_BLOCK_SIZE;
+  auto Ncb = cfg.Ncb > 0 && cfg.Ncb < Nc ? cfg.Ncb : Nc;
+  auto BSb = cfg.BSb;
+  auto rem = BS % BSb;
 
   bool with_bias = (t_bias.numel() > 0);
   auto copy_bias_tpp = SCOPEIT(CpyBiasTPP<T>(BSb, Hk, K), BIAS);
@@ -550,8 +635,9 @@ inline void tpp_linear_add(
 
   {
     RECORD_SCOPE(tpp_linear_add_krnl, {t_in, t_wt_V});
+    auto next_wt = next_weight_to_prefetch(t_wt, BS);
 
-    auto loop_scheme = large_cache_opt ? GEMM_LOOP_SCHEME : "aCb";
+    auto loop_scheme = cfg.loop_scheme;
     auto ogemm_loop = torch_ipex::tpp::ThreadedLoop<3>(
         {{0, Nc, Ncb, false}, {0L, BS, BSb}, {Nk}}, loop_scheme);
     ogemm_loop(
@@ -587,7 +673,10 @@ inline void tpp_linear_add(
           }
         },
         [&]() { brgemm_tpp.config(); },
-        [&]() { brgemm_tpp.release(); });
+        [&]() {
+          brgemm_tpp.release();
+          prefetch_weight_slice(next_wt);
+        });
   }
 }
 
@@ -596,10 +685,11 @@ inline void tpp_linear_silu(
     at::Tensor t_in,
     at::Tensor t_wt,
     at::Tensor t_bias,
-    at::Tensor t_out) {
+    at::Tensor t_out,
+    const GemmTuneConfig& cfg) {
   auto in_sizes = t_in.sizes();
   auto BS = in_sizes[0] * in_sizes[1];
-  if (BS > FT_OPT_SIZE) { // first token compute
+  if (cfg.merge_wt) { // first token compute
     t_wt = wt_tensor_for_first_token<T>(t_wt);
   }
   auto wt_sizes = t_wt.sizes();
@@ -618,11 +708,9 @@ inline void tpp_linear_silu(
   auto bias = GetVLAPtr<T>(t_bias, {Hk});
   auto out = GetVLAPtr<T>(t_out, {Nk, Hk});
 
-  auto Ncb = Nc;
-  auto BSb = 64L;
-  auto rem = BS % 64;
-  if (large_cache_opt)
-    Ncb = NCB_BLOCK_SIZE;
+  auto Ncb = cfg.Ncb > 0 && cfg.Ncb < Nc ? cfg.Ncb : Nc;
+  auto BSb = cfg.BSb;
+  auto rem = BS % BSb;
 
   bool with_bias = (t_bias.numel() > 0);
   auto copy_bias_tpp = SCOPEIT(CpyBiasTPP<T>(BSb, Hk, K), BIAS);
@@ -638,8 +726,9 @@ inline void tpp_linear_silu(
 
   {
     RECORD_SCOPE(tpp_linear_silu_krnl, {t_in, t_wt_V});
+    auto next_wt = next_weight_to_prefetch(t_wt, BS);
 
-    auto loop_scheme = large_cache_opt ? GEMM_LOOP_SCHEME : "aCb";
+    auto loop_scheme = cfg.loop_scheme;
     auto igemm_loop = torch_ipex::tpp::ThreadedLoop<3>(
         {{0, Nc, Ncb, false}, {0, BS, BSb}, {Nk}}, loop_scheme);
     igemm_loop(
@@ -675,7 +764,270 @@ inline void tpp_linear_silu(
           }
         },
         [&]() { brgemm_tpp.config(); },
-        [&]() { brgemm_tpp.release(); });
+        [&]() {
+          brgemm_tpp.release();
+          prefetch_weight_slice(next_wt);
+        });
+  }
+}
+
+// Gate and up projections of the MLP in one pass. t_wt holds the blocked
+// weights of the two linears interleaved along the output blocks, i.e. block
+// 2 * nk of the gate projection and block 2 * nk + 1 of the up projection, so
+// both brgemms share the same input tile, and silu(gate) * up is applied on
+// the last nc iteration while the blocks are still in cache.
+template <typename T>
+inline void tpp_linear_silu_mul(
+    at::Tensor t_in,
+    at::Tensor t_wt,
+    at::Tensor t_bias,
+    at::Tensor t_out,
+    const GemmTuneConfig& cfg) {
+  auto in_sizes = t_in.sizes();
+  auto BS = in_sizes[0] * in_sizes[1];
+  // The first token weight reorder merges adjacent output blocks, which would
+  // mix the gate and up blocks, so the interleaved weight is used as is.
+  auto wt_sizes = t_wt.sizes();
+  auto C = in_sizes[2];
+
+  auto Nc = wt_sizes[1];
+  auto Hc = C / Nc;
+  auto Nk2 = wt_sizes[0];
+  auto Nk = Nk2 / 2;
+  auto Hk = wt_sizes[3];
+  auto K = Nk * Hk;
+
+  auto t_wt_V = torch_ipex::tpp::wt_tensor_for_fwd(Nk2, Hk, Nc, Hc, t_wt);
+  auto t_gate = t_out.new_empty(t_out.sizes());
+
+  auto in = GetVLAPtr<T>(t_in, {Nc, Hc});
+  auto wt_V = GetVLAPtr<T>(t_wt_V, {2, Nc, Hc * Hk});
+  auto bias = GetVLAPtr<T>(t_bias, {2, Hk});
+  auto gate = GetVLAPtr<T>(t_gate, {Nk, Hk});
+  auto out = GetVLAPtr<T>(t_out, {Nk, Hk});
+
+  auto Ncb = cfg.Ncb > 0 && cfg.Ncb < Nc ? cfg.Ncb : Nc;
+  auto BSb = cfg.BSb;
+  auto rem = BS % BSb;
+
+  bool with_bias = (t_bias.numel() > 0);
+  auto copy_bias_tpp = SCOPEIT(CpyBiasTPP<T>(BSb, Hk, K), BIAS);
+  auto copy_bias_tpp_rem = SCOPEIT(CpyBiasTPP<T>(rem, Hk, K), BIAS);
+  auto zero_tpp = SCOPEIT(SetZeroTPP<T>(BSb, Hk, K), EW_ZERO);
+  auto zero_tpp_rem = SCOPEIT(SetZeroTPP<T>(rem, Hk, K), EW_ZERO);
+  auto brgemm_tpp = SCOPEITGEMM(
+      (BrgemmTPP<T, T>(BSb, Hk, Hc, Hc, Hk * Hc, C, Hk, K, 1.0, 0, Ncb)));
+  auto brgemm_tpp_rem = SCOPEITGEMM(
+      (BrgemmTPP<T, T>(rem, Hk, Hc, Hc, Hk * Hc, C, Hk, K, 1.0, 0, Ncb)));
+  auto silu_fwd_tpp = SCOPEIT(SiLUFwdTPP<T>(BSb, Hk, K, K), ACT);
+  auto silu_fwd_tpp_rem = SCOPEIT(SiLUFwdTPP<T>(rem, Hk, K, K), ACT);
+  auto mul_tpp = SCOPEIT((MulTPP<T, T>(BSb, Hk, K, K)), EW_MUL);
+  auto mul_tpp_rem = SCOPEIT((MulTPP<T, T>(rem, Hk, K, K)), EW_MUL);
+
+  {
+    RECORD_SCOPE(tpp_linear_silu_mul_krnl, {t_in, t_wt_V});
+    auto next_wt = next_weight_to_prefetch(t_wt, BS);
+
+    auto loop_scheme = cfg.loop_scheme;
+    auto igemm_loop = torch_ipex::tpp::ThreadedLoop<3>(
+        {{0, Nc, Ncb, false}, {0, BS, BSb}, {Nk}}, loop_scheme);
+    igemm_loop(
+        [&](int* ind) {
+          int nc = ind[0], s1 = ind[1], nk = ind[2];
+          auto count = nc + Ncb < Nc ? Ncb : Nc - nc;
+          bool is_rem = (s1 + BSb > BS);
+          if (!is_rem) {
+            if (nc == 0) {
+              if (with_bias) {
+                copy_bias_tpp(bias[nk][0], gate[s1][nk]);
+                copy_bias_tpp(bias[nk][1], out[s1][nk]);
+              } else {
+                zero_tpp(gate[s1][nk]);
+                zero_tpp(out[s1][nk]);
+              }
+            }
+            brgemm_tpp(in[s1][nc], wt_V[nk][0][nc], gate[s1][nk], count, true);
+            brgemm_tpp(in[s1][nc], wt_V[nk][1][nc], out[s1][nk], count, true);
+            if (!(nc + Ncb < Nc)) { // last nc iter
+              silu_fwd_tpp(gate[s1][nk], gate[s1][nk]);
+              mul_tpp(gate[s1][nk], out[s1][nk], out[s1][nk]);
+            }
+          } else {
+            if (nc == 0) {
+              if (with_bias) {
+                copy_bias_tpp_rem(bias[nk][0], gate[s1][nk]);
+                copy_bias_tpp_rem(bias[nk][1], out[s1][nk]);
+              } else {
+                zero_tpp_rem(gate[s1][nk]);
+                zero_tpp_rem(out[s1][nk]);
+              }
+            }
+            brgemm_tpp_rem(
+                in[s1][nc], wt_V[nk][0][nc], gate[s1][nk], count, false);
+            brgemm_tpp_rem(
+                in[s1][nc], wt_V[nk][1][nc], out[s1][nk], count, false);
+            brgemm_tpp.config();
+            if (!(nc + Ncb < Nc)) { // last nc iter
+              silu_fwd_tpp_rem(gate[s1][nk], gate[s1][nk]);
+              mul_tpp_rem(gate[s1][nk], out[s1][nk], out[s1][nk]);
+            }
+          }
+        },
+        [&]() { brgemm_tpp.config(); },
+        [&]() {
+          brgemm_tpp.release();
+          prefetch_weight_slice(next_wt);
+        });
+  }
+}
+
+// QKV projection with the rotary embedding in the epilogue. t_wt holds the
+// blocked weights of the q, k and v linears concatenated along the output
+// blocks, so the output row of a token is [q heads, k heads, v heads]. The
+// output blocks are tiled by head: an nh iteration computes all the H / Hk
+// blocks of head nh, so on the last nc iteration the whole head of the BSb
+// tokens is in cache. The query and key heads are rotated there, and every
+// head is copied to t_query, t_key or t_value. t_key/t_value may be strided
+// along the batch and sequence dims, e.g. the slot of the current token in
+// the kv cache, which saves the store of the attention op.
+template <typename T>
+inline void tpp_linear_qkv_rope(
+    at::Tensor t_in,
+    at::Tensor t_wt,
+    at::Tensor t_bias,
+    at::Tensor t_emb_pos,
+    at::Tensor t_pos,
+    at::Tensor t_query,
+    at::Tensor t_key,
+    at::Tensor t_value,
+    int64_t N, // N: number of query head, KVN: number of key head
+    int64_t KVN,
+    int64_t H,
+    int64_t offset,
+    int64_t rotary_ndims,
+    const GemmTuneConfig& cfg) {
+  auto in_sizes = t_in.sizes();
+  auto B = in_sizes[0];
+  auto S = in_sizes[1];
+  auto BS = B * S;
+  // a head should keep whole blocks after the blocks are merged
+  if (cfg.merge_wt && H % (2 * t_wt.size(3)) == 0) { // first token compute
+    t_wt = wt_tensor_for_first_token<T>(t_wt);
+  }
+  auto wt_sizes = t_wt.sizes();
+  auto C = in_sizes[2];
+
+  auto Nc = wt_sizes[1];
+  auto Hc = C / Nc;
+  auto Nk = wt_sizes[0];
+  auto Hk = wt_sizes[3];
+  auto K = Nk * Hk;
+  auto Hb = H / Hk; // output blocks of a head
+  auto NH = N + 2 * KVN;
+
+  auto t_wt_V = torch_ipex::tpp::wt_tensor_for_fwd(Nk, Hk, Nc, Hc, t_wt);
+  auto t_qkv = t_in.new_empty({BS, K});
+
+  auto in = GetVLAPtr<T>(t_in, {Nc, Hc});
+  auto wt_V = GetVLAPtr<T>(t_wt_V, {Nc, Hc * Hk});
+  auto bias = GetVLAPtr<T>(t_bias, {Hk});
+  auto qkv = GetVLAPtr<T>(t_qkv, {Nk, Hk});
+  auto q_ptr = t_query.data_ptr<T>(); // [B][S][N][H]
+  auto k_ptr = t_key.data_ptr<T>(); // [B][S][KVN][H], strided along B and S
+  auto v_ptr = t_value.data_ptr<T>();
+  auto k_stride_b = t_key.stride(0);
+  auto k_stride_s = t_key.stride(1);
+  auto v_stride_b = t_value.stride(0);
+  auto v_stride_s = t_value.stride(1);
+  auto HR = t_emb_pos.size(1); // rotary_dim
+  auto emb_pos_ptr = t_emb_pos.data_ptr<float>(); // [MP][HR]
+  auto pos_ptr = t_pos.data_ptr<long>(); // [MB][S]
+  auto pos_numel = t_pos.numel();
+
+  auto Ncb = cfg.Ncb > 0 && cfg.Ncb < Nc ? cfg.Ncb : Nc;
+  auto BSb = cfg.BSb;
+  auto rem = BS % BSb;
+
+  bool with_bias = (t_bias.numel() > 0);
+  auto copy_bias_tpp = SCOPEIT(CpyBiasTPP<T>(BSb, Hk, K), BIAS);
+  auto copy_bias_tpp_rem = SCOPEIT(CpyBiasTPP<T>(rem, Hk, K), BIAS);
+  auto zero_tpp = SCOPEIT(SetZeroTPP<T>(BSb, Hk, K), EW_ZERO);
+  auto zero_tpp_rem = SCOPEIT(SetZeroTPP<T>(rem, Hk, K), EW_ZERO);
+  auto brgemm_tpp = SCOPEITGEMM(
+      (BrgemmTPP<T, T>(BSb, Hk, Hc, Hc, Hk * Hc, C, Hk, K, 1.0, 0, Ncb)));
+  auto brgemm_tpp_rem = SCOPEITGEMM(
+      (BrgemmTPP<T, T>(rem, Hk, Hc, Hc, Hk * Hc, C, Hk, K, 1.0, 0, Ncb)));
+
+  // rotate the head nh of token s in place and copy it to its output
+  auto store_head = [&](long s, long nh) {
+    auto b = s / S;
+    auto si = s % S;
+    T* head = qkv[s][nh * Hb];
+    T* out_ptr_start;
+    if (nh < N) {
+      out_ptr_start = q_ptr + (s * N + nh) * H;
+    } else if (nh < N + KVN) {
+      out_ptr_start = k_ptr + b * k_stride_b + si * k_stride_s + (nh - N) * H;
+    } else {
+      out_ptr_start =
+          v_ptr + b * v_stride_b + si * v_stride_s + (nh - N - KVN) * H;
+    }
+    if (nh < N + KVN) {
+      long p = torch_ipex::cpu::get_rope_position(
+          pos_ptr, pos_numel, offset, b, S, si);
+      torch_ipex::cpu::apply_rope_on_head<T>(
+          head, emb_pos_ptr, p, HR, offset, rotary_ndims);
+    }
+    std::memcpy(out_ptr_start, head, H * sizeof(T));
+  };
+
+  {
+    RECORD_SCOPE(tpp_linear_qkv_rope_krnl, {t_in, t_wt_V});
+    auto next_wt = next_weight_to_prefetch(t_wt, BS);
+
+    auto loop_scheme = cfg.loop_scheme;
+    auto igemm_loop = torch_ipex::tpp::ThreadedLoop<3>(
+        {{0, Nc, Ncb, false}, {0, BS, BSb}, {NH}}, loop_scheme);
+    igemm_loop(
+        [&](int* ind) {
+          int nc = ind[0], s1 = ind[1], nh = ind[2];
+          auto count = nc + Ncb < Nc ? Ncb : Nc - nc;
+          bool is_rem = (s1 + BSb > BS);
+          for (int nk = nh * Hb; nk < (nh + 1) * Hb; nk++) {
+            if (!is_rem) {
+              if (nc == 0) {
+                if (with_bias) {
+                  copy_bias_tpp(bias[nk], qkv[s1][nk]);
+                } else {
+                  zero_tpp(qkv[s1][nk]);
+                }
+              }
+              brgemm_tpp(in[s1][nc], wt_V[nk][nc], qkv[s1][nk], count, true);
+            } else {
+              if (nc == 0) {
+                if (with_bias) {
+                  copy_bias_tpp_rem(bias[nk], qkv[s1][nk]);
+                } else {
+                  zero_tpp_rem(qkv[s1][nk]);
+                }
+              }
+              brgemm_tpp_rem(
+                  in[s1][nc], wt_V[nk][nc], qkv[s1][nk], count, false);
+              brgemm_tpp.config();
+            }
+          }
+          if (!(nc + Ncb < Nc)) { // last nc iter
+            auto rows = is_rem ? rem : BSb;
+            for (int s = s1; s < s1 + rows; s++) {
+              store_head(s, nh);
+            }
+          }
+        },
+        [&]() { brgemm_tpp.config(); },
+        [&]() {
+          brgemm_tpp.release();
+          prefetch_weight_slice(next_wt);
+        });
   }
 }
 
@@ -684,10 +1036,11 @@ inline void tpp_linear_relu(
     at::Tensor t_in,
     at::Tensor t_wt,
     at::Tensor t_bias,
-    at::Tensor t_out) {
+    at::Tensor t_out,
+    const GemmTuneConfig& cfg) {
   auto in_sizes = t_in.sizes();
   auto BS = in_sizes[0] * in_sizes[1];
-  if (BS > FT_OPT_SIZE) { // first token compute
+  if (cfg.merge_wt) { // first token compute
     t_wt = wt_tensor_for_first_token<T>(t_wt);
   }
   auto wt_sizes = t_wt.sizes();
@@ -706,11 +1059,9 @@ inline void tpp_linear_relu(
   auto bias = GetVLAPtr<T>(t_bias, {Hk});
   auto out = GetVLAPtr<T>(t_out, {Nk, Hk});
 
-  auto Ncb = Nc;
-  auto BSb = 64L;
-  auto rem = BS % 64;
-  if (large_cache_opt)
-    Ncb = NCB_BLOCK_SIZE;
+  auto Ncb = cfg.Ncb > 0 && cfg.Ncb < Nc ? cfg.Ncb : Nc;
+  auto BSb = cfg.BSb;
+  auto rem = BS % BSb;
 
   bool with_bias = (t_bias.numel() > 0);
   auto copy_bias_tpp = SCOPEIT(CpyBiasTPP<T>(BSb, Hk, K), BIAS);
@@ -726,8 +1077,9 @@ inline void tpp_linear_relu(
 
   {
     RECORD_SCOPE(tpp_linear_relu_krnl, {t_in, t_wt_V});
+    auto next_wt = next_weight_to_prefetch(t_wt, BS);
 
-    auto loop_scheme = large_cache_opt ? GEMM_LOOP_SCHEME : "aCb";
+    auto loop_scheme = cfg.loop_scheme;
     auto igemm_loop = torch_ipex::tpp::ThreadedLoop<3>(
         {{0, Nc, Ncb, false}, {0, BS, BSb}, {Nk}}, loop_scheme);
     igemm_loop(
@@ -763,7 +1115,10 @@ inline void tpp_linear_relu(
           }
         },
         [&]() { brgemm_tpp.config(); },
-        [&]() { brgemm_tpp.release(); });
+        [&]() {
+          brgemm_tpp.release();
+          prefetch_weight_slice(next_wt);
+        });
   }
 }
 
@@ -0,0 +1,78 @@
+#include "weight_prefetch.h"
+#include <torch/all.h>
+#include <atomic>
+#include <cstdlib>
+#include <mutex>
+#include <unordered_map>
+
+namespace torch_ipex {
+namespace tpp {
+
+namespace {
+
+std::atomic<bool>& prefetch_enabled() {
+  static std::atomic<bool> enabled([]() {
+    auto env = getenv("TPP_WEIGHT_PREFETCH");
+    return env != nullptr && atoi(env) != 0;
+  }());
+  return enabled;
+}
+
+// The weight after each weight in the last decode step
+struct WeightChain {
+  std::mutex mutex;
+  std::unordered_map<const void*, WeightPrefetchRange> next;
+  const void* last = nullptr;
+};
+
+WeightChain& weight_chain() {
+  static WeightChain chain;
+  return chain;
+}
+
+} // namespace
+
+bool weight_prefetch_enabled() {
+  return prefetch_enabled().load(std::memory_order_relaxed);
+}
+
+void set_weight_prefetch_enabled(bool enabled) {
+  auto& chain = weight_chain();
+  std::lock_guard<std::mutex> lock(chain.mutex);
+  prefetch_enabled() = enabled;
+  chain.next.clear();
+  chain.last = nullptr;
+}
+
+WeightPrefetchRange next_weight_to_prefetch(
+    const at::Tensor& weight,
+    long M) {
+  if (!weight_prefetch_enabled() || M > WEIGHT_PREFETCH_MAX_M) {
+    return WeightPrefetchRange();
+  }
+  const void* ptr = weight.data_ptr();
+  auto& chain = weight_chain();
+  std::lock_guard<std::mutex> lock(chain.mutex);
+  if (chain.last != nullptr && chain.last != ptr) {
+    WeightPrefetchRange range;
+    range.ptr = static_cast<const char*>(ptr);
+    range.bytes = weight.nbytes();
+    chain.next[chain.last] = range;
+  }
+  chain.last = ptr;
+  auto it = chain.next.find(ptr);
+  return it == chain.next.end() ? WeightPrefetchRange() : it->second;
+}
+
+} // namespace tpp
+} // namespace torch_ipex
+
+namespace {
+
+TORCH_LIBRARY_FRAGMENT(torch_ipex, m) {
+  m.def(
+      "set_weight_prefetch_enabled(bool enabled) -> ()",
+      torch_ipex::tpp::set_weight_prefetch_enabled);
+}
+
+} // namespace
@@ -0,0 +1,62 @@
+#ifndef _WEIGHT_PREFETCH_H_
+#define _WEIGHT_PREFETCH_H_
+
+#include <ATen/ATen.h>
+#include <omp.h>
+#ifdef __x86_64__
+#include <immintrin.h>
+#endif
+#include <algorithm>
+#include <cstddef>
+
+namespace torch_ipex {
+namespace tpp {
+
+// A GEMM with at most this many rows is bound by reading its weight.
+constexpr long WEIGHT_PREFETCH_MAX_M = 16;
+// The bytes of the next weight a thread prefetches at most, to stay in L2.
+constexpr size_t WEIGHT_PREFETCH_MAX_BYTES_PER_THREAD = 1 << 20;
+
+struct WeightPrefetchRange {
+  const char* ptr = nullptr;
+  size_t bytes = 0;
+};
+
+// Cross-layer weight prefetch for the decode GEMMs. The weights of the
+// bandwidth-bound GEMMs are linked in the order they run, so a GEMM knows the
+// weight of the GEMM after it. Every thread of the GEMM prefetches its part of
+// that weight into L2 once it finishes its own blocks, while the other
+// threads are still computing. The mode is enabled by TPP_WEIGHT_PREFETCH=1 or
+// set_weight_prefetch_enabled.
+bool weight_prefetch_enabled();
+void set_weight_prefetch_enabled(bool enabled);
+
+// Link the weight after the weight of the last GEMM, and return the weight
+// which followed it the last time it ran. The range is empty if the mode is
+// disabled or the GEMM is not bandwidth bound.
+WeightPrefetchRange next_weight_to_prefetch(const at::Tensor& weight, long M);
+
+// Prefetch the slice of the weight which the calling thread is likely to
+// compute on. The GEMMs split their output blocks evenly and contiguously
+// across the threads, so the slice is the thread's share of the weight.
+inline void prefetch_weight_slice(const WeightPrefetchRange& range) {
+#ifdef __x86_64__
+  if (range.ptr == nullptr)
+    return;
+  size_t num_threads = omp_get_num_threads();
+  size_t tid = omp_get_thread_num();
+  size_t slice = (range.bytes + num_threads - 1) / num_threads;
+  size_t begin = std::min(range.bytes, tid * slice);
+  size_t end = std::min(
+      range.bytes,
+      begin + std::min(slice, WEIGHT_PREFETCH_MAX_BYTES_PER_THREAD));
+  for (size_t offset = begin; offset < end; offset += 64) {
+    _mm_prefetch(range.ptr + offset, _MM_HINT_T1);
+  }
+#endif
+}
+
+} // namespace tpp
+} // namespace torch_ipex
+
+#endif // _WEIGHT_PREFETCH_H_
@@ -2,6 +2,10 @@
 
 #include <ideep.hpp>
 
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+
 namespace torch_ipex {
 namespace utils {
 
@@ -17,5 +21,29 @@ bool onednn_has_fp16_type_support() {
   return ideep::has_fp16_type_support();
 }
 
+namespace {
+
+std::atomic<int64_t>& conv_primitive_cache_capacity() {
+  static std::atomic<int64_t> capacity([]() -> int64_t {
+    auto env = std::getenv("IPEX_CONV_PRIMITIVE_CACHE_CAPACITY");
+    return env != nullptr ? std::max<int64_t>(std::atoll(env), 0) : 8;
+  }());
+  return capacity;
+}
+
+} // namespace
+
+void set_conv_primitive_cache_capacity(int64_t capacity) {
+  TORCH_CHECK(
+      capacity >= 0,
+      "conv primitive cache capacity should be non-negative, but got ",
+      capacity);
+  conv_primitive_cache_capacity() = capacity;
+}
+
+int64_t get_conv_primitive_cache_capacity() {
+  return conv_primitive_cache_capacity();
+}
+
 } // namespace utils
 } // namespace torch_ipex
@@ -8,5 +8,11 @@ IPEX_API int onednn_set_verbose(int level);
 IPEX_API bool onednn_has_bf16_type_support();
 IPEX_API bool onednn_has_fp16_type_support();
 
+// The number of the input shapes that every prepacked convolution keeps a
+// primitive for besides the prepacked one. 0 disables the cache. The default
+// is read from the environment variable IPEX_CONV_PRIMITIVE_CACHE_CAPACITY.
+IPEX_API void set_conv_primitive_cache_capacity(int64_t capacity);
+IPEX_API int64_t get_conv_primitive_cache_capacity();
+
 } // namespace utils
 } // namespace torch_ipex
@@ -55,6 +55,137 @@ void _compute_rmsnorm(
   }
 }
 
+// residual += input, and return the sum of squares of the updated residual
+template <typename T>
+float _add_residual_and_compute_sum_of_squares(
+    const T* input_ptr,
+    T* residual_ptr,
+    const int& size) {
+  auto vec_acc_pow = _mm512_set1_ps(0.0);
+  int i;
+  for (i = 0; i <= size - 16; i += 16) {
+    auto vec_add = _loadu(input_ptr + i) + _loadu(residual_ptr + i);
+    _storeu(residual_ptr + i, vec_add);
+    // the norm is computed on the residual rounded to T
+    auto vec_res = _loadu(residual_ptr + i);
+    vec_acc_pow = _mm512_fmadd_ps(vec_res, vec_res, vec_acc_pow);
+  }
+  if (i < size) {
+    __mmask16 mask = (1 << (size - i)) - 1;
+    auto vec_add = _maskz_loadu(input_ptr + i, mask) +
+        _maskz_loadu(residual_ptr + i, mask);
+    _mask_storeu(residual_ptr + i, vec_add, mask);
+    auto vec_res = _maskz_loadu(residual_ptr + i, mask);
+    vec_acc_pow = _mm512_fmadd_ps(vec_res, vec_res, vec_acc_pow);
+  }
+  return _mm512_reduce_add_ps(vec_acc_pow);
+}
+
+// out = a * scale * gamma
+template <typename T, typename T1, typename TOut>
+void _normalize_rmsnorm(
+    const T* a_ptr,
+    const int& size,
+    float scale,
+    const T1* gamma_ptr,
+    TOut* out_ptr) {
+  auto vec_scale = _mm512_set1_ps(scale);
+  int i;
+  for (i = 0; i <= size - 16; i += 16) {
+    auto vec_res = _loadu(a_ptr + i) * vec_scale;
+    if (gamma_ptr) {
+      vec_res = vec_res * _loadu(gamma_ptr + i);
+    }
+    _storeu(out_ptr + i, vec_res);
+  }
+  if (i < size) {
+    __mmask16 mask = (1 << (size - i)) - 1;
+    auto vec_res = _maskz_loadu(a_ptr + i, mask) * vec_scale;
+    if (gamma_ptr) {
+      vec_res = vec_res * _maskz_loadu(gamma_ptr + i, mask);
+    }
+    _mask_storeu(out_ptr + i, vec_res, mask);
+  }
+}
+
+// Quantize a row of float to uint8 with its scale and zero point
+inline void _quantize_row_to_uint8(
+    const float* in_ptr,
+    const int& size,
+    float scale,
+    int32_t zp,
+    uint8_t* out_ptr) {
+  auto vec_inv_scale = _mm512_set1_ps(1.0f / scale);
+  auto vec_zp = _mm512_set1_ps((float)zp);
+  auto vec_min = _mm512_set1_ps(0.0f);
+  auto vec_max = _mm512_set1_ps(255.0f);
+  auto quantize = [&](__m512 vec_in) {
+    // round(in / scale) + zp, rounding half to even as std::nearbyint
+    auto vec_q = _mm512_add_ps(
+        _mm512_roundscale_ps(
+            _mm512_mul_ps(vec_in, vec_inv_scale),
+            _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC),
+        vec_zp);
+    vec_q = _mm512_min_ps(_mm512_max_ps(vec_q, vec_min), vec_max);
+    return _mm512_cvtps_epi32(vec_q);
+  };
+  int i;
+  for (i = 0; i <= size - 16; i += 16) {
+    _mm_storeu_si128(
+        (__m128i*)(out_ptr + i),
+        _mm512_cvtusepi32_epi8(quantize(_mm512_loadu_ps(in_ptr + i))));
+  }
+  if (i < size) {
+    __mmask16 mask = (1 << (size - i)) - 1;
+    _mm512_mask_cvtusepi32_storeu_epi8(
+        out_ptr + i,
+        mask,
+        quantize(_mm512_maskz_loadu_ps(mask, in_ptr + i)));
+  }
+}
+
+// Normalize a row into the float buffer, and quantize it to uint8 with the
+// scale and zero point of the row, which are computed from the buffer before
+// it leaves the cache.
+template <typename T, typename T1>
+void _compute_rmsnorm_quantized(
+    const T* a_ptr,
+    const int& size,
+    float scale,
+    const T1* gamma_ptr,
+    float* buf,
+    uint8_t* out_ptr,
+    float* out_scale,
+    int32_t* out_zp) {
+  _normalize_rmsnorm<T, T1, float>(a_ptr, size, scale, gamma_ptr, buf);
+  // the range always covers 0, so that 0 is exact
+  auto vec_min = _mm512_set1_ps(0.0f);
+  auto vec_max = _mm512_set1_ps(0.0f);
+  int i;
+  for (i = 0; i <= size - 16; i += 16) {
+    auto vec_res = _mm512_loadu_ps(buf + i);
+    vec_min = _mm512_min_ps(vec_min, vec_res);
+    vec_max = _mm512_max_ps(vec_max, vec_res);
+  }
+  if (i < size) {
+    __mmask16 mask = (1 << (size - i)) - 1;
+    auto vec_res = _mm512_maskz_loadu_ps(mask, buf + i);
+    vec_min = _mm512_min_ps(vec_min, vec_res);
+    vec_max = _mm512_max_ps(vec_max, vec_res);
+  }
+  float min_val = _mm512_reduce_min_ps(vec_min);
+  float max_val = _mm512_reduce_max_ps(vec_max);
+  float q_scale = (max_val - min_val) / 255.0f;
+  if (q_scale == 0.0f) {
+    // an all-zero row
+    q_scale = 1.0f;
+  }
+  int32_t q_zp = (int32_t)(-std::nearbyint(min_val / q_scale));
+  _quantize_row_to_uint8(buf, size, q_scale, q_zp, out_ptr);
+  *out_scale = q_scale;
+  *out_zp = q_zp;
+}
+
 } // namespace kernel
 } // namespace cpu
 } // namespace torch_ipex
@@ -61,10 +61,15 @@ make_fallback(torch.ops.torch_ipex.tpp_linear_gelu)
 make_fallback(torch.ops.torch_ipex.tpp_linear_add_add)
 make_fallback(torch.ops.torch_ipex.tpp_linear_relu)
 make_fallback(torch.ops.torch_ipex.tpp_linear_silu)
+make_fallback(torch.ops.torch_ipex.tpp_linear_silu_mul)
+make_fallback(torch.ops.torch_ipex.tpp_linear_qkv_rope)
 make_fallback(torch.ops.torch_ipex.tpp_linear_add)
 make_fallback(torch.ops.torch_ipex.tpp_linear_mul)
 make_fallback(torch.ops.torch_ipex.masked_multihead_self_attention)
+make_fallback(torch.ops.torch_ipex.paged_masked_multihead_self_attention)
+make_fallback(torch.ops.torch_ipex.continuous_batching_masked_multihead_self_attention)
 make_fallback(torch.ops.torch_ipex.rotary_position_embedding_out)
+make_fallback(torch.ops.torch_ipex.rotary_position_embedding_qk)
 
 make_fallback(torch.ops.torch_ipex.add_softmax_)
 make_fallback(torch.ops.torch_ipex.bmm_add)
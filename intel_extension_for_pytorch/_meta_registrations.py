@@ -564,6 +564,34 @@ def meta_tpp_linear_silu(
     return input.new_empty((*input.shape[:-1], out_features))
 
 
+@register_meta("tpp_linear_silu_mul")
+def meta_tpp_linear_silu_mul(
+    input,
+    weight,
+    bias,
+    out_features,
+):
+    return input.new_empty((*input.shape[:-1], out_features))
+
+
+@register_meta("tpp_linear_qkv_rope")
+def meta_tpp_linear_qkv_rope(
+    input,
+    weight,
+    bias,
+    emb_pos,
+    position_ids,
+    key,
+    value,
+    num_head,
+    num_kv_head,
+    head_dim,
+    offset,
+    rotary_ndims,
+):
+    return input.new_empty((*input.shape[:-1], num_head, head_dim))
+
+
 @register_meta("tpp_linear_add")
 def meta_tpp_linear_add(
     input,
@@ -600,6 +628,8 @@ def meta_masked_multihead_self_attention(
     max_positions,
     head_mask,
     attention_mask,
+    key_scale=None,
+    value_scale=None,
 ):
     attn_output = query.new_empty(
         (query.shape[0], query.shape[2], query.shape[1], query.shape[3])
@@ -615,16 +645,83 @@ def meta_masked_multihead_self_attention(
             ),
         )
     attn_weights = None
+    # the int8/fp8 kv cache keeps its data type
+    cache_dtype = (
+        key_cache.dtype
+        if key_cache.dtype in [torch.int8, torch.float8_e4m3fn]
+        else query.dtype
+    )
     key_cache_out = query.new_empty(
-        (key_cache.shape[0], key_cache.shape[1], key.shape[2], key.shape[3])
+        (key_cache.shape[0], key_cache.shape[1], key.shape[2], key.shape[3]),
+        dtype=cache_dtype,
     )
     value_cache_out = query.new_empty(
-        (value_cache.shape[0], value_cache.shape[1], value.shape[2], value.shape[3])
+        (value_cache.shape[0], value_cache.shape[1], value.shape[2], value.shape[3]),
+        dtype=cache_dtype,
     )
     beam_idx_out = query.new_empty(beam_idx.shape)
     return (attn_output, attn_weights, key_cache_out, value_cache_out, beam_idx_out)
 
 
+@register_meta("paged_masked_multihead_self_attention")
+def meta_paged_masked_multihead_self_attention(
+    query,
+    key,
+    value,
+    key_cache,
+    value_cache,
+    block_table,
+    free_blocks,
+    beam_idx,
+    seq_info,
+    scale_attn,
+    head_mask,
+    attention_mask,
+    key_scale=None,
+    value_scale=None,
+):
+    attn_output = query.new_empty(
+        (query.shape[0], query.shape[2], query.shape[1], query.shape[3])
+    )
+    if query.dtype == torch.bfloat16:
+        attn_output.as_strided_(
+            attn_output.shape,
+            (
+                query.shape[1] * query.shape[2] * query.shape[3],
+                query.shape[3],
+                query.shape[2] * query.shape[3],
+                1,
+            ),
+        )
+    attn_weights = None
+    key_cache_out = key_cache.new_empty(key_cache.shape)
+    value_cache_out = value_cache.new_empty(value_cache.shape)
+    beam_idx_out = beam_idx.new_empty(
+        (block_table.shape[1] * key_cache.shape[1], block_table.shape[0])
+    )
+    return (attn_output, attn_weights, key_cache_out, value_cache_out, beam_idx_out)
+
+
+@register_meta("continuous_batching_masked_multihead_self_attention")
+def meta_continuous_batching_masked_multihead_self_attention(
+    query,
+    key,
+    value,
+    key_cache,
+    value_cache,
+    block_table,
+    free_blocks,
+    query_start_loc,
+    past_lens,
+    slot_ids,
+    scale_attn,
+):
+    attn_output = query.new_empty(query.shape)
+    key_cache_out = key_cache.new_empty(key_cache.shape)
+    value_cache_out = value_cache.new_empty(value_cache.shape)
+    return (attn_output, key_cache_out, value_cache_out)
+
+
 @register_meta("rotary_position_embedding")
 def meta_rotary_position_embedding(
     t_in,
@@ -649,3 +746,20 @@ def meta_rotary_position_embedding_out(
     rotary_ndims,
 ):
     return t_in
+
+
+@register_meta("rotary_position_embedding_qk")
+def meta_rotary_position_embedding_qk(
+    t_q,
+    t_k,
+    t_emb_pos,
+    t_pos,
+    N,
+    KVN,
+    H,
+    offset,
+    rotary_ndims,
+):
+    q_out = t_q.new_empty(t_q.shape[:2] + (N, H))
+    k_out = t_k.new_empty(t_k.shape[:2] + (KVN, H))
+    return (q_out, k_out)
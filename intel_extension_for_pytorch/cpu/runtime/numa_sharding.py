@@ -0,0 +1,193 @@
+import torch
+import torch.nn as nn
+import warnings
+from .cpupool import CPUPool
+from .task import Task
+from .runtime_utils import get_num_nodes
+
+# The output features of a shard are a multiple of this, so that the shards
+# keep the blocking of the packed weights.
+_SHARD_BLOCK_SIZE = 64
+
+# One task per CPU pool, shared by all the sharded linears. Every task owns a
+# thread with an OpenMP team, so the linears must not create their own.
+_shard_tasks = {}
+
+
+def _run(fn, *args):
+    return fn(*args)
+
+
+def _get_shard_task(cpu_pool):
+    key = tuple(cpu_pool.core_ids)
+    if key not in _shard_tasks:
+        _shard_tasks[key] = Task(_run, cpu_pool)
+    return _shard_tasks[key]
+
+
+def _split_sizes(n, num_shards):
+    num_blocks = (n + _SHARD_BLOCK_SIZE - 1) // _SHARD_BLOCK_SIZE
+    sizes = []
+    begin = 0
+    for i in range(num_shards):
+        end = min(n, num_blocks * (i + 1) // num_shards * _SHARD_BLOCK_SIZE)
+        sizes.append(end - begin)
+        begin = end
+    return sizes
+
+
+def _create_shard(weight, bias, num_concats, pack_fn):
+    # Run on the thread pinned to the node of the shard. The weight is copied
+    # here, so its pages are first touched, thus allocated, on the node. So are
+    # the packed weights created by pack_fn.
+    shard = nn.Linear(
+        weight.size(1),
+        weight.size(0),
+        bias=bias is not None,
+        device="meta",
+        dtype=weight.dtype,
+    )
+    shard.weight = nn.Parameter(weight.clone(), requires_grad=False)
+    if bias is not None:
+        shard.bias = nn.Parameter(bias.clone(), requires_grad=False)
+    if num_concats > 1:
+        shard._num_concats = num_concats
+    shard.eval()
+    if pack_fn is not None:
+        with torch.no_grad():
+            shard = pack_fn(shard)
+    return shard
+
+
+class NumaShardedLinear(nn.Module):
+    r"""
+    Tensor parallelism of a linear across the NUMA nodes of one process.
+
+    The weight is split along the output features into one shard per CPU pool.
+    Each shard is created and packed by a thread pinned to its CPU pool, so its
+    memory is allocated on the NUMA node of the pool, and it is computed by the
+    threads of the pool. The partial outputs are gathered into the output in
+    the shared memory of the process, without any communication library.
+
+    Args:
+        linear (torch.nn.Linear): The linear to shard. If it concatenates the
+            weights of several linears (``_num_concats``), each of them is
+            sharded, so that a shard concatenates the same number of weights.
+        cpu_pools (list): A list of
+            intel_extension_for_pytorch.cpu.runtime.CPUPool, one per shard,
+            usually one per NUMA node.
+        pack_fn (callable): A function which takes the ``torch.nn.Linear`` of a
+            shard and returns the module to compute it with, e.g., to pack its
+            weight with ``ipex.optimize`` or weight-only quantization. The
+            shard is computed as a plain linear if it is None.
+
+    Returns:
+        intel_extension_for_pytorch.cpu.runtime.NumaShardedLinear: Generated
+        intel_extension_for_pytorch.cpu.runtime.NumaShardedLinear object.
+    """
+
+    def __init__(self, linear: nn.Linear, cpu_pools: list, pack_fn=None):
+        super(NumaShardedLinear, self).__init__()
+        assert all(
+            type(cpu_pool) is CPUPool for cpu_pool in cpu_pools
+        ), "Input of cpu_pools must be a list of ipex.cpu.runtime.CPUPool"
+        # a task runs one call at a time, so the shards must not share a pool
+        assert len(set(tuple(cpu_pool.core_ids) for cpu_pool in cpu_pools)) == len(
+            cpu_pools
+        ), "The CPU pools of the shards must be different"
+        self.in_features = linear.in_features
+        self.out_features = linear.out_features
+        self.num_concats = getattr(linear, "_num_concats", 1)
+        assert (
+            self.out_features % self.num_concats == 0
+        ), "The output features must be divisible by the number of concats"
+        concat_size = self.out_features // self.num_concats
+        sizes = _split_sizes(concat_size, len(cpu_pools))
+
+        weight = linear.weight.detach().view(self.num_concats, concat_size, -1)
+        bias = linear.bias
+        if bias is not None:
+            bias = bias.detach().view(self.num_concats, concat_size)
+        self.shard_sizes = []
+        self.tasks = []
+        shards = []
+        begin = 0
+        for cpu_pool, size in zip(cpu_pools, sizes):
+            if size == 0:
+                continue
+            shard_weight = weight[:, begin : begin + size].reshape(-1, self.in_features)
+            shard_bias = (
+                None
+                if bias is None
+                else bias[:, begin : begin + size].reshape(-1).contiguous()
+            )
+            task = _get_shard_task(cpu_pool)
+            shards.append(
+                task.run_sync(
+                    _create_shard,
+                    shard_weight.contiguous(),
+                    shard_bias,
+                    self.num_concats,
+                    pack_fn,
+                )
+            )
+            self.shard_sizes.append(size)
+            self.tasks.append(task)
+            begin += size
+        self.shards = nn.ModuleList(shards)
+
+    def forward(self, x):
+        futures = [task(shard, x) for task, shard in zip(self.tasks, self.shards)]
+        outputs = [future.get() for future in futures]
+        if len(outputs) == 1:
+            return outputs[0]
+        if self.num_concats > 1:
+            # the shard holds its part of every concatenated output
+            outputs = [
+                output.view(*output.shape[:-1], self.num_concats, size)
+                for output, size in zip(outputs, self.shard_sizes)
+            ]
+            return torch.cat(outputs, dim=-1).view(*x.shape[:-1], self.out_features)
+        return torch.cat(outputs, dim=-1)
+
+    def extra_repr(self):
+        return "in_features={}, out_features={}, shard_sizes={}".format(
+            self.in_features, self.out_features, self.shard_sizes
+        )
+
+
+def shard_linears_across_numa_nodes(
+    model, cpu_pools: list = None, pack_fn=None, min_out_features: int = 1024
+):
+    r"""
+    Replace the ``torch.nn.Linear`` of the model with
+    intel_extension_for_pytorch.cpu.runtime.NumaShardedLinear, so that their
+    weights are split across the NUMA nodes, allocated on them and computed by
+    the cores of each node. The model is kept as is on a single node.
+
+    Args:
+        model (torch.nn.Module): The input model, whose linears are not packed
+            yet.
+        cpu_pools (list): A list of
+            intel_extension_for_pytorch.cpu.runtime.CPUPool, one per shard. It
+            is one CPU pool per NUMA node by default.
+        pack_fn (callable): A function which packs the ``torch.nn.Linear`` of a
+            shard. See intel_extension_for_pytorch.cpu.runtime.NumaShardedLinear.
+        min_out_features (int): The linears with fewer output features are not
+            sharded, since their GEMMs are too small to be split.
+
+    Returns:
+        The model with the linears replaced.
+    """
+
+    if cpu_pools is None:
+        cpu_pools = [CPUPool(node_id=node_id) for node_id in range(get_num_nodes())]
+    if len(cpu_pools) < 2:
+        warnings.warn("Only one CPU pool is found, the linears are not sharded.")
+        return model
+    for name, child in model.named_children():
+        if type(child) is nn.Linear and child.out_features >= min_out_features:
+            setattr(model, name, NumaShardedLinear(child, cpu_pools, pack_fn))
+        else:
+            shard_linears_across_numa_nodes(child, cpu_pools, pack_fn, min_out_features)
+    return model
@@ -91,6 +91,12 @@ void InitIpexModuleBindings(py::module m) {
   m.def("onednn_has_fp16_support", []() {
     return torch_ipex::utils::onednn_has_fp16_type_support();
   });
+  m.def(
+      "_set_conv_primitive_cache_capacity",
+      &torch_ipex::utils::set_conv_primitive_cache_capacity);
+  m.def(
+      "_get_conv_primitive_cache_capacity",
+      &torch_ipex::utils::get_conv_primitive_cache_capacity);
 
   // ipex amp autocast
   m.def("get_autocast_dtype", []() {
@@ -130,6 +136,51 @@ void InitIpexModuleBindings(py::module m) {
   m.def(
       "_jit_llga_weight_cache_enabled",
       &torch_ipex::jit::fuser::onednn::getLlgaWeightCacheEnabled);
+  m.def("_jit_llga_compiled_partition_cache_stats", []() {
+    auto stats =
+        torch_ipex::jit::fuser::onednn::getLlgaCompiledPartitionCacheStats();
+    py::dict result;
+    result["hits"] = stats[0];
+    result["misses"] = stats[1];
+    result["evictions"] = stats[2];
+    return result;
+  });
+  m.def(
+      "_jit_reset_llga_compiled_partition_cache_stats",
+      &torch_ipex::jit::fuser::onednn::resetLlgaCompiledPartitionCacheStats);
+  m.def(
+      "_jit_clear_llga_compiled_partition_cache",
+      &torch_ipex::jit::fuser::onednn::clearLlgaCompiledPartitionCache);
+  m.def(
+      "_jit_set_llga_compiled_partition_cache_capacity",
+      &torch_ipex::jit::fuser::onednn::setLlgaCompiledPartitionCacheCapacity);
+  m.def(
+      "_jit_llga_compiled_partition_cache_capacity",
+      &torch_ipex::jit::fuser::onednn::getLlgaCompiledPartitionCacheCapacity);
+  m.def(
+      "_jit_set_llga_persistent_cache_dir",
+      &torch_ipex::jit::fuser::onednn::setLlgaPersistentCacheDir);
+  m.def(
+      "_jit_llga_persistent_cache_dir",
+      &torch_ipex::jit::fuser::onednn::getLlgaPersistentCacheDir);
+  m.def(
+      "_jit_wait_llga_persistent_cache_warmup",
+      &torch_ipex::jit::fuser::onednn::waitLlgaPersistentCacheWarmup);
+  m.def(
+      "_jit_set_llga_shape_bucketing",
+      &torch_ipex::jit::fuser::onednn::setLlgaShapeBucketing,
+      py::arg("enabled"),
+      py::arg("dim") = 1,
+      py::arg("boundaries") = std::vector<int64_t>());
+  m.def("_jit_llga_shape_bucketing", []() {
+    py::dict result;
+    result["enabled"] =
+        torch_ipex::jit::fuser::onednn::isLlgaShapeBucketingEnabled();
+    result["dim"] = torch_ipex::jit::fuser::onednn::getLlgaShapeBucketingDim();
+    result["boundaries"] =
+        torch_ipex::jit::fuser::onednn::getLlgaShapeBucketingBoundaries();
+    return result;
+  });
 
   m.def("enable_jit_opt", []() {
     AutoOptConfig::singleton().set_jit_fuse(true);
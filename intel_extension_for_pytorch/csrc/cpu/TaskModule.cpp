@@ -78,21 +78,17 @@ std::unique_ptr<FutureTensor> TaskModule::run_async(
       future_tensor_result->script_module_initialized_ = true;
       future_tensor_result->future_script_tensor = task->get_future();
 
-      {
-        std::unique_lock<std::mutex> lock(this->task_executor->get_mutex());
-        // submit task to a stopping the pool is not allowed
-        if (this->task_executor->is_stop())
-          throw std::runtime_error(
-              "submit TaskModule(py::object) on stopped ThreadPool");
-        this->task_executor->get_tasks().emplace([task, grad_mode]() {
-          // set the thread local status, such as the grad mode before
-          // execuating the status
-          at::GradMode::set_enabled(grad_mode);
-          // execuate the task
-          (*task)();
-        });
-      }
-      this->task_executor->get_condition().notify_one();
+      // submit task to a stopping the pool is not allowed
+      if (this->task_executor->is_stop())
+        throw std::runtime_error(
+            "submit TaskModule(py::object) on stopped ThreadPool");
+      this->task_executor->submit([task, grad_mode]() {
+        // set the thread local status, such as the grad mode before
+        // execuating the status
+        at::GradMode::set_enabled(grad_mode);
+        // execuate the task
+        (*task)();
+      });
     }
   } else {
     CHECK(this->module_initialized_);
@@ -112,21 +108,17 @@ std::unique_ptr<FutureTensor> TaskModule::run_async(
     future_tensor_result->module_initialized_ = true;
     future_tensor_result->future_tensor = task->get_future();
 
-    {
-      std::unique_lock<std::mutex> lock(this->task_executor->get_mutex());
-      // submit task to a stopping the pool is not allowed
-      if (this->task_executor->is_stop())
-        throw std::runtime_error(
-            "submit TaskModule(py::object) on stopped ThreadPool");
-      this->task_executor->get_tasks().emplace([task, grad_mode]() {
-        // set the thread local status, such as the grad mode before execuating
-        // the status
-        at::GradMode::set_enabled(grad_mode);
-        // execuate the task
-        (*task)();
-      });
-    }
-    this->task_executor->get_condition().notify_one();
+    // submit task to a stopping the pool is not allowed
+    if (this->task_executor->is_stop())
+      throw std::runtime_error(
+          "submit TaskModule(py::object) on stopped ThreadPool");
+    this->task_executor->submit([task, grad_mode]() {
+      // set the thread local status, such as the grad mode before execuating
+      // the status
+      at::GradMode::set_enabled(grad_mode);
+      // execuate the task
+      (*task)();
+    });
   }
   return future_tensor_result;
 }
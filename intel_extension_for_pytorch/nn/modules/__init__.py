@@ -4,5 +4,11 @@ from .merged_embeddingbag import MergedEmbeddingBagWithSGD
 from .merged_embeddingbag import MergedEmbeddingBag
 from .merged_embeddingbag import MergedEmbeddingBagWithCat
 from .merged_embeddingbag import MergedEmbeddingBagWithAdaGrad
+from .merged_embeddingbag import MergedEmbeddingBagRowwiseQuantized
+from .merged_embeddingbag import HotRowCache
+from .merged_embeddingbag import MmapRowFetcher
+from .merged_embeddingbag import quantize_embedding_rowwise
+from .merged_embeddingbag import save_mmap_embedding_table
+from .merged_embeddingbag import load_mmap_embedding_table
 from ...cpu.nn.linear_fuse_eltwise import IPEXLinearEltwise
 from .weight_only_quantization import IpexWoqLinear
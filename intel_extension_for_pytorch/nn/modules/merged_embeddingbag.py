@@ -3,6 +3,8 @@ from torch import nn
 from torch.autograd import Function
 from typing import List, Optional, NamedTuple
 import enum
+import mmap
+import time
 
 
 class PoolingMode(enum.IntEnum):
@@ -33,13 +35,36 @@ class EmbeddingSpec(NamedTuple):
     include_last_offset: bool
 
 
-def merged_embeddingbag(weights, indices, offsets, pooling_mode, include_last_offset):
+def _merged_embeddingbag_forward(
+    weights, indices, offsets, pooling_mode, include_last_offset, hot_row_cache
+):
+    if hot_row_cache is None:
+        return torch.ops.torch_ipex.merged_embeddingbag_forward(
+            weights, indices, offsets, pooling_mode, include_last_offset
+        )
+    return hot_row_cache.forward(
+        weights, indices, offsets, pooling_mode, include_last_offset
+    )
+
+
+def merged_embeddingbag(
+    weights,
+    indices,
+    offsets,
+    pooling_mode,
+    include_last_offset,
+    hot_row_cache=None,
+):
     if torch.is_grad_enabled():
+        if hot_row_cache is not None:
+            # the weights are updated by the optimizer out of the module, so
+            # the copies of the hot rows go out of date
+            hot_row_cache.invalidate()
         return MergedEmbeddingBagFunc.apply(
             indices, offsets, pooling_mode, include_last_offset, *weights
         )
-    return torch.ops.torch_ipex.merged_embeddingbag_forward(
-        weights, indices, offsets, pooling_mode, include_last_offset
+    return _merged_embeddingbag_forward(
+        weights, indices, offsets, pooling_mode, include_last_offset, hot_row_cache
     )
 
 
@@ -59,7 +84,13 @@ def merged_embeddingbag_with_cat(
 
 
 def merged_embeddingbag_sgd(
-    weights, indices, offsets, pooling_mode, include_last_offset, sgd_args
+    weights,
+    indices,
+    offsets,
+    pooling_mode,
+    include_last_offset,
+    sgd_args,
+    hot_row_cache=None,
 ):
     if torch.is_grad_enabled():
         return MergedEmbeddingBagSGDFunc.apply(
@@ -68,15 +99,22 @@ def merged_embeddingbag_sgd(
             pooling_mode,
             include_last_offset,
             sgd_args,
+            hot_row_cache,
             *weights,
         )
-    return torch.ops.torch_ipex.merged_embeddingbag_forward(
-        weights, indices, offsets, pooling_mode, include_last_offset
+    return _merged_embeddingbag_forward(
+        weights, indices, offsets, pooling_mode, include_last_offset, hot_row_cache
     )
 
 
 def merged_embeddingbag_adagrad(
-    weights, indices, offsets, pooling_mode, include_last_offset, adagrad_args
+    weights,
+    indices,
+    offsets,
+    pooling_mode,
+    include_last_offset,
+    adagrad_args,
+    hot_row_cache=None,
 ):
     if torch.is_grad_enabled():
         return MergedEmbeddingBagAdaGradFunc.apply(
@@ -85,13 +123,321 @@ def merged_embeddingbag_adagrad(
             pooling_mode,
             include_last_offset,
             adagrad_args,
+            hot_row_cache,
             *weights,
         )
-    return torch.ops.torch_ipex.merged_embeddingbag_forward(
-        weights, indices, offsets, pooling_mode, include_last_offset
+    return _merged_embeddingbag_forward(
+        weights, indices, offsets, pooling_mode, include_last_offset, hot_row_cache
     )
 
 
+# The rows are quantized by chunks, so that the temporary fp32 copy of a chunk
+# stays small for large tables.
+_QUANTIZE_CHUNK_ROWS = 65536
+
+
+def quantize_embedding_rowwise(weight: torch.Tensor, bit_width: int = 8):
+    r"""
+    Quantize an embedding table row by row, in the layout of
+    `MergedEmbeddingBagRowwiseQuantized` and
+    `torch.ops.torch_ipex.embedding_bag_rowwise_quantized`.
+
+    Each row is stored as its unsigned 8-bit values, or its 4-bit values packed
+    two per byte with the lower nibble first, followed by its fp16 scale and
+    bias, i.e., the row is dequantized as ``q * scale + bias``.
+
+    Args:
+        weight (Tensor): the table of shape `(num_embeddings, embedding_dim)`.
+        bit_width (int): 8 or 4. `embedding_dim` must be even for 4 bits.
+    Returns:
+        uint8 Tensor of shape `(num_embeddings, embedding_dim * bit_width / 8 + 4)`.
+    """
+    assert bit_width in (8, 4), "only 8-bit and 4-bit rows are supported"
+    assert weight.dim() == 2, "expect a 2D embedding table"
+    num_embeddings, embedding_dim = weight.shape
+    assert (
+        embedding_dim * bit_width % 8 == 0
+    ), "embedding_dim must be even for 4-bit rows"
+    data_bytes = embedding_dim * bit_width // 8
+    levels = (1 << bit_width) - 1
+    qweight = torch.empty((num_embeddings, data_bytes + 4), dtype=torch.uint8)
+    for begin in range(0, num_embeddings, _QUANTIZE_CHUNK_ROWS):
+        end = min(num_embeddings, begin + _QUANTIZE_CHUNK_ROWS)
+        w = weight[begin:end].detach().float()
+        w_min, w_max = w.aminmax(dim=1)
+        # quantize with the fp16 qparams that the rows are dequantized with
+        bias = w_min.half()
+        scale = ((w_max - bias.float()) / levels).half()
+        scale.masked_fill_(scale == 0, 1.0)
+        q = (
+            ((w - bias.float().unsqueeze(1)) / scale.float().unsqueeze(1))
+            .round_()
+            .clamp_(0, levels)
+            .to(torch.uint8)
+        )
+        if bit_width == 4:
+            q = q[:, 0::2] | (q[:, 1::2] << 4)
+        qweight[begin:end, :data_bytes] = q
+        qweight[begin:end, data_bytes:] = torch.stack([scale, bias], dim=1).view(
+            torch.uint8
+        )
+    return qweight
+
+
+class HotRowCache(object):
+    r"""
+    A software cache of the most frequently looked up rows of the tables of a
+    `MergedEmbeddingBag`, for the huge tables where a few rows take most of the
+    lookups and the long tail thrashes the LLC. It is created by
+    `MergedEmbeddingBag.enable_hot_row_cache`.
+
+    Every table has a compact cache of `num_hot_rows` rows next to it, which
+    holds the copies of its hot rows, and a hot row set, a small open
+    addressing hash from the hot rows to their copies. The pooling looks every
+    lookup up in the hot row set, and reads the hot rows from their copies,
+    which are packed together instead of scattered over the table. The hot row
+    set is a few times `num_hot_rows` entries, so it stays in the caches of the
+    cores however large the table is.
+
+    The forward samples every `sample_stride` lookups into the counts of the
+    rows. Every `refresh_interval` forwards, the caches are refilled with the
+    rows of the highest counts, and the counts are halved, so that the caches
+    follow the shift of the hot rows.
+
+    The weights are not moved or copied, so they, e.g., the state dict, hold
+    the rows as before. The fused SGD and AdaGrad updates write the updated hot
+    rows through to their copies. Call `invalidate` after modifying the weights
+    out of the module, e.g., loading a state dict.
+    """
+
+    def __init__(
+        self,
+        weights: List[torch.Tensor],
+        num_hot_rows: int,
+        sample_stride: int = 16,
+        refresh_interval: int = 100,
+    ):
+        self.weights = weights
+        self.num_hot_rows = num_hot_rows
+        self.sample_stride = sample_stride
+        self.refresh_interval = refresh_interval
+        self.caches = []
+        self.hot_row_sets = []
+        self.counts = []
+        self.hot_rows = []
+        for weight in weights:
+            num_rows, embedding_dim = weight.shape
+            capacity = min(num_hot_rows, num_rows)
+            self.caches.append(
+                torch.empty((capacity, embedding_dim), dtype=weight.dtype)
+            )
+            # a power of 2 of at least twice the hot rows, see HotRowSet
+            num_buckets = 1 << max(2 * capacity - 1, 1).bit_length()
+            self.hot_row_sets.append(torch.full((2, num_buckets), -1, dtype=torch.long))
+            self.counts.append(torch.zeros(num_rows, dtype=torch.int32))
+            self.hot_rows.append(torch.empty(0, dtype=torch.long))
+        self.num_calls = 0
+        self.stale = False
+        self.reset_stats()
+
+    def _copy_hot_rows(self):
+        for weight, cache, hot_rows in zip(self.weights, self.caches, self.hot_rows):
+            torch.index_select(
+                weight.detach(), 0, hot_rows, out=cache[: hot_rows.numel()]
+            )
+            self.rows_copied += hot_rows.numel()
+        self.stale = False
+
+    def refresh(self):
+        r"""
+        Refill the caches with the rows of the highest counts.
+        """
+        start = time.time()
+        for i, counts in enumerate(self.counts):
+            hot_counts, hot_rows = counts.topk(self.caches[i].size(0))
+            # copy the rows in the order of the table
+            self.hot_rows[i] = hot_rows[hot_counts > 0].sort().values
+            counts.div_(2, rounding_mode="floor")
+        torch.ops.torch_ipex.merged_embeddingbag_build_hot_row_sets(
+            self.hot_rows, self.hot_row_sets
+        )
+        self._copy_hot_rows()
+        self.num_refreshes += 1
+        self.refresh_time += time.time() - start
+
+    def invalidate(self):
+        r"""
+        Mark the copies of the hot rows out of date, they are copied again
+        before the next lookup.
+        """
+        self.stale = True
+
+    def forward(self, weights, indices, offsets, pooling_mode, include_last_offset):
+        if (
+            self.refresh_interval > 0
+            and self.num_calls > 0
+            and self.num_calls % self.refresh_interval == 0
+        ):
+            self.refresh()
+        elif self.stale:
+            self._copy_hot_rows()
+        self.num_calls += 1
+        return torch.ops.torch_ipex.merged_embeddingbag_cached_forward(
+            weights,
+            indices,
+            offsets,
+            pooling_mode,
+            include_last_offset,
+            self.caches,
+            self.hot_row_sets,
+            self.counts,
+            self.lookup_stats,
+            self.sample_stride,
+        )
+
+    def stats(self):
+        r"""
+        Returns:
+            A dict of ``hit_rate`` and ``sampled_lookups``, the hit rate of the
+            sampled lookups and the number of them of every table,
+            ``sample_time``, the seconds spent in sampling the lookups,
+            ``refreshes`` and ``refresh_time``, the number of refreshes and the
+            seconds spent in them, and ``rows_copied``, the number of rows
+            copied to the caches.
+        """
+        hits, samples, sample_ns = self.lookup_stats.unbind(1)
+        return {
+            "hit_rate": (hits.double() / samples.clamp(min=1)).tolist(),
+            "sampled_lookups": samples.tolist(),
+            "sample_time": sample_ns.sum().item() / 1e9,
+            "refreshes": self.num_refreshes,
+            "refresh_time": self.refresh_time,
+            "rows_copied": self.rows_copied,
+        }
+
+    def reset_stats(self):
+        # the sampled hits, sampled lookups and nanoseconds of sampling of
+        # every table
+        self.lookup_stats = torch.zeros((len(self.caches), 3), dtype=torch.long)
+        self.num_refreshes = 0
+        self.refresh_time = 0.0
+        self.rows_copied = 0
+
+
+def save_mmap_embedding_table(weight: torch.Tensor, path: str):
+    r"""
+    Write the rows of a table to a file, e.g., on NVMe, to be mapped by
+    `load_mmap_embedding_table`. The table is fp32, bf16, or uint8 rows of
+    `quantize_embedding_rowwise`.
+
+    Returns:
+        The table mapped from the file.
+    """
+    table = load_mmap_embedding_table(path, weight.shape, weight.dtype)
+    table.copy_(weight.detach())
+    return table
+
+
+def load_mmap_embedding_table(path: str, shape, dtype: torch.dtype):
+    r"""
+    Map a table of `shape` and `dtype` from a file written by
+    `save_mmap_embedding_table`. The mapping is shared with the file, so the
+    table can be larger than the memory, and the updates of the weights are
+    written back to the file.
+    """
+    num_rows, row_size = shape
+    return torch.from_file(
+        path, shared=True, size=num_rows * row_size, dtype=dtype
+    ).view(num_rows, row_size)
+
+
+class MmapRowFetcher(object):
+    r"""
+    Fetch the rows of the tables mapped from files by
+    `load_mmap_embedding_table` ahead of the lookups of a minibatch. It is
+    created by `MergedEmbeddingBag.enable_mmap_fetch` or
+    `MergedEmbeddingBagRowwiseQuantized.enable_mmap_fetch`.
+
+    Without it, every lookup of a row which is not in the memory faults, and
+    the pooling waits for the reads from the file one by one. The fetch
+    deduplicates the pages of the rows looked up by the minibatch, issues the
+    reads of the missing ones together with `madvise(MADV_WILLNEED)`, and waits
+    for them from all the threads, so that the reads are in flight together on
+    the device. The pooling then runs the in-memory kernels on the resident
+    rows, so the results are the same as with the tables in the memory.
+
+    Every table keeps a LRU of its resident pages. Once a table has more than
+    `max_resident_bytes` in the memory, the least recently used pages are
+    written back to the file if they are dirty, and dropped from the mapping
+    and the page cache, so that the memory held by the tables stays bounded as
+    they grow. The kernel may still drop the pages on its own under memory
+    pressure, which costs a fault in the pooling.
+    """
+
+    def __init__(self, weights, max_resident_bytes: int = 0):
+        self.weights = weights
+        self.page_size = mmap.PAGESIZE
+        self.max_resident_pages = max_resident_bytes // self.page_size
+        self.page_last_use = []
+        # the previous and the next page of every page in the LRU of a table,
+        # the last column is the head of the LRU
+        self.page_lru = []
+        for weight in weights:
+            num_pages = (
+                weight.data_ptr() % self.page_size
+                + weight.numel() * weight.element_size()
+                + self.page_size
+                - 1
+            ) // self.page_size
+            self.page_last_use.append(torch.zeros(num_pages, dtype=torch.long))
+            lru = torch.full((2, num_pages + 1), -1, dtype=torch.long)
+            lru[:, num_pages] = num_pages
+            self.page_lru.append(lru)
+        self.step = 0
+        # the page hits, fetches, evictions and resident pages of every table
+        self.fetch_stats = torch.zeros((len(self.page_last_use), 4), dtype=torch.long)
+        self.reset_stats()
+
+    def fetch(self, indices):
+        r"""
+        Fetch the rows looked up by `indices` into the memory.
+        """
+        start = time.time()
+        self.step += 1
+        torch.ops.torch_ipex.merged_embeddingbag_fetch_rows(
+            list(self.weights),
+            indices,
+            self.page_last_use,
+            self.page_lru,
+            self.fetch_stats,
+            self.step,
+            self.max_resident_pages,
+        )
+        self.fetch_time += time.time() - start
+
+    def stats(self):
+        r"""
+        Returns:
+            A dict of ``hit_rate``, ``fetched_bytes``, ``evicted_bytes`` and
+            ``resident_bytes``, the hit rate of the pages looked up and the
+            bytes fetched, evicted and resident of every table, and
+            ``fetch_time``, the seconds spent in the fetches.
+        """
+        hits, fetches, evictions, resident = self.fetch_stats.unbind(1)
+        return {
+            "hit_rate": (hits.double() / (hits + fetches).clamp(min=1)).tolist(),
+            "fetched_bytes": (fetches * self.page_size).tolist(),
+            "evicted_bytes": (evictions * self.page_size).tolist(),
+            "resident_bytes": (resident * self.page_size).tolist(),
+            "fetch_time": self.fetch_time,
+        }
+
+    def reset_stats(self):
+        # the resident pages are the state of the LRUs, they are not reset
+        self.fetch_stats[:, :3].zero_()
+        self.fetch_time = 0.0
+
+
 class MergedEmbeddingBagFunc(Function):
     @staticmethod
     def forward(ctx, indices, offsets, pooling_mode, include_last_offset, *weights):
@@ -133,10 +479,11 @@ class MergedEmbeddingBagSGDFunc(Function):
         pooling_mode,
         include_last_offset,
         sgd_args,
+        hot_row_cache,
         *weights,
     ):
-        output = torch.ops.torch_ipex.merged_embeddingbag_forward(
-            weights, indices, offsets, pooling_mode, include_last_offset
+        output = _merged_embeddingbag_forward(
+            weights, indices, offsets, pooling_mode, include_last_offset, hot_row_cache
         )
         ctx.indices = indices
         ctx.offsets = offsets
@@ -144,6 +491,7 @@ class MergedEmbeddingBagSGDFunc(Function):
         ctx.pooling_mode = pooling_mode
         ctx.include_last_offset = include_last_offset
         ctx.sgd_args = sgd_args
+        ctx.hot_row_cache = hot_row_cache
         return tuple(output)
 
     @staticmethod
@@ -157,6 +505,11 @@ class MergedEmbeddingBagSGDFunc(Function):
         bf16_trail = sgd_args.bf16_trail
         weight_decay = sgd_args.weight_decay
         lr = sgd_args.lr
+        hot_row_sets, hot_row_caches = [], []
+        if ctx.hot_row_cache is not None:
+            # write the updated hot rows through to their copies
+            hot_row_sets = ctx.hot_row_cache.hot_row_sets
+            hot_row_caches = ctx.hot_row_cache.caches
         grad_list = torch.ops.torch_ipex.merged_embeddingbag_backward_sgd(
             grad_out,
             weights,
@@ -167,8 +520,10 @@ class MergedEmbeddingBagSGDFunc(Function):
             bf16_trail,
             weight_decay,
             lr,
+            hot_row_sets,
+            hot_row_caches,
         )
-        output = [None] * (5 + len(weights))
+        output = [None] * (6 + len(weights))
         return tuple(output)
 
 
@@ -181,10 +536,11 @@ class MergedEmbeddingBagAdaGradFunc(Function):
         pooling_mode,
         include_last_offset,
         adagrad_args,
+        hot_row_cache,
         *weights,
     ):
-        output = torch.ops.torch_ipex.merged_embeddingbag_forward(
-            weights, indices, offsets, pooling_mode, include_last_offset
+        output = _merged_embeddingbag_forward(
+            weights, indices, offsets, pooling_mode, include_last_offset, hot_row_cache
         )
         ctx.indices = indices
         ctx.offsets = offsets
@@ -192,6 +548,7 @@ class MergedEmbeddingBagAdaGradFunc(Function):
         ctx.pooling_mode = pooling_mode
         ctx.include_last_offset = include_last_offset
         ctx.adagrad_args = adagrad_args
+        ctx.hot_row_cache = hot_row_cache
         return tuple(output)
 
     @staticmethod
@@ -206,6 +563,10 @@ class MergedEmbeddingBagAdaGradFunc(Function):
         hessian = adagrad_args.hessian
         eps = adagrad_args.eps
         lr = adagrad_args.lr
+        hot_row_sets, hot_row_caches = [], []
+        if ctx.hot_row_cache is not None:
+            hot_row_sets = ctx.hot_row_cache.hot_row_sets
+            hot_row_caches = ctx.hot_row_cache.caches
         grad_list = torch.ops.torch_ipex.merged_embeddingbag_backward_adagrad(
             grad_out,
             weights,
@@ -217,8 +578,10 @@ class MergedEmbeddingBagAdaGradFunc(Function):
             bf16_trail,
             eps,
             lr,
+            hot_row_sets,
+            hot_row_caches,
         )
-        output = [None] * (5 + len(weights))
+        output = [None] * (6 + len(weights))
         return tuple(output)
 
 
@@ -306,6 +669,73 @@ class MergedEmbeddingBag(nn.Module):
             if weight is None:
                 weight = torch.empty((num_embeddings, embedding_dim), dtype=dtype)
             self.weights[i] = nn.Parameter(weight)
+        self.hot_row_cache = None
+        self.mmap_fetcher = None
+
+    def enable_hot_row_cache(
+        self,
+        num_hot_rows: int,
+        sample_stride: int = 16,
+        refresh_interval: int = 100,
+    ):
+        r"""
+        Cache the `num_hot_rows` most frequently looked up rows of every table,
+        see `HotRowCache`. Only the `num_hot_rows` rows of every cache are
+        allocated, and the weights stay as they are, so call it after
+        `to_bfloat16_train` to cache the rows of the bf16 weights. The cache is
+        used by the inference and the fused updates. The training with the
+        dense grads does not use it, and the hot rows are copied again at the
+        next inference since the weights may have been updated.
+
+        Args:
+            num_hot_rows (int): the number of rows cached per table.
+            sample_stride (int): sample one lookup in every `sample_stride`
+                lookups to count the rows, 0 to stop counting.
+            refresh_interval (int): refill the caches every `refresh_interval`
+                forwards, 0 to refill them only by `HotRowCache.refresh`.
+        Returns:
+            The `HotRowCache`, e.g., to get its stats.
+        """
+        assert num_hot_rows > 0, "expect to cache at least 1 row per table"
+        assert sample_stride >= 0 and refresh_interval >= 0
+        self.hot_row_cache = HotRowCache(
+            self.weights, num_hot_rows, sample_stride, refresh_interval
+        )
+        return self.hot_row_cache
+
+    def disable_hot_row_cache(self):
+        r"""
+        Drop the hot row cache.
+        """
+        self.hot_row_cache = None
+
+    def enable_mmap_fetch(self, max_resident_bytes: int = 0):
+        r"""
+        Fetch the rows of the weights mapped from files by
+        `load_mmap_embedding_table` ahead of every forward, see
+        `MmapRowFetcher`.
+
+            >>> weights = [
+            >>>     load_mmap_embedding_table(path, (num_rows, dim), torch.float)
+            >>>     for path, num_rows in zip(paths, table_rows)
+            >>> ]
+            >>> merged_emb = MergedEmbeddingBag(
+            >>>     [EmbeddingSpec(w.size(0), dim, "sum", w.dtype, w, False, False)
+            >>>      for w in weights])
+            >>> merged_emb.enable_mmap_fetch(max_resident_bytes=16 << 30)
+
+        Args:
+            max_resident_bytes (int): the bytes of every table kept in the
+                memory, 0 to leave them to the kernel.
+        Returns:
+            The `MmapRowFetcher`, e.g., to get its stats.
+        """
+        assert max_resident_bytes >= 0
+        self.mmap_fetcher = MmapRowFetcher(self.weights, max_resident_bytes)
+        return self.mmap_fetcher
+
+    def disable_mmap_fetch(self):
+        self.mmap_fetcher = None
 
     @classmethod
     def from_embeddingbag_list(
@@ -353,8 +783,15 @@ class MergedEmbeddingBag(nn.Module):
             List[Tensor] output shape of `(batch_size, embedding_dim)` which length = num of tables.
         """
         assert self.dense
+        if self.mmap_fetcher is not None:
+            self.mmap_fetcher.fetch(indices)
         return merged_embeddingbag(
-            self.weights, indices, offsets, self.pooling_mode, self.include_last_offset
+            self.weights,
+            indices,
+            offsets,
+            self.pooling_mode,
+            self.include_last_offset,
+            self.hot_row_cache,
         )
 
 
@@ -454,6 +891,12 @@ class MergedEmbeddingBagWithSGD(MergedEmbeddingBag):
             trails.append(trail)
             self.weights[i] = torch.nn.Parameter(bf16_w)
         self.sgd_args = self.sgd_args._replace(bf16_trail=trails)
+        if self.hot_row_cache is not None:
+            # the cache holds the weights of the former dtype
+            cache = self.hot_row_cache
+            self.enable_hot_row_cache(
+                cache.num_hot_rows, cache.sample_stride, cache.refresh_interval
+            )
 
     def forward(self, indices, offsets):
         r"""
@@ -465,6 +908,8 @@ class MergedEmbeddingBagWithSGD(MergedEmbeddingBag):
         Returns:
             List[Tensor] output shape of `(batch_size, embedding_dim)` which length = num of tables.
         """
+        if self.mmap_fetcher is not None:
+            self.mmap_fetcher.fetch(indices)
         return merged_embeddingbag_sgd(
             self.weights,
             indices,
@@ -472,6 +917,7 @@ class MergedEmbeddingBagWithSGD(MergedEmbeddingBag):
             self.pooling_mode,
             self.include_last_offset,
             self.sgd_args,
+            self.hot_row_cache,
         )
 
     @classmethod
@@ -559,6 +1005,12 @@ class MergedEmbeddingBagWithAdaGrad(MergedEmbeddingBag):
             trails.append(trail)
             self.weights[i] = torch.nn.Parameter(bf16_w)
         self.adagrad_args = self.adagrad_args._replace(bf16_trail=trails)
+        if self.hot_row_cache is not None:
+            # the cache holds the weights of the former dtype
+            cache = self.hot_row_cache
+            self.enable_hot_row_cache(
+                cache.num_hot_rows, cache.sample_stride, cache.refresh_interval
+            )
 
     def forward(self, indices, offsets):
         r"""
@@ -570,6 +1022,8 @@ class MergedEmbeddingBagWithAdaGrad(MergedEmbeddingBag):
         Returns:
             List[Tensor] output shape of `(batch_size, embedding_dim)` which length = num of tables.
         """
+        if self.mmap_fetcher is not None:
+            self.mmap_fetcher.fetch(indices)
         return merged_embeddingbag_adagrad(
             self.weights,
             indices,
@@ -577,6 +1031,7 @@ class MergedEmbeddingBagWithAdaGrad(MergedEmbeddingBag):
             self.pooling_mode,
             self.include_last_offset,
             self.adagrad_args,
+            self.hot_row_cache,
         )
 
     @classmethod
@@ -642,9 +1097,131 @@ class MergedEmbeddingBagWithCat(MergedEmbeddingBag):
         Returns:
             output shape of `(batch_size, feature_size)` which feature_size = emb_dim * (num of tables + 1).
         """
+        if self.mmap_fetcher is not None:
+            self.mmap_fetcher.fetch(indices)
         return merged_embeddingbag_with_cat(
             self.weights,
             indices,
             offsets,
             dense_feature,
         )
+
+
+class MergedEmbeddingBagRowwiseQuantized(nn.Module):
+    r"""
+    Inference only `MergedEmbeddingBag` with tables quantized row by row to 8
+    or 4 bits, with an fp16 scale and bias stored inline at the end of each row.
+    See `quantize_embedding_rowwise` for the layout.
+
+    The rows are dequantized and pooled in registers, so a lookup reads about
+    1/2 (8 bits) or 1/4 (4 bits) of the bytes of a bf16 or fp32 table.
+
+        >>> EmbLists = torch.nn.Modulist(emb1, emb2, emb3, ..., emb_m)
+        >>> merged_emb = MergedEmbeddingBagRowwiseQuantized.from_embeddingbag_list(
+        >>>     EmbLists, bit_width=4, output_dtype=torch.bfloat16)
+        >>> outputs = merged_emb(indices, offsets)
+    """
+
+    def __init__(
+        self,
+        qweights: List[torch.Tensor],
+        bit_width: int,
+        pooling_mode: str,
+        include_last_offset: bool,
+        output_dtype: torch.dtype = torch.float,
+    ):
+        super(MergedEmbeddingBagRowwiseQuantized, self).__init__()
+        self.n_tables = len(qweights)
+        assert self.n_tables > 0, "MergedEmbeddingBag at least have 1 table"
+        assert bit_width in (8, 4), "only 8-bit and 4-bit rows are supported"
+        assert all(
+            w.dtype == torch.uint8 and w.shape[1] == qweights[0].shape[1]
+            for w in qweights
+        ), "expect uint8 tables with the same row size"
+        assert pooling_mode in (
+            "sum",
+            "mean",
+        ), "MergedEmbeddingBag only support EmbeddingBag with model sum or mean"
+        assert output_dtype in (
+            torch.float,
+            torch.bfloat16,
+        ), "only float and bfloat16 outputs are supported"
+        self.bit_width = bit_width
+        self.embedding_dim = (qweights[0].shape[1] - 4) * 8 // bit_width
+        self.pooling_mode = (
+            PoolingMode.SUM if pooling_mode == "sum" else PoolingMode.MEAN
+        )
+        self.include_last_offset = include_last_offset
+        self.output_dtype = output_dtype
+        for i, qweight in enumerate(qweights):
+            self.register_buffer("qweight_{}".format(i), qweight.contiguous())
+        self.mmap_fetcher = None
+
+    @property
+    def qweights(self):
+        return [getattr(self, "qweight_{}".format(i)) for i in range(self.n_tables)]
+
+    def enable_mmap_fetch(self, max_resident_bytes: int = 0):
+        r"""
+        Fetch the rows of the tables mapped from files by
+        `load_mmap_embedding_table` ahead of every forward, see
+        `MmapRowFetcher` and `MergedEmbeddingBag.enable_mmap_fetch`.
+        """
+        assert max_resident_bytes >= 0
+        self.mmap_fetcher = MmapRowFetcher(self.qweights, max_resident_bytes)
+        return self.mmap_fetcher
+
+    def disable_mmap_fetch(self):
+        self.mmap_fetcher = None
+
+    @classmethod
+    def from_embeddingbag_list(
+        cls,
+        tables: List[torch.nn.EmbeddingBag],
+        bit_width: int = 8,
+        output_dtype: torch.dtype = torch.float,
+    ):
+        assert all(
+            emb.mode == tables[0].mode
+            and emb.include_last_offset == tables[0].include_last_offset
+            for emb in tables
+        ), "expect all tables have same pooling_mode and include_last_offset"
+        qweights = [quantize_embedding_rowwise(emb.weight, bit_width) for emb in tables]
+        return cls(
+            qweights,
+            bit_width,
+            tables[0].mode,
+            tables[0].include_last_offset,
+            output_dtype,
+        )
+
+    def extra_repr(self) -> str:
+        return "number of tables={}, embedding_dim={}, bit_width={}, {}, {}".format(
+            self.n_tables,
+            self.embedding_dim,
+            self.bit_width,
+            self.pooling_mode,
+            self.output_dtype,
+        )
+
+    def forward(self, indices, offsets):
+        r"""
+        Args:
+            indices (List[Tensor]):
+                See https://pytorch.org/docs/stable/generated/torch.nn.EmbeddingBag.html#torch.nn.EmbeddingBag.forward
+            offsets (List[Tensor]):
+                See https://pytorch.org/docs/stable/generated/torch.nn.EmbeddingBag.html#torch.nn.EmbeddingBag.forward
+        Returns:
+            List[Tensor] output shape of `(batch_size, embedding_dim)` which length = num of tables.
+        """
+        if self.mmap_fetcher is not None:
+            self.mmap_fetcher.fetch(indices)
+        return torch.ops.torch_ipex.rowwise_quantized_merged_embeddingbag_forward(
+            self.qweights,
+            indices,
+            offsets,
+            self.pooling_mode,
+            self.include_last_offset,
+            self.bit_width,
+            self.output_dtype,
+        )
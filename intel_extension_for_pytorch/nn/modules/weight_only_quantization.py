@@ -157,7 +157,8 @@ class IpexWoqLinear(nn.Module):
                           utilities or provided by the user
             qweight (Tensor): tensor in int32 dtype and contains actually int4 data
             bias (Tensor or None): bias for linear
-            scales (Tensor): scales for qweight
+            scales (Tensor): scales for qweight, in shape [N] for per-channel
+                             quantization or [N, K / group_size] for group-wise
             zero_points (Tensor): zero points for qweight
         """
         float_modules = [torch.nn.Linear]
@@ -231,6 +232,25 @@ class IpexWoqLinear(nn.Module):
         qlinear._act_quant_mode = act_quant_mode
         return qlinear
 
+    @classmethod
+    def _init_from_packed_state(
+        cls, in_features, out_features, bias_, dtype, packed_state, repack
+    ):
+        r"""Create a weight-only quantized module from the state returned by
+        `_op_context.get_packed_state()`, without packing the weight again unless
+        `repack` is True.
+        """
+        qlinear = cls(in_features, out_features, bias_, dtype=dtype)
+        qlinear._op_context = (
+            torch.ops.ipex_prepack.weight_only_qlinear_prepack_from_packed(
+                *packed_state[:4], None, *packed_state[4:], repack
+            )
+        )
+        qlinear._lowp_mode = packed_state[5]
+        qlinear._num_concats = packed_state[6]
+        qlinear._act_quant_mode = packed_state[7]
+        return qlinear
+
 
 class IpexWoqLinearAllreduce(IpexWoqLinear):
     def __init__(
@@ -10,3 +10,4 @@ from ._qconfig import (
     WoqActQuantMode,
 )
 from ._autotune import autotune
+from ._woq_packed_weights import save_woq_packed_weights, load_woq_packed_weights
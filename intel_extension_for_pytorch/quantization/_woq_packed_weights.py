@@ -0,0 +1,178 @@
+import json
+import os
+import warnings
+import torch
+import intel_extension_for_pytorch._C as core
+
+# File layout:
+#   magic (8 bytes) | header length (8 bytes, little endian) | header (JSON) |
+#   tensor data, each aligned to _ALIGNMENT bytes from the start of the file
+# The header holds the tag of the packing and, for each module, its attributes
+# and the dtype, shape and offset of its tensors.
+_MAGIC = b"IPEXWOQP"
+_FORMAT_VERSION = 1
+# Bump it when the blocking or the layout of the packed WOQ weight changes, so
+# that the files packed before are packed again when they are loaded.
+_WOQ_PACKED_LAYOUT = 1
+# Page aligned, so that the weights are mapped from the file directly
+_ALIGNMENT = 4096
+
+
+def _packing_tag():
+    return {"isa": core._get_current_isa_level(), "layout": _WOQ_PACKED_LAYOUT}
+
+
+def _align(offset):
+    return (offset + _ALIGNMENT - 1) // _ALIGNMENT * _ALIGNMENT
+
+
+def save_woq_packed_weights(model, path):
+    r"""
+    Save the packed weights of the weight-only quantized linears of a model, so
+    that `load_woq_packed_weights` creates the linears from them without
+    quantizing and packing the weights again.
+
+    The file is tagged with the ISA and the layout of the packing. Only the
+    weights packed for the TPP kernels are saved, the other linears are skipped
+    with a warning.
+
+    Args:
+        model (torch.nn.Module): model with weight-only quantized linears
+        path (str): path of the file to write
+    """
+    from ..nn.modules import IpexWoqLinear
+
+    modules = {}
+    tensors = []
+    offset = 0
+    for name, mod in model.named_modules():
+        if type(mod) is not IpexWoqLinear:
+            continue
+        state = mod._op_context.get_packed_state()
+        weight, scales, zero_points, bias = state[:4]
+        if weight.dim() != 4:
+            warnings.warn(
+                "Skip saving {} because its weight is not packed for the TPP kernels".format(
+                    name
+                )
+            )
+            continue
+        if weight.is_quantized:
+            weight = weight.int_repr()
+        entry = {
+            "in_features": mod.in_features,
+            "out_features": mod.out_features,
+            "bias": bool(mod.bias),
+            "dtype": str(mod.dtype).split(".")[-1],
+            "is_int4": state[4],
+            "lowp_mode": state[5],
+            "num_concats": state[6],
+            "act_quant_mode": state[7],
+            "orig_wei_shape": state[8],
+            "group_size": state[9],
+            "tensors": {},
+        }
+        named_tensors = [
+            ("weight", weight),
+            ("scales", scales),
+            ("zero_points", zero_points),
+            ("bias", bias),
+        ]
+        for key, t in named_tensors:
+            if t is None:
+                continue
+            t = t.contiguous()
+            entry["tensors"][key] = {
+                "dtype": str(t.dtype).split(".")[-1],
+                "shape": list(t.shape),
+                "offset": offset,
+            }
+            tensors.append(t)
+            offset = _align(offset + t.numel() * t.element_size())
+        modules[name] = entry
+
+    header = json.dumps(
+        {"version": _FORMAT_VERSION, "tag": _packing_tag(), "modules": modules}
+    ).encode("utf-8")
+    with open(path, "wb") as f:
+        f.write(_MAGIC)
+        f.write(len(header).to_bytes(8, "little"))
+        f.write(header)
+        for t in tensors:
+            f.write(b"\0" * (_align(f.tell()) - f.tell()))
+            f.write(t.view(-1).view(torch.uint8).numpy().tobytes())
+        f.write(b"\0" * (_align(f.tell()) - f.tell()))
+
+
+def load_woq_packed_weights(model, path):
+    r"""
+    Replace the modules of a model by the weight-only quantized linears saved
+    by `save_woq_packed_weights`. The modules are looked up by name, so the
+    model must have the structure of the saved one, e.g., created on the meta
+    device. The modules which are not in the file are kept.
+
+    The file is mapped into memory and the weights are used in place, without
+    a copy. They are unpacked and packed again only if the file is tagged with
+    another ISA or packing layout than the current one.
+
+    Args:
+        model (torch.nn.Module): model to load the linears into
+        path (str): path of the file written by `save_woq_packed_weights`
+    Return:
+        The model with the linears replaced
+    """
+    from ..nn.modules import IpexWoqLinear
+
+    with open(path, "rb") as f:
+        assert f.read(len(_MAGIC)) == _MAGIC, "{} is not a WOQ packed file".format(path)
+        header_len = int.from_bytes(f.read(8), "little")
+        header = json.loads(f.read(header_len).decode("utf-8"))
+    assert (
+        header["version"] == _FORMAT_VERSION
+    ), "Unsupported WOQ packed file version {}".format(header["version"])
+    repack = header["tag"] != _packing_tag()
+    if repack:
+        warnings.warn(
+            "{} is packed for {}, but the current packing is {}. Packing the weights again.".format(
+                path, header["tag"], _packing_tag()
+            )
+        )
+    data_start = _align(len(_MAGIC) + 8 + header_len)
+    # A private mapping opens the file read-only, and its pages are still read
+    # lazily without a copy. A write to a loaded tensor does not reach the file.
+    data = torch.from_file(
+        path, shared=False, size=os.path.getsize(path), dtype=torch.uint8
+    )
+
+    def get_tensor(info):
+        dtype = getattr(torch, info["dtype"])
+        nbytes = torch.Size(info["shape"]).numel() * dtype.itemsize
+        begin = data_start + info["offset"]
+        return data[begin : begin + nbytes].view(dtype).view(info["shape"])
+
+    for name, entry in header["modules"].items():
+        tensors = entry["tensors"]
+        packed_state = (
+            get_tensor(tensors["weight"]),
+            get_tensor(tensors["scales"]),
+            get_tensor(tensors["zero_points"]),
+            get_tensor(tensors["bias"]) if "bias" in tensors else None,
+            entry["is_int4"],
+            entry["lowp_mode"],
+            entry["num_concats"],
+            entry["act_quant_mode"],
+            entry["orig_wei_shape"],
+            entry["group_size"],
+        )
+        qlinear = IpexWoqLinear._init_from_packed_state(
+            entry["in_features"],
+            entry["out_features"],
+            entry["bias"],
+            getattr(torch, entry["dtype"]),
+            packed_state,
+            repack,
+        )
+        parent_name, _, attr = name.rpartition(".")
+        parent = model.get_submodule(parent_name) if parent_name else model
+        setattr(parent, attr, qlinear)
+    return model
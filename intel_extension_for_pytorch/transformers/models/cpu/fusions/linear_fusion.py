@@ -3,7 +3,9 @@ from torch import nn
 import math
 import warnings
 import copy
+from typing import Optional, Tuple
 from intel_extension_for_pytorch.nn.modules import IpexWoqLinear
+from intel_extension_for_pytorch.cpu.tpp.utils.blocked_layout import BlockedParameter
 from intel_extension_for_pytorch.quantization import (
     get_weight_only_quant_qconfig_mapping,
 )
@@ -198,101 +200,181 @@ class _IPEXlinearGeluCPU(_IPEXlinearFusionCPU):
             return x
 
 
+def _concat_woq_linears(linear_list):
+    r"""
+    Concat the weights of the WOQ linears along N and return a WOQ linear with
+    `_num_concats` set, or None if any of the linears is not supported.
+    """
+    # Quantization is done before lowering to CPU.
+    # We assume weights are all in shape [N, K] and per-channel quantized, axis = 0.
+    # And it must be one of the two cases below.
+    # Case 1:
+    #   - weight dtype = qint8, qscheme = torch.per_channel_affine,
+    #   - scales dtype = float, zero points dtype = int
+    # Case 2:
+    #   - weight dtype = quint4x2, qscheme = torch.per_channel_affine_float_qparams,
+    #   - scales dtype = float, zero points dtype = float
+    # We need to unpack weights then concat them
+    weights_list = []
+    scales_list = []
+    zeros_list = []
+    bias_list = []
+    w_dtype = linear_list[0].dtype
+    lowp_mode = linear_list[0]._lowp_mode
+    act_quant_mode = linear_list[0]._act_quant_mode
+    qconfig_mapping = get_weight_only_quant_qconfig_mapping(
+        weight_dtype=w_dtype,
+        lowp_mode=lowp_mode,
+        act_quant_mode=act_quant_mode,
+    )
+    qconfig = qconfig_mapping.global_qconfig
+    for linear in linear_list:
+        if not hasattr(linear, "_op_context"):
+            warnings.warn(
+                "Concat linear fusion for CPU WOQ failed "
+                "because linear is not converted to WOQ Linear. "
+                "Falling back to separate linears."
+            )
+            return None
+        qw = linear._op_context.to_public(linear._op_context.get_weight())
+        if (
+            not qw.is_quantized
+            or qw.qscheme()
+            not in [
+                torch.per_channel_affine,
+                torch.per_channel_affine_float_qparams,
+            ]
+            or qw.q_per_channel_axis() != 0
+        ):
+            warnings.warn(
+                "Concat linear fusion for CPU WOQ failed "
+                "because quantization type of weight is not supported. "
+                "Falling back to separate linears."
+            )
+            return None
+        s = qw.q_per_channel_scales().float()
+        z = qw.q_per_channel_zero_points().float()
+        weights_list.append(qw.dequantize().float())
+        scales_list.append(s)
+        zeros_list.append(z)
+        bias_list.append(linear._op_context.get_bias())
+        w_dtype = linear.dtype
+    concat_weight = torch.concat(weights_list, 0)
+    concat_scales = torch.concat(scales_list, -1)
+    concat_zeros = torch.concat(zeros_list, -1)
+    use_bias = all(bias_list)
+    concat_bias = torch.concat(bias_list, 0) if use_bias else None
+    mod = nn.Linear(concat_weight.shape[1], concat_weight.shape[0], use_bias)
+    mod.weight = nn.Parameter(concat_weight)
+    mod.bias = nn.Parameter(concat_bias) if use_bias else None
+    mod.qconfig = qconfig
+    mod._num_concats = len(weights_list)
+    if w_dtype == torch.quint4x2:
+        return IpexWoqLinear.from_float_and_int4_weight(
+            mod, concat_weight, concat_scales, concat_zeros
+        )
+    else:  # qint8
+        assert w_dtype == torch.qint8
+        return IpexWoqLinear.from_float(mod)
+
+
 class _IPEXConcatLinearCPU(_IPEXlinearFusionCPU):
     def __init__(self, module, tpp=False, woq=False):
         assert hasattr(module, "linear_0")
         super().__init__(module.linear_0, tpp=tpp, woq=woq)
         assert hasattr(module, "num_concat")
         self.num_concat = module.num_concat
-        self.linear_list = []
+        # the separate linears are not kept once they are concatenated, so that
+        # their weights are freed with the original module
+        linear_list = []
         for i in range(self.num_concat):
             attr_name = f"linear_{i}"
             assert hasattr(module, attr_name)
-            self.linear_list.append(getattr(module, attr_name))
+            linear_list.append(getattr(module, attr_name))
         self.concat_linear = None
-        if woq and all(
-            isinstance(linear, IpexWoqLinear) for linear in self.linear_list
-        ):
-            # Quantization is done before lowering to CPU.
-            # We assume weights are all in shape [N, K] and per-channel quantized, axis = 0.
-            # And it must be one of the two cases below.
-            # Case 1:
-            #   - weight dtype = qint8, qscheme = torch.per_channel_affine,
-            #   - scales dtype = float, zero points dtype = int
-            # Case 2:
-            #   - weight dtype = quint4x2, qscheme = torch.per_channel_affine_float_qparams,
-            #   - scales dtype = float, zero points dtype = float
-            # We need to unpack weights then concat them
-            weights_list = []
-            scales_list = []
-            zeros_list = []
-            bias_list = []
-            w_dtype = self.linear_list[0].dtype
-            lowp_mode = self.linear_list[0]._lowp_mode
-            act_quant_mode = self.linear_list[0]._act_quant_mode
-            qconfig_mapping = get_weight_only_quant_qconfig_mapping(
-                weight_dtype=w_dtype,
-                lowp_mode=lowp_mode,
-                act_quant_mode=act_quant_mode,
-            )
-            qconfig = qconfig_mapping.global_qconfig
-            for i in range(self.num_concat):
-                linear = self.linear_list[i]
-                if not hasattr(linear, "_op_context"):
-                    warnings.warn(
-                        "Concat linear fusion for CPU WOQ failed "
-                        "because linear is not converted to WOQ Linear. "
-                        "Falling back to separate linears."
-                    )
-                    weights_list = []
-                    break
-                qw = linear._op_context.to_public(linear._op_context.get_weight())
-                if (
-                    qw.qscheme()
-                    not in [
-                        torch.per_channel_affine,
-                        torch.per_channel_affine_float_qparams,
-                    ]
-                    or qw.q_per_channel_axis() != 0
-                ):
-                    warnings.warn(
-                        "Concat linear fusion for CPU WOQ failed "
-                        "because quantization type of weight is not supported. "
-                        "Falling back to separate linears."
-                    )
-                    weights_list = []
-                    break
-                s = qw.q_per_channel_scales().float()
-                z = qw.q_per_channel_zero_points().float()
-                weights_list.append(qw.dequantize().float())
-                scales_list.append(s)
-                zeros_list.append(z)
-                bias_list.append(linear._op_context.get_bias())
-                w_dtype = linear.dtype
-            if weights_list:
-                concat_weight = torch.concat(weights_list, 0)
-                concat_scales = torch.concat(scales_list, -1)
-                concat_zeros = torch.concat(zeros_list, -1)
-                use_bias = all(bias_list)
-                concat_bias = torch.concat(bias_list, 0) if use_bias else None
-                mod = nn.Linear(
-                    concat_weight.shape[1], concat_weight.shape[0], use_bias
-                )
-                mod.weight = nn.Parameter(concat_weight)
-                mod.bias = nn.Parameter(concat_bias) if use_bias else None
-                mod.qconfig = qconfig
-                mod._num_concats = len(weights_list)
-                if w_dtype == torch.quint4x2:
-                    self.concat_linear = IpexWoqLinear.from_float_and_int4_weight(
-                        mod, concat_weight, concat_scales, concat_zeros
-                    )
-                else:  # qint8
-                    assert w_dtype == torch.qint8
-                    self.concat_linear = IpexWoqLinear.from_float(mod)
-        else:
+        self.qkv_weight = None
+        self.qkv_bias = None
+        if woq and all(isinstance(linear, IpexWoqLinear) for linear in linear_list):
+            self.concat_linear = _concat_woq_linears(linear_list)
+        if self.concat_linear is None:
             for i in range(self.num_concat):
                 attr_name = f"linear_{i}"
                 setattr(self, attr_name, copy.deepcopy(getattr(module, attr_name)))
+            if self.tpp and self.num_concat == 3:
+                self._fuse_qkv_tpp()
+
+    def _fuse_qkv_tpp(self):
+        # Concatenate the blocked q, k and v weights along the output blocks so
+        # that tpp_linear_qkv_rope computes the three projections in one GEMM.
+        # The weights of the linears become views of the fused one.
+        linears = [getattr(self, f"linear_{i}") for i in range(self.num_concat)]
+        weights = [linear.weight for linear in linears]
+        biases = [linear.bias for linear in linears]
+        if (
+            not all(isinstance(w, BlockedParameter) for w in weights)
+            or not all(w.is_blocked() for w in weights)
+            or any(w._data.shape[1:] != weights[0]._data.shape[1:] for w in weights)
+            or any((b is None) != (biases[0] is None) for b in biases)
+        ):
+            return
+        with torch.no_grad():
+            qkv = torch.cat([w._data for w in weights])
+            start = 0
+            for w in weights:
+                end = start + w._data.shape[0]
+                w._data = qkv[start:end]
+                w.data = w._data
+                start = end
+            self.qkv_weight = qkv
+            if biases[0] is not None:
+                self.qkv_bias = torch.cat(biases)
+
+    def forward_rope(
+        self,
+        x: torch.Tensor,
+        rope: nn.Module,
+        position_ids: torch.Tensor,
+        num_head: int,
+        num_kv_head: int,
+        head_dim: int,
+        offset: int,
+        rotary_ndims: int,
+        seq_len: Optional[int] = None,
+        kv_cache_slot: Optional[Tuple[torch.Tensor, torch.Tensor]] = None,
+    ):
+        # The projections with the rotary embedding of query and key in the
+        # epilogue of one GEMM. The key/value are written to kv_cache_slot if
+        # it is given. Return None if the qkv weights are not fused, or a head
+        # does not hold whole output blocks.
+        if (
+            self.qkv_weight is None
+            or head_dim % self.qkv_weight.shape[3] != 0
+            or self.qkv_weight.shape[0] * self.qkv_weight.shape[3]
+            != (num_head + 2 * num_kv_head) * head_dim
+        ):
+            return None
+        x = x.to(self.dtype).contiguous()
+        if kv_cache_slot is not None:
+            key, value = kv_cache_slot
+        else:
+            key = x.new_empty((x.shape[0], x.shape[1], num_kv_head, head_dim))
+            value = torch.empty_like(key)
+        sin_cos, _, _ = rope.embed_positions(seq_len)
+        query = torch.ops.torch_ipex.tpp_linear_qkv_rope(
+            x,
+            self.qkv_weight,
+            self.qkv_bias if self.qkv_bias is not None else x.new_empty(0),
+            sin_cos,
+            position_ids.contiguous(),
+            key,
+            value,
+            num_head,
+            num_kv_head,
+            head_dim,
+            offset,
+            rotary_ndims,
+        )
+        return query, key, value
 
     def forward(self, x):
         if self.concat_linear is not None:
@@ -321,10 +403,61 @@ class _IPEXlinearSiluMulCPU(nn.Module):
         self.linear_s = module_s
         self.linear_m = module_m
         self.dtype = module_s.weight.dtype if self.tpp else None
+        self.gate_up_weight = None
+        self.gate_up_bias = None
+        self.gate_up_linear = None
+        if self.tpp:
+            self._fuse_gate_up_tpp()
+        elif (
+            self.woq
+            and isinstance(module_s, IpexWoqLinear)
+            and isinstance(module_m, IpexWoqLinear)
+        ):
+            self.gate_up_linear = _concat_woq_linears([module_s, module_m])
+            if self.gate_up_linear is not None:
+                # drop the separate linears, so that their weights are freed
+                # with the original module
+                self.linear_s = None
+                self.linear_m = None
+
+    def _fuse_gate_up_tpp(self):
+        # Interleave the blocked gate and up weights along the output blocks so
+        # that tpp_linear_silu_mul computes both projections on the same input
+        # tile. The weights of the two linears become views of the fused one.
+        w_s, w_m = self.linear_s.weight, self.linear_m.weight
+        b_s, b_m = self.linear_s.bias, self.linear_m.bias
+        if (
+            not isinstance(w_s, BlockedParameter)
+            or not isinstance(w_m, BlockedParameter)
+            or not (w_s.is_blocked() and w_m.is_blocked())
+            or w_s.shape != w_m.shape
+            or (b_s is None) != (b_m is None)
+        ):
+            return
+        with torch.no_grad():
+            gate_up = torch.stack([w_s._data, w_m._data], dim=1)
+            for i, w in enumerate([w_s, w_m]):
+                w._data = gate_up[:, i]
+                w.data = w._data
+            self.gate_up_weight = gate_up.view(-1, *gate_up.shape[2:])
+            if b_s is not None:
+                hk = gate_up.shape[3]
+                self.gate_up_bias = torch.stack(
+                    [b_s.view(-1, hk), b_m.view(-1, hk)], dim=1
+                ).view(-1)
 
     def forward(self, x):
         if self.tpp:
             x = x.to(self.dtype).contiguous()
+            if self.gate_up_weight is not None:
+                return torch.ops.torch_ipex.tpp_linear_silu_mul(
+                    x,
+                    self.gate_up_weight,
+                    self.gate_up_bias
+                    if self.gate_up_bias is not None
+                    else x.new_empty(0),
+                    self.linear_s.out_features,
+                )
             x1 = torch.ops.torch_ipex.tpp_linear_silu(
                 x,
                 self.linear_s.weight,
@@ -342,5 +475,10 @@ class _IPEXlinearSiluMulCPU(nn.Module):
                 else x.new_empty(0),
                 self.linear_m.out_features,
             )
+        if self.gate_up_linear is not None:
+            return torch.ops.torch_ipex.woq_linear_silu_mul(
+                x,
+                self.gate_up_linear._op_context.get_data_handle(),
+            )
         else:  # fallback path
             return nn.functional.silu(self.linear_s(x)) * self.linear_m(x)
@@ -42,12 +42,72 @@ class _IPEXRopeCPU(nn.Module):
 
         return x
 
+    def forward_qk(
+        self,
+        query: torch.Tensor,
+        key: torch.Tensor,
+        position_ids: torch.Tensor,
+        num_head: int,
+        num_kv_head: int,
+        head_dim: int,
+        offset: int,
+        rotary_ndims: int,
+        seq_len: Optional[int] = None,
+    ):
+        # rotate query and key in one launch instead of two, reading them
+        # straight from the views of the QKV projection
+        position_ids = position_ids.contiguous()
+        sin_cos, _, _ = self.embed_positions(seq_len)
+        return torch.ops.torch_ipex.rotary_position_embedding_qk(
+            query,
+            key,
+            sin_cos,
+            position_ids,
+            num_head,
+            num_kv_head,
+            head_dim,
+            offset,
+            rotary_ndims,
+        )
+
 
 class _IPEXScaleDotProductCPU(nn.Module):
     def __init__(self, text_max_length):
         super().__init__()
         self.text_max_length = text_max_length
 
+    def kv_cache_slot(
+        self,
+        layer_past: Optional[Tuple[torch.Tensor]],
+        batch: int,
+        seq_len: int,
+        num_kv_head: int,
+        head_dim: int,
+        dtype: torch.dtype,
+    ):
+        # The views [batch, seq_len, num_kv_head, head_dim] of the key/value
+        # cache slot of the next token, which the QKV projection can write to
+        # directly. Only for a decode step within the allocated cache, where
+        # masked_multihead_self_attention finds the key/value in place and does
+        # not store them again. None otherwise.
+        if layer_past is None or seq_len != 1:
+            return None
+        offset = layer_past[0].size(-2)
+        key_cache, value_cache = layer_past[1], layer_past[2]
+        if offset == 0 or offset + seq_len > key_cache.size(0):
+            return None
+        for cache in (key_cache, value_cache):
+            if (
+                cache.dtype != dtype
+                or not cache.is_contiguous()
+                or list(cache.shape[1:]) != [batch, num_kv_head, head_dim]
+            ):
+                return None
+        return tuple(
+            cache[offset : offset + seq_len].transpose(0, 1)
+            for cache in (key_cache, value_cache)
+        )
+
     def forward(
         self,
         query: torch.Tensor,
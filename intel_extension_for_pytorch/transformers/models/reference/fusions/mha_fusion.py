@@ -165,6 +165,26 @@ class _IPEXRopeRef(nn.Module):
             AssertionError(False, "Do not support the optimization of your model yet")
         return x
 
+    def forward_qk(
+        self,
+        query: torch.Tensor,
+        key: torch.Tensor,
+        position_ids: torch.Tensor,
+        num_head: int,
+        num_kv_head: int,
+        head_dim: int,
+        offset: int,
+        rotary_ndims: int,
+        seq_len: Optional[int] = None,
+    ):
+        key = self.forward(
+            key, position_ids, num_kv_head, head_dim, offset, rotary_ndims, seq_len
+        )
+        query = self.forward(
+            query, position_ids, num_head, head_dim, offset, rotary_ndims, seq_len
+        )
+        return query, key
+
 
 class _IPEXScaleDotProductRef(nn.Module):
     def __init__(self, module, config):
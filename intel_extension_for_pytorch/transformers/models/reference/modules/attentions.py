@@ -12,6 +12,46 @@ from ..fusions.linear_fusion import (
 )
 
 
+def _qkv_rope(
+    self,
+    hidden_states,
+    position_ids,
+    layer_past,
+    num_head,
+    num_kv_head,
+    head_dim,
+    offset,
+    rotary_ndims,
+    seq_len=None,
+):
+    # The QKV projection with the rotary embedding in its epilogue, which
+    # writes the key/value of a decode step straight to their kv cache slot.
+    # Only the TPP concat linear of the CPU module has it, None otherwise.
+    forward_rope = getattr(getattr(self, "concat_qkv", None), "forward_rope", None)
+    if forward_rope is None:
+        return None
+    kv_cache_slot = self._IPEXScaleDotProduct.kv_cache_slot(
+        layer_past,
+        hidden_states.size(0),
+        hidden_states.size(1),
+        num_kv_head,
+        head_dim,
+        self.concat_qkv.dtype,
+    )
+    return forward_rope(
+        hidden_states,
+        self._IPEXROPE,
+        position_ids,
+        num_head,
+        num_kv_head,
+        head_dim,
+        offset,
+        rotary_ndims,
+        seq_len,
+        kv_cache_slot,
+    )
+
+
 def _GPTJAttention_forward(
     self,
     hidden_states: torch.FloatTensor,
@@ -25,34 +65,42 @@ def _GPTJAttention_forward(
     Tuple[torch.Tensor, Tuple[torch.Tensor]],
     Optional[Tuple[torch.Tensor, Tuple[torch.Tensor], Tuple[torch.Tensor, ...]]],
 ]:
-    if hasattr(self, "concat_qkv"):
-        query, key, value = self.concat_qkv(hidden_states)
-    else:
-        query = self.q_proj(hidden_states)
-        key = self.k_proj(hidden_states)
-        value = self.v_proj(hidden_states)
-
-    query = self._split_heads(query, self.num_attention_heads, self.head_dim, True)
-    key = self._split_heads(key, self.num_attention_heads, self.head_dim, True)
-
-    key = self._IPEXROPE(
-        key,
-        position_ids.contiguous(),
+    qkv = _qkv_rope(
+        self,
+        hidden_states,
+        position_ids,
+        layer_past if use_cache else None,
         self.num_attention_heads,
-        self.head_dim,
-        1,  # neighbor elements
-        64,
-    )
-    query = self._IPEXROPE(
-        query,
-        position_ids.contiguous(),
         self.num_attention_heads,
         self.head_dim,
-        1,
+        1,  # neighbor elements
         64,
     )
-    if use_cache:
+    if qkv is not None:
+        query, key, value = qkv
+    else:
+        if hasattr(self, "concat_qkv"):
+            query, key, value = self.concat_qkv(hidden_states)
+        else:
+            query = self.q_proj(hidden_states)
+            key = self.k_proj(hidden_states)
+            value = self.v_proj(hidden_states)
+
+        query = self._split_heads(query, self.num_attention_heads, self.head_dim, True)
+        key = self._split_heads(key, self.num_attention_heads, self.head_dim, True)
         value = self._split_heads(value, self.num_attention_heads, self.head_dim, True)
+
+        query, key = self._IPEXROPE.forward_qk(
+            query,
+            key,
+            position_ids.contiguous(),
+            self.num_attention_heads,
+            self.num_attention_heads,
+            self.head_dim,
+            1,  # neighbor elements
+            64,
+        )
+    if use_cache:
         (
             attn_output,
             attn_weights,
@@ -69,7 +117,7 @@ def _GPTJAttention_forward(
     else:
         key = key.permute(0, 2, 1, 3)
         query = query.permute(0, 2, 1, 3)
-        value = self._split_heads(value, self.num_attention_heads, self.head_dim, False)
+        value = value.permute(0, 2, 1, 3)
         present = None
         # compute self-attention: V x Softmax(QK^T)
         attn_output, attn_weights = self._attn(
@@ -112,36 +160,44 @@ def _LlamaAttention_forward(
     use_cache: bool = False,
 ) -> Tuple[torch.Tensor, Optional[torch.Tensor], Optional[Tuple[torch.Tensor]]]:
     bsz, q_len, _ = hidden_states.size()
-    if hasattr(self, "concat_qkv"):
-        query, key, value = self.concat_qkv(hidden_states)
-    else:
-        query = self.q_proj(hidden_states)
-        key = self.k_proj(hidden_states)
-        value = self.v_proj(hidden_states)
-    query = query.view(bsz, q_len, self.num_heads, self.head_dim)
-    key = key.view(bsz, q_len, self.num_key_value_heads, self.head_dim)
-    value = value.view(bsz, q_len, self.num_key_value_heads, self.head_dim)
     kv_seq_len = (
         q_len + past_key_value[0].size(-2) if past_key_value is not None else q_len
     )
-    key = self._IPEXROPE(
-        key,
-        position_ids,
-        self.num_key_value_heads,
-        self.head_dim,
-        self.head_dim // 2,
-        self.head_dim,
-        kv_seq_len,
-    )
-    query = self._IPEXROPE(
-        query,
+    qkv = _qkv_rope(
+        self,
+        hidden_states,
         position_ids,
+        past_key_value if use_cache else None,
         self.num_heads,
+        self.num_key_value_heads,
         self.head_dim,
         self.head_dim // 2,
         self.head_dim,
         kv_seq_len,
     )
+    if qkv is not None:
+        query, key, value = qkv
+    else:
+        if hasattr(self, "concat_qkv"):
+            query, key, value = self.concat_qkv(hidden_states)
+        else:
+            query = self.q_proj(hidden_states)
+            key = self.k_proj(hidden_states)
+            value = self.v_proj(hidden_states)
+        query = query.view(bsz, q_len, self.num_heads, self.head_dim)
+        key = key.view(bsz, q_len, self.num_key_value_heads, self.head_dim)
+        value = value.view(bsz, q_len, self.num_key_value_heads, self.head_dim)
+        query, key = self._IPEXROPE.forward_qk(
+            query,
+            key,
+            position_ids,
+            self.num_heads,
+            self.num_key_value_heads,
+            self.head_dim,
+            self.head_dim // 2,
+            self.head_dim,
+            kv_seq_len,
+        )
 
     if use_cache:
         (attn_output, attn_weights, past_key_value) = self._IPEXScaleDotProduct(
@@ -0,0 +1,94 @@
+import torch
+import intel_extension_for_pytorch as ipex
+from intel_extension_for_pytorch.quantization import prepare, convert
+from intel_extension_for_pytorch.cpu._auto_kernel_selection import (
+    _enable_tpp,
+    _disable_tpp,
+)
+import argparse
+import time
+
+
+def stream_bandwidth(args):
+    # the bandwidth of copying a buffer much larger than the LLC, in GB/s of
+    # the bytes read and written
+    src = torch.ones(args.stream_size_mb * 1024 * 1024 // 4)
+    dst = torch.empty_like(src)
+    for _ in range(args.warmup):
+        dst.copy_(src)
+    start = time.time()
+    for _ in range(args.iters):
+        dst.copy_(src)
+    end = time.time()
+    return 2 * src.nbytes * args.iters / (end - start) / 1e9
+
+
+def create_layers(args):
+    layers = torch.nn.Sequential(
+        *[
+            torch.nn.Linear(args.hidden_size, args.hidden_size, bias=False)
+            for _ in range(args.num_layers)
+        ]
+    ).eval()
+    data = torch.rand(args.batch_size, args.hidden_size)
+    if args.woq:
+        qconfig = ipex.quantization.get_weight_only_quant_qconfig_mapping(
+            weight_dtype=torch.quint4x2 if args.int4 else torch.qint8,
+            lowp_mode=2,
+        )
+        prepared = prepare(layers, qconfig, example_inputs=data, inplace=True)
+        with torch.no_grad():
+            layers = convert(prepared)
+        weight_bytes = sum(layer._op_context.get_weight().nbytes for layer in layers)
+    else:
+        _enable_tpp()
+        layers = ipex.optimize(layers.to(torch.bfloat16), dtype=torch.bfloat16)
+        _disable_tpp()
+        data = data.to(torch.bfloat16)
+        weight_bytes = sum(layer.weight.nbytes for layer in layers)
+    return layers, data, weight_bytes
+
+
+def decode_benchmark(args, layers, data, prefetch):
+    torch.ops.torch_ipex.set_weight_prefetch_enabled(prefetch)
+    with torch.no_grad():
+        # the first step links the weights in the order they run
+        for _ in range(args.warmup):
+            layers(data)
+        start = time.time()
+        for _ in range(args.iters):
+            layers(data)
+        end = time.time()
+    torch.ops.torch_ipex.set_weight_prefetch_enabled(False)
+    return (end - start) / args.iters
+
+
+def run():
+    parser = argparse.ArgumentParser(
+        description="benchmark for the bandwidth of the decode GEMMs with and without cross-layer weight prefetch"
+    )
+    parser.add_argument("--batch-size", type=int, default=1)
+    parser.add_argument("--hidden-size", type=int, default=4096)
+    parser.add_argument("--num-layers", type=int, default=32)
+    parser.add_argument("--woq", action="store_true", default=False)
+    parser.add_argument("--int4", action="store_true", default=False)
+    parser.add_argument("--stream-size-mb", type=int, default=1024)
+    parser.add_argument("--warmup", type=int, default=10)
+    parser.add_argument("--iters", type=int, default=50)
+    args = parser.parse_args()
+
+    peak = stream_bandwidth(args)
+    print("STREAM copy bandwidth: {:.1f} GB/s".format(peak))
+    layers, data, weight_bytes = create_layers(args)
+    for prefetch in [False, True]:
+        latency = decode_benchmark(args, layers, data, prefetch)
+        bandwidth = weight_bytes / latency / 1e9
+        print(
+            "prefetch: {}, latency: {:.3f} ms, weight bandwidth: {:.1f} GB/s ({:.1f}% of STREAM)".format(
+                prefetch, latency * 1000, bandwidth, bandwidth / peak * 100
+            )
+        )
+
+
+if __name__ == "__main__":
+    run()
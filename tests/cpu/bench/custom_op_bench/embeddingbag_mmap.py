@@ -0,0 +1,124 @@
+import torch
+import intel_extension_for_pytorch as ipex
+import argparse
+import os
+import time
+
+r"""
+The lookups per second of the MergedEmbeddingBag over the number of rows of the
+tables mapped from files, e.g., on NVMe, with and without fetching the rows of
+every minibatch ahead of the lookups. Without the fetch, the pooling faults on
+the rows which are not in the memory one by one.
+
+The tables are written to --path in chunks, so that they can be larger than the
+memory. The page cache keeps the rows of the tables smaller than the memory, so
+the tables should be larger than it to see the reads from the file.
+r"""
+
+EmbeddingSpec = ipex.nn.modules.merged_embeddingbag.EmbeddingSpec
+
+
+def write_table(path, num_rows, args):
+    dtype = torch.uint8 if args.dtype == "int8" else getattr(torch, args.dtype)
+    row_size = args.vector_size + 4 if args.dtype == "int8" else args.vector_size
+    table = ipex.nn.modules.load_mmap_embedding_table(path, (num_rows, row_size), dtype)
+    chunk = 1 << 16
+    for begin in range(0, num_rows, chunk):
+        rows = torch.randn(min(chunk, num_rows - begin), args.vector_size)
+        if args.dtype == "int8":
+            rows = ipex.nn.modules.quantize_embedding_rowwise(rows)
+        table[begin : begin + rows.size(0)].copy_(rows)
+    return table
+
+
+def get_module(tables, args):
+    if args.dtype == "int8":
+        return ipex.nn.modules.MergedEmbeddingBagRowwiseQuantized(
+            tables, 8, "sum", False
+        )
+    return ipex.nn.modules.MergedEmbeddingBag(
+        [
+            EmbeddingSpec(t.size(0), t.size(1), "sum", t.dtype, t, False, False)
+            for t in tables
+        ]
+    )
+
+
+def run_bench(bench_name, m, num_rows, args):
+    num_lookups = args.num_tables * args.batch_size * args.pooling_factor
+    offsets = [
+        torch.arange(0, args.batch_size * args.pooling_factor, args.pooling_factor)
+        for _ in range(args.num_tables)
+    ]
+
+    def get_indices():
+        return [
+            torch.randint(0, num_rows, (args.batch_size * args.pooling_factor,))
+            for _ in range(args.num_tables)
+        ]
+
+    with torch.no_grad():
+        for _ in range(args.warmup):
+            m(get_indices(), offsets)
+        inputs = [get_indices() for _ in range(args.iters)]
+        start = time.time()
+        for indices in inputs:
+            m(indices, offsets)
+        end = time.time()
+    print(
+        "{}: {:.2f} M lookups/s".format(
+            bench_name, num_lookups * args.iters / (end - start) / 1e6
+        )
+    )
+
+
+def mmap_bench(args):
+    for num_rows in args.num_rows:
+        tables = [
+            write_table(
+                os.path.join(args.path, "table_{}_{}.bin".format(num_rows, i)),
+                num_rows,
+                args,
+            )
+            for i in range(args.num_tables)
+        ]
+        table_gb = sum(t.numel() * t.element_size() for t in tables) / (1 << 30)
+        name = f"{args.dtype} rows:{num_rows} tables:{table_gb:.1f}GB"
+        m = get_module(tables, args)
+        run_bench(f"mmap {name}", m, num_rows, args)
+        fetcher = m.enable_mmap_fetch(args.max_resident_mb << 20)
+        run_bench(f"mmap with fetch {name}", m, num_rows, args)
+        stats = fetcher.stats()
+        print(
+            "  page hit rate: {:.3f}, fetched: {:.1f} MB, fetch time: {:.2f} s".format(
+                sum(stats["hit_rate"]) / len(stats["hit_rate"]),
+                sum(stats["fetched_bytes"]) / (1 << 20),
+                stats["fetch_time"],
+            )
+        )
+        if args.keep_files:
+            continue
+        del m, tables
+        for i in range(args.num_tables):
+            os.remove(os.path.join(args.path, "table_{}_{}.bin".format(num_rows, i)))
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(
+        description="benchmark for the embedding bags of the tables mapped from files"
+    )
+    parser.add_argument("--path", type=str, default=".")
+    parser.add_argument(
+        "--dtype", type=str, default="float32", choices=["float32", "bfloat16", "int8"]
+    )
+    parser.add_argument("--batch-size", type=int, default=2048)
+    parser.add_argument("--vector-size", type=int, default=128)
+    parser.add_argument("--num-tables", type=int, default=4)
+    parser.add_argument("--pooling-factor", type=int, default=32)
+    parser.add_argument("--num-rows", type=int, nargs="+", default=[1000000, 10000000])
+    parser.add_argument("--max-resident-mb", type=int, default=1024)
+    parser.add_argument("--keep-files", action="store_true")
+    parser.add_argument("--warmup", type=int, default=2)
+    parser.add_argument("--iters", type=int, default=20)
+    args = parser.parse_args()
+    mmap_bench(args)
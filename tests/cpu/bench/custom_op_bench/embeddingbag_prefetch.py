@@ -0,0 +1,119 @@
+import torch
+import intel_extension_for_pytorch as ipex
+import argparse
+import time
+
+r"""
+The lookups per second of the embedding bags over the number of rows of the
+tables and the pooling factor (the lookups per bag). The indices are uniform
+over the rows, so the lookups of a table far larger than the LLC miss the
+caches, which is what the lookahead prefetch of the rows hides.
+
+Run it with IPEX_EMBEDDINGBAG_PREFETCH_DISTANCE=0 to disable the prefetch, or
+with another distance to tune it, the distance is picked from the size of the
+rows and of the table otherwise.
+r"""
+
+
+def get_data(args, num_rows, pooling_factor):
+    indices = [
+        torch.randint(0, num_rows, (args.batch_size * pooling_factor,))
+        for _ in range(args.num_tables)
+    ]
+    offsets = [
+        torch.arange(0, args.batch_size * pooling_factor, pooling_factor)
+        for _ in range(args.num_tables)
+    ]
+    return indices, offsets
+
+
+def run_bench(bench_name, fn, num_lookups, args):
+    for _ in range(args.warmup):
+        fn()
+    start = time.time()
+    for _ in range(args.iters):
+        fn()
+    end = time.time()
+    print(
+        "{}: {:.2f} M lookups/s".format(
+            bench_name, num_lookups * args.iters / (end - start) / 1e6
+        )
+    )
+
+
+def prefetch_bench(args):
+    for num_rows in args.num_rows:
+        emblist = torch.nn.ModuleList(
+            [
+                torch.nn.EmbeddingBag(num_rows, args.vector_size, mode="sum")
+                for _ in range(args.num_tables)
+            ]
+        )
+        merged_emb = ipex.nn.modules.MergedEmbeddingBag.from_embeddingbag_list(emblist)
+        qweights = [
+            torch.quantize_per_tensor(emb.weight.detach(), 0.05, 0, torch.qint8)
+            for emb in emblist
+        ]
+        qdense = torch.quantize_per_tensor(
+            torch.randn(args.batch_size, args.vector_size), 0.05, 0, torch.qint8
+        )
+        rowwise_emb = (
+            ipex.nn.modules.MergedEmbeddingBagRowwiseQuantized.from_embeddingbag_list(
+                emblist
+            )
+        )
+        for pooling_factor in args.pooling_factors:
+            indices, offsets = get_data(args, num_rows, pooling_factor)
+            num_lookups = args.num_tables * args.batch_size * pooling_factor
+            name = f"rows:{num_rows} pooling_factor:{pooling_factor}"
+            with torch.no_grad():
+                run_bench(
+                    f"EmbeddingBag {name}",
+                    lambda: [
+                        torch.ops.torch_ipex.embedding_bag(
+                            emb.weight, indices[i], offsets[i], False, False
+                        )
+                        for i, emb in enumerate(emblist)
+                    ],
+                    num_lookups,
+                    args,
+                )
+                run_bench(
+                    f"MergedEmbeddingBag {name}",
+                    lambda: merged_emb(indices, offsets),
+                    num_lookups,
+                    args,
+                )
+                run_bench(
+                    f"MergedEmbeddingBagRowwiseQuantized {name}",
+                    lambda: rowwise_emb(indices, offsets),
+                    num_lookups,
+                    args,
+                )
+                run_bench(
+                    f"MergedEmbeddingBagWithCat int8 {name}",
+                    lambda: torch.ops.ipex.qmerged_embeddingbag_cat(
+                        qweights, indices, offsets, qdense, 0.1, 0, torch.qint8
+                    ),
+                    num_lookups,
+                    args,
+                )
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(
+        description="benchmark for the prefetch of the embedding bags"
+    )
+    parser.add_argument("--batch-size", type=int, default=2048)
+    parser.add_argument("--vector-size", type=int, default=128)
+    parser.add_argument("--num-tables", type=int, default=4)
+    parser.add_argument(
+        "--num-rows", type=int, nargs="+", default=[1000, 100000, 1000000]
+    )
+    parser.add_argument(
+        "--pooling-factors", type=int, nargs="+", default=[1, 8, 32, 100]
+    )
+    parser.add_argument("--warmup", type=int, default=10)
+    parser.add_argument("--iters", type=int, default=100)
+    args = parser.parse_args()
+    prefetch_bench(args)
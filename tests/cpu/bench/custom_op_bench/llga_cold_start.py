@@ -0,0 +1,80 @@
+import argparse
+import os
+import subprocess
+import sys
+import tempfile
+import time
+
+
+def serve(args):
+    import torch
+    import torch.nn as nn
+    import intel_extension_for_pytorch as ipex
+
+    if args.cache_dir:
+        ipex._C._jit_set_llga_persistent_cache_dir(args.cache_dir)
+    torch._C._jit_set_profiling_mode(True)
+    torch._C._jit_set_profiling_executor(True)
+    ipex._C.set_llga_fp32_bf16_enabled(True)
+
+    layers = []
+    channels = 3
+    for _ in range(args.num_layers):
+        layers += [nn.Conv2d(channels, 64, 3, padding=1), nn.ReLU()]
+        channels = 64
+    model = nn.Sequential(*layers).eval()
+    start = time.time()
+    with torch.no_grad():
+        traced = torch.jit.freeze(
+            torch.jit.trace(model, torch.rand(args.batch_sizes[0], 3, 56, 56))
+        )
+        # the profiling runs of the JIT executor
+        for _ in range(2):
+            traced(torch.rand(args.batch_sizes[0], 3, 56, 56))
+        first_request = None
+        for bs in args.batch_sizes:
+            traced(torch.rand(bs, 3, 56, 56))
+            if first_request is None:
+                first_request = time.time() - start
+        total = time.time() - start
+    print("{:.3f} {:.3f}".format(first_request, total))
+
+
+def cold_start(args, cache_dir):
+    cmd = [sys.executable, os.path.abspath(__file__), "--serve"]
+    cmd += ["--num-layers", str(args.num_layers), "--batch-sizes"]
+    cmd += [str(bs) for bs in args.batch_sizes]
+    if cache_dir:
+        cmd += ["--cache-dir", cache_dir]
+    output = subprocess.check_output(cmd).decode().split()
+    return float(output[-2]), float(output[-1])
+
+
+def run():
+    parser = argparse.ArgumentParser(
+        description="benchmark for the cold start of the oneDNN Graph fuser"
+    )
+    parser.add_argument("--num-layers", type=int, default=16)
+    parser.add_argument("--batch-sizes", type=int, nargs="+", default=[1, 2, 4, 8])
+    parser.add_argument("--cache-dir", type=str, default="")
+    parser.add_argument("--serve", action="store_true", default=False)
+    args = parser.parse_args()
+    if args.serve:
+        serve(args)
+        return
+    with tempfile.TemporaryDirectory() as cache_dir:
+        for name, path in [
+            ("without cache", ""),
+            ("populate cache", cache_dir),
+            ("with cache", cache_dir),
+        ]:
+            first_request, total = cold_start(args, path)
+            print(
+                "{}: first request {:.3f} s, all requests {:.3f} s".format(
+                    name, first_request, total
+                )
+            )
+
+
+if __name__ == "__main__":
+    run()
@@ -0,0 +1,81 @@
+import torch
+import intel_extension_for_pytorch as ipex  # noqa F401
+import argparse
+import time
+
+
+def decode_benchmark(args, context_len, num_threads, dtype):
+    torch.set_num_threads(num_threads)
+    bs = args.batch_size
+    head_num = args.head_num
+    head_num_kv = args.head_num_kv
+    head_size = args.head_size
+    offset = context_len - 1
+    key_cache = torch.randn(context_len, bs, head_num_kv, head_size).to(dtype)
+    value_cache = torch.randn(context_len, bs, head_num_kv, head_size).to(dtype)
+    beam_idx = torch.arange(bs).repeat(context_len, 1)
+    query = torch.randn(bs, 1, head_num, head_size).to(dtype)
+    key = torch.randn(bs, 1, head_num_kv, head_size).to(dtype)
+    value = torch.randn(bs, 1, head_num_kv, head_size).to(dtype)
+    attention_mask = torch.zeros(bs, 1, 1, context_len).to(dtype)
+    seq_info = torch.tensor(offset)
+
+    def step():
+        return torch.ops.torch_ipex.masked_multihead_self_attention(
+            query,
+            key,
+            value,
+            key_cache,
+            value_cache,
+            beam_idx,
+            seq_info,
+            head_size**0.5,
+            context_len,
+            None,
+            attention_mask,
+        )
+
+    with torch.no_grad():
+        for _ in range(args.warmup):
+            step()
+        start = time.time()
+        for _ in range(args.iters):
+            step()
+        end = time.time()
+    return (end - start) / args.iters * 1000
+
+
+def run():
+    parser = argparse.ArgumentParser(
+        description="benchmark for the next token of ipex masked multihead attention"
+    )
+    parser.add_argument("--batch-size", type=int, default=1)
+    parser.add_argument("--head-num", type=int, default=32)
+    parser.add_argument("--head-num-kv", type=int, default=32)
+    parser.add_argument("--head-size", type=int, default=128)
+    parser.add_argument(
+        "--context-len", type=int, nargs="+", default=[1024, 4096, 8192, 16384]
+    )
+    parser.add_argument("--num-threads", type=int, nargs="+", default=None)
+    parser.add_argument("--bf16", action="store_true", default=False)
+    parser.add_argument("--warmup", type=int, default=10)
+    parser.add_argument("--iters", type=int, default=100)
+    args = parser.parse_args()
+    dtype = torch.bfloat16 if args.bf16 else torch.float32
+    num_threads = args.num_threads
+    if num_threads is None:
+        max_threads = torch.get_num_threads()
+        num_threads = [t for t in [1, 2, 4, 8, 16, 28, 56] if t < max_threads]
+        num_threads.append(max_threads)
+    for context_len in args.context_len:
+        for threads in num_threads:
+            latency = decode_benchmark(args, context_len, threads, dtype)
+            print(
+                "context_len: {}, threads: {}, latency: {:.3f} ms".format(
+                    context_len, threads, latency
+                )
+            )
+
+
+if __name__ == "__main__":
+    run()
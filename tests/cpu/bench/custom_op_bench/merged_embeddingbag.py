@@ -86,6 +86,21 @@ class MergedEmb(torch.nn.Module):
         return self.merged_emb(indices, offsets)
 
 
+class QMergedEmbCatDense(torch.nn.Module):
+    def __init__(self, emblist, w_scale=0.05, o_scale=0.1):
+        super(QMergedEmbCatDense, self).__init__()
+        self.qweights = [
+            torch.quantize_per_tensor(emb.weight.detach(), w_scale, 0, torch.qint8)
+            for emb in emblist.list
+        ]
+        self.o_scale = o_scale
+
+    def forward(self, indices, offsets, qdense):
+        return torch.ops.ipex.qmerged_embeddingbag_cat(
+            self.qweights, indices, offsets, qdense, self.o_scale, 0, torch.qint8
+        )
+
+
 class MergedEmbSGD(torch.nn.Module):
     def __init__(self, emblist, lr=0.01, weight_decay=0):
         super(MergedEmbSGD, self).__init__()
@@ -190,6 +205,34 @@ def merged_emb_cat_bench(args, input):
             )
 
 
+def vector_size_bench(args, input):
+    # the kernels specialized for the common vector sizes, and the runtime
+    # vector size one for the others (e.g., 100)
+    assert args.inference
+    indices, offsets = input
+    for vector_size in args.vector_sizes:
+        for dtype in [torch.float32, torch.bfloat16, torch.float16]:
+            for mode in ["sum", "mean"]:
+                emblist = EmbeddingBagList(NUM_TABLE, vector_size, dtype, mode=mode)
+                m = MergedEmb(emblist)
+                with torch.no_grad():
+                    run_bench(
+                        f"MergedEmbeddingBag: vector_size:{vector_size} value_dtype:{dtype} mode:{mode}",
+                        m,
+                        input,
+                    )
+        emblist = EmbeddingBagList(NUM_TABLE, vector_size, torch.float32)
+        m = QMergedEmbCatDense(emblist)
+        dense = torch.randn(args.batch_size, vector_size)
+        qdense = torch.quantize_per_tensor(dense, 0.05, 0, torch.qint8)
+        with torch.no_grad():
+            run_bench(
+                f"MergedEmbeddingBagWithCat: vector_size:{vector_size} value_dtype:torch.qint8",
+                m,
+                (indices, offsets, qdense),
+            )
+
+
 def merged_emb_with_sgd(args, input):
     for dtype in [torch.float32, torch.bfloat16]:
         if dtype == torch.bfloat16:
@@ -272,6 +315,24 @@ def merged_emb_with_adagrad(args, input):
             )
 
 
+def scaling_bench(args, input):
+    # the backward aggregates the grads of a row once, so the time of the
+    # fused update should keep dropping as the number of threads rises
+    emblist = EmbeddingBagList(NUM_TABLE, args.vector_size, torch.float32)
+    if args.optimizer == "sgd":
+        m = MergedEmbSGD(emblist, lr=0.1)
+    else:
+        m = MergedEmbAdaGrad(emblist, lr=0.1)
+    for num_threads in args.num_threads:
+        torch.set_num_threads(num_threads)
+        run_bench(
+            f"Merged EmbedddingBag Training with {args.optimizer}: threads:{num_threads}",
+            m,
+            input,
+            training=True,
+        )
+
+
 def get_data(batch_size):
     indices = []
     offsets = []
@@ -328,6 +389,8 @@ def run():
     parser.add_argument("--batch-size", type=int, default=7168)
     parser.add_argument("--vector-size", type=int, default=128)
     parser.add_argument("--with-cat", action="store_true", default=False)
+    parser.add_argument("--vector-sizes", type=int, nargs="+", default=None)
+    parser.add_argument("--num-threads", type=int, nargs="+", default=None)
     parser.add_argument(
         "--optimizer",
         type=str,
@@ -341,6 +404,15 @@ def run():
         merged_emb_cat_bench(args, input_data)
         exit()
 
+    if args.vector_sizes:
+        vector_size_bench(args, input_data)
+        exit()
+
+    if args.num_threads:
+        assert not args.inference
+        scaling_bench(args, input_data)
+        exit()
+
     if args.optimizer == "sgd":
         merged_emb_with_sgd(args, input_data)
     else:
@@ -430,3 +430,87 @@ TEST(TestRuntimeTaskAPI, TestTaskAPISameTasksMultiTensorInputs) {
   ASSERT_VARIABLE_EQ(res, res_ref);
   ASSERT_VARIABLE_EQ(res2, res_ref2);
 }
+
+TEST(TestRuntimeTaskAPI, TestTaskAPIMultiGroupTaskExecutor) {
+  if (!torch_ipex::runtime::is_runtime_ext_enabled()) {
+    GTEST_SKIP()
+        << "Skip TestRuntimeTaskAPI::TestTaskAPIMultiGroupTaskExecutor. Didn't preload IOMP.";
+  }
+  std::vector<torch_ipex::runtime::CPUPool> cpu_pools;
+  cpu_pools.emplace_back(std::vector<int32_t>({0}));
+  cpu_pools.emplace_back(std::vector<int32_t>({1}));
+  std::shared_ptr<torch_ipex::runtime::TaskExecutor> task_executor =
+      std::make_shared<torch_ipex::runtime::TaskExecutor>(cpu_pools);
+  ASSERT_EQ(task_executor->get_num_groups(), 2);
+
+  std::vector<at::Tensor> input_tensors;
+  std::vector<at::Tensor> res_refs;
+  for (int i = 0; i < 16; i++) {
+    input_tensors.emplace_back(at::rand({100, 8276}));
+    res_refs.emplace_back(at::softmax(input_tensors.back(), -1));
+  }
+  // Submit the tasks one by one to the groups in round-robin order
+  torch_ipex::runtime::
+      Task<at::Tensor (*)(const at::Tensor&), const at::Tensor&>
+          task(taskfunction_const_lvalue_reference, task_executor);
+  std::vector<std::future<at::Tensor>> res_futures;
+  for (auto& input_tensor : input_tensors) {
+    res_futures.emplace_back(task(input_tensor));
+  }
+  for (int i = 0; i < 16; i++) {
+    ASSERT_VARIABLE_EQ(res_futures[i].get(), res_refs[i]);
+  }
+
+  // Submit the tasks in one batch
+  std::vector<at::Tensor> res(16);
+  std::vector<std::function<void()>> tasks;
+  std::atomic<int> finished_tasks{0};
+  for (int i = 0; i < 16; i++) {
+    tasks.emplace_back([&, i]() {
+      res[i] = at::softmax(input_tensors[i], -1);
+      finished_tasks++;
+    });
+  }
+  task_executor->submit(std::move(tasks));
+  while (finished_tasks < 16) {
+    std::this_thread::yield();
+  }
+  for (int i = 0; i < 16; i++) {
+    ASSERT_VARIABLE_EQ(res[i], res_refs[i]);
+  }
+}
+
+TEST(TestRuntimeTaskAPI, TestTaskAPITaskExecutorWorkStealing) {
+  if (!torch_ipex::runtime::is_runtime_ext_enabled()) {
+    GTEST_SKIP()
+        << "Skip TestRuntimeTaskAPI::TestTaskAPITaskExecutorWorkStealing. Didn't preload IOMP.";
+  }
+  std::vector<torch_ipex::runtime::CPUPool> cpu_pools;
+  cpu_pools.emplace_back(std::vector<int32_t>({0}));
+  cpu_pools.emplace_back(std::vector<int32_t>({1}));
+  std::shared_ptr<torch_ipex::runtime::TaskExecutor> task_executor =
+      std::make_shared<torch_ipex::runtime::TaskExecutor>(cpu_pools);
+  if (task_executor->get_numa_node(0) != task_executor->get_numa_node(1)) {
+    GTEST_SKIP()
+        << "Skip TestRuntimeTaskAPI::TestTaskAPITaskExecutorWorkStealing. Core 0 and 1 are on different NUMA nodes.";
+  }
+  // Block the worker of group 0, the tasks submitted to group 0 are stolen
+  // and run by group 1.
+  std::promise<void> blocker;
+  auto blocker_future = blocker.get_future().share();
+  task_executor->submit(0, [blocker_future]() { blocker_future.wait(); });
+
+  at::Tensor input_tensor = at::rand({100, 8276});
+  auto res_ref = at::softmax(input_tensor, -1);
+  at::Tensor res;
+  std::promise<void> finished;
+  auto finished_future = finished.get_future();
+  task_executor->submit(0, [&]() {
+    res = at::softmax(input_tensor, -1);
+    finished.set_value();
+  });
+  auto status = finished_future.wait_for(std::chrono::seconds(60));
+  blocker.set_value();
+  ASSERT_EQ(status, std::future_status::ready);
+  ASSERT_VARIABLE_EQ(res, res_ref);
+}
@@ -324,7 +324,8 @@ class TestIpexOps(JitLlgaTestCase):
             return fake_quant(expect, o_scale, 0)
 
         with torch.no_grad():
-            for emb_dim in [128, 129]:  # fast path for 128 and general path for 129
+            # specialized kernels for 64, 128 and 512, runtime emb_dim one for 129
+            for emb_dim in [64, 128, 129, 512]:
                 NUM_TABLE = 5
                 BATCH_SIZE = 16
                 input, offsets, dense = get_input(emb_dim, NUM_TABLE, BATCH_SIZE)
@@ -263,10 +263,12 @@ class OptimizeTransformersTester(TestCase):
                     model.model.layers[0].self_attn.concat_qkv.concat_linear,
                     model.model.layers[0].mha_linear_add.linear,
                     model.model.layers[0].mlp_linear_add.linear,
-                    model.model.layers[0].linear_silu_mul.linear_s,
-                    model.model.layers[0].linear_silu_mul.linear_m,
+                    model.model.layers[0].linear_silu_mul.gate_up_linear,
                 ]
             )
+            # the gate and up linears are only kept in their concat
+            assert model.model.layers[0].linear_silu_mul.linear_s is None
+            assert model.model.layers[0].linear_silu_mul.linear_m is None
         # Ensure model can run without errors
         with torch.no_grad():
             example_inputs = _get_gptj_example_inputs()
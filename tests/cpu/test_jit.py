@@ -3870,6 +3870,41 @@ class Tester(TestCase):
                 eager_y = m(x2)
                 self.assertEqual(eager_y, traced_y)
 
+    def test_conv_primitive_cache_dynamic_shape(self):
+        capacity = core._get_conv_primitive_cache_capacity()
+        x1 = torch.randn(1, 64, 56, 56).to(memory_format=torch.channels_last)
+        # more shapes than the capacity, and every shape runs twice
+        shapes = [(2, 64, 56, 56), (1, 64, 28, 28), (1, 64, 40, 32)] * 2
+        models = [
+            Bottleneck_v1().eval(),
+            Bottleneck_v2().eval(),
+            ConvSum(2, 64, 32, kernel_size=3, stride=1).eval(),
+        ]
+        try:
+            for cache_capacity in [0, 2]:
+                core._set_conv_primitive_cache_capacity(cache_capacity)
+                self.assertEqual(
+                    core._get_conv_primitive_cache_capacity(), cache_capacity
+                )
+                for m in models:
+                    with torch.no_grad():
+                        ipex_m = ipex.optimize(m, dtype=torch.float32, level="O1")
+                        traced = torch.jit.trace(ipex_m, x1.clone())
+                        traced = torch.jit.freeze(traced)
+                        # apply fusion
+                        traced(x1.clone())
+                        traced(x1.clone())
+                        for shape in shapes:
+                            x = torch.randn(shape)
+                            x = x.to(memory_format=torch.channels_last)
+                            traced_y = traced(x.clone())
+                            eager_y = m(x.clone())
+                            self.assertEqual(eager_y, traced_y, prec=1e-4)
+        finally:
+            core._set_conv_primitive_cache_capacity(capacity)
+        with self.assertRaises(RuntimeError):
+            core._set_conv_primitive_cache_capacity(-1)
+
     def test_jit_conv_sum_in_diff_block(self):
         batch_size = 8
         out_channels = 32
@@ -1,5 +1,7 @@
 import os
 import subprocess
+import tempfile
+import threading
 import unittest
 import itertools
 import torch
@@ -1016,6 +1018,196 @@ class TestAPI(JitLlgaTestCase):
         # set the value back to the default one
         ipex._C._jit_set_llga_weight_cache_enabled(weight_cache_enabled_default_value)
 
+    @llga_fp32_bf16_test_env
+    def test_compiled_partition_cache_api(self):
+        m = nn.Sequential(nn.Conv2d(3, 8, 3), nn.ReLU())
+        x = torch.rand(1, 3, 16, 16)
+        ipex._C._jit_clear_llga_compiled_partition_cache()
+        ipex._C._jit_reset_llga_compiled_partition_cache_stats()
+        graph, traced = self.checkTrace(m, [x])
+        self.assertGraphContainsExactly(graph, LLGA_FUSION_GROUP, 1)
+        misses = ipex._C._jit_llga_compiled_partition_cache_stats()["misses"]
+        self.assertGreater(misses, 0)
+
+        # the partitions compiled by the main thread are shared by the others
+        num_threads = torch.get_num_threads()
+        num_runs = 3
+
+        def run():
+            torch.set_num_threads(num_threads)
+            with torch.no_grad():
+                for _ in range(num_runs):
+                    traced(x)
+
+        ipex._C._jit_reset_llga_compiled_partition_cache_stats()
+        threads = [threading.Thread(target=run) for _ in range(4)]
+        for t in threads:
+            t.start()
+        for t in threads:
+            t.join()
+        stats = ipex._C._jit_llga_compiled_partition_cache_stats()
+        self.assertEqual(stats["misses"], 0)
+        self.assertEqual(stats["hits"], len(threads) * num_runs)
+        self.assertEqual(stats["evictions"], 0)
+
+        capacity = ipex._C._jit_llga_compiled_partition_cache_capacity()
+        ipex._C._jit_set_llga_compiled_partition_cache_capacity(1024)
+        self.assertEqual(ipex._C._jit_llga_compiled_partition_cache_capacity(), 1024)
+        ipex._C._jit_set_llga_compiled_partition_cache_capacity(capacity)
+
+    @llga_fp32_bf16_test_env
+    def test_persistent_cache_dir(self):
+        with tempfile.TemporaryDirectory() as cache_dir:
+            ipex._C._jit_set_llga_persistent_cache_dir(cache_dir)
+            self.assertEqual(ipex._C._jit_llga_persistent_cache_dir(), cache_dir)
+            try:
+                m = nn.Sequential(nn.Conv2d(3, 8, 3), nn.ReLU())
+                x = torch.rand(1, 3, 16, 16)
+                graph, _ = self.checkTrace(m, [x])
+                self.assertGraphContainsExactly(graph, LLGA_FUSION_GROUP, 1)
+                records = [
+                    f for f in os.listdir(cache_dir) if f.startswith("llga_partition_")
+                ]
+                self.assertEqual(len(records), 1)
+                with open(os.path.join(cache_dir, records[0])) as f:
+                    self.assertGreaterEqual(len(f.readlines()), 1)
+            finally:
+                ipex._C._jit_set_llga_persistent_cache_dir("")
+
+    @llga_fp32_bf16_test_env
+    def test_persistent_cache_warmup(self):
+        m = nn.Sequential(nn.Linear(16, 32), nn.ReLU())
+        seq_lens = [5, 12, 3]
+
+        def record_lines(cache_dir):
+            records = [
+                f for f in os.listdir(cache_dir) if f.startswith("llga_partition_")
+            ]
+            self.assertEqual(len(records), 1)
+            with open(os.path.join(cache_dir, records[0])) as f:
+                return f.readlines()
+
+        with tempfile.TemporaryDirectory() as cache_dir:
+            ipex._C._jit_set_llga_persistent_cache_dir(cache_dir)
+            ipex._C._jit_set_llga_shape_bucketing(True, dim=1)
+            try:
+                # record the buckets of 8, 16 and 4
+                _, traced = self.checkTrace(m, [torch.rand(2, seq_lens[0], 16)])
+                with torch.no_grad():
+                    for seq_len in seq_lens:
+                        traced(torch.rand(2, seq_len, 16))
+                lines = record_lines(cache_dir)
+                self.assertEqual(len(lines), len(seq_lens))
+
+                # A new kernel of the same graph, as in a restarted process,
+                # compiles the recorded shapes in the background as soon as it
+                # is created, and the runs on them compile nothing.
+                ipex._C._jit_clear_llga_compiled_partition_cache()
+                _, traced = self.checkTrace(m, [torch.rand(2, seq_lens[0], 16)])
+                ipex._C._jit_wait_llga_persistent_cache_warmup()
+                ipex._C._jit_reset_llga_compiled_partition_cache_stats()
+                with torch.no_grad():
+                    for seq_len in seq_lens:
+                        x = torch.rand(2, seq_len, 16)
+                        self.assertEqual(traced(x), m(x))
+                stats = ipex._C._jit_llga_compiled_partition_cache_stats()
+                self.assertEqual(stats["misses"], 0)
+                self.assertEqual(stats["hits"], len(seq_lens))
+
+                # the known shapes are not recorded again
+                self.assertEqual(record_lines(cache_dir), lines)
+            finally:
+                ipex._C._jit_set_llga_shape_bucketing(False)
+                ipex._C._jit_set_llga_persistent_cache_dir("")
+
+    @llga_fp32_bf16_test_env
+    def test_shape_bucketing(self):
+        m = nn.Sequential(nn.Linear(16, 32), nn.ReLU())
+        ipex._C._jit_set_llga_shape_bucketing(True, dim=1)
+        bucketing = ipex._C._jit_llga_shape_bucketing()
+        self.assertTrue(bucketing["enabled"])
+        self.assertEqual(bucketing["dim"], 1)
+        self.assertEqual(bucketing["boundaries"], [])
+        try:
+            graph, traced = self.checkTrace(m, [torch.rand(2, 5, 16)])
+            self.assertGraphContainsExactly(graph, LLGA_FUSION_GROUP, 1)
+
+            # the sequence lengths from 5 to 8 share the bucket of 8
+            ipex._C._jit_clear_llga_compiled_partition_cache()
+            ipex._C._jit_reset_llga_compiled_partition_cache_stats()
+            with torch.no_grad():
+                for seq_len in range(5, 9):
+                    x = torch.rand(2, seq_len, 16)
+                    y = traced(x)
+                    self.assertEqual(y.size(), (2, seq_len, 32))
+                    self.assertEqual(y, m(x))
+            stats = ipex._C._jit_llga_compiled_partition_cache_stats()
+            self.assertEqual(stats["misses"], 1)
+            self.assertEqual(stats["hits"], 3)
+
+            # the non-contiguous inputs are not padded, and do not hit the
+            # partitions compiled for the contiguous ones
+            ipex._C._jit_reset_llga_compiled_partition_cache_stats()
+            with torch.no_grad():
+                for seq_len in [6, 8]:
+                    x = torch.rand(2, 16, seq_len).transpose(1, 2)
+                    self.assertEqual(traced(x), m(x))
+            stats = ipex._C._jit_llga_compiled_partition_cache_stats()
+            self.assertEqual(stats["misses"], 2)
+
+            # the sizes beyond the last boundary are not padded
+            ipex._C._jit_set_llga_shape_bucketing(True, dim=1, boundaries=[4, 8])
+            graph, traced = self.checkTrace(m, [torch.rand(2, 3, 16)])
+            ipex._C._jit_reset_llga_compiled_partition_cache_stats()
+            with torch.no_grad():
+                for seq_len in [3, 4, 9, 10]:
+                    x = torch.rand(2, seq_len, 16)
+                    self.assertEqual(traced(x), m(x))
+            stats = ipex._C._jit_llga_compiled_partition_cache_stats()
+            self.assertEqual(stats["misses"], 2)
+        finally:
+            ipex._C._jit_set_llga_shape_bucketing(False)
+
+    @llga_fp32_bf16_test_env
+    def test_shape_bucketing_attention(self):
+        class Attention(nn.Module):
+            def forward(self, q, k, v, mask):
+                # [batch, seq, heads, head_size] -> [batch, heads, seq, head_size]
+                q = q.permute(0, 2, 1, 3)
+                k = k.permute(0, 2, 3, 1)
+                v = v.permute(0, 2, 1, 3)
+                scores = torch.matmul(q, k) / 4.0
+                probs = torch.softmax(scores + mask, dim=-1)
+                return torch.matmul(probs, v).permute(0, 2, 1, 3)
+
+        def inputs(seq_len):
+            q, k, v = (torch.rand(2, seq_len, 4, 16) for _ in range(3))
+            # the last key of the first sample is masked out
+            mask = torch.zeros(2, 1, 1, seq_len)
+            mask[0, :, :, -1] = torch.finfo(torch.float).min
+            return q, k, v, mask
+
+        m = Attention()
+        ipex._C._jit_set_llga_shape_bucketing(True, dim=1)
+        try:
+            _, traced = self.checkTrace(m, inputs(5))
+            # The padded keys are masked out of the softmax and the padded
+            # values are zeros, so the sequence lengths from 5 to 8 share the
+            # partitions compiled for the bucket of 8.
+            ipex._C._jit_clear_llga_compiled_partition_cache()
+            with torch.no_grad():
+                traced(*inputs(5))
+                ipex._C._jit_reset_llga_compiled_partition_cache_stats()
+                for seq_len in range(5, 9):
+                    x = inputs(seq_len)
+                    y = traced(*x)
+                    self.assertEqual(y.size(), (2, seq_len, 4, 16))
+                    self.assertEqual(y, m(*x))
+            stats = ipex._C._jit_llga_compiled_partition_cache_stats()
+            self.assertEqual(stats["misses"], 0)
+        finally:
+            ipex._C._jit_set_llga_shape_bucketing(False)
+
 
 class TestDebugLog(JitLlgaTestCase):
     def test_fusion_group_name(self):
@@ -126,6 +126,11 @@ class MaskedMHA(torch.nn.Module):
             return attention_output, None, key_cache, value_cache, None
 
 
+def paged_kv_cache_used_blocks(block_table):
+    # the blocks shared by several rows are counted once
+    return block_table[block_table >= 0].unique().numel()
+
+
 class MaskedMHATest(TestCase):
     def _test_mha(self, torchcompile=False):
         beam_size_list = [1, 4]
@@ -774,6 +779,526 @@ class MaskedMHATest(TestCase):
                             value_cache_iakv_half[offset, :, :, :],
                         )
 
+    def test_paged_mha(self):
+        head_size = 64
+        head_num = 16
+        head_num_kv = 4
+        first_seq_len = 20
+        block_size = 16
+        max_blocks_per_seq = 4
+        for batch_size in [1, 2]:
+            for beam_size in [1, 4]:
+                for dtype in [torch.float32, torch.bfloat16]:
+                    beam_batch = batch_size * beam_size
+                    num_blocks = beam_batch * max_blocks_per_seq
+                    key_pool = torch.zeros(
+                        num_blocks, block_size, head_num_kv, head_size, dtype=dtype
+                    )
+                    value_pool = torch.zeros_like(key_pool)
+                    block_table = torch.full(
+                        (beam_batch, max_blocks_per_seq), -1, dtype=torch.long
+                    )
+                    free_blocks = torch.ops.torch_ipex.paged_kv_cache_init_free_blocks(
+                        num_blocks
+                    )
+                    key_cache = torch.zeros(1, 1, 1, 1, dtype=dtype)
+                    value_cache = torch.zeros(1, 1, 1, 1, dtype=dtype)
+                    beam_idx = torch.zeros(1, beam_batch, dtype=torch.long)
+                    paged_beam_idx = beam_idx.clone()
+                    offset = 0
+                    cur_bs = batch_size
+                    cur_len = first_seq_len
+                    for step in range(block_size + 2):
+                        query = torch.randn(
+                            cur_bs, cur_len, head_num, head_size, dtype=dtype
+                        )
+                        key = torch.randn(
+                            cur_bs, cur_len, head_num_kv, head_size, dtype=dtype
+                        )
+                        value = torch.randn(
+                            cur_bs, cur_len, head_num_kv, head_size, dtype=dtype
+                        )
+                        attention_mask = torch.zeros(
+                            cur_bs, 1, cur_len, offset + cur_len, dtype=dtype
+                        )
+                        (
+                            output,
+                            _,
+                            key_cache,
+                            value_cache,
+                            beam_idx,
+                        ) = torch.ops.torch_ipex.masked_multihead_self_attention(
+                            query,
+                            key,
+                            value,
+                            key_cache,
+                            value_cache,
+                            beam_idx,
+                            torch.tensor(offset),
+                            head_size**0.5,
+                            first_seq_len,
+                            None,
+                            attention_mask,
+                        )
+                        (
+                            paged_output,
+                            _,
+                            key_pool,
+                            value_pool,
+                            paged_beam_idx,
+                        ) = torch.ops.torch_ipex.paged_masked_multihead_self_attention(
+                            query,
+                            key,
+                            value,
+                            key_pool,
+                            value_pool,
+                            block_table,
+                            free_blocks,
+                            paged_beam_idx,
+                            torch.tensor(offset),
+                            head_size**0.5,
+                            None,
+                            attention_mask,
+                        )
+                        self.assertEqual(output, paged_output)
+                        offset = offset + cur_len
+                        # the cache grows by blocks without any copy
+                        used_blocks = paged_kv_cache_used_blocks(block_table)
+                        self.assertEqual(
+                            used_blocks + free_blocks[0].item(), num_blocks
+                        )
+                        beam_idx_t = torch.arange(beam_batch)
+                        if beam_size == 4:
+                            beam_idx_t = torch.tensor([1, 3, 0, 0]).repeat(batch_size)
+                            for i in range(1, batch_size):
+                                beam_idx_t[i * beam_size : (i + 1) * beam_size] += (
+                                    i * beam_size
+                                )
+                        beam_idx[offset - 1] = beam_idx_t
+                        paged_beam_idx[offset - 1] = beam_idx_t
+                        cur_bs = beam_batch
+                        cur_len = 1
+                    # the finished sequences return their blocks to the pool
+                    torch.ops.torch_ipex.paged_kv_cache_free_blocks(
+                        block_table, free_blocks, list(range(beam_batch))
+                    )
+                    self.assertEqual(free_blocks[0].item(), num_blocks)
+                    self.assertTrue((block_table == -1).all())
+                    self.assertEqual(
+                        free_blocks[1 : num_blocks + 1].sort().values,
+                        torch.arange(num_blocks),
+                    )
+
+    def test_paged_kv_cache_free_blocks(self):
+        head_size = 64
+        head_num = 16
+        block_size = 16
+        max_blocks_per_seq = 4
+        batch_size = 2
+        beam_size = 4
+        beam_batch = batch_size * beam_size
+        num_blocks = beam_batch * max_blocks_per_seq
+        # 2 full blocks and a partial one
+        prompt_len = 2 * block_size + 8
+        key_pool = torch.zeros(num_blocks, block_size, head_num, head_size)
+        value_pool = torch.zeros_like(key_pool)
+        block_table = torch.full((beam_batch, max_blocks_per_seq), -1, dtype=torch.long)
+        free_blocks = torch.ops.torch_ipex.paged_kv_cache_init_free_blocks(num_blocks)
+        query = torch.randn(batch_size, prompt_len, head_num, head_size)
+        (
+            _,
+            _,
+            _,
+            _,
+            beam_idx,
+        ) = torch.ops.torch_ipex.paged_masked_multihead_self_attention(
+            query,
+            torch.randn_like(query),
+            torch.randn_like(query),
+            key_pool,
+            value_pool,
+            block_table,
+            free_blocks,
+            torch.zeros(1, beam_batch, dtype=torch.long),
+            torch.tensor(0),
+            head_size**0.5,
+            None,
+            torch.zeros(batch_size, 1, prompt_len, prompt_len),
+        )
+        # the other beams reference the full prompt blocks of the first beam
+        for bi in range(batch_size):
+            first_beam = bi * beam_size
+            for beam in range(first_beam + 1, first_beam + beam_size):
+                self.assertEqual(block_table[beam, :2], block_table[first_beam, :2])
+                self.assertEqual(block_table[beam, 2].item(), -1)
+        self.assertEqual(free_blocks[0].item(), num_blocks - 3 * batch_size)
+        self.assertEqual(paged_kv_cache_used_blocks(block_table), 3 * batch_size)
+
+        # the other beams read the prompt through the first beam, which is
+        # not freed before them
+        with self.assertRaisesRegex(RuntimeError, "still reached"):
+            torch.ops.torch_ipex.paged_kv_cache_free_blocks(
+                block_table, free_blocks, [0], beam_idx, prompt_len
+            )
+        self.assertEqual(free_blocks[0].item(), num_blocks - 3 * batch_size)
+        self.assertEqual(block_table[0, 0].item(), block_table[1, 0].item())
+
+        # the shared blocks are returned by the last beam freeing them
+        prompt_blocks = block_table[0, :2].clone()
+        torch.ops.torch_ipex.paged_kv_cache_free_blocks(block_table, free_blocks, [0])
+        self.assertEqual(free_blocks[0].item(), num_blocks - 3 * batch_size + 1)
+        self.assertEqual(block_table[1, :2], prompt_blocks)
+        torch.ops.torch_ipex.paged_kv_cache_free_blocks(
+            block_table, free_blocks, [1, 2]
+        )
+        self.assertEqual(free_blocks[0].item(), num_blocks - 3 * batch_size + 1)
+        torch.ops.torch_ipex.paged_kv_cache_free_blocks(block_table, free_blocks, [3])
+        self.assertEqual(free_blocks[0].item(), num_blocks - 3)
+        free_ids = free_blocks[1 : free_blocks[0].item() + 1]
+        for block in prompt_blocks.tolist():
+            self.assertTrue(block in free_ids)
+
+        # a block referenced by a row without its reference count is detected
+        # when it is freed the second time
+        block_table[0] = block_table[4]
+        torch.ops.torch_ipex.paged_kv_cache_free_blocks(
+            block_table, free_blocks, list(range(4, 8))
+        )
+        self.assertEqual(free_blocks[0].item(), num_blocks)
+        with self.assertRaisesRegex(RuntimeError, "freed twice"):
+            torch.ops.torch_ipex.paged_kv_cache_free_blocks(
+                block_table, free_blocks, [0]
+            )
+        self.assertEqual(free_blocks[0].item(), num_blocks)
+        with self.assertRaisesRegex(RuntimeError, "out of the block table"):
+            torch.ops.torch_ipex.paged_kv_cache_free_blocks(
+                block_table, free_blocks, [beam_batch]
+            )
+
+        # the next token of a row reaching a freed row is rejected instead of
+        # reading the blocks returned to the pool
+        block_table.fill_(-1)
+        free_blocks.copy_(
+            torch.ops.torch_ipex.paged_kv_cache_init_free_blocks(num_blocks)
+        )
+        query = torch.randn(beam_batch, 1, head_num, head_size)
+        with self.assertRaisesRegex(RuntimeError, "freed kv cache block"):
+            torch.ops.torch_ipex.paged_masked_multihead_self_attention(
+                query,
+                torch.randn_like(query),
+                torch.randn_like(query),
+                key_pool,
+                value_pool,
+                block_table,
+                free_blocks,
+                beam_idx,
+                torch.tensor(prompt_len),
+                head_size**0.5,
+                None,
+                torch.zeros(beam_batch, 1, 1, prompt_len + 1),
+            )
+
+    def test_paged_mha_quantized_kv_cache(self):
+        head_size = 64
+        head_num = 16
+        head_num_kv = 4
+        first_seq_len = 20
+        block_size = 16
+        max_blocks_per_seq = 4
+        batch_size = 2
+        beam_size = 4
+        beam_batch = batch_size * beam_size
+        num_blocks = beam_batch * max_blocks_per_seq
+        for dtype in [torch.float32, torch.bfloat16]:
+            for cache_dtype, prec in [(torch.int8, 0.05), (torch.float8_e4m3fn, 0.1)]:
+                key_pool = torch.zeros(
+                    num_blocks, block_size, head_num_kv, head_size, dtype=cache_dtype
+                )
+                value_pool = torch.zeros_like(key_pool)
+                key_scale = torch.zeros(num_blocks, block_size, head_num_kv)
+                value_scale = torch.zeros_like(key_scale)
+                block_table = torch.full(
+                    (beam_batch, max_blocks_per_seq), -1, dtype=torch.long
+                )
+                free_blocks = torch.ops.torch_ipex.paged_kv_cache_init_free_blocks(
+                    num_blocks
+                )
+                key_cache = torch.zeros(1, 1, 1, 1, dtype=dtype)
+                value_cache = torch.zeros(1, 1, 1, 1, dtype=dtype)
+                beam_idx = torch.zeros(1, beam_batch, dtype=torch.long)
+                paged_beam_idx = beam_idx.clone()
+                # the contiguous cache is quantized if it is passed in int8/fp8
+                quant_key_cache = torch.zeros(1, 1, 1, 1, dtype=cache_dtype)
+                quant_value_cache = torch.zeros_like(quant_key_cache)
+                quant_key_scale = torch.zeros(1)
+                quant_value_scale = torch.zeros(1)
+                quant_beam_idx = beam_idx.clone()
+                offset = 0
+                cur_bs = batch_size
+                cur_len = first_seq_len
+                for step in range(block_size + 2):
+                    query = torch.randn(
+                        cur_bs, cur_len, head_num, head_size, dtype=dtype
+                    )
+                    key = torch.randn(
+                        cur_bs, cur_len, head_num_kv, head_size, dtype=dtype
+                    )
+                    value = torch.randn(
+                        cur_bs, cur_len, head_num_kv, head_size, dtype=dtype
+                    )
+                    attention_mask = torch.zeros(
+                        cur_bs, 1, cur_len, offset + cur_len, dtype=dtype
+                    )
+                    (
+                        output,
+                        _,
+                        key_cache,
+                        value_cache,
+                        beam_idx,
+                    ) = torch.ops.torch_ipex.masked_multihead_self_attention(
+                        query,
+                        key,
+                        value,
+                        key_cache,
+                        value_cache,
+                        beam_idx,
+                        torch.tensor(offset),
+                        head_size**0.5,
+                        first_seq_len,
+                        None,
+                        attention_mask,
+                    )
+                    (
+                        paged_output,
+                        _,
+                        key_pool,
+                        value_pool,
+                        paged_beam_idx,
+                    ) = torch.ops.torch_ipex.paged_masked_multihead_self_attention(
+                        query,
+                        key,
+                        value,
+                        key_pool,
+                        value_pool,
+                        block_table,
+                        free_blocks,
+                        paged_beam_idx,
+                        torch.tensor(offset),
+                        head_size**0.5,
+                        None,
+                        attention_mask,
+                        key_scale,
+                        value_scale,
+                    )
+                    self.assertEqual(output.float(), paged_output.float(), prec=prec)
+                    # the cache grows from first_seq_len + 1 positions
+                    (
+                        quant_output,
+                        _,
+                        quant_key_cache,
+                        quant_value_cache,
+                        quant_beam_idx,
+                    ) = torch.ops.torch_ipex.masked_multihead_self_attention(
+                        query,
+                        key,
+                        value,
+                        quant_key_cache,
+                        quant_value_cache,
+                        quant_beam_idx,
+                        torch.tensor(offset),
+                        head_size**0.5,
+                        first_seq_len + 1,
+                        None,
+                        attention_mask,
+                        quant_key_scale,
+                        quant_value_scale,
+                    )
+                    self.assertEqual(quant_key_cache.dtype, cache_dtype)
+                    self.assertEqual(quant_key_scale.shape, quant_key_cache.shape[:-1])
+                    self.assertEqual(quant_output.float(), output.float(), prec=prec)
+                    self.assertEqual(
+                        quant_output.float(), paged_output.float(), prec=1e-3
+                    )
+                    # the dequantized cache of the current tokens
+                    beam = (cur_bs - 1) * beam_size if cur_len > 1 else cur_bs - 1
+                    for ti in range(offset, offset + cur_len):
+                        block = block_table[beam, ti // block_size]
+                        slot = ti % block_size
+                        dequant_key = key_pool[block, slot].float() * key_scale[
+                            block, slot
+                        ].unsqueeze(-1)
+                        self.assertEqual(
+                            dequant_key,
+                            key[-1, ti - offset].float(),
+                            prec=prec * 4,
+                        )
+                    offset = offset + cur_len
+                    beam_idx_t = torch.tensor([1, 3, 0, 0]).repeat(batch_size)
+                    for i in range(1, batch_size):
+                        beam_idx_t[i * beam_size : (i + 1) * beam_size] += i * beam_size
+                    beam_idx[offset - 1] = beam_idx_t
+                    paged_beam_idx[offset - 1] = beam_idx_t
+                    quant_beam_idx[offset - 1] = beam_idx_t
+                    cur_bs = beam_batch
+                    cur_len = 1
+
+    def test_continuous_batching_mha(self):
+        head_size = 64
+        head_num = 16
+        head_num_kv = 4
+        block_size = 16
+        max_blocks_per_seq = 4
+        num_slots = 3
+        num_blocks = num_slots * max_blocks_per_seq
+        scale = head_size**0.5
+        # every step lists (slot, new tokens), the slot 1 is released after the
+        # second step and reused by a new sequence in the third step
+        steps = [
+            [(0, 7), (1, 3)],
+            [(0, 1), (1, 1), (2, 20)],
+            [(0, 1), (2, 1), (1, 4)],
+            [(0, 1), (1, 1), (2, 1)],
+        ]
+        for dtype in [torch.float32, torch.bfloat16]:
+            key_pool = torch.zeros(
+                num_blocks, block_size, head_num_kv, head_size, dtype=dtype
+            )
+            value_pool = torch.zeros_like(key_pool)
+            block_table = torch.full(
+                (num_slots, max_blocks_per_seq), -1, dtype=torch.long
+            )
+            free_blocks = torch.ops.torch_ipex.paged_kv_cache_init_free_blocks(
+                num_blocks
+            )
+            history = {}
+            for step, seqs in enumerate(steps):
+                if step == 2:
+                    torch.ops.torch_ipex.paged_kv_cache_free_blocks(
+                        block_table, free_blocks, [1]
+                    )
+                    del history[1]
+                lens = [n for _, n in seqs]
+                num_tokens = sum(lens)
+                query = torch.randn(num_tokens, head_num, head_size, dtype=dtype)
+                key = torch.randn(num_tokens, head_num_kv, head_size, dtype=dtype)
+                value = torch.randn(num_tokens, head_num_kv, head_size, dtype=dtype)
+                query_start_loc = torch.tensor([0] + lens).cumsum(0)
+                past_lens = torch.tensor(
+                    [
+                        history[slot][0].size(0) if slot in history else 0
+                        for slot, _ in seqs
+                    ]
+                )
+                slot_ids = torch.tensor([slot for slot, _ in seqs])
+                (
+                    output,
+                    key_pool,
+                    value_pool,
+                ) = torch.ops.torch_ipex.continuous_batching_masked_multihead_self_attention(
+                    query,
+                    key,
+                    value,
+                    key_pool,
+                    value_pool,
+                    block_table,
+                    free_blocks,
+                    query_start_loc,
+                    past_lens,
+                    slot_ids,
+                    scale,
+                )
+                for i, (slot, n) in enumerate(seqs):
+                    start, end = query_start_loc[i], query_start_loc[i + 1]
+                    k, v = key[start:end], value[start:end]
+                    if slot in history:
+                        k = torch.cat([history[slot][0], k])
+                        v = torch.cat([history[slot][1], v])
+                    history[slot] = (k, v)
+                    q = query[start:end].float().transpose(0, 1)
+                    k = k.float().repeat_interleave(head_num // head_num_kv, 1)
+                    v = v.float().repeat_interleave(head_num // head_num_kv, 1)
+                    scores = q.matmul(k.permute(1, 2, 0)) / scale
+                    past = k.size(0) - n
+                    causal = torch.full((n, k.size(0)), -1e6).triu(past + 1)
+                    ref = (scores + causal).softmax(-1).matmul(v.transpose(0, 1))
+                    self.assertEqual(
+                        output[start:end].float(),
+                        ref.transpose(0, 1),
+                        prec=2e-2 if dtype == torch.bfloat16 else 1e-5,
+                    )
+            used_blocks = paged_kv_cache_used_blocks(block_table)
+            self.assertEqual(used_blocks + free_blocks[0].item(), num_blocks)
+
+    def test_flash_decoding(self):
+        head_size = 128
+        head_num = 4
+        head_num_kv = 2
+        for batch_size in [1, 2]:
+            for context_len in [17, 1000, 4099]:
+                for dtype in [torch.float32, torch.bfloat16]:
+                    offset = context_len - 1
+                    key_cache = torch.randn(
+                        context_len, batch_size, head_num_kv, head_size
+                    ).to(dtype)
+                    value_cache = torch.randn(
+                        context_len, batch_size, head_num_kv, head_size
+                    ).to(dtype)
+                    # every beam reads the past tokens from the other beam
+                    beam_idx = torch.arange(batch_size).flip(0).repeat(context_len, 1)
+                    query = torch.randn(batch_size, 1, head_num, head_size).to(dtype)
+                    key = torch.randn(batch_size, 1, head_num_kv, head_size).to(dtype)
+                    value = torch.randn(batch_size, 1, head_num_kv, head_size).to(dtype)
+                    attention_mask = torch.zeros(batch_size, 1, 1, context_len)
+                    attention_mask[:, :, :, : context_len // 3] = -1e6
+                    attention_mask = attention_mask.to(dtype)
+                    # the reference with the reordered cache
+                    past_beam = torch.arange(batch_size)
+                    past_keys = []
+                    past_values = []
+                    for ti in range(offset - 1, -1, -1):
+                        past_beam = beam_idx[ti][past_beam]
+                        past_keys.insert(0, key_cache[ti][past_beam])
+                        past_values.insert(0, value_cache[ti][past_beam])
+                    ref_key = torch.cat([torch.stack(past_keys, 1), key], 1).float()
+                    ref_value = torch.cat(
+                        [torch.stack(past_values, 1), value], 1
+                    ).float()
+                    n_rep = head_num // head_num_kv
+                    ref_key = ref_key.repeat_interleave(n_rep, 2).transpose(1, 2)
+                    ref_value = ref_value.repeat_interleave(n_rep, 2).transpose(1, 2)
+                    scores = (
+                        query.float().transpose(1, 2).matmul(ref_key.transpose(-1, -2))
+                        / (head_size**0.5)
+                        + attention_mask.float()
+                    )
+                    ref_output = scores.softmax(-1).matmul(ref_value)
+                    (
+                        output,
+                        _,
+                        key_cache,
+                        value_cache,
+                        _,
+                    ) = torch.ops.torch_ipex.masked_multihead_self_attention(
+                        query,
+                        key,
+                        value,
+                        key_cache,
+                        value_cache,
+                        beam_idx,
+                        torch.tensor(offset),
+                        head_size**0.5,
+                        context_len,
+                        None,
+                        attention_mask,
+                    )
+                    self.assertEqual(
+                        output.float(),
+                        ref_output,
+                        prec=2e-2 if dtype == torch.bfloat16 else 1e-5,
+                    )
+                    self.assertEqual(key_cache[offset], key[:, 0])
+                    self.assertEqual(value_cache[offset], value[:, 0])
+
     def test_mha(self):
         self._test_mha(torchcompile=False)
         self._test_mha_fp16(torchcompile=False)
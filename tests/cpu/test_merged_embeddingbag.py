@@ -11,6 +11,21 @@ from bench.custom_op_bench.merged_embeddingbag import (
 )
 import intel_extension_for_pytorch as ipex
 import copy
+import ctypes
+import mmap
+import os
+import tempfile
+
+
+def resident_pages(t):
+    # the pages of the tensor in the memory, by mincore
+    libc = ctypes.CDLL(None, use_errno=True)
+    begin = t.data_ptr() // mmap.PAGESIZE * mmap.PAGESIZE
+    length = t.data_ptr() + t.numel() * t.element_size() - begin
+    vec = (ctypes.c_ubyte * ((length + mmap.PAGESIZE - 1) // mmap.PAGESIZE))()
+    ret = libc.mincore(ctypes.c_void_p(begin), ctypes.c_size_t(length), vec)
+    assert ret == 0, os.strerror(ctypes.get_errno())
+    return sum(v & 1 for v in vec)
 
 
 class TestMergedEmbedding(TestCase):
@@ -134,8 +149,9 @@ class TestMergedEmbedding(TestCase):
                         torch.bfloat16,
                         torch.float16,
                     ]:
-                        for NUM_DIM in [128, 129]:
-                            # 128 for fast path, 129 for general path
+                        for NUM_DIM in [96, 128, 129, 512]:
+                            # 96, 128 and 512 for the kernels specialized by
+                            # emb_dim, 129 for the runtime emb_dim one
                             emb_list = EmbeddingBagList(
                                 NUM_TABLE,
                                 NUM_DIM,
@@ -230,6 +246,342 @@ class TestMergedEmbedding(TestCase):
                                 )
                             self._test_training(m, ref_m, (indices, offsets), opt=opt)
 
+    def test_training_num_threads(self):
+        # the grads of the hot rows are aggregated from many bags, the results
+        # should not depend on how the rows are split across the threads
+        B = 1029
+        NUM_TABLE = 26
+        NUM_DIM = 129
+        indices = [
+            torch.randint(10, (B * self.multi_hot[i],)) for i in range(NUM_TABLE)
+        ]
+        offsets = [
+            torch.arange(0, B * self.multi_hot[i], self.multi_hot[i])
+            for i in range(NUM_TABLE)
+        ]
+        num_threads = torch.get_num_threads()
+        try:
+            for mode in ["mean", "sum"]:
+                emb_list = EmbeddingBagList(
+                    NUM_TABLE, NUM_DIM, torch.float32, mode=mode
+                )
+                for threads in [1, 3, num_threads]:
+                    torch.set_num_threads(threads)
+                    m = MergedEmb(copy.deepcopy(emb_list))
+                    ref_m = copy.deepcopy(emb_list)
+                    self._test_training(m, ref_m, (indices, offsets))
+
+                    m = MergedEmbAdaGrad(copy.deepcopy(emb_list), lr=0.01)
+                    ref_m = copy.deepcopy(emb_list)
+                    opt = torch.optim.Adagrad(ref_m.parameters(), lr=0.01)
+                    self._test_training(m, ref_m, (indices, offsets), opt=opt)
+        finally:
+            torch.set_num_threads(num_threads)
+
+    def test_hot_row_cache(self):
+        B = 1029
+        NUM_TABLE = 4
+        NUM_DIM = 129
+
+        def get_indices(index_type):
+            # 90% of the lookups are of 10 hot rows
+            return [
+                torch.where(
+                    torch.rand(B * self.multi_hot[i]) < 0.9,
+                    torch.randint(10, (B * self.multi_hot[i],)),
+                    torch.randint(1000, (B * self.multi_hot[i],)),
+                ).to(index_type)
+                for i in range(NUM_TABLE)
+            ]
+
+        def check_inference(m, ref_m, inputs):
+            # not traced, the cache is refreshed by the python module
+            m.eval()
+            ref_m.eval()
+            with torch.no_grad():
+                self.assertEqual(m(*inputs), ref_m(*inputs))
+
+        for index_type in [torch.int32, torch.int64]:
+            offsets = [
+                torch.arange(0, B * self.multi_hot[i], self.multi_hot[i]).to(index_type)
+                for i in range(NUM_TABLE)
+            ]
+            for mode in ["mean", "sum"]:
+                emb_list = EmbeddingBagList(
+                    NUM_TABLE, NUM_DIM, torch.float32, mode=mode
+                )
+                m = MergedEmb(copy.deepcopy(emb_list))
+                weights = list(m.merged_emb.weights)
+                state_dict = m.state_dict()
+                cache = m.merged_emb.enable_hot_row_cache(
+                    16, sample_stride=4, refresh_interval=2
+                )
+                # the weights stay as they are, and only the hot rows are
+                # allocated next to them
+                self.assertTrue(
+                    all(w is c for w, c in zip(weights, m.merged_emb.weights))
+                )
+                self.assertEqual(
+                    {k: v.shape for k, v in m.state_dict().items()},
+                    {k: v.shape for k, v in state_dict.items()},
+                )
+                self.assertTrue(all(c.shape == (16, NUM_DIM) for c in cache.caches))
+                ref_m = copy.deepcopy(emb_list)
+                for _ in range(4):
+                    check_inference(m, ref_m, (get_indices(index_type), offsets))
+                stats = cache.stats()
+                self.assertTrue(stats["refreshes"] > 0)
+                cache.reset_stats()
+                with torch.no_grad():
+                    m(get_indices(index_type), offsets)
+                self.assertTrue(all(h > 0.8 for h in cache.stats()["hit_rate"]))
+
+                # the cache is copied again after the update with the dense grads
+                self._test_training(m, ref_m, (get_indices(index_type), offsets))
+                with torch.no_grad():
+                    for w, ref_w in zip(m.merged_emb.weights, ref_m.parameters()):
+                        w -= 0.1 * w.grad
+                        ref_w -= 0.1 * ref_w.grad
+                check_inference(m, ref_m, (get_indices(index_type), offsets))
+
+                # the fused updates write the hot rows through to the cache
+                m = MergedEmbSGD(copy.deepcopy(emb_list), lr=0.1)
+                m.merged_emb.enable_hot_row_cache(
+                    16, sample_stride=4, refresh_interval=2
+                )
+                ref_m = copy.deepcopy(emb_list)
+                opt = torch.optim.SGD(ref_m.parameters(), lr=0.1)
+                for _ in range(4):
+                    self._test_training(
+                        m, ref_m, (get_indices(index_type), offsets), opt=opt
+                    )
+
+                m = MergedEmbAdaGrad(copy.deepcopy(emb_list), lr=0.01)
+                m.merged_emb.enable_hot_row_cache(
+                    16, sample_stride=4, refresh_interval=2
+                )
+                ref_m = copy.deepcopy(emb_list)
+                opt = torch.optim.Adagrad(ref_m.parameters(), lr=0.01)
+                for _ in range(4):
+                    self._test_training(
+                        m, ref_m, (get_indices(index_type), offsets), opt=opt
+                    )
+
+    def _dequantize_rowwise(self, qweight, bit_width):
+        data = qweight[:, :-4].to(torch.int32)
+        if bit_width == 4:
+            data = torch.stack([data & 0xF, data >> 4], dim=-1).flatten(1)
+        qparams = qweight[:, -4:].contiguous().view(torch.float16).float()
+        return data * qparams[:, 0:1] + qparams[:, 1:2]
+
+    def test_rowwise_quantized_inference(self):
+        B = 1029
+        NUM_TABLE = 26
+        for bit_width in [8, 4]:
+            for NUM_DIM in [128, 130]:
+                # 130 for the tail of the rows
+                emb_list = EmbeddingBagList(NUM_TABLE, NUM_DIM, torch.float32)
+                qweights = [
+                    ipex.nn.modules.quantize_embedding_rowwise(emb.weight, bit_width)
+                    for emb in emb_list.list
+                ]
+                for qweight, emb in zip(qweights, emb_list.list):
+                    # the quantization error is half a step of the row, plus the
+                    # rounding of the fp16 scale and bias
+                    w = emb.weight.detach()
+                    step = (w.amax(dim=1) - w.amin(dim=1)) / ((1 << bit_width) - 1)
+                    err = (self._dequantize_rowwise(qweight, bit_width) - w).abs()
+                    self.assertTrue((err <= step.unsqueeze(1)).all())
+                dequantized = [self._dequantize_rowwise(w, bit_width) for w in qweights]
+                for mode in ["mean", "sum"]:
+                    for index_type in [torch.int32, torch.int64]:
+                        indices = [
+                            torch.randint(1000, (B * self.multi_hot[i],)).to(index_type)
+                            for i in range(NUM_TABLE)
+                        ]
+                        offsets = [
+                            torch.arange(
+                                0, B * self.multi_hot[i], self.multi_hot[i]
+                            ).to(index_type)
+                            for i in range(NUM_TABLE)
+                        ]
+                        ref_out = [
+                            torch.nn.functional.embedding_bag(
+                                indices[i], dequantized[i], offsets[i], mode=mode
+                            )
+                            for i in range(NUM_TABLE)
+                        ]
+                        for output_dtype in [torch.float32, torch.bfloat16]:
+                            m = ipex.nn.modules.MergedEmbeddingBagRowwiseQuantized(
+                                qweights, bit_width, mode, False, output_dtype
+                            )
+                            with torch.no_grad():
+                                out = m(indices, offsets)
+                            self.assertTrue(all(o.dtype is output_dtype for o in out))
+                            self.assertEqual(
+                                [o.float() for o in out],
+                                ref_out,
+                                atol=1e-2 if output_dtype == torch.float else 0.1,
+                                rtol=1e-3 if output_dtype == torch.float else 1e-2,
+                            )
+                            # the single table path
+                            out = torch.ops.torch_ipex.embedding_bag_rowwise_quantized(
+                                qweights[0],
+                                indices[0],
+                                offsets[0],
+                                m.pooling_mode,
+                                False,
+                                bit_width,
+                                output_dtype,
+                            )
+                            self.assertEqual(
+                                out.float(),
+                                ref_out[0],
+                                atol=1e-2 if output_dtype == torch.float else 0.1,
+                                rtol=1e-3 if output_dtype == torch.float else 1e-2,
+                            )
+
+    def test_mmap_fetch(self):
+        B = 1029
+        NUM_TABLE = 4
+        NUM_ROWS = 10000
+        NUM_DIM = 128
+        # 64 pages per table, to evict the pages of the former minibatches
+        MAX_RESIDENT_BYTES = 64 * 4096
+
+        def get_inputs(index_type):
+            indices = [
+                torch.randint(NUM_ROWS, (B * self.multi_hot[i],)).to(index_type)
+                for i in range(NUM_TABLE)
+            ]
+            offsets = [
+                torch.arange(0, B * self.multi_hot[i], self.multi_hot[i]).to(index_type)
+                for i in range(NUM_TABLE)
+            ]
+            return indices, offsets
+
+        def get_tables(dtype, mode="sum"):
+            return [
+                torch.nn.EmbeddingBag(NUM_ROWS, NUM_DIM, dtype=dtype, mode=mode)
+                for _ in range(NUM_TABLE)
+            ]
+
+        def drop_page_cache(path):
+            fd = os.open(path, os.O_RDONLY)
+            try:
+                os.fsync(fd)
+                os.posix_fadvise(fd, 0, 0, os.POSIX_FADV_DONTNEED)
+            finally:
+                os.close(fd)
+
+        def mmap_tables(tmpdir, weights, name):
+            # the tables are mapped again after their pages are dropped, so that
+            # only the fetched pages are in the memory
+            paths = [
+                os.path.join(tmpdir, "{}_{}.bin".format(name, i))
+                for i in range(len(weights))
+            ]
+            for w, path in zip(weights, paths):
+                ipex.nn.modules.save_mmap_embedding_table(w, path)
+                drop_page_cache(path)
+            return [
+                ipex.nn.modules.load_mmap_embedding_table(path, w.shape, w.dtype)
+                for w, path in zip(weights, paths)
+            ]
+
+        def check_fetcher(fetcher, tables_dropped):
+            stats = fetcher.stats()
+            self.assertTrue(all(f > 0 for f in stats["fetched_bytes"]))
+            self.assertTrue(sum(stats["evicted_bytes"]) > 0)
+            # at most the budget and the pages of the last minibatch
+            for weight, resident, last_use in zip(
+                fetcher.weights, stats["resident_bytes"], fetcher.page_last_use
+            ):
+                max_resident = MAX_RESIDENT_BYTES + fetcher.page_size * int(
+                    (last_use == fetcher.step).sum()
+                )
+                self.assertTrue(resident <= max_resident)
+                # the evicted pages are dropped from the page cache too
+                if tables_dropped:
+                    self.assertTrue(
+                        resident_pages(weight) * fetcher.page_size <= resident
+                    )
+
+        with tempfile.TemporaryDirectory() as tmpdir:
+            # the page cache of some file systems, e.g., tmpfs, can not be
+            # dropped, the residency of the pages is only checked on the others
+            probe = mmap_tables(tmpdir, [torch.ones(16, 4096)], "probe")[0]
+            tables_dropped = resident_pages(probe) == 0
+            del probe
+            for dtype in [torch.float32, torch.bfloat16]:
+                for mode in ["mean", "sum"]:
+                    ref_m = ipex.nn.modules.MergedEmbeddingBag.from_embeddingbag_list(
+                        get_tables(dtype, mode)
+                    )
+                    weights = mmap_tables(tmpdir, ref_m.weights, "w")
+                    m = ipex.nn.modules.MergedEmbeddingBag(
+                        [
+                            ipex.nn.modules.merged_embeddingbag.EmbeddingSpec(
+                                NUM_ROWS, NUM_DIM, mode, dtype, w, False, False
+                            )
+                            for w in weights
+                        ]
+                    )
+                    fetcher = m.enable_mmap_fetch(MAX_RESIDENT_BYTES)
+                    for index_type in [torch.int32, torch.int64]:
+                        for _ in range(4):
+                            inputs = get_inputs(index_type)
+                            with torch.no_grad():
+                                out = m(*inputs)
+                                ref_out = ref_m(*inputs)
+                            for o, ref_o in zip(out, ref_out):
+                                self.assertTrue(torch.equal(o, ref_o))
+                    check_fetcher(fetcher, tables_dropped)
+
+            # the fused updates are written back to the files
+            ref_m = ipex.nn.modules.MergedEmbeddingBagWithSGD.from_embeddingbag_list(
+                get_tables(torch.float32), lr=0.1
+            )
+            weights = mmap_tables(tmpdir, ref_m.weights, "sgd")
+            m = ipex.nn.modules.MergedEmbeddingBagWithSGD(
+                [
+                    ipex.nn.modules.merged_embeddingbag.EmbeddingSpec(
+                        NUM_ROWS, NUM_DIM, "sum", torch.float32, w, False, False
+                    )
+                    for w in weights
+                ],
+                lr=0.1,
+            )
+            fetcher = m.enable_mmap_fetch(MAX_RESIDENT_BYTES)
+            for _ in range(4):
+                inputs = get_inputs(torch.int64)
+                sum(o.sum() for o in m(*inputs)).backward()
+                sum(o.sum() for o in ref_m(*inputs)).backward()
+            check_fetcher(fetcher, tables_dropped)
+            for i, ref_w in enumerate(ref_m.weights):
+                w = ipex.nn.modules.load_mmap_embedding_table(
+                    os.path.join(tmpdir, "sgd_{}.bin".format(i)),
+                    (NUM_ROWS, NUM_DIM),
+                    torch.float32,
+                )
+                self.assertTrue(torch.equal(w, ref_w))
+
+            # the row-wise quantized tables
+            ref_m = ipex.nn.modules.MergedEmbeddingBagRowwiseQuantized.from_embeddingbag_list(
+                get_tables(torch.float32)
+            )
+            qweights = mmap_tables(tmpdir, ref_m.qweights, "q")
+            m = ipex.nn.modules.MergedEmbeddingBagRowwiseQuantized(
+                qweights, 8, "sum", False
+            )
+            fetcher = m.enable_mmap_fetch(MAX_RESIDENT_BYTES)
+            for _ in range(4):
+                inputs = get_inputs(torch.int64)
+                with torch.no_grad():
+                    for o, ref_o in zip(m(*inputs), ref_m(*inputs)):
+                        self.assertTrue(torch.equal(o, ref_o))
+            check_fetcher(fetcher, tables_dropped)
+
 
 if __name__ == "__main__":
     test = unittest.main()
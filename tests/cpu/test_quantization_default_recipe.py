@@ -972,8 +972,191 @@ class WeightOnlyQuantizationTester(TestCase):
                 output2 = qm2(data)
                 torch.testing.assert_close(output1, output2, atol=1e-2, rtol=1e-4)
 
+    def test_weight_only_quantization_k_splits(self):
+        # N is too small to keep the threads busy, so K is split across the
+        # threads. The output must match the one of a single thread, which
+        # never splits K.
+        class Mod(nn.Module):
+            def __init__(self, has_bias):
+                super().__init__()
+                self.qkv = nn.Linear(1024, 64 * 3, bias=has_bias)
+                self.qkv._num_concats = 3
+
+            def forward(self, x):
+                return self.qkv(x)
+
+        num_threads = torch.get_num_threads()
+        if num_threads < 2:
+            return
+        for has_bias, M in itertools.product([False, True], [1, 4, 33, 100]):
+            m = Mod(has_bias).eval()
+            data = torch.rand(M, 1024)
+            qconfig = ipex.quantization.get_weight_only_quant_qconfig_mapping(
+                lowp_mode=2
+            )
+            prepared = prepare(m, qconfig, example_inputs=data, inplace=True)
+            for bf16 in [False, True]:
+                with torch.no_grad(), torch.cpu.amp.autocast(
+                    enabled=bf16, dtype=torch.bfloat16 if bf16 else None
+                ):
+                    qm = convert(prepared)
+                    output = qm(data)
+                    torch.set_num_threads(1)
+                    try:
+                        output_ref = qm(data)
+                    finally:
+                        torch.set_num_threads(num_threads)
+                    torch.testing.assert_close(output, output_ref, atol=1e-2, rtol=1e-2)
+
+    def test_weight_only_quantization_packed_weights(self):
+        from intel_extension_for_pytorch.quantization import (
+            save_woq_packed_weights,
+            load_woq_packed_weights,
+            WoqLowpMode,
+        )
+        from intel_extension_for_pytorch.quantization._woq_packed_weights import (
+            _MAGIC,
+        )
+        from intel_extension_for_pytorch.nn.modules import IpexWoqLinear
+        import json
+
+        class Mod(nn.Module):
+            def __init__(self, has_bias):
+                super().__init__()
+                # N is not a multiple of the block size, so it is padded
+                self.linear = nn.Sequential(
+                    nn.Linear(128, 100, bias=has_bias), nn.Linear(100, 64)
+                )
+
+            def forward(self, x):
+                return self.linear(x)
+
+        def retag(path):
+            # pretend the file is packed for another machine
+            with open(path, "r+b") as f:
+                f.seek(len(_MAGIC))
+                header_len = int.from_bytes(f.read(8), "little")
+                header = json.loads(f.read(header_len).decode("utf-8"))
+                header["tag"]["isa"] = (
+                    "AVX2" if header["tag"]["isa"] != "AVX2" else "AVX512"
+                )
+                new_header = json.dumps(header).encode("utf-8")
+                assert len(new_header) <= header_len
+                f.seek(len(_MAGIC) + 8)
+                f.write(new_header + b" " * (header_len - len(new_header)))
+
+        def check_save_load(qm, new_model, data):
+            output_ref = qm(data)
+            num_woq_linears = sum(
+                isinstance(mod, IpexWoqLinear) for mod in qm.modules()
+            )
+            for repack in [False, True]:
+                with tempfile.NamedTemporaryFile() as f:
+                    save_woq_packed_weights(qm, f.name)
+                    if repack:
+                        retag(f.name)
+                    loaded = load_woq_packed_weights(new_model(), f.name)
+                    assert num_woq_linears == sum(
+                        isinstance(mod, IpexWoqLinear) for mod in loaded.modules()
+                    )
+                    output = loaded(data)
+                torch.testing.assert_close(output, output_ref)
+
+        # The int4 weight in LOWP_MODE_INT8 is packed in another layout, and a
+        # large M computes with the int8 weight unpacked from it
+        cases = [
+            (torch.qint8, WoqLowpMode.BF16),
+            (torch.quint4x2, WoqLowpMode.BF16),
+            (torch.quint4x2, WoqLowpMode.INT8),
+        ]
+        for (w_dtype, lowp_mode), has_bias, M in itertools.product(
+            cases, [False, True], [4, 200]
+        ):
+            m = Mod(has_bias).eval()
+            data = torch.rand(M, 128)
+            qconfig = ipex.quantization.get_weight_only_quant_qconfig_mapping(
+                weight_dtype=w_dtype, lowp_mode=lowp_mode
+            )
+            prepared = prepare(m, qconfig, example_inputs=data, inplace=True)
+            with torch.no_grad():
+                qm = convert(prepared)
+                check_save_load(qm, lambda: Mod(has_bias).eval(), data)
+
+        class GroupWiseMod(nn.Module):
+            def __init__(self, has_bias):
+                super().__init__()
+                self.linear = nn.Linear(256, 100, bias=has_bias)
+
+            def forward(self, x):
+                return self.linear(x)
+
+        def compress_int4(t):
+            # Two int4 values per byte and eight per int32, the lower first
+            return (t[:, ::2] | (t[:, 1::2] << 4)).contiguous().view(torch.int32)
+
+        group_size = 32
+        for lowp_mode, has_bias in itertools.product(
+            [WoqLowpMode.NONE, WoqLowpMode.BF16, WoqLowpMode.INT8], [False, True]
+        ):
+            m = GroupWiseMod(has_bias).eval()
+            data = torch.rand(4, 256)
+            N, K = m.linear.weight.shape
+            qw = torch.randint(0, 16, (N, K), dtype=torch.uint8)
+            scales = (torch.rand(N, K // group_size) / 16).half()
+            zps = torch.randint(0, 16, (N, K // group_size), dtype=torch.uint8)
+            qconfig = ipex.quantization.get_weight_only_quant_qconfig_mapping(
+                weight_dtype=torch.quint4x2, lowp_mode=lowp_mode
+            )
+            m.linear.qconfig = qconfig.global_qconfig
+            with torch.no_grad():
+                m.linear = IpexWoqLinear.from_float_and_int4_weight(
+                    m.linear, compress_int4(qw), scales, compress_int4(zps)
+                )
+                check_save_load(m, lambda: GroupWiseMod(has_bias).eval(), data)
+
+    def test_weight_only_quantization_silu_mul(self):
+        from intel_extension_for_pytorch.transformers.models.cpu.fusions.linear_fusion import (
+            _concat_woq_linears,
+            _IPEXlinearSiluMulCPU,
+        )
+
+        class Mod(nn.Module):
+            def __init__(self, has_bias):
+                super().__init__()
+                self.gate = nn.Linear(64, 128, bias=has_bias)
+                self.up = nn.Linear(64, 128, bias=has_bias)
+
+            def forward(self, x):
+                return nn.functional.silu(self.gate(x)) * self.up(x)
+
+        for has_bias, M in itertools.product([False, True], [4, 33]):
+            m = Mod(has_bias).eval()
+            data = torch.rand(M, 64)
+            qconfig = ipex.quantization.get_weight_only_quant_qconfig_mapping(
+                lowp_mode=2
+            )
+            prepared = prepare(m, qconfig, example_inputs=data, inplace=True)
+            for bf16 in [False, True]:
+                with torch.no_grad(), torch.cpu.amp.autocast(
+                    enabled=bf16, dtype=torch.bfloat16 if bf16 else None
+                ):
+                    qm = convert(prepared)
+                    gate_up = _concat_woq_linears([qm.gate, qm.up])
+                    output1 = qm(data)
+                    output2 = torch.ops.torch_ipex.woq_linear_silu_mul(
+                        data, gate_up._op_context.get_data_handle()
+                    )
+                    torch.testing.assert_close(output1, output2, atol=1e-2, rtol=1e-2)
+                    # the fused module only keeps the concat of the linears
+                    silu_mul = _IPEXlinearSiluMulCPU(qm.gate, qm.up, woq=True)
+                    self.assertIsNone(silu_mul.linear_s)
+                    self.assertIsNone(silu_mul.linear_m)
+                    torch.testing.assert_close(
+                        output1, silu_mul(data), atol=1e-2, rtol=1e-2
+                    )
+
     def test_weight_only_quantization_act_quant_mode(self):
-        M, N, K = 4, 64, 128
+        N, K = 64, 128
         groupsize = 64
 
         class Mod(nn.Module):
@@ -1051,7 +1234,7 @@ class WeightOnlyQuantizationTester(TestCase):
                     .view(t.shape)
                 )
 
-        def test(has_bias, act_quant_mode):
+        def test(M, has_bias, act_quant_mode):
             dtype = torch.bfloat16
             model = Mod(has_bias)
             m = model.eval()
@@ -1084,6 +1267,8 @@ class WeightOnlyQuantizationTester(TestCase):
                 m.linear.weight.data = fake_quant_w
                 y_ref = m(fake_quant_x).to(dtype)
                 y = woq_model(data)
+                # the weight unpacked per N block gives the same result again
+                torch.testing.assert_close(woq_model(data), y)
                 try:
                     torch.testing.assert_close(y, y_ref, atol=1e-2 * 5, rtol=1e-1 * 2)
                 except Exception:
@@ -1094,11 +1279,126 @@ class WeightOnlyQuantizationTester(TestCase):
                     y_ref = y_ref.to(dtype)
                     torch.testing.assert_close(y, y_ref, atol=1e-2, rtol=1e-1)
 
+        # a large M takes the int4 weight unpacked to int8 once for all M blocks
+        M_list = [4, 200]
         has_bias_list = [False, True]
         quant_mode_list = [0, 1, 2, 3]
-        cases = itertools.product(has_bias_list, quant_mode_list)
-        for has_bias, quant_mode in cases:
-            test(has_bias, quant_mode)
+        cases = itertools.product(M_list, has_bias_list, quant_mode_list)
+        for M, has_bias, quant_mode in cases:
+            test(M, has_bias, quant_mode)
+
+    def test_weight_only_quantization_quantized_input(self):
+        # add_rmsnorm_quantize quantizes the input of the next GEMM per row,
+        # which takes it as is in LOWP_MODE_INT8
+        K, N = 128, 100
+        eps = 1e-6
+
+        class Mod(nn.Module):
+            def __init__(self, has_bias):
+                super().__init__()
+                self.linear = nn.Linear(K, N, has_bias)
+
+            def forward(self, x):
+                return self.linear(x)
+
+        for M, has_bias, dtype in itertools.product(
+            [4, 200], [False, True], [torch.float, torch.bfloat16]
+        ):
+            m = Mod(has_bias).eval()
+            qconfig = ipex.quantization.get_weight_only_quant_qconfig_mapping(
+                weight_dtype=torch.quint4x2,
+                lowp_mode=ipex.quantization.WoqLowpMode.INT8,
+                act_quant_mode=ipex.quantization.WoqActQuantMode.PER_BATCH,
+            )
+            data = torch.rand(M, K)
+            prepared = prepare(m, qconfig, example_inputs=data, inplace=True)
+            with torch.no_grad():
+                woq_model = convert(prepared)
+                x = torch.randn(M, K).to(dtype)
+                residual = torch.randn(M, K).to(dtype)
+                gamma = torch.ones(K)
+                residual_ref = residual.clone()
+                y_norm = torch.ops.torch_ipex.add_rmsnorm(x, residual_ref, gamma, eps)
+                y_ref = woq_model(y_norm)
+                x_q, scales, zps = torch.ops.torch_ipex.add_rmsnorm_quantize(
+                    x, residual, gamma, eps
+                )
+                y = torch.ops.torch_ipex.woq_linear_quantized_input(
+                    x_q,
+                    scales,
+                    zps,
+                    dtype,
+                    woq_model.linear._op_context.get_data_handle(),
+                )
+                self.assertEqual(residual, residual_ref)
+                self.assertEqual(y.dtype, y_ref.dtype)
+                self.assertEqual(y.shape, y_ref.shape)
+                torch.testing.assert_close(y, y_ref, atol=5e-2, rtol=5e-2)
+
+    def test_weight_only_quantization_group_wise_int4_weight(self):
+        from intel_extension_for_pytorch.quantization import WoqLowpMode
+
+        M, K = 4, 1024
+
+        class Mod(nn.Module):
+            def __init__(self, N, has_bias):
+                super(Mod, self).__init__()
+                self.linear = torch.nn.Linear(K, N, has_bias)
+
+            def forward(self, x):
+                return self.linear(x)
+
+        def quantize_by_group(w, group_size):
+            grouped = w.view(w.size(0), -1, group_size)
+            zeros = torch.zeros(1)
+            min = torch.minimum(grouped.min(dim=-1)[0], zeros)
+            max = torch.maximum(grouped.max(dim=-1)[0], zeros)
+            scales = ((max - min) / 15).half()
+            zps = torch.round(-min / scales.float())
+            qw = torch.clamp(
+                torch.round(grouped / scales.float().unsqueeze(-1)) + zps.unsqueeze(-1),
+                min=0,
+                max=15,
+            )
+            return qw.view(w.shape).to(torch.uint8), scales, zps.to(torch.uint8)
+
+        def compress_int4(t):
+            # Two int4 values per byte and eight per int32, the lower first
+            return (t[:, ::2] | (t[:, 1::2] << 4)).contiguous().view(torch.int32)
+
+        def test(N, has_bias, group_size, lowp_mode):
+            m = Mod(N, has_bias).eval()
+            data = torch.rand(M, K)
+            qw, scales, zps = quantize_by_group(m.linear.weight.data, group_size)
+            w_ref = (
+                qw.float() - zps.float().repeat_interleave(group_size, 1)
+            ) * scales.float().repeat_interleave(group_size, 1)
+            y_ref = data @ w_ref.T + (m.linear.bias if has_bias else 0)
+            qconfig = ipex.quantization.get_weight_only_quant_qconfig_mapping(
+                weight_dtype=torch.quint4x2, lowp_mode=lowp_mode
+            )
+            m.linear.qconfig = qconfig.global_qconfig
+            with torch.no_grad():
+                woq_linear = IpexWoqLinear.from_float_and_int4_weight(
+                    m.linear, compress_int4(qw), scales, compress_int4(zps)
+                )
+                y = woq_linear(data)
+                if lowp_mode == WoqLowpMode.NONE:
+                    torch.testing.assert_close(y, y_ref, atol=1e-3, rtol=1e-3)
+                else:
+                    torch.testing.assert_close(y, y_ref, atol=1e-2, rtol=1e-2)
+
+        from intel_extension_for_pytorch.nn.modules import IpexWoqLinear
+
+        N_list = [64, 100]
+        has_bias_list = [False, True]
+        group_size_list = [32, 128]
+        lowp_mode_list = [WoqLowpMode.NONE, WoqLowpMode.BF16, WoqLowpMode.INT8]
+        cases = itertools.product(
+            N_list, has_bias_list, group_size_list, lowp_mode_list
+        )
+        for N, has_bias, group_size, lowp_mode in cases:
+            test(N, has_bias, group_size, lowp_mode)
 
 
 if __name__ == "__main__":
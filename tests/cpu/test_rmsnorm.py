@@ -46,6 +46,61 @@ class RMSNormTester(TestCase):
                 fused_y1_bf16 = model(x_bf16, fused_rmsnorm=True)
                 self.assertEqual(y1_bf16, fused_y1_bf16, prec=1e-2)
 
+    def test_add_rmsnorm(self):
+        for dtype, w_dtype, out_dtype in [
+            (torch.float, torch.float, None),
+            (torch.bfloat16, torch.float, None),
+            (torch.bfloat16, torch.bfloat16, None),
+            (torch.bfloat16, torch.bfloat16, torch.float),
+            (torch.float, torch.float, torch.bfloat16),
+        ]:
+            # N is not a multiple of the vector size
+            for size in [[3, 4096], [2, 5, 100]]:
+                x = torch.randn(size).to(dtype)
+                residual = torch.randn(size).to(dtype)
+                model = RMSNorm(size[-1]).eval()
+                model.weight.data = torch.randn(size[-1]).to(w_dtype)
+                residual_ref = residual + x
+                # the output is rounded to out_dtype only once
+                r = residual_ref.float()
+                y_ref = (
+                    model.weight.float()
+                    * r
+                    * torch.rsqrt(r.pow(2).mean(-1, keepdim=True) + 1e-6)
+                ).to(out_dtype if out_dtype is not None else dtype)
+                y = torch.ops.torch_ipex.add_rmsnorm(
+                    x, residual, model.weight, model.variance_epsilon, out_dtype
+                )
+                self.assertEqual(residual, residual_ref)
+                self.assertEqual(y.dtype, y_ref.dtype)
+                torch.testing.assert_close(y, y_ref, rtol=1e-2, atol=1e-2)
+
+    def test_add_rmsnorm_quantize(self):
+        for dtype in [torch.float, torch.bfloat16]:
+            for size in [[3, 4096], [2, 5, 100]]:
+                x = torch.randn(size).to(dtype)
+                residual = torch.randn(size).to(dtype)
+                model = RMSNorm(size[-1]).eval()
+                residual_ref = residual + x
+                r = residual_ref.float()
+                y_ref = r * torch.rsqrt(r.pow(2).mean(-1, keepdim=True) + 1e-6)
+                y_q, scales, zps = torch.ops.torch_ipex.add_rmsnorm_quantize(
+                    x, residual, model.weight, model.variance_epsilon
+                )
+                self.assertEqual(residual, residual_ref)
+                self.assertEqual(y_q.dtype, torch.uint8)
+                self.assertEqual(scales.numel(), y_ref.numel() // size[-1])
+                # the per-row qparams cover the range of the row and 0
+                rows = y_ref.view(-1, size[-1])
+                min = torch.minimum(rows.min(-1)[0], torch.zeros(1))
+                max = torch.maximum(rows.max(-1)[0], torch.zeros(1))
+                self.assertEqual(scales, (max - min) / 255, prec=1e-2)
+                y = (
+                    y_q.view(-1, size[-1]).float() - zps.unsqueeze(-1)
+                ) * scales.unsqueeze(-1)
+                # at most half a step off
+                self.assertTrue(((y - rows).abs() <= scales.unsqueeze(-1) * 0.51).all())
+
 
 if __name__ == "__main__":
     test = unittest.main()
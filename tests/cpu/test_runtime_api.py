@@ -248,6 +248,59 @@ class TestRuntimeAPI(TestCase):
         self.assertEqual(y, y_runtime2)
 
 
+class TestNumaShardedLinear(TestCase):
+    @unittest.skipIf(
+        not ipex.cpu.runtime.is_runtime_ext_enabled(),
+        "Skip when IPEX Runtime extension is not enabled",
+    )
+    @runtime_thread_affinity_test_env
+    def test_numa_sharded_linear(self):
+        # two pools on one node stand for two nodes
+        cpu_pools = [
+            ipex.cpu.runtime.CPUPool([1, 2]),
+            ipex.cpu.runtime.CPUPool([3, 4]),
+        ]
+        x = torch.rand(4, 128)
+        for out_features, num_concats, bias in [
+            (200, 1, True),
+            (384, 3, False),
+            (32, 1, True),
+        ]:
+            linear = torch.nn.Linear(128, out_features, bias=bias).eval()
+            if num_concats > 1:
+                linear._num_concats = num_concats
+            y = linear(x)
+            sharded = ipex.cpu.runtime.NumaShardedLinear(linear, cpu_pools)
+            self.assertEqual(sum(sharded.shard_sizes), out_features // num_concats)
+            with torch.no_grad():
+                y_sharded = sharded(x)
+            self.assertEqual(y, y_sharded)
+
+    @unittest.skipIf(
+        not ipex.cpu.runtime.is_runtime_ext_enabled(),
+        "Skip when IPEX Runtime extension is not enabled",
+    )
+    @runtime_thread_affinity_test_env
+    def test_shard_linears_across_numa_nodes(self):
+        model = torch.nn.Sequential(
+            torch.nn.Linear(64, 256), torch.nn.ReLU(), torch.nn.Linear(256, 64)
+        ).eval()
+        x = torch.rand(4, 64)
+        y = model(x)
+        cpu_pools = [
+            ipex.cpu.runtime.CPUPool([1, 2]),
+            ipex.cpu.runtime.CPUPool([3, 4]),
+        ]
+        model = ipex.cpu.runtime.shard_linears_across_numa_nodes(
+            model, cpu_pools, min_out_features=128
+        )
+        self.assertTrue(isinstance(model[0], ipex.cpu.runtime.NumaShardedLinear))
+        self.assertTrue(type(model[2]) is torch.nn.Linear)
+        with torch.no_grad():
+            y_sharded = model(x)
+        self.assertEqual(y, y_sharded)
+
+
 class TestMultiStreamModule(TestCase):
     @unittest.skipIf(
         not ipex.cpu.runtime.is_runtime_ext_enabled(),
@@ -4,6 +4,10 @@ import torch
 import intel_extension_for_pytorch as ipex
 from torch.testing._internal.common_utils import TestCase
 import copy
+import os
+import subprocess
+import sys
+import tempfile
 from intel_extension_for_pytorch.cpu._auto_kernel_selection import (
     _enable_tpp,
     _disable_tpp,
@@ -64,6 +68,24 @@ class Linear_mul(torch.nn.Module):
         return self.mlp(x) * x
 
 
+class Linear_silu_mul(torch.nn.Module):
+    def __init__(self, bias=False):
+        super(Linear_silu_mul, self).__init__()
+        self.gate_proj = torch.nn.Linear(4096, 4096, bias=bias)
+        self.up_proj = torch.nn.Linear(4096, 4096, bias=bias)
+
+    def forward(self, x):
+        return torch.nn.functional.silu(self.gate_proj(x)) * self.up_proj(x)
+
+
+class Linear_qkv(torch.nn.Module):
+    def __init__(self, bias=False):
+        super(Linear_qkv, self).__init__()
+        self.q_proj = torch.nn.Linear(4096, 4096, bias=bias)
+        self.k_proj = torch.nn.Linear(4096, 4096, bias=bias)
+        self.v_proj = torch.nn.Linear(4096, 4096, bias=bias)
+
+
 class Linear_add(torch.nn.Module):
     def __init__(self):
         super(Linear_add, self).__init__()
@@ -323,6 +345,100 @@ class TestTPPlinear(TestCase):
                 self.assertEqual(out, ref_out)
                 _disable_tpp()
 
+    def test_tpp_linear_silu_mul(self):
+        from intel_extension_for_pytorch.transformers.models.cpu.fusions.linear_fusion import (
+            _IPEXlinearSiluMulCPU,
+        )
+
+        with torch.no_grad():
+            for dtype, bias, bs in itertools.product(
+                [torch.float32, torch.bfloat16], [True, False], [1, 4, 300]
+            ):
+                x = torch.rand(1, bs, 4096).to(dtype)
+                model = Linear_silu_mul(bias).eval().to(dtype)
+                ref_out = model(x)
+                ref_gate = model.gate_proj(x)
+
+                _enable_tpp()
+                model = ipex.optimize(model, dtype=dtype)
+                fused = _IPEXlinearSiluMulCPU(model.gate_proj, model.up_proj, tpp=True)
+                # gate and up weights are interleaved into one GEMM
+                self.assertTrue(fused.gate_up_weight is not None)
+                out = fused(x)
+                self.assertEqual(out, ref_out, atol=1e-2, rtol=1e-2)
+                # the linears still work on the views of the fused weight
+                self.assertEqual(model.gate_proj(x), ref_gate, atol=1e-2, rtol=1e-2)
+                _disable_tpp()
+
+    def test_tpp_linear_qkv_rope(self):
+        from intel_extension_for_pytorch.transformers.models.cpu.fusions.linear_fusion import (
+            _IPEXConcatLinearCPU,
+        )
+        from intel_extension_for_pytorch.transformers.models.cpu.fusions.mha_fusion import (
+            _IPEXRopeCPU,
+            _IPEXScaleDotProductCPU,
+        )
+        from intel_extension_for_pytorch.transformers.models.reference.fusions.linear_fusion import (
+            _IPEXConcatLinearRef,
+        )
+
+        batch, num_head, head_dim = 2, 32, 128
+        sdp = _IPEXScaleDotProductCPU(text_max_length=2048)
+        with torch.no_grad():
+            for dtype, bias, seq_len, (offset, rotary_ndims) in itertools.product(
+                [torch.float32, torch.bfloat16],
+                [True, False],
+                [1, 300],
+                [(1, 64), (head_dim // 2, head_dim)],  # GPT-J, LLaMA
+            ):
+                x = torch.rand(batch, seq_len, 4096).to(dtype)
+                position_ids = torch.arange(seq_len).unsqueeze(0).repeat(batch, 1)
+                rope = _IPEXRopeCPU(2048, rotary_ndims)
+                model = Linear_qkv(bias).eval().to(dtype)
+
+                _enable_tpp()
+                model = ipex.optimize(model, dtype=dtype)
+                fused = _IPEXConcatLinearCPU(
+                    _IPEXConcatLinearRef([model.q_proj, model.k_proj, model.v_proj]),
+                    tpp=True,
+                )
+                # the q, k and v weights are concatenated into one GEMM
+                self.assertTrue(fused.qkv_weight is not None)
+                args = (rope, position_ids, num_head, num_head, head_dim)
+                args += (offset, rotary_ndims)
+                query, key, value = fused.forward_rope(x, *args)
+                # the linears still work on the views of the fused weight
+                query_ref, key_ref, value_ref = (
+                    t.view(batch, seq_len, num_head, head_dim) for t in fused(x)
+                )
+                query_ref, key_ref = rope.forward_qk(query_ref, key_ref, *args[1:])
+                self.assertEqual(query, query_ref, atol=1e-2, rtol=1e-2)
+                self.assertEqual(key, key_ref, atol=1e-2, rtol=1e-2)
+                self.assertEqual(value, value_ref, atol=1e-2, rtol=1e-2)
+
+                # a decode step writes the key/value to their kv cache slot
+                if seq_len == 1:
+                    past_len = 3
+                    layer_past = (
+                        torch.empty(1, past_len, past_len, 1),
+                        torch.zeros(8, batch, num_head, head_dim, dtype=dtype),
+                        torch.zeros(8, batch, num_head, head_dim, dtype=dtype),
+                        torch.zeros(8, batch, dtype=torch.long),
+                    )
+                    slot = sdp.kv_cache_slot(
+                        layer_past, batch, seq_len, num_head, head_dim, dtype
+                    )
+                    self.assertTrue(slot is not None)
+                    _, key, value = fused.forward_rope(x, *args, None, slot)
+                    self.assertEqual(key.data_ptr(), layer_past[1][past_len].data_ptr())
+                    self.assertEqual(
+                        layer_past[1][past_len], key_ref[:, 0], atol=1e-2, rtol=1e-2
+                    )
+                    self.assertEqual(
+                        layer_past[2][past_len], value_ref[:, 0], atol=1e-2, rtol=1e-2
+                    )
+                _disable_tpp()
+
     def test_tpp_linear_mul_torchcompile(self):
         x = torch.rand(2, 2, 4096)
 
@@ -474,6 +590,54 @@ class TestTPPlinear(TestCase):
             self.assertTrue(out.dtype == dtype)
             _disable_tpp()
 
+    def test_tpp_linear_autotune(self):
+        script = """
+import torch
+import intel_extension_for_pytorch as ipex
+from intel_extension_for_pytorch.cpu._auto_kernel_selection import _enable_tpp
+model = torch.nn.Linear(4096, 4096).eval()
+_enable_tpp()
+model_tpp = ipex.optimize(model, dtype=torch.float)
+for bs in [1, 300]:
+    x = torch.rand(1, bs, 4096)
+    torch.testing.assert_close(model_tpp(x), model(x))
+print("PASS")
+"""
+        with tempfile.TemporaryDirectory() as tmp:
+            tuning_file = os.path.join(tmp, "tpp_gemm_tuning.txt")
+            env = dict(os.environ)
+            env["TPP_GEMM_TUNING_FILE"] = tuning_file
+            # tune the shapes, then run with the saved table
+            for autotune in ["1", "0"]:
+                env["TPP_GEMM_AUTOTUNE"] = autotune
+                out = subprocess.check_output(
+                    [sys.executable, "-c", script],
+                    env=env,
+                    stderr=subprocess.STDOUT,
+                )
+                self.assertIn("PASS", out.decode())
+                with open(tuning_file) as f:
+                    entries = [line for line in f if not line.startswith("#")]
+                # one entry per M bucket
+                self.assertEqual(len(entries), 2)
+
+    def test_tpp_linear_weight_prefetch(self):
+        model = torch.nn.Sequential(
+            *[torch.nn.Linear(4096, 4096, bias=False) for _ in range(4)]
+        ).eval()
+        model = model.to(torch.bfloat16)
+        x = torch.rand(1, 1, 4096).to(torch.bfloat16)
+        ref_out = model(x)
+        _enable_tpp()
+        model = ipex.optimize(model, dtype=torch.bfloat16)
+        torch.ops.torch_ipex.set_weight_prefetch_enabled(True)
+        # the first step links the weights, the later ones prefetch them
+        for _ in range(3):
+            out = model(x)
+            self.assertEqual(out, ref_out)
+        torch.ops.torch_ipex.set_weight_prefetch_enabled(False)
+        _disable_tpp()
+
 
 if __name__ == "__main__":
     test = unittest.main()
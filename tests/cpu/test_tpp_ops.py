@@ -289,6 +289,63 @@ class TPPOPsTester(TestCase):
             self.assertEqual(query_compile, query)
             self.assertEqual(key_compile, key)
 
+    def test_rope_qk(self):
+        batch, seq_len, num_head, num_kv_head, head_dim = 2, 8, 16, 4, 128
+        position_ids = torch.arange(seq_len).unsqueeze(0).repeat(batch, 1)
+        for dtype in [torch.float, torch.bfloat16]:
+            for offset, rotary_ndims, num_kv in [
+                (1, 64, num_head),  # GPT-J
+                (head_dim // 2, head_dim, num_kv_head),  # LLaMA with GQA
+            ]:
+                embed_positions = self.create_sinusoidal_positions(2048, rotary_ndims)
+                # query and key are the strided views of a packed QKV output
+                qkv = torch.rand(batch, seq_len, (num_head + 2 * num_kv) * head_dim).to(
+                    dtype
+                )
+                query = qkv[:, :, : num_head * head_dim].view(
+                    batch, seq_len, num_head, head_dim
+                )
+                key = qkv[
+                    :, :, num_head * head_dim : (num_head + num_kv) * head_dim
+                ].view(batch, seq_len, num_kv, head_dim)
+                query_ref = query.contiguous()
+                key_ref = key.contiguous()
+                torch.ops.torch_ipex.rotary_position_embedding(
+                    query_ref,
+                    embed_positions,
+                    position_ids,
+                    num_head,
+                    head_dim,
+                    offset,
+                    rotary_ndims,
+                )
+                torch.ops.torch_ipex.rotary_position_embedding(
+                    key_ref,
+                    embed_positions,
+                    position_ids,
+                    num_kv,
+                    head_dim,
+                    offset,
+                    rotary_ndims,
+                )
+                qkv_ref = qkv.clone()
+                query_out, key_out = torch.ops.torch_ipex.rotary_position_embedding_qk(
+                    query,
+                    key,
+                    embed_positions,
+                    position_ids,
+                    num_head,
+                    num_kv,
+                    head_dim,
+                    offset,
+                    rotary_ndims,
+                )
+                self.assertEqual(query_out, query_ref)
+                self.assertEqual(key_out, key_ref)
+                self.assertTrue(query_out.is_contiguous())
+                # the input is not modified
+                self.assertEqual(qkv, qkv_ref)
+
 
 if __name__ == "__main__":
     test = unittest.main()